@@ -0,0 +1,103 @@
+//! Benchmarks for joining eBPF counters into the scan results.
+//!
+//! Measures the update step after the parallel scan: indexing the results by
+//! PID and merging network and block I/O counters, against the previous
+//! linear search per eBPF entry. The eBPF side is capped at the default map
+//! size of 10240 entries, as on a host with a full map.
+//!
+//! Run with `cargo bench --bench cache_merge`.
+
+use ahash::AHashMap as HashMap;
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use herakles_node_exporter::cache::{merge_blkio, merge_net_io, ProcMem};
+use herakles_node_exporter::fixtures;
+
+const EBPF_MAP_ENTRIES: usize = 10240;
+const PROCESS_COUNTS: [usize; 4] = [1_000, 5_000, 15_000, 50_000];
+
+fn proc_mem(pid: u32) -> ProcMem {
+    ProcMem {
+        rss: 64 << 20,
+        pss: 32 << 20,
+        uss: 16 << 20,
+        cpu_percent: 1.0,
+        cpu_time_seconds: 10.0,
+        start_time_seconds: 100.0,
+        read_bytes: 4096,
+        write_bytes: 4096,
+        last_read_bytes: 4096,
+        last_write_bytes: 4096,
+        ..fixtures::proc_mem(pid)
+    }
+}
+
+/// Scan results for `count` processes with sparse PIDs, as on a busy host.
+fn scan_results(count: usize) -> Vec<ProcMem> {
+    (0..count as u32).map(|i| proc_mem(i * 7 + 1)).collect()
+}
+
+/// eBPF `(pid, a, b)` entries for the most recently started processes.
+fn ebpf_entries(results: &[ProcMem]) -> Vec<(u32, u64, u64)> {
+    results
+        .iter()
+        .rev()
+        .take(EBPF_MAP_ENTRIES)
+        .map(|p| (p.pid, p.pid as u64 * 3, p.pid as u64 * 5))
+        .collect()
+}
+
+/// The merge as it was done before the PID index: one scan of the results
+/// per eBPF entry.
+fn linear_merge(results: &mut [ProcMem], net: &[(u32, u64, u64)]) {
+    for &(pid, rx_bytes, tx_bytes) in net {
+        if let Some(proc) = results.iter_mut().find(|p| p.pid == pid) {
+            proc.rx_bytes = rx_bytes;
+            proc.tx_bytes = tx_bytes;
+        }
+    }
+}
+
+fn bench_merge(c: &mut Criterion) {
+    let mut group = c.benchmark_group("ebpf_merge");
+    group.sample_size(10);
+
+    for count in PROCESS_COUNTS {
+        let results = scan_results(count);
+        let previous: HashMap<u32, ProcMem> = results.iter().map(|p| (p.pid, p.clone())).collect();
+        let net = ebpf_entries(&results);
+        let blkio = ebpf_entries(&results);
+        group.throughput(Throughput::Elements(count as u64));
+
+        group.bench_with_input(BenchmarkId::new("pid_index", count), &count, |b, _| {
+            b.iter_batched(
+                || results.clone(),
+                |results| {
+                    let mut processes: HashMap<u32, ProcMem> =
+                        results.into_iter().map(|p| (p.pid, p)).collect();
+                    merge_net_io(&mut processes, &previous, net.iter().copied(), 1.0);
+                    merge_blkio(&mut processes, blkio.iter().copied());
+                    black_box(processes)
+                },
+                criterion::BatchSize::LargeInput,
+            )
+        });
+
+        // Quadratic; skip the largest count to keep the run short
+        if count <= 15_000 {
+            group.bench_with_input(BenchmarkId::new("linear", count), &count, |b, _| {
+                b.iter_batched(
+                    || results.clone(),
+                    |mut results| {
+                        linear_merge(&mut results, &net);
+                        black_box(results)
+                    },
+                    criterion::BatchSize::LargeInput,
+                )
+            });
+        }
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_merge);
+criterion_main!(benches);
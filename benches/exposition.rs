@@ -0,0 +1,106 @@
+//! Benchmarks of the /metrics render and the HTTP handlers.
+//!
+//! Each tree size of `fixtures::BENCH_PROCESS_COUNTS` is scanned once with
+//! `update_cache`, and the ringbuffer of every subgroup is then filled to
+//! capacity from the scan's entries. `render` copies the cache and system
+//! snapshot into the registry and encodes the text body, as a scrape of a
+//! stale body does. `encode` times each other representation of a fresh
+//! render; they are encoded on first request. `metrics_handler` is a scrape
+//! served from the current render, `details_handler` the /details report
+//! over the full history.
+//!
+//! Run with `cargo bench --bench exposition`.
+
+use axum::extract::{Query, State};
+use axum::http::{header, HeaderMap, HeaderValue};
+use axum::response::IntoResponse;
+use criterion::{
+    black_box, criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion,
+};
+use herakles_node_exporter::cache_updater::update_cache;
+use herakles_node_exporter::exposition::{Encoding, Format};
+use herakles_node_exporter::fixtures::{
+    app_state, write_proc_tree, ProcTreeSpec, BENCH_PROCESS_COUNTS,
+};
+use herakles_node_exporter::handlers::details::DetailsQuery;
+use herakles_node_exporter::handlers::metrics::render_metrics;
+use herakles_node_exporter::handlers::{details_handler, metrics_handler};
+use herakles_node_exporter::process::SUBGROUP_REGISTRY;
+use herakles_node_exporter::state::SharedState;
+
+/// Fills every subgroup's ringbuffer with copies of its latest entry, one
+/// interval apart.
+fn fill_history(state: &SharedState) {
+    let manager = &state.ringbuffer_manager;
+    let stats = manager.get_stats();
+    for key in manager.get_all_subgroups() {
+        let (Some(info), Some(latest)) = (
+            SUBGROUP_REGISTRY.get_by_key(&key),
+            manager.get_subgroup_history(&key).and_then(|h| h.last().copied()),
+        ) else {
+            continue;
+        };
+        for i in 1..stats.entries_per_subgroup as i64 {
+            let mut entry = latest;
+            entry.timestamp += i * stats.interval_seconds as i64;
+            manager.record(info.id, entry);
+        }
+    }
+}
+
+fn bench_exposition(c: &mut Criterion) {
+    let runtime = tokio::runtime::Runtime::new().unwrap();
+    let mut group = c.benchmark_group("exposition");
+    group.sample_size(10);
+
+    for count in BENCH_PROCESS_COUNTS {
+        let root = tempfile::tempdir().unwrap();
+        write_proc_tree(root.path(), &ProcTreeSpec::new(count)).unwrap();
+        let state = app_state(root.path()).unwrap();
+        runtime.block_on(update_cache(&state)).unwrap();
+        fill_history(&state);
+
+        group.bench_with_input(BenchmarkId::new("render", count), &count, |b, _| {
+            b.iter(|| runtime.block_on(render_metrics(&state, 1)).unwrap())
+        });
+
+        for (name, format, encoding) in [
+            ("text_gzip", Format::Text, Encoding::Gzip),
+            ("text_zstd", Format::Text, Encoding::Zstd),
+            ("protobuf", Format::Protobuf, Encoding::Identity),
+            ("openmetrics", Format::OpenMetrics, Encoding::Identity),
+        ] {
+            let id = BenchmarkId::new(format!("encode_{}", name), count);
+            group.bench_with_input(id, &count, |b, _| {
+                b.iter_batched(
+                    || runtime.block_on(render_metrics(&state, 1)).unwrap(),
+                    |rendered| black_box(rendered.body(format, encoding)),
+                    BatchSize::SmallInput,
+                )
+            });
+        }
+
+        let mut headers = HeaderMap::new();
+        headers.insert(header::ACCEPT_ENCODING, HeaderValue::from_static("gzip"));
+        group.bench_with_input(BenchmarkId::new("metrics_handler", count), &count, |b, _| {
+            b.iter(|| {
+                runtime
+                    .block_on(metrics_handler(State(state.clone()), headers.clone()))
+                    .unwrap()
+            })
+        });
+
+        group.bench_with_input(BenchmarkId::new("details_handler", count), &count, |b, _| {
+            b.iter(|| {
+                let query = Query(DetailsQuery { subgroup: None });
+                runtime
+                    .block_on(details_handler(State(state.clone()), query))
+                    .into_response()
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_exposition);
+criterion_main!(benches);
@@ -0,0 +1,86 @@
+//! Benchmarks for the /proc read backends.
+//!
+//! Compares reading the per-process files of a scan (`comm`, `stat`,
+//! `smaps_rollup`, `status`, `io`) with one `open`/`read`/`close` per file on
+//! the rayon pool against batched reads through `uring::BatchReader`. The
+//! process directories are a synthetic tree from `fixtures::write_proc_tree`
+//! in a temporary directory, so the numbers measure syscall and scheduling
+//! overhead and exclude the kernel's cost of generating real `/proc` files.
+//!
+//! The io_uring side is skipped where io_uring is unavailable.
+//!
+//! Run with `cargo bench --bench proc_backends`.
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use herakles_node_exporter::fixtures::{write_proc_tree, ProcTreeSpec, BENCH_PROCESS_COUNTS};
+use herakles_node_exporter::procfs;
+use herakles_node_exporter::uring::{BatchReader, DEFAULT_SLOTS, DEFAULT_SLOT_BYTES};
+use rayon::prelude::*;
+use std::ffi::CString;
+use std::fs::File;
+use std::os::fd::AsRawFd;
+
+const FILES: [&str; 5] = ["comm", "stat", "smaps_rollup", "status", "io"];
+
+fn bench_backends(c: &mut Criterion) {
+    let mut group = c.benchmark_group("proc_backends");
+    group.sample_size(10);
+    let mut reader = match BatchReader::new(DEFAULT_SLOTS, DEFAULT_SLOT_BYTES) {
+        Ok(reader) => Some(reader),
+        Err(e) => {
+            eprintln!("io_uring unavailable, benchmarking rayon only: {}", e);
+            None
+        }
+    };
+
+    for count in BENCH_PROCESS_COUNTS {
+        let root = tempfile::tempdir().unwrap();
+        write_proc_tree(root.path(), &ProcTreeSpec::new(count)).unwrap();
+        group.throughput(Throughput::Elements(count as u64));
+
+        group.bench_with_input(BenchmarkId::new("rayon", count), &count, |b, &count| {
+            b.iter(|| {
+                let bytes: usize = (1..=count)
+                    .into_par_iter()
+                    .map(|pid| {
+                        let dir = root.path().join(pid.to_string());
+                        FILES
+                            .iter()
+                            .map(|name| {
+                                procfs::with_file(&dir.join(name), 0, |content| content.len())
+                                    .unwrap()
+                            })
+                            .sum::<usize>()
+                    })
+                    .sum();
+                black_box(bytes)
+            })
+        });
+
+        if let Some(reader) = reader.as_mut() {
+            let dir = File::open(root.path()).unwrap();
+            let paths: Vec<CString> = (1..=count)
+                .flat_map(|pid| {
+                    FILES
+                        .iter()
+                        .map(move |name| CString::new(format!("{}/{}", pid, name)).unwrap())
+                })
+                .collect();
+            group.bench_with_input(BenchmarkId::new("io_uring", count), &count, |b, _| {
+                b.iter(|| {
+                    let mut bytes = 0;
+                    reader
+                        .read_all(dir.as_raw_fd(), &paths, |_, content| {
+                            bytes += content.unwrap().len();
+                        })
+                        .unwrap();
+                    black_box(bytes)
+                })
+            });
+        }
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_backends);
+criterion_main!(benches);
@@ -0,0 +1,136 @@
+//! Benchmarks for the /proc parsers.
+//!
+//! Compares the byte parsers in `herakles_node_exporter::procfs` against the
+//! previous `BufReader::lines()` based implementations on files captured from
+//! a real `/proc` (see `benches/fixtures`). Both sides parse from memory, so
+//! the numbers exclude the kernel's cost of generating the file.
+//!
+//! Run with `cargo bench --bench proc_parsers`.
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion};
+use herakles_node_exporter::procfs;
+use std::io::{BufRead, BufReader, Cursor};
+
+const SMAPS_ROLLUP: &[u8] = include_bytes!("fixtures/smaps_rollup");
+const SMAPS: &[u8] = include_bytes!("fixtures/smaps");
+const STATUS: &[u8] = include_bytes!("fixtures/status");
+const IO: &[u8] = include_bytes!("fixtures/io");
+const STAT: &[u8] = include_bytes!("fixtures/stat");
+
+/// Line-based reference implementations, as used before the procfs module.
+mod lines {
+    use super::*;
+
+    fn parse_kb_value(v: &str) -> Option<u64> {
+        v.split_whitespace().next()?.parse().ok()
+    }
+
+    pub fn parse_smaps(content: &[u8]) -> (u64, u64, u64) {
+        let reader = BufReader::new(Cursor::new(content));
+        let (mut rss, mut pss, mut pc, mut pd) = (0, 0, 0, 0);
+
+        for line in reader.lines() {
+            let l = line.unwrap();
+            if let Some(kb) = l.strip_prefix("Rss:") {
+                rss += parse_kb_value(kb).unwrap_or(0);
+            } else if let Some(kb) = l.strip_prefix("Pss:") {
+                pss += parse_kb_value(kb).unwrap_or(0);
+            } else if let Some(kb) = l.strip_prefix("Private_Clean:") {
+                pc += parse_kb_value(kb).unwrap_or(0);
+            } else if let Some(kb) = l.strip_prefix("Private_Dirty:") {
+                pd += parse_kb_value(kb).unwrap_or(0);
+            }
+        }
+
+        (rss * 1024, pss * 1024, (pc + pd) * 1024)
+    }
+
+    pub fn parse_vmswap(content: &[u8]) -> u64 {
+        let content = String::from_utf8_lossy(content).into_owned();
+        for line in content.lines() {
+            if let Some(v) = line.strip_prefix("VmSwap:") {
+                if let Some(kb) = parse_kb_value(v) {
+                    return kb * 1024;
+                }
+            }
+        }
+        0
+    }
+
+    pub fn parse_io(content: &[u8]) -> (u64, u64) {
+        let content = String::from_utf8_lossy(content).into_owned();
+        let (mut read_bytes, mut write_bytes) = (0, 0);
+        for line in content.lines() {
+            if let Some(v) = line.strip_prefix("read_bytes:") {
+                read_bytes = v.trim().parse().unwrap_or(0);
+            } else if let Some(v) = line.strip_prefix("write_bytes:") {
+                write_bytes = v.trim().parse().unwrap_or(0);
+            }
+        }
+        (read_bytes, write_bytes)
+    }
+
+    pub fn parse_stat(content: &[u8]) -> Option<(u64, u64)> {
+        let content = String::from_utf8_lossy(content).into_owned();
+        let parts: Vec<&str> = content.split_whitespace().collect();
+        let utime: u64 = parts.get(13)?.parse().ok()?;
+        let stime: u64 = parts.get(14)?.parse().ok()?;
+        let start: u64 = parts.get(21)?.parse().ok()?;
+        Some((utime + stime, start))
+    }
+}
+
+fn bench_smaps_rollup(c: &mut Criterion) {
+    let mut group = c.benchmark_group("smaps_rollup");
+    group.bench_function("lines", |b| {
+        b.iter(|| lines::parse_smaps(black_box(SMAPS_ROLLUP)))
+    });
+    group.bench_function("procfs", |b| {
+        b.iter(|| procfs::parse_smaps_rollup(black_box(SMAPS_ROLLUP)))
+    });
+    group.finish();
+}
+
+fn bench_smaps(c: &mut Criterion) {
+    let mut group = c.benchmark_group("smaps");
+    group.bench_function("lines", |b| b.iter(|| lines::parse_smaps(black_box(SMAPS))));
+    group.bench_function("procfs", |b| {
+        b.iter(|| procfs::parse_smaps(black_box(SMAPS)))
+    });
+    group.finish();
+}
+
+fn bench_status(c: &mut Criterion) {
+    let mut group = c.benchmark_group("status_vmswap");
+    group.bench_function("lines", |b| {
+        b.iter(|| lines::parse_vmswap(black_box(STATUS)))
+    });
+    group.bench_function("procfs", |b| {
+        b.iter(|| procfs::parse_status_vmswap(black_box(STATUS)))
+    });
+    group.finish();
+}
+
+fn bench_io(c: &mut Criterion) {
+    let mut group = c.benchmark_group("io");
+    group.bench_function("lines", |b| b.iter(|| lines::parse_io(black_box(IO))));
+    group.bench_function("procfs", |b| b.iter(|| procfs::parse_io(black_box(IO))));
+    group.finish();
+}
+
+fn bench_stat(c: &mut Criterion) {
+    let mut group = c.benchmark_group("stat");
+    group.bench_function("lines", |b| b.iter(|| lines::parse_stat(black_box(STAT))));
+    group.bench_function("procfs", |b| b.iter(|| procfs::parse_stat(black_box(STAT))));
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_smaps_rollup,
+    bench_smaps,
+    bench_status,
+    bench_io,
+    bench_stat
+);
+criterion_main!(benches);
@@ -0,0 +1,120 @@
+//! Benchmarks of the ringbuffer history storage.
+//!
+//! The entries are those `update_cache` records for the subgroups of a 1k
+//! process tree from `fixtures::write_proc_tree`, repeated one interval
+//! apart with the CPU usage varied, so the columnar encoding sees realistic
+//! deltas. Buffers have the capacity and byte budget `RingbufferManager`
+//! gives each subgroup with the default configuration of the respective
+//! storage. `push` appends to a full buffer, evicting the oldest entry or
+//! block; `get_history` copies the history out and `view` is the copy-free
+//! read used by /details.
+//!
+//! Run with `cargo bench --bench ringbuffer`.
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion};
+use herakles_node_exporter::cache_updater::update_cache;
+use herakles_node_exporter::config::{RingbufferConfig, RingbufferStorage};
+use herakles_node_exporter::fixtures::{app_state, write_proc_tree, ProcTreeSpec};
+use herakles_node_exporter::process::SUBGROUPS;
+use herakles_node_exporter::ringbuffer::{HistoryView, Metric, Ringbuffer, RingbufferEntry};
+use herakles_node_exporter::ringbuffer_columnar::ColumnarRingbuffer;
+use herakles_node_exporter::ringbuffer_manager::RingbufferManager;
+
+/// Latest entry of every subgroup after one scan of a 1k process tree.
+fn scan_entries() -> Vec<RingbufferEntry> {
+    let root = tempfile::tempdir().unwrap();
+    write_proc_tree(root.path(), &ProcTreeSpec::new(1_000)).unwrap();
+    let state = app_state(root.path()).unwrap();
+    let runtime = tokio::runtime::Runtime::new().unwrap();
+    runtime.block_on(update_cache(&state)).unwrap();
+
+    let manager = &state.ringbuffer_manager;
+    manager
+        .get_all_subgroups()
+        .iter()
+        .filter_map(|key| manager.get_subgroup_history(key)?.last().copied())
+        .collect()
+}
+
+/// The `n`th sample of `base`, one interval after the previous one.
+fn sample(base: &RingbufferEntry, n: usize, interval: i64) -> RingbufferEntry {
+    let mut entry = *base;
+    entry.timestamp += n as i64 * interval;
+    entry.cpu_percent *= 1.0 + (n % 7) as f32 / 50.0;
+    entry
+}
+
+/// Entries and bytes per subgroup `RingbufferManager` allots to `storage`.
+fn budget(storage: RingbufferStorage) -> (usize, usize) {
+    let config = RingbufferConfig {
+        storage,
+        ..RingbufferConfig::default()
+    };
+    let stats = RingbufferManager::new(config, SUBGROUPS.len().max(1)).get_stats();
+    (stats.entries_per_subgroup, stats.bytes_per_subgroup)
+}
+
+fn bench_ringbuffer(c: &mut Criterion) {
+    let entries = scan_entries();
+    let base = entries[0];
+    let interval = RingbufferConfig::default().interval_seconds as i64;
+    let mut group = c.benchmark_group("ringbuffer");
+
+    let (capacity_entries, _) = budget(RingbufferStorage::Entries);
+    let mut rb = Ringbuffer::new(capacity_entries);
+    for n in 0..capacity_entries {
+        rb.push(sample(&base, n, interval));
+    }
+    let mut n = capacity_entries;
+    group.bench_with_input(BenchmarkId::new("push", "entries"), &(), |b, _| {
+        b.iter(|| {
+            rb.push(sample(&base, n, interval));
+            n += 1;
+        })
+    });
+    group.bench_with_input(BenchmarkId::new("get_history", "entries"), &(), |b, _| {
+        b.iter(|| black_box(rb.get_history()))
+    });
+
+    let (capacity_columnar, max_bytes) = budget(RingbufferStorage::Columnar);
+    let mut columnar = ColumnarRingbuffer::new(capacity_columnar, max_bytes);
+    for n in 0..capacity_columnar {
+        columnar.push(sample(&base, n, interval));
+    }
+    let mut n = capacity_columnar;
+    group.bench_with_input(BenchmarkId::new("push", "columnar"), &(), |b, _| {
+        b.iter(|| {
+            columnar.push(sample(&base, n, interval));
+            n += 1;
+        })
+    });
+    group.bench_with_input(BenchmarkId::new("get_history", "columnar"), &(), |b, _| {
+        b.iter(|| black_box(columnar.get_history()))
+    });
+    group.bench_with_input(BenchmarkId::new("view", "columnar"), &(), |b, _| {
+        b.iter(|| {
+            let mut sum = 0u64;
+            columnar.for_each(Metric::Rss, 0..columnar.len(), &mut |_, bytes| sum += bytes);
+            black_box(sum)
+        })
+    });
+
+    // Every subgroup of the scan in turn, as the cache updater records them
+    let mut n = 0;
+    let mut columnar_all: Vec<_> = entries
+        .iter()
+        .map(|_| ColumnarRingbuffer::new(capacity_columnar, max_bytes))
+        .collect();
+    group.bench_with_input(BenchmarkId::new("push_all", "columnar"), &(), |b, _| {
+        b.iter(|| {
+            for (rb, entry) in columnar_all.iter_mut().zip(&entries) {
+                rb.push(sample(entry, n, interval));
+            }
+            n += 1;
+        })
+    });
+    group.finish();
+}
+
+criterion_group!(benches, bench_ringbuffer);
+criterion_main!(benches);
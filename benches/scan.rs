@@ -0,0 +1,68 @@
+//! End-to-end benchmarks of a process scan over a synthetic /proc tree.
+//!
+//! The trees come from `fixtures::write_proc_tree` at 1k, 10k and 50k
+//! processes with a fixed seed, so runs on different commits read identical
+//! files. `update_cache` runs the exporter's cache update against the tree
+//! through `proc_root`: reading and parsing every process, classification,
+//! CPU deltas, subgroup aggregation, top-K ranking, publication and the
+//! ringbuffer record, as the `processes` collector does on every tick.
+//! Iterations after the first see the tree unchanged, like steady-state
+//! scans of a quiet host. `classify` runs `classify_process_raw` over the
+//! process names of the tree. The tree lives in a temporary directory, so
+//! the numbers exclude the kernel's cost of generating real `/proc` files.
+//!
+//! Run with `cargo bench --bench scan`; compare commits with
+//! `--save-baseline <name>` and `--baseline <name>`.
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use herakles_node_exporter::cache_updater::update_cache;
+use herakles_node_exporter::fixtures::{
+    app_state, write_proc_tree, ProcTreeSpec, BENCH_PROCESS_COUNTS,
+};
+use herakles_node_exporter::process::classify_process_raw;
+use std::fs;
+use std::path::Path;
+
+/// Process names of the tree under `root`, as read from `comm`.
+fn process_names(root: &Path) -> Vec<String> {
+    fs::read_dir(root)
+        .unwrap()
+        .filter_map(|entry| {
+            let path = entry.ok()?.path();
+            let comm = fs::read_to_string(path.join("comm")).ok()?;
+            Some(comm.trim_end().to_string())
+        })
+        .collect()
+}
+
+fn bench_scan(c: &mut Criterion) {
+    let runtime = tokio::runtime::Runtime::new().unwrap();
+    let mut group = c.benchmark_group("scan");
+    group.sample_size(10);
+
+    for count in BENCH_PROCESS_COUNTS {
+        let root = tempfile::tempdir().unwrap();
+        write_proc_tree(root.path(), &ProcTreeSpec::new(count)).unwrap();
+        group.throughput(Throughput::Elements(count as u64));
+
+        let state = app_state(root.path()).unwrap();
+        runtime.block_on(update_cache(&state)).unwrap();
+        assert!(!runtime.block_on(state.cache.read()).snapshot().is_empty());
+        group.bench_with_input(BenchmarkId::new("update_cache", count), &count, |b, _| {
+            b.iter(|| runtime.block_on(update_cache(&state)).unwrap())
+        });
+
+        let names = process_names(root.path());
+        group.bench_with_input(BenchmarkId::new("classify", count), &count, |b, _| {
+            b.iter(|| {
+                for name in &names {
+                    black_box(classify_process_raw(name));
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_scan);
+criterion_main!(benches);
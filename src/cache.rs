@@ -4,16 +4,25 @@
 //! between collection intervals, along with metadata about the cache state.
 
 use ahash::AHashMap as HashMap;
+use std::sync::Arc;
 use std::time::Instant;
 
+use crate::topk::SubgroupTop;
+
 /// Process memory and CPU metrics collected from /proc.
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Default)]
 pub struct ProcMem {
     pub pid: u32,
     pub name: String,
+    // Classification, computed once per process lifetime
+    pub group: Arc<str>,
+    pub subgroup: Arc<str>,
+    pub subgroup_id: u32,         // Index into the subgroup registry
+    pub cgroup: Option<Arc<str>>, // cgroup v2 path, if cgroup aggregation is enabled
     pub rss: u64,
     pub pss: u64,
     pub uss: u64,
+    pub memory_sampled_at: f64, // Unix timestamp of the smaps read PSS/USS are from
     pub cpu_percent: f32,
     pub cpu_time_seconds: f32,
     pub vmswap: u64,
@@ -24,6 +33,9 @@ pub struct ProcMem {
     // Network I/O metrics from eBPF (if available)
     pub rx_bytes: u64, // Total bytes received from network
     pub tx_bytes: u64, // Total bytes transmitted to network
+    // Block I/O metrics from eBPF (if available), summed over devices
+    pub blkio_read_bytes: u64,
+    pub blkio_write_bytes: u64,
     // Previous I/O values for delta calculation
     pub last_read_bytes: u64,
     pub last_write_bytes: u64,
@@ -34,11 +46,161 @@ pub struct ProcMem {
 }
 
 /// Cache state for storing process metrics with update timing information.
+///
+/// `processes` is an immutable snapshot of the last completed scan. The
+/// updater publishes a new snapshot by swapping the `Arc`, so readers only
+/// hold the lock long enough to clone it. `top_processes` holds the
+/// per-subgroup rankings computed from the same scan, indexed by subgroup ID.
+/// `exited` accumulates the final totals of processes that exited since
+/// startup, also indexed by subgroup ID (shorter if no process of the
+/// highest IDs exited).
 #[derive(Clone, Default)]
 pub struct MetricsCache {
-    pub processes: HashMap<u32, ProcMem>,
+    pub processes: Arc<HashMap<u32, ProcMem>>,
+    pub top_processes: Arc<Vec<SubgroupTop>>,
+    pub exited: Arc<Vec<ExitedTotals>>,
     pub last_updated: Option<Instant>,
     pub update_duration_seconds: f64,
     pub update_success: bool,
     pub is_updating: bool,
 }
+
+impl MetricsCache {
+    /// Returns the current process snapshot without copying it.
+    pub fn snapshot(&self) -> Arc<HashMap<u32, ProcMem>> {
+        Arc::clone(&self.processes)
+    }
+}
+
+/// Final totals of the processes of one subgroup that exited.
+///
+/// Reported by the eBPF lifecycle events, so group CPU counters keep the
+/// CPU time of processes that are gone from the snapshot.
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct ExitedTotals {
+    pub processes: u64,
+    pub cpu_time_seconds: f64,
+}
+
+/// Adds exited processes to `totals`, indexed by subgroup ID.
+///
+/// `exits` yields `(subgroup_id, cpu_time_seconds)`; `totals` grows as
+/// needed.
+pub fn fold_exited(totals: &mut Vec<ExitedTotals>, exits: impl IntoIterator<Item = (u32, f64)>) {
+    for (subgroup_id, cpu_time_seconds) in exits {
+        let index = subgroup_id as usize;
+        if index >= totals.len() {
+            totals.resize(index + 1, ExitedTotals::default());
+        }
+        totals[index].processes += 1;
+        totals[index].cpu_time_seconds += cpu_time_seconds;
+    }
+}
+
+/// Joins eBPF network counters into `processes` by PID.
+///
+/// `stats` yields `(pid, rx_bytes, tx_bytes)`; entries without a matching
+/// process are ignored. The previous counters become the rate baseline, a
+/// process seen for the first time starts from its current values.
+pub fn merge_net_io(
+    processes: &mut HashMap<u32, ProcMem>,
+    previous: &HashMap<u32, ProcMem>,
+    stats: impl IntoIterator<Item = (u32, u64, u64)>,
+    current_time: f64,
+) {
+    for (pid, rx_bytes, tx_bytes) in stats {
+        if let Some(proc) = processes.get_mut(&pid) {
+            let (last_rx, last_tx) = previous
+                .get(&pid)
+                .map_or((rx_bytes, tx_bytes), |prev| (prev.rx_bytes, prev.tx_bytes));
+
+            proc.rx_bytes = rx_bytes;
+            proc.tx_bytes = tx_bytes;
+            proc.last_rx_bytes = last_rx;
+            proc.last_tx_bytes = last_tx;
+            proc.last_update_time = current_time;
+        }
+    }
+}
+
+/// Adds eBPF block I/O counters to `processes` by PID.
+///
+/// `stats` yields `(pid, read_bytes, write_bytes)` per device; the devices
+/// of one process are summed.
+pub fn merge_blkio(
+    processes: &mut HashMap<u32, ProcMem>,
+    stats: impl IntoIterator<Item = (u32, u64, u64)>,
+) {
+    for (pid, read_bytes, write_bytes) in stats {
+        if let Some(proc) = processes.get_mut(&pid) {
+            proc.blkio_read_bytes += read_bytes;
+            proc.blkio_write_bytes += write_bytes;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::fixtures::proc_mem;
+
+    fn processes(pids: &[u32]) -> HashMap<u32, ProcMem> {
+        pids.iter().map(|&pid| (pid, proc_mem(pid))).collect()
+    }
+
+    #[test]
+    fn test_merge_net_io_uses_previous_as_baseline() {
+        let mut current = processes(&[1, 2]);
+        let mut previous = processes(&[1]);
+        previous.get_mut(&1).unwrap().rx_bytes = 100;
+        previous.get_mut(&1).unwrap().tx_bytes = 50;
+
+        merge_net_io(
+            &mut current,
+            &previous,
+            [(1, 300, 80), (2, 10, 20), (3, 1, 1)],
+            42.0,
+        );
+
+        let p1 = &current[&1];
+        assert_eq!((p1.rx_bytes, p1.tx_bytes), (300, 80));
+        assert_eq!((p1.last_rx_bytes, p1.last_tx_bytes), (100, 50));
+        assert_eq!(p1.last_update_time, 42.0);
+
+        // New process: the baseline is its current value
+        let p2 = &current[&2];
+        assert_eq!((p2.last_rx_bytes, p2.last_tx_bytes), (10, 20));
+        assert!(!current.contains_key(&3));
+    }
+
+    #[test]
+    fn test_fold_exited_grows_by_subgroup() {
+        let mut totals = Vec::new();
+        fold_exited(&mut totals, [(2, 1.5), (0, 0.25), (2, 0.5)]);
+
+        assert_eq!(totals.len(), 3);
+        assert_eq!(
+            totals[0],
+            ExitedTotals {
+                processes: 1,
+                cpu_time_seconds: 0.25
+            }
+        );
+        assert_eq!(totals[1], ExitedTotals::default());
+        assert_eq!(
+            totals[2],
+            ExitedTotals {
+                processes: 2,
+                cpu_time_seconds: 2.0
+            }
+        );
+    }
+
+    #[test]
+    fn test_merge_blkio_sums_devices() {
+        let mut current = processes(&[1]);
+        merge_blkio(&mut current, [(1, 10, 1), (1, 5, 2), (0, 99, 99)]);
+        assert_eq!(current[&1].blkio_read_bytes, 15);
+        assert_eq!(current[&1].blkio_write_bytes, 3);
+    }
+}
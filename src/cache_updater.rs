@@ -6,20 +6,25 @@
 use ahash::AHashMap as HashMap;
 use rayon::prelude::*;
 use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
 use std::time::Instant;
 use tracing::{debug, error, info, instrument, warn};
 
-use crate::cache::ProcMem;
+use crate::cache::{fold_exited, merge_blkio, merge_net_io, ExitedTotals, ProcMem};
 use crate::commands::generate::load_test_data_from_file;
+use crate::config::DEFAULT_PROC_ROOT;
+use crate::ebpf::{LifecycleEvent, LifecycleKind};
+use crate::health_stats::Phase;
 use crate::process::{
-    classify_process_raw, collect_proc_entries, get_cpu_stat_for_pid, parse_memory_for_process,
-    parse_start_time_seconds, read_block_io, read_process_name, read_vmswap,
-    should_include_process, MAX_IO_BUFFER_BYTES, MAX_SMAPS_BUFFER_BYTES,
+    classify_pid, group_by_cgroup, registered_subgroups, should_include_process, CgroupEntry,
+    ClassEntry, CollectOptions, CpuEntry, CpuStat, Discovery, ProcRoot, ProcSample, ScanError,
+    SmapsEntry, SmapsPlan, SmapsTiering, SubgroupInfo, MAX_IO_BUFFER_BYTES, MAX_SMAPS_BUFFER_BYTES,
     MAX_SMAPS_ROLLUP_BUFFER_BYTES,
 };
-use crate::ringbuffer::{RingbufferEntry, TopProcessInfo};
+use crate::ringbuffer::{RingbufferEntry, TopProcessInfo, TOP_SLOTS};
 use crate::state::SharedState;
 use crate::system;
+use crate::topk::{ProcessRankings, Ranking, SubgroupTop};
 
 /// CPU percentage scaling factor to preserve precision in u32 storage.
 /// CPU percent values are multiplied by this factor before storing,
@@ -27,6 +32,7 @@ use crate::system;
 const CPU_SCALE_FACTOR: f32 = 1000.0;
 
 /// Aggregated metrics data for a subgroup.
+#[derive(Default)]
 struct AggregatedData {
     rss_sum: u64,
     pss_sum: u64,
@@ -36,32 +42,83 @@ struct AggregatedData {
     process_count: usize,
 }
 
-/// Helper function to extract top-3 processes from a slice.
-fn extract_top_3<F, V>(procs: &[&ProcMem], compare_fn: F, value_fn: V) -> [TopProcessInfo; 3]
+/// Per-subgroup state of the parallel aggregation: sums and top-K rankings.
+struct SubgroupAccumulator<'a> {
+    data: AggregatedData,
+    rankings: ProcessRankings<'a>,
+}
+
+impl<'a> SubgroupAccumulator<'a> {
+    fn new(top_n: usize) -> Self {
+        Self {
+            data: AggregatedData::default(),
+            rankings: ProcessRankings::new(top_n),
+        }
+    }
+
+    fn add(&mut self, p: &'a ProcMem) {
+        self.data.rss_sum += p.rss;
+        self.data.pss_sum += p.pss;
+        self.data.uss_sum += p.uss;
+        self.data.cpu_percent_sum += p.cpu_percent as f64;
+        self.data.cpu_time_sum += p.cpu_time_seconds as f64;
+        self.data.process_count += 1;
+        self.rankings.push(p);
+    }
+
+    fn merge(&mut self, other: Self) {
+        self.data.rss_sum += other.data.rss_sum;
+        self.data.pss_sum += other.data.pss_sum;
+        self.data.uss_sum += other.data.uss_sum;
+        self.data.cpu_percent_sum += other.data.cpu_percent_sum;
+        self.data.cpu_time_sum += other.data.cpu_time_sum;
+        self.data.process_count += other.data.process_count;
+        self.rankings.merge(other.rankings);
+    }
+}
+
+/// Aggregates `processes` per subgroup in parallel, indexed by subgroup ID.
+///
+/// `top_n[id]` is the number of processes ranked for each metric of that
+/// subgroup. Every worker folds its share into its own dense accumulators,
+/// which are then merged pairwise.
+fn aggregate_subgroups<'a>(
+    processes: &'a HashMap<u32, ProcMem>,
+    top_n: &[usize],
+) -> Vec<SubgroupAccumulator<'a>> {
+    let new_accumulators = || -> Vec<SubgroupAccumulator<'a>> {
+        top_n.iter().map(|&n| SubgroupAccumulator::new(n)).collect()
+    };
+
+    let procs: Vec<&ProcMem> = processes.values().collect();
+    procs
+        .par_iter()
+        .fold(new_accumulators, |mut acc, &p| {
+            acc[p.subgroup_id as usize].add(p);
+            acc
+        })
+        .reduce(new_accumulators, |mut left, right| {
+            for (l, r) in left.iter_mut().zip(right) {
+                l.merge(r);
+            }
+            left
+        })
+}
+
+/// Copies the first `TOP_SLOTS` processes of a ranking into ringbuffer slots.
+fn top_slots<V>(
+    rankings: &ProcessRankings,
+    ranking: Ranking,
+    value_fn: V,
+) -> [TopProcessInfo; TOP_SLOTS]
 where
-    F: Fn(&ProcMem, &ProcMem) -> std::cmp::Ordering,
     V: Fn(&ProcMem) -> u32,
 {
-    let mut sorted: Vec<&ProcMem> = procs.to_vec();
-    sorted.sort_by(|a, b| compare_fn(a, b));
-
-    [
-        if !sorted.is_empty() {
-            TopProcessInfo::new(sorted[0].pid, value_fn(sorted[0]), &sorted[0].name)
-        } else {
-            TopProcessInfo::default()
-        },
-        if sorted.len() > 1 {
-            TopProcessInfo::new(sorted[1].pid, value_fn(sorted[1]), &sorted[1].name)
-        } else {
-            TopProcessInfo::default()
-        },
-        if sorted.len() > 2 {
-            TopProcessInfo::new(sorted[2].pid, value_fn(sorted[2]), &sorted[2].name)
-        } else {
-            TopProcessInfo::default()
-        },
-    ]
+    let mut slots = [TopProcessInfo::default(); TOP_SLOTS];
+    for (slot, p) in slots.iter_mut().zip(rankings.top(ranking)) {
+        *slot = TopProcessInfo::new(p.pid, value_fn(p), &p.name);
+    }
+    slots
 }
 
 /// Reads the exporter's own memory and CPU usage from /proc/self.
@@ -108,14 +165,350 @@ fn read_self_cpu_percent() -> Option<f64> {
     }
 }
 
+/// Scans /proc and converts the per-process samples into `ProcMem` entries.
+///
+/// Uses the incremental tracker when `incremental_scan` is set (only
+/// re-parsing memory for processes whose `stat` changed, and finding
+/// processes through `discovery`), otherwise reads every process in a single
+/// pass through `ProcRoot`, batched through io_uring when `io_uring` is set
+/// and falling back to parallel reads if the ring fails. Processes are
+/// classified once per (PID, start time, name) and again after an exec
+/// event; the command line is only read for processes not seen in the
+/// previous scan. With `smaps_tiering`,
+/// smaps_rollup is only read for the processes a [`SmapsPlan`] selects.
+fn scan_processes(
+    state: &SharedState,
+    previous_cache: &HashMap<u32, ProcMem>,
+    min_uss_bytes: u64,
+    current_time: f64,
+    included_count: &AtomicUsize,
+    skipped_count: &AtomicUsize,
+    discovery: Discovery<'_>,
+) -> Vec<ProcMem> {
+    let proc_root = state
+        .config
+        .proc_root
+        .as_deref()
+        .unwrap_or(std::path::Path::new(DEFAULT_PROC_ROOT));
+    let incremental = state.config.incremental_scan.unwrap_or(false);
+    let options = CollectOptions::from_config(&state.config);
+    let uptime = system::read_uptime_at(&proc_root.join("uptime")).unwrap_or(0.0);
+    let mut clock = state.health_stats.phases.clock();
+
+    // The previous smaps reads are only read while sampling and converting;
+    // the map built from this scan replaces them, dropping exited PIDs
+    let tiering = SmapsTiering::from_config(&state.config).filter(|_| options.memory);
+    let previous_smaps = if tiering.is_some() {
+        state.smaps_cache.take()
+    } else {
+        HashMap::new()
+    };
+    let plan = tiering
+        .map(|tiering| SmapsPlan::new(tiering, state.smaps_cache.next_cycle(), &previous_smaps));
+    let mut pid_caches = clock.split();
+
+    let samples: Vec<(u32, Result<ProcSample, ScanError>)> = if incremental {
+        state.process_tracker.scan(
+            proc_root,
+            state.config.max_processes,
+            &state.config,
+            options,
+            &state.buffer_config,
+            uptime,
+            discovery,
+            plan.as_ref(),
+        )
+    } else {
+        match ProcRoot::open(proc_root) {
+            Ok(root) => {
+                let pids = root.pids(state.config.max_processes);
+                clock.lap(Phase::Discovery);
+                let batched = state.uring.as_ref().and_then(|reader| {
+                    let mut reader = reader.lock().expect("uring lock poisoned");
+                    root.collect_batched(
+                        &mut reader,
+                        &pids,
+                        &state.config,
+                        options,
+                        &state.buffer_config,
+                        uptime,
+                        plan.as_ref(),
+                    )
+                    .map_err(|e| warn!("io_uring scan failed, using threaded reads: {}", e))
+                    .ok()
+                });
+                batched.unwrap_or_else(|| {
+                    pids.into_par_iter()
+                        .map(|pid| {
+                            let sample = root.collect(
+                                pid,
+                                &state.config,
+                                options,
+                                &state.buffer_config,
+                                uptime,
+                                plan.as_ref(),
+                            );
+                            (pid, sample)
+                        })
+                        .collect()
+                })
+            }
+            Err(e) => {
+                warn!("Failed to open /proc: {}", e);
+                state.health_stats.record_proc_read_error();
+                Vec::new()
+            }
+        }
+    };
+    clock.lap(Phase::ReadParse);
+    debug!("Sampled {} process entries from /proc", samples.len());
+
+    // The previous CPU samples are only read during the parallel conversion;
+    // the map built from this scan replaces them, dropping exited PIDs
+    let previous_cpu = if options.cpu {
+        state.cpu_cache.take()
+    } else {
+        HashMap::new()
+    };
+    let sampled_at = Instant::now();
+    let previous_classes = state.class_cache.take();
+    let cgroups = state.config.enable_cgroups.unwrap_or(false);
+    let cgroup_depth = state.config.cgroup_depth;
+    let previous_cgroups = if cgroups {
+        state.cgroup_cache.take()
+    } else {
+        HashMap::new()
+    };
+    pid_caches = pid_caches + clock.split();
+
+    type Included = (ClassEntry, Option<CgroupEntry>, ProcMem);
+    type Converted = (u32, Option<CpuEntry>, Option<SmapsEntry>, Option<Included>);
+    let converted: Vec<Converted> = samples
+        .into_par_iter()
+        .filter_map(|(pid, sample)| {
+            let sample = match sample {
+                Ok(sample) => sample,
+                Err(ScanError::Vanished) => {
+                    skipped_count.fetch_add(1, Ordering::Relaxed);
+                    return None;
+                }
+                Err(ScanError::NoName) => {
+                    debug!("Skipping process {}: could not read name", pid);
+                    state.health_stats.record_proc_read_error();
+                    skipped_count.fetch_add(1, Ordering::Relaxed);
+                    return None;
+                }
+                Err(ScanError::Filtered(name)) => {
+                    debug!("Skipping process {}: filtered by name config", name);
+                    skipped_count.fetch_add(1, Ordering::Relaxed);
+                    return None;
+                }
+                Err(ScanError::Memory(name, e)) => {
+                    debug!("Skipping process {}: failed to parse memory: {}", name, e);
+                    state.health_stats.record_parsing_error();
+                    if e.kind() == std::io::ErrorKind::PermissionDenied {
+                        state.health_stats.record_permission_denied();
+                    }
+                    skipped_count.fetch_add(1, Ordering::Relaxed);
+                    return None;
+                }
+            };
+
+            if let Some(parse_duration_ms) = sample.parse_duration_ms {
+                state
+                    .health_stats
+                    .record_parsing_duration_ms(parse_duration_ms);
+            }
+
+            // Keep the CPU sample even for processes below the USS threshold
+            // so they have a baseline once they cross it
+            let cpu_entry = options.cpu.then(|| {
+                CpuEntry::sample(previous_cpu.get(&pid), sample.cpu_time_seconds, sampled_at)
+            });
+            let cpu = cpu_entry.as_ref().map_or(
+                CpuStat {
+                    cpu_percent: 0.0,
+                    cpu_time_seconds: sample.cpu_time_seconds,
+                },
+                |entry| entry.stat,
+            );
+            // Like the CPU sample, kept for processes below the USS threshold
+            let smaps_entry = tiering
+                .is_some()
+                .then(|| SmapsEntry::sample(previous_smaps.get(&pid), &sample, current_time));
+
+            if sample.uss < min_uss_bytes {
+                debug!(
+                    "Skipping process {}: USS {} bytes below threshold {} bytes",
+                    sample.name, sample.uss, min_uss_bytes
+                );
+                skipped_count.fetch_add(1, Ordering::Relaxed);
+                return Some((pid, cpu_entry, smaps_entry, None));
+            }
+
+            // Previous values are the baseline for rate calculation; a new
+            // process starts from its current values so the first rate is 0
+            let prev = previous_cache.get(&pid);
+
+            debug!(
+                "Including process {}: {} (RSS: {} MB, PSS: {} MB, USS: {} MB, CPU: {:.6}%)",
+                pid,
+                sample.name,
+                sample.rss / 1024 / 1024,
+                sample.pss / 1024 / 1024,
+                sample.uss / 1024 / 1024,
+                cpu.cpu_percent
+            );
+
+            let class = ClassEntry::classify(
+                previous_classes.get(&pid).filter(|_| !discovery.exec(pid)),
+                sample.start_ticks,
+                &sample.name,
+                || std::fs::read(proc_root.join(pid.to_string()).join("cmdline")).ok(),
+            );
+            let SubgroupInfo {
+                id: subgroup_id,
+                group,
+                subgroup,
+                ..
+            } = class.class.clone();
+            let cgroup = cgroups.then(|| {
+                CgroupEntry::resolve(
+                    previous_cgroups.get(&pid),
+                    sample.start_ticks,
+                    cgroup_depth,
+                    || std::fs::read_to_string(proc_root.join(pid.to_string()).join("cgroup")).ok(),
+                )
+            });
+
+            included_count.fetch_add(1, Ordering::Relaxed);
+            let proc_mem = ProcMem {
+                pid,
+                name: sample.name,
+                group,
+                subgroup,
+                subgroup_id,
+                cgroup: cgroup.as_ref().and_then(|entry| entry.path.clone()),
+                rss: sample.rss,
+                pss: sample.pss,
+                uss: sample.uss,
+                memory_sampled_at: sample.memory_sampled_at.unwrap_or(current_time),
+                cpu_percent: cpu.cpu_percent as f32,
+                cpu_time_seconds: cpu.cpu_time_seconds as f32,
+                vmswap: sample.vmswap,
+                start_time_seconds: sample.start_time_seconds,
+                read_bytes: sample.read_bytes,
+                write_bytes: sample.write_bytes,
+                rx_bytes: 0,          // Will be filled by eBPF if available
+                tx_bytes: 0,          // Will be filled by eBPF if available
+                blkio_read_bytes: 0,  // Will be filled by eBPF if available
+                blkio_write_bytes: 0, // Will be filled by eBPF if available
+                last_read_bytes: prev.map_or(sample.read_bytes, |p| p.read_bytes),
+                last_write_bytes: prev.map_or(sample.write_bytes, |p| p.write_bytes),
+                last_rx_bytes: prev.map_or(0, |p| p.rx_bytes),
+                last_tx_bytes: prev.map_or(0, |p| p.tx_bytes),
+                last_update_time: prev.map_or(current_time, |p| p.last_update_time),
+            };
+            Some((pid, cpu_entry, smaps_entry, Some((class, cgroup, proc_mem))))
+        })
+        .collect();
+
+    let mut cpu_entries = HashMap::with_capacity(converted.len());
+    let mut class_entries = HashMap::with_capacity(converted.len());
+    let mut cgroup_entries = HashMap::new();
+    let mut smaps_entries = HashMap::new();
+    let mut results = Vec::with_capacity(converted.len());
+    for (pid, cpu_entry, smaps_entry, included) in converted {
+        if let Some(entry) = cpu_entry {
+            cpu_entries.insert(pid, entry);
+        }
+        if let Some(entry) = smaps_entry {
+            smaps_entries.insert(pid, entry);
+        }
+        if let Some((class, cgroup, proc_mem)) = included {
+            class_entries.insert(pid, class);
+            if let Some(cgroup) = cgroup {
+                cgroup_entries.insert(pid, cgroup);
+            }
+            results.push(proc_mem);
+        }
+    }
+    clock.lap(Phase::Convert);
+
+    if options.cpu {
+        state.cpu_cache.replace(cpu_entries);
+    }
+    state.class_cache.replace(class_entries);
+    if cgroups {
+        state.cgroup_cache.replace(cgroup_entries);
+    }
+    if tiering.is_some() {
+        state.smaps_cache.replace(smaps_entries);
+    }
+    state
+        .health_stats
+        .phases
+        .record(Phase::PidCaches, pid_caches + clock.split());
+
+    results
+}
+
+/// Folds the exit events of a lifecycle batch into the exited totals.
+///
+/// Processes of the previous snapshot keep their subgroup. Processes that
+/// exited before any scan saw them are classified by name and only counted
+/// if the name filter passes and no USS threshold is set, since their memory
+/// is unknown. Threads exiting at the same time can each report the exit of
+/// their process; only the one with the largest totals is counted.
+fn fold_lifecycle_exits(
+    previous_exited: &Arc<Vec<ExitedTotals>>,
+    events: &[LifecycleEvent],
+    previous_cache: &HashMap<u32, ProcMem>,
+    state: &SharedState,
+    min_uss_bytes: u64,
+) -> Arc<Vec<ExitedTotals>> {
+    let mut unique: HashMap<(u32, u64), &LifecycleEvent> = HashMap::new();
+    for event in events
+        .iter()
+        .filter(|event| event.kind == LifecycleKind::Exit)
+    {
+        let kept = unique
+            .entry((event.tgid, event.start_ticks))
+            .or_insert(event);
+        if event.cpu_time_seconds > kept.cpu_time_seconds {
+            *kept = event;
+        }
+    }
+
+    let mut exits = unique
+        .into_values()
+        .filter(|event| {
+            previous_cache.contains_key(&event.tgid)
+                || (min_uss_bytes == 0 && should_include_process(&event.comm, &state.config))
+        })
+        .map(|event| {
+            (
+                classify_pid(previous_cache, event.tgid, &event.comm),
+                event.cpu_time_seconds,
+            )
+        })
+        .peekable();
+    if exits.peek().is_none() {
+        return Arc::clone(previous_exited);
+    }
+
+    let mut exited = previous_exited.as_ref().clone();
+    fold_exited(&mut exited, exits);
+    Arc::new(exited)
+}
+
 /// Cache update function.
-/// This function can be called both by the background periodic task and on-demand.
+/// Called once at startup and then by the `processes` collector of the scheduler.
 #[instrument(skip(state))]
 pub async fn update_cache(state: &SharedState) -> Result<(), Box<dyn std::error::Error>> {
     let start = Instant::now();
 
     // Check if an update is already in progress - if so, serve stale cache
-    // This is important for on-demand updates triggered by multiple concurrent /metrics requests
     {
         let mut cache = state.cache.write().await;
         if cache.is_updating {
@@ -138,10 +531,31 @@ pub async fn update_cache(state: &SharedState) -> Result<(), Box<dyn std::error:
     let included_count = AtomicUsize::new(0);
     let skipped_count = AtomicUsize::new(0);
 
-    // Clone previous cache for I/O rate delta calculation
-    let previous_cache: HashMap<u32, ProcMem> = {
+    // Previous snapshot for I/O rate delta calculation (shared, not copied)
+    let (previous_cache, previous_exited) = {
         let cache = state.cache.read().await;
-        cache.processes.clone()
+        (cache.snapshot(), Arc::clone(&cache.exited))
+    };
+
+    // Process churn since the previous scan. The last event of a PID decides
+    // whether it is alive or exec'd; /proc is only skipped if no event was lost
+    let mut clock = state.health_stats.phases.clock();
+    let lifecycle = state
+        .ebpf
+        .as_ref()
+        .and_then(|ebpf| ebpf.take_lifecycle_events());
+    if lifecycle.is_some() {
+        clock.lap(Phase::EbpfLifecycle);
+    }
+    let mut lifecycle_changes: HashMap<u32, LifecycleKind> = HashMap::new();
+    if let Some(batch) = &lifecycle {
+        for event in &batch.events {
+            lifecycle_changes.insert(event.tgid, event.kind);
+        }
+    }
+    let discovery = match &lifecycle {
+        Some(batch) if batch.complete => Discovery::Events(&lifecycle_changes),
+        _ => Discovery::Full,
     };
 
     let results: Vec<ProcMem> = if let Some(test_file) = &state.config.test_data_file {
@@ -197,111 +611,15 @@ pub async fn update_cache(state: &SharedState) -> Result<(), Box<dyn std::error:
             })
             .collect()
     } else {
-        let entries = collect_proc_entries("/proc", state.config.max_processes);
-        debug!("Collected {} process entries from /proc", entries.len());
-
-        entries
-            .par_iter()
-            .filter_map(|entry| {
-                let name = match read_process_name(&entry.proc_path) {
-                    Some(name) => name,
-                    None => {
-                        debug!("Skipping process {}: could not read name", entry.pid);
-                        state.health_stats.record_proc_read_error();
-                        skipped_count.fetch_add(1, Ordering::Relaxed);
-                        return None;
-                    }
-                };
-
-                if !should_include_process(&name, &state.config) {
-                    debug!("Skipping process {}: filtered by name config", name);
-                    skipped_count.fetch_add(1, Ordering::Relaxed);
-                    return None;
-                }
-
-                let cpu = get_cpu_stat_for_pid(entry.pid, &entry.proc_path, &state.cpu_cache);
-
-                let parse_start = Instant::now();
-                match parse_memory_for_process(&entry.proc_path, &state.buffer_config) {
-                    Ok((rss, pss, uss)) => {
-                        let parse_duration_ms = parse_start.elapsed().as_secs_f64() * 1000.0;
-                        state.health_stats.record_parsing_duration_ms(parse_duration_ms);
-
-                        if uss < min_uss_bytes {
-                            debug!(
-                                "Skipping process {}: USS {} bytes below threshold {} bytes",
-                                name, uss, min_uss_bytes
-                            );
-                            skipped_count.fetch_add(1, Ordering::Relaxed);
-                            return None;
-                        }
-
-                        // Read VmSwap from /proc/[pid]/status
-                        let vmswap = read_vmswap(&entry.proc_path).unwrap_or(0);
-
-                        // Read process start time from /proc/[pid]/stat
-                        let start_time_seconds = parse_start_time_seconds(&entry.proc_path).unwrap_or(0.0);
-
-                        // Read Block I/O from /proc/[pid]/io
-                        let (read_bytes, write_bytes) = read_block_io(&entry.proc_path).unwrap_or((0, 0));
-
-                        // Get previous I/O values from cache (if exists)
-                        let (last_read_bytes, last_write_bytes, last_rx_bytes, last_tx_bytes, last_update_time) =
-                            if let Some(prev) = previous_cache.get(&entry.pid) {
-                                // Use previous values as baseline for rate calculation
-                                (prev.read_bytes, prev.write_bytes, prev.rx_bytes, prev.tx_bytes, prev.last_update_time)
-                            } else {
-                                // First time seeing this process - use current values as baseline
-                                // This means the first rate calculation will show 0 (expected)
-                                (read_bytes, write_bytes, 0, 0, current_time)
-                            };
-
-                        debug!(
-                            "Including process {}: {} (RSS: {} MB, PSS: {} MB, USS: {} MB, CPU: {:.6}%)",
-                            entry.pid,
-                            name,
-                            rss / 1024 / 1024,
-                            pss / 1024 / 1024,
-                            uss / 1024 / 1024,
-                            cpu.cpu_percent
-                        );
-
-                        included_count.fetch_add(1, Ordering::Relaxed);
-                        Some(ProcMem {
-                            pid: entry.pid,
-                            name,
-                            rss,
-                            pss,
-                            uss,
-                            cpu_percent: cpu.cpu_percent as f32,
-                            cpu_time_seconds: cpu.cpu_time_seconds as f32,
-                            vmswap,
-                            start_time_seconds,
-                            read_bytes,
-                            write_bytes,
-                            rx_bytes: 0,  // Will be filled by eBPF if available
-                            tx_bytes: 0,  // Will be filled by eBPF if available
-                            last_read_bytes,
-                            last_write_bytes,
-                            last_rx_bytes,
-                            last_tx_bytes,
-                            last_update_time,
-                        })
-                    }
-                    Err(e) => {
-                        let err_msg = e.to_string();
-                        debug!("Skipping process {}: failed to parse memory: {}", name, err_msg);
-                        state.health_stats.record_parsing_error();
-                        // Check if it's a permission denied error
-                        if err_msg.contains("Permission denied") || err_msg.contains("permission") {
-                            state.health_stats.record_permission_denied();
-                        }
-                        skipped_count.fetch_add(1, Ordering::Relaxed);
-                        None
-                    }
-                }
-            })
-            .collect()
+        scan_processes(
+            state,
+            &previous_cache,
+            min_uss_bytes,
+            current_time,
+            &included_count,
+            &skipped_count,
+            discovery,
+        )
     };
 
     let final_included = included_count.load(Ordering::Relaxed);
@@ -316,134 +634,105 @@ pub async fn update_cache(state: &SharedState) -> Result<(), Box<dyn std::error:
         warn!("No processes matched filters after sorting");
     }
 
-    // Convert results to mutable vector for eBPF network stats update
-    let mut results = results;
+    // Index the results by PID so eBPF counters join in O(1) per entry
+    let mut clock = state.health_stats.phases.clock();
+    let mut processes: HashMap<u32, ProcMem> = results.into_iter().map(|p| (p.pid, p)).collect();
 
-    // Update network I/O from eBPF if available
+    // Exited processes can still be listed as zombies until they are reaped;
+    // their final totals are folded below instead
+    if !lifecycle_changes.is_empty() {
+        processes.retain(|pid, _| lifecycle_changes.get(pid) != Some(&LifecycleKind::Exit));
+    }
+
+    // Update network and block I/O from eBPF if available
     if let Some(ref ebpf_manager) = state.ebpf {
-        match ebpf_manager.read_process_net_stats() {
+        let mut read = state.health_stats.phases.clock();
+        let net_stats = ebpf_manager.read_process_net_stats();
+        read.lap(Phase::EbpfNetStats);
+        match net_stats {
             Ok(net_stats) => {
                 debug!("Read {} network stats from eBPF", net_stats.len());
-                for stat in net_stats {
-                    if let Some(proc) = results.iter_mut().find(|p| p.pid == stat.pid) {
-                        // Get previous network I/O from cache
-                        let (last_rx, last_tx, _last_time) =
-                            if let Some(prev) = previous_cache.get(&stat.pid) {
-                                (prev.rx_bytes, prev.tx_bytes, prev.last_update_time)
-                            } else {
-                                // First time seeing network stats for this process
-                                (stat.rx_bytes, stat.tx_bytes, current_time)
-                            };
-
-                        proc.rx_bytes = stat.rx_bytes;
-                        proc.tx_bytes = stat.tx_bytes;
-                        proc.last_rx_bytes = last_rx;
-                        proc.last_tx_bytes = last_tx;
-                        // Update last_update_time to current time for rate calculation
-                        proc.last_update_time = current_time;
-                    }
-                }
+                merge_net_io(
+                    &mut processes,
+                    &previous_cache,
+                    net_stats.iter().map(|s| (s.pid, s.rx_bytes, s.tx_bytes)),
+                    current_time,
+                );
             }
             Err(e) => {
                 debug!("Failed to read eBPF network stats: {}", e);
             }
         }
+        let mut read = state.health_stats.phases.clock();
+        let blkio_stats = ebpf_manager.read_process_blkio_stats();
+        read.lap(Phase::EbpfBlkioStats);
+        match blkio_stats {
+            Ok(blkio_stats) => {
+                debug!("Read {} block I/O stats from eBPF", blkio_stats.len());
+                merge_blkio(
+                    &mut processes,
+                    blkio_stats
+                        .iter()
+                        .map(|s| (s.pid, s.read_bytes, s.write_bytes)),
+                );
+            }
+            Err(e) => {
+                debug!("Failed to read eBPF block I/O stats: {}", e);
+            }
+        }
+
+        // Classify the kernel's I/O histograms by this scan's subgroups
+        let mut read = state.health_stats.phases.clock();
+        let pushed =
+            ebpf_manager.push_pid_classes(processes.values().map(|p| (p.pid, p.subgroup_id)));
+        read.lap(Phase::EbpfPidClasses);
+        if let Err(e) = pushed {
+            debug!("Failed to push process classes to eBPF: {}", e);
+        }
     } else {
         // No eBPF available - update timestamps for processes that had previous data
-        for proc in results.iter_mut() {
+        for proc in processes.values_mut() {
             if previous_cache.contains_key(&proc.pid) {
                 proc.last_update_time = current_time;
             }
         }
     }
+    clock.lap(Phase::EbpfMerge);
+
+    // Aggregate metrics and rank processes per subgroup, indexed by subgroup
+    // ID. At least TOP_SLOTS processes are ranked so the ringbuffer history
+    // stays complete when a smaller top-N is configured
+    let subgroups = registered_subgroups();
+    let top_n_subgroup = state.config.top_n_subgroup.unwrap_or(3).max(TOP_SLOTS);
+    let top_n_others = state.config.top_n_others.unwrap_or(10).max(TOP_SLOTS);
+    let top_n: Vec<usize> = subgroups
+        .iter()
+        .map(|info| {
+            if info.group.as_ref() == "other" {
+                top_n_others
+            } else {
+                top_n_subgroup
+            }
+        })
+        .collect();
 
-    // Update cache with new data
+    let timestamp = chrono::Utc::now().timestamp();
+    let mut subgroups_count = 0u64;
+    let mut top_processes = vec![SubgroupTop::default(); subgroups.len()];
+    let mut ringbuffer_entries = Vec::new();
+    for (info, acc) in subgroups
+        .iter()
+        .zip(aggregate_subgroups(&processes, &top_n))
     {
-        let mut cache = state.cache.write().await;
-        cache.processes.clear();
-        for p in &results {
-            cache.processes.insert(p.pid, p.clone());
+        let agg_data = &acc.data;
+        if agg_data.process_count == 0 {
+            continue;
         }
-
-        cache.update_duration_seconds = start.elapsed().as_secs_f64();
-        cache.update_success = true;
-        cache.last_updated = Some(start);
-        cache.is_updating = false;
-
-        state.cache_updating.set(0.0);
-    }
-
-    // Count unique subgroups and aggregate metrics for ringbuffer
-    // Also collect processes per subgroup for top-N calculation
-    let mut aggregated_by_subgroup: HashMap<String, AggregatedData> = HashMap::new();
-    let mut processes_by_subgroup: HashMap<String, Vec<&ProcMem>> = HashMap::new();
-
-    for p in &results {
-        let (group, subgroup) = classify_process_raw(&p.name);
-        let key = format!("{}:{}", group, subgroup);
-
-        let agg = aggregated_by_subgroup
-            .entry(key.clone())
-            .or_insert(AggregatedData {
-                rss_sum: 0,
-                pss_sum: 0,
-                uss_sum: 0,
-                cpu_percent_sum: 0.0,
-                cpu_time_sum: 0.0,
-                process_count: 0,
-            });
-
-        agg.rss_sum += p.rss;
-        agg.pss_sum += p.pss;
-        agg.uss_sum += p.uss;
-        agg.cpu_percent_sum += p.cpu_percent as f64;
-        agg.cpu_time_sum += p.cpu_time_seconds as f64;
-        agg.process_count += 1;
-
-        // Store process reference for top-N calculation
-        processes_by_subgroup
-            .entry(key)
-            .or_insert_with(Vec::new)
-            .push(p);
-    }
-
-    let subgroups_count = aggregated_by_subgroup.len() as u64;
-
-    // Record ringbuffer entries for each subgroup
-    let timestamp = chrono::Utc::now().timestamp();
-    for (key, agg_data) in &aggregated_by_subgroup {
-        // Get top-3 processes for this subgroup
-        let procs = processes_by_subgroup
-            .get(key)
-            .map(|v| v.as_slice())
-            .unwrap_or(&[]);
+        subgroups_count += 1;
 
         // Total CPU usage for this subgroup (sum of all processes)
         let cpu_percent = agg_data.cpu_percent_sum as f32;
 
-        // Calculate top-3 by CPU, RSS, and PSS using helper function
-        let top_cpu = extract_top_3(
-            procs,
-            |a, b| {
-                b.cpu_percent
-                    .partial_cmp(&a.cpu_percent)
-                    .unwrap_or(std::cmp::Ordering::Equal)
-            },
-            |p| (p.cpu_percent * CPU_SCALE_FACTOR) as u32,
-        );
-
-        let top_rss = extract_top_3(
-            procs,
-            |a, b| b.rss.cmp(&a.rss),
-            |p| (p.rss / 1024) as u32, // Convert to KB
-        );
-
-        let top_pss = extract_top_3(
-            procs,
-            |a, b| b.pss.cmp(&a.pss),
-            |p| (p.pss / 1024) as u32, // Convert to KB
-        );
-
         let entry = RingbufferEntry {
             timestamp,
             rss_kb: agg_data.rss_sum / 1024,
@@ -451,24 +740,82 @@ pub async fn update_cache(state: &SharedState) -> Result<(), Box<dyn std::error:
             uss_kb: agg_data.uss_sum / 1024,
             cpu_percent,
             cpu_time_seconds: agg_data.cpu_time_sum as f32,
-            top_cpu,
-            top_rss,
-            top_pss,
+            top_cpu: top_slots(&acc.rankings, Ranking::Cpu, |p| {
+                (p.cpu_percent * CPU_SCALE_FACTOR) as u32
+            }),
+            top_rss: top_slots(&acc.rankings, Ranking::Rss, |p| (p.rss / 1024) as u32), // KB
+            top_pss: top_slots(&acc.rankings, Ranking::Pss, |p| (p.pss / 1024) as u32), // KB
             _padding: [],
         };
 
-        state.ringbuffer_manager.record(key, entry);
+        top_processes[info.id as usize] = acc.rankings.to_subgroup_top();
+        ringbuffer_entries.push((info, entry, agg_data.process_count));
+    }
+
+    let exited = match &lifecycle {
+        Some(batch) => fold_lifecycle_exits(
+            &previous_exited,
+            &batch.events,
+            &previous_cache,
+            state,
+            min_uss_bytes,
+        ),
+        None => previous_exited,
+    };
+
+    // cgroups for the cgroup collector and the per-cgroup metrics
+    if state.config.enable_cgroups.unwrap_or(false) {
+        let max_cgroups = state
+            .config
+            .max_cgroups
+            .unwrap_or(crate::config::DEFAULT_MAX_CGROUPS);
+        let (cgroups, dropped) = group_by_cgroup(
+            processes
+                .values()
+                .filter_map(|p| p.cgroup.as_ref().map(|cgroup| (cgroup, p.rss))),
+            max_cgroups,
+        );
+        if dropped > 0 {
+            debug!(
+                "{} cgroups over the max_cgroups limit of {} not exported",
+                dropped, max_cgroups
+            );
+        }
+        *state.cgroups.write().expect("cgroups lock poisoned") = Arc::new(cgroups);
+    }
+    clock.lap(Phase::Aggregate);
+
+    // Publish the new snapshot together with its rankings; readers still
+    // holding the previous one keep it alive until they finish
+    let snapshot = Arc::new(processes);
+    {
+        let mut cache = state.cache.write().await;
+        cache.processes = Arc::clone(&snapshot);
+        cache.top_processes = Arc::new(top_processes);
+        cache.exited = exited;
+
+        cache.update_duration_seconds = start.elapsed().as_secs_f64();
+        cache.update_success = true;
+        cache.last_updated = Some(start);
+        cache.is_updating = false;
+
+        state.cache_updating.set(0.0);
+    }
+    state.cache_published.notify_one();
+    clock.lap(Phase::Publish);
+
+    // Record ringbuffer entries for each subgroup
+    for (info, entry, process_count) in ringbuffer_entries {
+        state.ringbuffer_manager.record(info.id, entry);
 
         debug!(
             "Recorded ringbuffer entry for {}: {} processes, RSS={} KB, CPU={:.1}%",
-            key,
-            agg_data.process_count,
-            agg_data.rss_sum / 1024,
-            cpu_percent
+            info.key, process_count, entry.rss_kb, entry.cpu_percent
         );
     }
+    clock.lap(Phase::Ringbuffer);
 
-    let scanned = results.len() as u64;
+    let scanned = snapshot.len() as u64;
     let scan_duration = start.elapsed().as_secs_f64();
     state
         .health_stats
@@ -534,7 +881,7 @@ pub async fn update_cache(state: &SharedState) -> Result<(), Box<dyn std::error:
 
     info!(
         "Cache update completed: {} processes (subgroup filters applied at scrape), {} total scanned, {:.2}ms",
-        results.len(),
+        snapshot.len(),
         final_included + final_skipped,
         start.elapsed().as_secs_f64() * 1000.0
     );
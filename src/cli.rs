@@ -84,7 +84,7 @@ pub struct Args {
     #[arg(long)]
     pub debug: bool,
 
-    /// Cache metrics for N seconds
+    /// Seconds between background process scans
     #[arg(long)]
     pub cache_ttl: Option<u64>,
 
@@ -144,6 +144,14 @@ pub struct Args {
     #[arg(short = 't', long)]
     pub test_data_file: Option<PathBuf>,
 
+    /// Scan processes under this directory instead of /proc
+    #[arg(long)]
+    pub proc_root: Option<PathBuf>,
+
+    /// Push metrics to this Prometheus remote-write URL (override config)
+    #[arg(long)]
+    pub remote_write_url: Option<String>,
+
     /// Enable TLS/SSL for HTTPS
     #[arg(long)]
     pub enable_tls: bool,
@@ -257,6 +265,19 @@ pub enum Commands {
         /// Number of "other" processes to generate
         #[arg(long, default_value_t = 12)]
         others_count: usize,
+
+        /// Write a synthetic /proc tree to this directory instead of JSON
+        /// (scan it with --proc-root)
+        #[arg(long)]
+        proc_tree: Option<PathBuf>,
+
+        /// Number of processes in the /proc tree
+        #[arg(long, default_value_t = 10_000)]
+        processes: usize,
+
+        /// Seed of the /proc tree; the same seed gives the same tree
+        #[arg(long)]
+        seed: Option<u64>,
     },
 
     /// Install system-wide with systemd service
@@ -0,0 +1,142 @@
+//! cgroup v2 statistics collector.
+//!
+//! This module reads memory and CPU usage of the cgroups found by the last
+//! process scan straight from the cgroup v2 hierarchy:
+//! - <root>/<cgroup>/memory.current, memory.stat and memory.swap.current
+//! - <root>/<cgroup>/cpu.stat
+//!
+//! cgroup v2 counters are hierarchical and maintained by the kernel, which is
+//! far cheaper than summing `smaps_rollup` of every member process.
+
+use std::fs;
+use std::io;
+use std::os::unix::fs::MetadataExt;
+use std::path::Path;
+use std::sync::Arc;
+
+/// Usage of one cgroup.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct CgroupStats {
+    pub path: Arc<str>,
+    /// cgroup ID, the inode of the cgroup directory (as seen by eBPF)
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub id: u64,
+    pub memory_bytes: u64,
+    pub memory_anon_bytes: u64,
+    pub memory_file_bytes: u64,
+    /// 0 without swap accounting
+    pub memory_swap_bytes: u64,
+    pub cpu_user_seconds: f64,
+    pub cpu_system_seconds: f64,
+    /// 0 without the cpu controller
+    pub cpu_throttled_seconds: f64,
+}
+
+/// Reads the usage of every cgroup in `paths`, relative to the cgroup v2
+/// mount point `root`.
+///
+/// cgroups removed since the scan are skipped. Fails if `root` is not a
+/// cgroup v2 hierarchy.
+pub fn read_cgroup_stats<'a>(
+    root: &Path,
+    paths: impl IntoIterator<Item = &'a Arc<str>>,
+) -> Result<Vec<CgroupStats>, String> {
+    if !root.join("cgroup.controllers").exists() {
+        return Err(format!("{} is not a cgroup v2 hierarchy", root.display()));
+    }
+
+    Ok(paths
+        .into_iter()
+        .filter_map(|path| read_one(root, path).ok())
+        .collect())
+}
+
+fn read_one(root: &Path, path: &Arc<str>) -> io::Result<CgroupStats> {
+    let dir = root.join(path.trim_start_matches('/'));
+    let memory_stat = fs::read_to_string(dir.join("memory.stat"))?;
+    let cpu_stat = fs::read_to_string(dir.join("cpu.stat"))?;
+    let read_value = |name: &str| {
+        fs::read_to_string(dir.join(name))
+            .ok()
+            .and_then(|s| s.trim().parse::<u64>().ok())
+    };
+    let usec = |key: &str| parse_keyed(&cpu_stat, key).unwrap_or(0) as f64 / 1e6;
+
+    Ok(CgroupStats {
+        path: Arc::clone(path),
+        id: fs::metadata(&dir)?.ino(),
+        memory_bytes: read_value("memory.current").unwrap_or(0),
+        memory_anon_bytes: parse_keyed(&memory_stat, "anon").unwrap_or(0),
+        memory_file_bytes: parse_keyed(&memory_stat, "file").unwrap_or(0),
+        memory_swap_bytes: read_value("memory.swap.current").unwrap_or(0),
+        cpu_user_seconds: usec("user_usec"),
+        cpu_system_seconds: usec("system_usec"),
+        cpu_throttled_seconds: usec("throttled_usec"),
+    })
+}
+
+/// Returns the value of `key` in a flat keyed file such as memory.stat or
+/// cpu.stat (`<key> <value>` per line).
+pub fn parse_keyed(content: &str, key: &str) -> Option<u64> {
+    content.lines().find_map(|line| {
+        let (k, v) = line.split_once(' ')?;
+        if k == key {
+            v.trim().parse().ok()
+        } else {
+            None
+        }
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_parse_keyed() {
+        let content = "anon 4096\nfile 8192\nanon_thp 0\n";
+        assert_eq!(parse_keyed(content, "anon"), Some(4096));
+        assert_eq!(parse_keyed(content, "file"), Some(8192));
+        assert_eq!(parse_keyed(content, "shmem"), None);
+    }
+
+    #[test]
+    fn test_read_cgroup_stats() {
+        let root = tempdir().unwrap();
+        fs::write(root.path().join("cgroup.controllers"), "cpu memory\n").unwrap();
+        let dir = root.path().join("system.slice/nginx.service");
+        fs::create_dir_all(&dir).unwrap();
+        fs::write(dir.join("memory.current"), "65536\n").unwrap();
+        fs::write(dir.join("memory.stat"), "anon 4096\nfile 8192\n").unwrap();
+        fs::write(
+            dir.join("cpu.stat"),
+            "usage_usec 3000000\nuser_usec 2000000\nsystem_usec 1000000\n",
+        )
+        .unwrap();
+
+        let present: Arc<str> = Arc::from("/system.slice/nginx.service");
+        let removed: Arc<str> = Arc::from("/system.slice/gone.service");
+        let stats = read_cgroup_stats(root.path(), [&present, &removed]).unwrap();
+
+        assert_eq!(stats.len(), 1);
+        let stats = &stats[0];
+        assert_eq!(stats.path, present);
+        assert_eq!(stats.id, fs::metadata(&dir).unwrap().ino());
+        assert_eq!(stats.memory_bytes, 65536);
+        assert_eq!(
+            (stats.memory_anon_bytes, stats.memory_file_bytes),
+            (4096, 8192)
+        );
+        assert_eq!(stats.memory_swap_bytes, 0);
+        assert_eq!(stats.cpu_user_seconds, 2.0);
+        assert_eq!(stats.cpu_system_seconds, 1.0);
+        assert_eq!(stats.cpu_throttled_seconds, 0.0);
+    }
+
+    #[test]
+    fn test_read_cgroup_stats_requires_v2() {
+        let root = tempdir().unwrap();
+        assert!(read_cgroup_stats(root.path(), []).is_err());
+    }
+}
@@ -1,10 +1,16 @@
 //! Disk I/O statistics collector.
 //!
 //! This module provides functionality to read disk I/O statistics from /proc/diskstats
-//! and expose them as Prometheus metrics.
+//! and expose them as Prometheus metrics. The file stays open between runs
+//! and is parsed as bytes; device names are only allocated when the device
+//! list changes.
 
-use std::collections::HashMap;
 use std::fs;
+use std::path::PathBuf;
+
+use crate::procfs::{self, ProcFile};
+
+use super::{DeviceNames, DeviceTable};
 
 /// Disk statistics for a single device.
 #[derive(Debug, Clone)]
@@ -29,48 +35,94 @@ pub struct DiskStats {
     pub weighted_time_io_ms: u64,
 }
 
-/// Reads disk statistics from /proc/diskstats.
-///
-/// Returns a HashMap mapping device names to their statistics.
-/// Format: major minor name read_ios read_merges read_sectors read_ticks write_ios write_merges write_sectors write_ticks ios_in_progress time_in_queue weighted_time_in_queue
-pub fn read_diskstats() -> Result<HashMap<String, DiskStats>, String> {
-    let content = fs::read_to_string("/proc/diskstats")
-        .map_err(|e| format!("Failed to read /proc/diskstats: {}", e))?;
+/// Reads disk statistics from /proc/diskstats, keeping the file open and
+/// device names interned across runs.
+#[derive(Debug)]
+pub struct DiskstatsReader {
+    file: ProcFile,
+    names: DeviceNames,
+}
 
-    let mut stats = HashMap::new();
+impl Default for DiskstatsReader {
+    fn default() -> Self {
+        Self::new("/proc/diskstats")
+    }
+}
 
-    for line in content.lines() {
-        let parts: Vec<&str> = line.split_whitespace().collect();
-        if parts.len() < 14 {
-            continue; // Skip malformed lines
+impl DiskstatsReader {
+    pub fn new(path: impl Into<PathBuf>) -> Self {
+        Self {
+            file: ProcFile::new(path),
+            names: DeviceNames::default(),
         }
+    }
+
+    /// Reads the statistics of all tracked devices.
+    pub fn read(&mut self) -> Result<DeviceTable<DiskStats>, String> {
+        let content = match self.file.read() {
+            Ok(content) => content,
+            Err(e) => {
+                return Err(format!(
+                    "Failed to read {}: {}",
+                    self.file.path().display(),
+                    e
+                ))
+            }
+        };
+        Ok(parse_diskstats(content, &mut self.names))
+    }
+}
 
-        let device = parts[2].to_string();
+/// Parses /proc/diskstats into a table of devices.
+///
+/// Format: major minor name read_ios read_merges read_sectors read_ticks write_ios write_merges write_sectors write_ticks ios_in_progress time_in_queue weighted_time_in_queue
+fn parse_diskstats(content: &[u8], names: &mut DeviceNames) -> DeviceTable<DiskStats> {
+    let mut devices = Vec::with_capacity(names.len());
+
+    for line in procfs::lines(content) {
+        let mut fields = procfs::fields(line);
+        let device = match fields.nth(2) {
+            Some(device) => device,
+            None => continue, // Skip malformed lines
+        };
 
         // Skip loop devices and partitions we don't want to track
         // You can customize this filter as needed
-        if device.starts_with("loop") || device.starts_with("ram") {
+        if device.starts_with(b"loop") || device.starts_with(b"ram") {
             continue;
         }
 
+        let mut values = [0u64; 11];
+        let mut found = 0;
+        for (value, field) in values.iter_mut().zip(fields) {
+            *value = procfs::parse_u64(field).unwrap_or(0);
+            found += 1;
+        }
+        if found < values.len() {
+            continue; // Skip malformed lines
+        }
+
         let disk_stat = DiskStats {
-            reads_completed: parts[3].parse().unwrap_or(0),
-            reads_merged: parts[4].parse().unwrap_or(0),
-            sectors_read: parts[5].parse().unwrap_or(0),
-            time_reading_ms: parts[6].parse().unwrap_or(0),
-            writes_completed: parts[7].parse().unwrap_or(0),
-            writes_merged: parts[8].parse().unwrap_or(0),
-            sectors_written: parts[9].parse().unwrap_or(0),
-            time_writing_ms: parts[10].parse().unwrap_or(0),
-            ios_in_progress: parts[11].parse().unwrap_or(0),
-            time_io_ms: parts[12].parse().unwrap_or(0),
-            weighted_time_io_ms: parts[13].parse().unwrap_or(0),
+            reads_completed: values[0],
+            reads_merged: values[1],
+            sectors_read: values[2],
+            time_reading_ms: values[3],
+            writes_completed: values[4],
+            writes_merged: values[5],
+            sectors_written: values[6],
+            time_writing_ms: values[7],
+            ios_in_progress: values[8],
+            time_io_ms: values[9],
+            weighted_time_io_ms: values[10],
         };
 
-        stats.insert(device, disk_stat);
+        devices.push((names.intern(devices.len(), device), disk_stat));
     }
 
-    Ok(stats)
+    DeviceTable {
+        version: names.finish(devices.len()),
+        devices,
+    }
 }
 
 /// Reads PSI (Pressure Stall Information) I/O metrics from /proc/pressure/io.
@@ -102,15 +154,38 @@ pub fn read_psi_io() -> Result<f64, String> {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use std::sync::Arc;
 
     #[test]
     fn test_read_diskstats() {
-        let result = read_diskstats();
+        let result = DiskstatsReader::default().read();
         assert!(result.is_ok(), "Failed to read diskstats: {:?}", result);
 
         let stats = result.unwrap();
         // Should have at least one disk
-        assert!(!stats.is_empty(), "No disk statistics found");
+        assert!(!stats.devices.is_empty(), "No disk statistics found");
+    }
+
+    #[test]
+    fn test_parse_diskstats() {
+        let content = b"   7       0 loop0 1 0 2 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+   8       0 sda 100 5 2048 30 200 10 4096 60 2 500 90 0 0 0 0 0 0
+ 259       0 nvme0n1 1 2 3 4 5 6 7 8 9 10 11
+ 259       1 truncated 1 2 3
+";
+        let mut names = DeviceNames::default();
+        let table = parse_diskstats(content, &mut names);
+
+        let devices: Vec<&str> = table.devices.iter().map(|(name, _)| &**name).collect();
+        assert_eq!(devices, ["sda", "nvme0n1"]);
+        let sda = &table.devices[0].1;
+        assert_eq!((sda.sectors_read, sda.sectors_written), (2048, 4096));
+        assert_eq!((sda.ios_in_progress, sda.time_io_ms), (2, 500));
+        assert_eq!(table.devices[1].1.weighted_time_io_ms, 11);
+
+        let again = parse_diskstats(content, &mut names);
+        assert_eq!(again.version, table.version);
+        assert!(Arc::ptr_eq(&again.devices[0].0, &table.devices[0].0));
     }
 
     #[test]
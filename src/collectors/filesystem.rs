@@ -1,9 +1,24 @@
 //! Filesystem statistics collector.
 //!
-//! This module provides functionality to read filesystem statistics from mounted filesystems
-//! and expose them as Prometheus metrics.
+//! [`FilesystemCollector`] keeps the mount table parsed from
+//! `/proc/self/mountinfo` and only re-reads it when the kernel reports a
+//! change: the file signals `POLLPRI` after every mount and unmount in the
+//! namespace. Usage comes from `statvfs`, which can block indefinitely on an
+//! unresponsive network filesystem, so every mount is stat'ed on its own
+//! thread against a common deadline. A mount that does not answer in time
+//! keeps its last value, flagged as stale, and is not stat'ed again until the
+//! hung call returns, so each mount holds at most one thread.
 
-use std::fs;
+use ahash::AHashMap as HashMap;
+use std::fs::File;
+use std::os::fd::AsRawFd;
+use std::path::{Path, PathBuf};
+use std::sync::{mpsc, Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+use tracing::{debug, warn};
+
+use crate::procfs;
 
 /// Filesystem statistics for a single mount point.
 #[derive(Debug, Clone)]
@@ -17,55 +32,281 @@ pub struct FilesystemStats {
     pub used_bytes: u64,
     pub files_total: u64,
     pub files_free: u64,
+    /// The statvfs call timed out and the values are from an earlier one
+    pub stale: bool,
+    /// Duration of the last statvfs call, or of the running one while it hangs
+    pub collect_seconds: f64,
 }
 
-/// Reads filesystem statistics from /proc/mounts and uses libc statvfs to get usage data.
-///
-/// Returns a Vec of filesystem statistics for each mounted filesystem.
-pub fn read_filesystem_stats() -> Result<Vec<FilesystemStats>, String> {
-    let mounts_content = fs::read_to_string("/proc/mounts")
-        .map_err(|e| format!("Failed to read /proc/mounts: {}", e))?;
+/// A mounted filesystem from `/proc/self/mountinfo`.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Mount {
+    /// Mount ID, unique while the filesystem stays mounted
+    pub id: u64,
+    pub device: String,
+    pub mount_point: String,
+    pub fstype: String,
+}
 
-    let mut stats = Vec::new();
+/// Parses the contents of `/proc/<pid>/mountinfo`.
+pub fn parse_mountinfo(content: &str) -> Vec<Mount> {
+    content.lines().filter_map(parse_mountinfo_line).collect()
+}
 
-    for line in mounts_content.lines() {
-        let parts: Vec<&str> = line.split_whitespace().collect();
-        if parts.len() < 3 {
-            continue;
+/// Parses one line: `<id> <parent> <major:minor> <root> <mount point>
+/// <options> [optional fields] - <fstype> <source> <super options>`.
+fn parse_mountinfo_line(line: &str) -> Option<Mount> {
+    let (mount, filesystem) = line.split_once(" - ")?;
+    let mut mount = mount.split(' ');
+    let id = mount.next()?.parse().ok()?;
+    let mount_point = mount.nth(3)?;
+    let mut filesystem = filesystem.split(' ');
+    let fstype = filesystem.next()?;
+    let device = filesystem.next()?;
+    Some(Mount {
+        id,
+        device: unescape(device),
+        mount_point: unescape(mount_point),
+        fstype: fstype.to_string(),
+    })
+}
+
+/// Undoes the octal escapes the kernel applies to mount paths (`\040` for a
+/// space).
+fn unescape(field: &str) -> String {
+    if !field.contains('\\') {
+        return field.to_string();
+    }
+    let bytes = field.as_bytes();
+    let mut out = Vec::with_capacity(bytes.len());
+    let mut i = 0;
+    while i < bytes.len() {
+        let escaped = bytes
+            .get(i + 1..i + 4)
+            .filter(|_| bytes[i] == b'\\')
+            .and_then(|octal| u8::from_str_radix(std::str::from_utf8(octal).ok()?, 8).ok());
+        match escaped {
+            Some(byte) => {
+                out.push(byte);
+                i += 4;
+            }
+            None => {
+                out.push(bytes[i]);
+                i += 1;
+            }
         }
+    }
+    String::from_utf8_lossy(&out).into_owned()
+}
 
-        let device = parts[0].to_string();
-        let mount_point = parts[1].to_string();
-        let fstype = parts[2].to_string();
+/// Result of the last statvfs call of one mount.
+#[derive(Debug, Clone, Copy)]
+struct Usage {
+    size_bytes: u64,
+    available_bytes: u64,
+    used_bytes: u64,
+    files_total: u64,
+    files_free: u64,
+}
+
+/// statvfs state of one mount, shared with its probe thread.
+#[derive(Debug, Default)]
+struct Probe {
+    /// Start of the call still running, if any
+    running_since: Option<Instant>,
+    /// `None` until a call succeeds, or after a call failed
+    usage: Option<Usage>,
+    duration_seconds: f64,
+}
 
-        // Skip pseudo filesystems and irrelevant mount points
-        if should_skip_filesystem(&fstype, &mount_point) {
-            continue;
+impl Probe {
+    /// Starts statvfs of `path` on its own thread, unless the previous call
+    /// is still running. Returns a receiver that is signalled on completion.
+    fn start(probe: &Arc<Mutex<Probe>>, path: &str) -> Option<mpsc::Receiver<()>> {
+        {
+            let mut state = probe.lock().expect("filesystem probe lock poisoned");
+            if state.running_since.is_some() {
+                return None;
+            }
+            state.running_since = Some(Instant::now());
+        }
+
+        let (done, receiver) = mpsc::channel();
+        let thread_probe = Arc::clone(probe);
+        let thread_path = path.to_string();
+        let spawned = thread::Builder::new()
+            .name("statvfs".to_string())
+            .spawn(move || {
+                let start = Instant::now();
+                let usage = get_statvfs_stats(&thread_path).ok().map(
+                    |(size_bytes, available_bytes, used_bytes, files_total, files_free)| Usage {
+                        size_bytes,
+                        available_bytes,
+                        used_bytes,
+                        files_total,
+                        files_free,
+                    },
+                );
+                let mut state = thread_probe.lock().expect("filesystem probe lock poisoned");
+                state.running_since = None;
+                state.usage = usage;
+                state.duration_seconds = start.elapsed().as_secs_f64();
+                // The collector may have stopped waiting
+                let _ = done.send(());
+            });
+        match spawned {
+            Ok(_) => Some(receiver),
+            Err(e) => {
+                warn!("Failed to spawn statvfs thread for {}: {}", path, e);
+                probe
+                    .lock()
+                    .expect("filesystem probe lock poisoned")
+                    .running_since = None;
+                None
+            }
         }
+    }
+}
+
+#[derive(Default)]
+struct MountTable {
+    /// Open mountinfo, polled for changes
+    file: Option<File>,
+    /// Mounts that are reported, without pseudo filesystems
+    mounts: Vec<Mount>,
+    probes: HashMap<u64, Arc<Mutex<Probe>>>,
+}
+
+/// Collects filesystem usage with change-driven mount parsing and per-mount
+/// statvfs timeouts.
+pub struct FilesystemCollector {
+    mountinfo: PathBuf,
+    table: Mutex<MountTable>,
+}
 
-        // Get filesystem stats using statvfs
-        match get_statvfs_stats(&mount_point) {
-            Ok((size, available, used, files_total, files_free)) => {
+impl Default for FilesystemCollector {
+    fn default() -> Self {
+        Self::new(Path::new("/proc/self/mountinfo"))
+    }
+}
+
+impl FilesystemCollector {
+    /// Creates a collector reading the mount table from `mountinfo`.
+    pub fn new(mountinfo: &Path) -> Self {
+        Self {
+            mountinfo: mountinfo.to_path_buf(),
+            table: Mutex::new(MountTable::default()),
+        }
+    }
+
+    /// Returns the usage of every mounted filesystem.
+    ///
+    /// Waits at most `timeout` for the statvfs calls, which run in
+    /// parallel. Filesystems that do not answer in time are reported with
+    /// their last values and `stale` set, or left out if they never
+    /// answered. Fails only if the mount table cannot be read.
+    pub fn collect(&self, timeout: Duration) -> Result<Vec<FilesystemStats>, String> {
+        let mut guard = self
+            .table
+            .lock()
+            .expect("filesystem collector lock poisoned");
+        let table = &mut *guard;
+        self.refresh_mounts(table)?;
+
+        let deadline = Instant::now() + timeout;
+        let started: Vec<_> = table
+            .mounts
+            .iter()
+            .map(|mount| {
+                let probe = Arc::clone(table.probes.entry(mount.id).or_default());
+                let done = Probe::start(&probe, &mount.mount_point);
+                (mount, probe, done)
+            })
+            .collect();
+
+        let mut stats = Vec::with_capacity(started.len());
+        for (mount, probe, done) in started {
+            if let Some(done) = done {
+                let _ = done.recv_timeout(deadline.saturating_duration_since(Instant::now()));
+            }
+            let state = probe.lock().expect("filesystem probe lock poisoned");
+            // Still running once the deadline passed: the value is old
+            let (stale, collect_seconds) = match state.running_since {
+                Some(since) => {
+                    warn!(
+                        "statvfs of {} ({}) has not returned for {:.1}s",
+                        mount.mount_point,
+                        mount.fstype,
+                        since.elapsed().as_secs_f64()
+                    );
+                    (true, since.elapsed().as_secs_f64())
+                }
+                None => (false, state.duration_seconds),
+            };
+            // Filesystems that cannot be stat'ed are skipped
+            if let Some(usage) = state.usage {
                 stats.push(FilesystemStats {
-                    device,
-                    mount_point,
-                    fstype,
-                    size_bytes: size,
-                    available_bytes: available,
-                    used_bytes: used,
-                    files_total,
-                    files_free,
+                    device: mount.device.clone(),
+                    mount_point: mount.mount_point.clone(),
+                    fstype: mount.fstype.clone(),
+                    size_bytes: usage.size_bytes,
+                    available_bytes: usage.available_bytes,
+                    used_bytes: usage.used_bytes,
+                    files_total: usage.files_total,
+                    files_free: usage.files_free,
+                    stale,
+                    collect_seconds,
                 });
             }
-            Err(_) => continue, // Skip filesystems we can't stat
         }
+        Ok(stats)
     }
 
-    Ok(stats)
+    /// Re-reads the mount table on the first call and after changes.
+    fn refresh_mounts(&self, table: &mut MountTable) -> Result<(), String> {
+        if let Some(file) = &table.file {
+            if !mount_table_changed(file) {
+                return Ok(());
+            }
+        }
+
+        let file = match table.file.take() {
+            Some(file) => file,
+            None => File::open(&self.mountinfo)
+                .map_err(|e| format!("Failed to open {}: {}", self.mountinfo.display(), e))?,
+        };
+        let mut content = Vec::new();
+        procfs::read_at_start(&file, &mut content)
+            .map_err(|e| format!("Failed to read {}: {}", self.mountinfo.display(), e))?;
+        table.file = Some(file);
+
+        table.mounts = parse_mountinfo(&String::from_utf8_lossy(&content))
+            .into_iter()
+            .filter(|mount| !should_skip_filesystem(&mount.fstype, &mount.mount_point))
+            .collect();
+        let mounts = &table.mounts;
+        table
+            .probes
+            .retain(|id, _| mounts.iter().any(|mount| mount.id == *id));
+        debug!("Mount table read: {} filesystems", table.mounts.len());
+        Ok(())
+    }
+}
+
+/// Whether the mount table changed since `file` was last read.
+fn mount_table_changed(file: &File) -> bool {
+    let mut pollfd = libc::pollfd {
+        fd: file.as_raw_fd(),
+        events: libc::POLLPRI,
+        revents: 0,
+    };
+    // SAFETY: one valid pollfd, zero timeout
+    let ready = unsafe { libc::poll(&mut pollfd, 1, 0) };
+    // A failed poll re-reads the table rather than keeping an old one
+    ready < 0 || (ready > 0 && pollfd.revents & (libc::POLLPRI | libc::POLLERR) != 0)
 }
 
 /// Checks if a filesystem should be skipped based on type and mount point.
-#[allow(dead_code)] // Used internally by read_filesystem_stats
 fn should_skip_filesystem(fstype: &str, mount_point: &str) -> bool {
     // Skip pseudo/virtual filesystems
     let skip_types = [
@@ -106,7 +347,6 @@ fn should_skip_filesystem(fstype: &str, mount_point: &str) -> bool {
 }
 
 /// Gets filesystem statistics using libc statvfs.
-#[allow(dead_code)] // Used internally by read_filesystem_stats
 fn get_statvfs_stats(path: &str) -> Result<(u64, u64, u64, u64, u64), String> {
     use std::ffi::CString;
     use std::mem;
@@ -146,10 +386,13 @@ fn get_statvfs_stats(path: &str) -> Result<(u64, u64, u64, u64, u64), String> {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use std::fs;
+    use tempfile::tempdir;
 
     #[test]
     fn test_read_filesystem_stats() {
-        let result = read_filesystem_stats();
+        let collector = FilesystemCollector::default();
+        let result = collector.collect(Duration::from_secs(5));
         assert!(
             result.is_ok(),
             "Failed to read filesystem stats: {:?}",
@@ -163,6 +406,54 @@ mod tests {
         // Check that root filesystem is present
         let has_root = stats.iter().any(|fs| fs.mount_point == "/");
         assert!(has_root, "Root filesystem not found");
+        assert!(stats.iter().all(|fs| !fs.stale));
+    }
+
+    #[test]
+    fn test_parse_mountinfo() {
+        let content = "\
+22 1 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw
+23 22 0:21 / /proc rw,nosuid - proc proc rw
+40 22 0:35 / /mnt/my\\040share rw master:2 shared:3 - nfs4 srv:/export\\040a rw
+garbage
+";
+        let mounts = parse_mountinfo(content);
+        assert_eq!(mounts.len(), 3);
+        assert_eq!(
+            mounts[0],
+            Mount {
+                id: 22,
+                device: "/dev/sda1".to_string(),
+                mount_point: "/".to_string(),
+                fstype: "ext4".to_string(),
+            }
+        );
+        assert_eq!(mounts[1].fstype, "proc");
+        assert_eq!(mounts[2].id, 40);
+        assert_eq!(mounts[2].mount_point, "/mnt/my share");
+        assert_eq!(mounts[2].device, "srv:/export a");
+        assert_eq!(mounts[2].fstype, "nfs4");
+    }
+
+    #[test]
+    fn test_collect_uses_mountinfo() {
+        let dir = tempdir().unwrap();
+        let mountinfo = dir.path().join("mountinfo");
+        fs::write(
+            &mountinfo,
+            format!(
+                "1 0 8:1 / {} rw - ext4 /dev/test rw\n2 1 0:21 / /proc rw - proc proc rw\n",
+                dir.path().display()
+            ),
+        )
+        .unwrap();
+
+        let collector = FilesystemCollector::new(&mountinfo);
+        let stats = collector.collect(Duration::from_secs(5)).unwrap();
+        assert_eq!(stats.len(), 1);
+        assert_eq!(stats[0].device, "/dev/test");
+        assert!(!stats[0].stale);
+        assert!(stats[0].size_bytes > 0);
     }
 
     #[test]
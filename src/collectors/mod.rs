@@ -1,9 +1,98 @@
 //! Collectors module for system metrics.
 //!
 //! This module contains various collectors for system-level metrics such as
-//! disk I/O, filesystem usage, network interface statistics, and thermal sensors.
+//! disk I/O, filesystem usage, network interface statistics, thermal sensors and
+//! cgroup v2 usage.
 
+pub mod cgroup;
 pub mod diskstats;
 pub mod filesystem;
 pub mod netdev;
 pub mod thermal;
+
+use std::sync::Arc;
+
+/// Per-device readings of one collector run, in file order.
+///
+/// `version` changes whenever the set or order of devices does, so
+/// consumers can keep per-device state (like resolved metric handles)
+/// aligned with `devices` by index and rebuild it only on a new version.
+#[derive(Debug, Clone, Default)]
+pub struct DeviceTable<T> {
+    pub version: u64,
+    pub devices: Vec<(Arc<str>, T)>,
+}
+
+/// Device names of the previous run, reused while the device list is
+/// unchanged so a steady-state read allocates no labels.
+#[derive(Debug, Default)]
+pub struct DeviceNames {
+    names: Vec<Arc<str>>,
+    version: u64,
+    changed: bool,
+}
+
+impl DeviceNames {
+    /// Returns the interned name of the device at `index` in this run.
+    pub fn intern(&mut self, index: usize, name: &[u8]) -> Arc<str> {
+        match self.names.get(index) {
+            Some(known) if known.as_bytes() == name => Arc::clone(known),
+            _ => {
+                let interned: Arc<str> = Arc::from(String::from_utf8_lossy(name));
+                if index < self.names.len() {
+                    self.names[index] = Arc::clone(&interned);
+                } else {
+                    self.names.push(Arc::clone(&interned));
+                }
+                self.changed = true;
+                interned
+            }
+        }
+    }
+
+    /// Ends a run of `count` devices and returns the device list version.
+    pub fn finish(&mut self, count: usize) -> u64 {
+        if count != self.names.len() {
+            self.names.truncate(count);
+            self.changed = true;
+        }
+        if self.changed {
+            self.version += 1;
+            self.changed = false;
+        }
+        self.version
+    }
+
+    /// Number of devices of the last run.
+    pub fn len(&self) -> usize {
+        self.names.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.names.is_empty()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_device_names_version_follows_device_list() {
+        let mut names = DeviceNames::default();
+        let sda = names.intern(0, b"sda");
+        names.intern(1, b"sdb");
+        let first = names.finish(2);
+
+        assert!(Arc::ptr_eq(&names.intern(0, b"sda"), &sda));
+        names.intern(1, b"sdb");
+        assert_eq!(names.finish(2), first);
+
+        names.intern(0, b"sda");
+        assert_eq!(names.finish(1), first + 1);
+
+        names.intern(0, b"nvme0n1");
+        assert_eq!(names.finish(1), first + 2);
+        assert_eq!(names.len(), 1);
+    }
+}
@@ -1,10 +1,15 @@
 //! Network interface statistics collector.
 //!
 //! This module provides functionality to read network interface statistics from /proc/net/dev
-//! and expose them as Prometheus metrics.
+//! and expose them as Prometheus metrics. Like the diskstats collector, it
+//! keeps the file open and reuses interface names between runs.
 
-use std::collections::HashMap;
-use std::fs;
+use memchr::memchr;
+use std::path::PathBuf;
+
+use crate::procfs::{self, ProcFile};
+
+use super::{DeviceNames, DeviceTable};
 
 /// Network interface statistics.
 #[derive(Debug, Clone)]
@@ -21,50 +26,85 @@ pub struct NetDevStats {
     pub transmit_drop: u64,
 }
 
-/// Reads network interface statistics from /proc/net/dev.
-///
-/// Returns a HashMap mapping interface names to their statistics.
-pub fn read_netdev_stats() -> Result<HashMap<String, NetDevStats>, String> {
-    let content = fs::read_to_string("/proc/net/dev")
-        .map_err(|e| format!("Failed to read /proc/net/dev: {}", e))?;
+/// Reads network interface statistics from /proc/net/dev, keeping the file
+/// open and interface names interned across runs.
+#[derive(Debug)]
+pub struct NetdevReader {
+    file: ProcFile,
+    names: DeviceNames,
+}
 
-    let mut stats = HashMap::new();
+impl Default for NetdevReader {
+    fn default() -> Self {
+        Self::new("/proc/net/dev")
+    }
+}
 
-    for (idx, line) in content.lines().enumerate() {
-        // Skip the first two header lines
-        if idx < 2 {
-            continue;
+impl NetdevReader {
+    pub fn new(path: impl Into<PathBuf>) -> Self {
+        Self {
+            file: ProcFile::new(path),
+            names: DeviceNames::default(),
         }
+    }
 
-        // Split by ':' to separate interface name from stats
-        let parts: Vec<&str> = line.split(':').collect();
-        if parts.len() != 2 {
-            continue;
-        }
+    /// Reads the statistics of all interfaces.
+    pub fn read(&mut self) -> Result<DeviceTable<NetDevStats>, String> {
+        let content = match self.file.read() {
+            Ok(content) => content,
+            Err(e) => {
+                return Err(format!(
+                    "Failed to read {}: {}",
+                    self.file.path().display(),
+                    e
+                ))
+            }
+        };
+        Ok(parse_netdev(content, &mut self.names))
+    }
+}
 
-        let interface = parts[0].trim().to_string();
-        let stats_str = parts[1].trim();
+/// Parses /proc/net/dev into a table of interfaces.
+fn parse_netdev(content: &[u8], names: &mut DeviceNames) -> DeviceTable<NetDevStats> {
+    let mut devices = Vec::with_capacity(names.len());
 
-        let values: Vec<&str> = stats_str.split_whitespace().collect();
-        if values.len() < 16 {
+    // Skip the first two header lines
+    for line in procfs::lines(content).skip(2) {
+        // Split by ':' to separate interface name from stats
+        let colon = match memchr(b':', line) {
+            Some(colon) => colon,
+            None => continue,
+        };
+        let interface = line[..colon].trim_ascii();
+
+        let mut values = [0u64; 16];
+        let mut found = 0;
+        for (value, field) in values.iter_mut().zip(procfs::fields(&line[colon + 1..])) {
+            *value = procfs::parse_u64(field).unwrap_or(0);
+            found += 1;
+        }
+        if found < values.len() {
             continue; // Skip malformed lines
         }
 
         let net_stat = NetDevStats {
-            receive_bytes: values[0].parse().unwrap_or(0),
-            receive_packets: values[1].parse().unwrap_or(0),
-            receive_errs: values[2].parse().unwrap_or(0),
-            receive_drop: values[3].parse().unwrap_or(0),
-            transmit_bytes: values[8].parse().unwrap_or(0),
-            transmit_packets: values[9].parse().unwrap_or(0),
-            transmit_errs: values[10].parse().unwrap_or(0),
-            transmit_drop: values[11].parse().unwrap_or(0),
+            receive_bytes: values[0],
+            receive_packets: values[1],
+            receive_errs: values[2],
+            receive_drop: values[3],
+            transmit_bytes: values[8],
+            transmit_packets: values[9],
+            transmit_errs: values[10],
+            transmit_drop: values[11],
         };
 
-        stats.insert(interface, net_stat);
+        devices.push((names.intern(devices.len(), interface), net_stat));
     }
 
-    Ok(stats)
+    DeviceTable {
+        version: names.finish(devices.len()),
+        devices,
+    }
 }
 
 #[cfg(test)]
@@ -73,15 +113,37 @@ mod tests {
 
     #[test]
     fn test_read_netdev_stats() {
-        let result = read_netdev_stats();
+        let result = NetdevReader::default().read();
         assert!(result.is_ok(), "Failed to read netdev stats: {:?}", result);
 
         let stats = result.unwrap();
         // Should have at least one interface (lo)
-        assert!(!stats.is_empty(), "No network interface statistics found");
+        assert!(
+            !stats.devices.is_empty(),
+            "No network interface statistics found"
+        );
 
         // Check that loopback interface is present
-        let has_lo = stats.contains_key("lo");
+        let has_lo = stats.devices.iter().any(|(name, _)| &**name == "lo");
         assert!(has_lo, "Loopback interface not found");
     }
+
+    #[test]
+    fn test_parse_netdev() {
+        let content = b"Inter-|   Receive                                                |  Transmit
+ face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed
+    lo:  1000      10    0    0    0     0          0         0     1000      10    0    0    0     0       0          0
+  eth0: 123456    789    1    2    0     0          0         5    65432    321    3    4    0     0       0          0
+";
+        let mut names = DeviceNames::default();
+        let table = parse_netdev(content, &mut names);
+
+        assert_eq!(table.devices.len(), 2);
+        let (name, eth0) = &table.devices[1];
+        assert_eq!(&**name, "eth0");
+        assert_eq!((eth0.receive_bytes, eth0.transmit_bytes), (123456, 65432));
+        assert_eq!((eth0.receive_errs, eth0.receive_drop), (1, 2));
+        assert_eq!((eth0.transmit_errs, eth0.transmit_drop), (3, 4));
+        assert_eq!(parse_netdev(content, &mut names).version, table.version);
+    }
 }
@@ -59,13 +59,20 @@ fn add_config_comments(yaml: String) -> String {
 # exclude_names: null          # Exclude processes matching these names
 # parallelism: null            # Parallel threads (null = auto)
 # max_processes: null          # Maximum processes to scan
+# proc_root: "/proc"           # Directory scanned for processes
 #
 # Performance Tuning
 # ------------------
-# cache_ttl: 30                # Cache metrics for N seconds
+# cache_ttl: 30                # Seconds between background process scans
 # io_buffer_kb: 256            # Buffer size for generic /proc readers
 # smaps_buffer_kb: 512         # Buffer size for smaps parsing
 # smaps_rollup_buffer_kb: 256  # Buffer size for smaps_rollup parsing
+# incremental_scan: false      # Reuse open /proc files, skip unchanged processes
+# io_uring: false              # Batch /proc reads through io_uring (Linux 5.6+)
+# smaps_tiering: false         # Read PSS/USS only for some processes per scan:
+# smaps_top_n: 50              #   the largest by RSS,
+# smaps_rss_change_percent: 10 #   those whose RSS moved by this much,
+# smaps_refresh_cycles: 10     #   and every process once per N scans
 #
 # Feature Flags
 # -------------
@@ -89,6 +96,13 @@ fn add_config_comments(yaml: String) -> String {
 # top_n_subgroup: 3          # Top-N processes per subgroup (non-"other" groups)
 # top_n_others: 10           # Top-N processes for "other" group
 #
+# cgroup Aggregation
+# ------------------
+# enable_cgroups: false        # Per-cgroup (container) metrics from cgroup v2
+# cgroup_root: "/sys/fs/cgroup" # Mount point of the cgroup v2 hierarchy
+# cgroup_depth: null           # Cut paths to N components (3 = Kubernetes pod)
+# max_cgroups: 500             # Maximum cgroups exported, largest RSS first
+#
 # Metrics Enable Flags
 # --------------------
 # enable_rss: true             # Export RSS metrics
@@ -99,14 +113,51 @@ fn add_config_comments(yaml: String) -> String {
 # Collector Enable Flags
 # ----------------------
 # enable_filesystem_collector: true  # Enable filesystem metrics collection
+# filesystem_timeout_ms: 500         # statvfs timeout; hung mounts serve their last value
 # enable_thermal_collector: true     # Enable CPU/thermal sensors
 # enable_psi_collector: true         # Enable PSI (Pressure Stall Information)
 #
+# Collector Schedule
+# ------------------
+# Collectors run in the background; /metrics only serves their latest values.
+# Names: processes, cpu, memory, stat, psi, netdev, diskstats, filesystem,
+# thermal, cgroups, ebpf. The process scan defaults to every cache_ttl seconds,
+# filesystem to 30s, thermal to 15s and all others to 5s.
+# collectors:
+#   diskstats:
+#     interval_seconds: 5      # Seconds between two runs
+#     budget_ms: 100           # Runs slower than this count as overruns
+#     jitter_percent: 10       # Random interval spread (max 50)
+#
+# eBPF Configuration
+# ------------------
+# enable_ebpf: true            # Per-process I/O tracking via eBPF
+# enable_ebpf_network: true    # Per-process network I/O
+# enable_ebpf_disk: true       # Per-process disk I/O
+# enable_tcp_tracking: true    # TCP connection state tracking
+# ebpf_percpu_maps: false      # Per-CPU counter maps (no atomics, more memory)
+# ebpf_lru_maps: false         # LRU stats maps (evict stale entries when full)
+# ebpf_map_max_entries: 10240  # Capacity of the per-process stats maps
+# ebpf_net_latency: false      # Network syscall latency histograms
+#
 # TLS/SSL Configuration
 # ---------------------
 # enable_tls: false            # Enable HTTPS (default: false)
 # tls_cert_path: null          # Path to TLS certificate (PEM format)
 # tls_key_path: null           # Path to TLS private key (PEM format)
+#
+# Remote-Write Push
+# -----------------
+# Pushes changed series after process scans, e.g. from hosts that cannot
+# be scraped. Unchanged series are resent every resend_interval_seconds.
+# remote_write:
+#   url: null                  # Remote-write endpoint (null = push disabled)
+#   batch_cycles: 4            # Process scans per request
+#   resend_interval_seconds: 240  # Resend unchanged series after this long
+#   max_queued_batches: 16     # Batches kept for retry; oldest dropped first
+#   timeout_seconds: 10        # Request timeout
+#   external_labels: {}        # job/instance default to exporter and host name
+#   headers: {}                # Extra HTTP headers, e.g. Authorization
 "#;
 
     format!("{comments}\n{yaml}")
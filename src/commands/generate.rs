@@ -1,6 +1,7 @@
 //! Generate testdata command implementation.
 //!
-//! Generates synthetic test data JSON files for testing.
+//! Generates synthetic test data JSON files for testing, or synthetic /proc
+//! trees to scan through `proc_root`.
 
 use ahash::AHashMap as HashMap;
 use chrono::Utc;
@@ -12,7 +13,8 @@ use tracing::{debug, info};
 
 use crate::cache::ProcMem;
 use crate::config::Config;
-use crate::process::{classify_process_with_config, SUBGROUPS};
+use crate::fixtures::{write_proc_tree, ProcTreeSpec};
+use crate::process::{classify_process_with_config, SUBGROUPS, SUBGROUP_REGISTRY};
 
 // Constants for byte conversions
 const GB: u64 = 1024 * 1024 * 1024;
@@ -64,12 +66,18 @@ pub struct TestData {
 /// only tracks byte counts for memory efficiency.
 impl From<TestProcess> for ProcMem {
     fn from(tp: TestProcess) -> Self {
+        let class = SUBGROUP_REGISTRY.intern(&tp.group, &tp.subgroup);
         ProcMem {
             pid: tp.pid,
             name: tp.name,
+            group: class.group,
+            subgroup: class.subgroup,
+            subgroup_id: class.id,
+            cgroup: None,
             rss: tp.rss,
             pss: tp.pss,
             uss: tp.uss,
+            memory_sampled_at: 0.0,
             cpu_percent: tp.cpu_percent as f32,
             cpu_time_seconds: tp.cpu_time_seconds as f32,
             vmswap: 0,               // Test data doesn't have swap, default to 0
@@ -78,6 +86,8 @@ impl From<TestProcess> for ProcMem {
             write_bytes: tp.write_bytes,
             rx_bytes: tp.rx_bytes,
             tx_bytes: tp.tx_bytes,
+            blkio_read_bytes: 0,   // Test data has no eBPF block I/O
+            blkio_write_bytes: 0,  // Test data has no eBPF block I/O
             last_read_bytes: 0,    // No previous data for test
             last_write_bytes: 0,   // No previous data for test
             last_rx_bytes: 0,      // No previous data for test
@@ -210,6 +220,36 @@ pub fn command_generate_testdata(
     Ok(())
 }
 
+/// Writes a synthetic /proc tree of `processes` processes to `dir`.
+///
+/// Use it with `--proc-root` to run the full scan, classification and
+/// rendering path on a fixed, reproducible process set.
+pub fn command_generate_proc_tree(
+    dir: &Path,
+    processes: usize,
+    seed: Option<u64>,
+) -> Result<(), Box<dyn std::error::Error>> {
+    let mut spec = ProcTreeSpec::new(processes);
+    if let Some(seed) = seed {
+        spec.seed = seed;
+    }
+    debug!(
+        "Generating /proc tree: processes={}, seed={}, dir={}",
+        spec.processes,
+        spec.seed,
+        dir.display()
+    );
+
+    write_proc_tree(dir, &spec)?;
+
+    println!(
+        "✅ Generated /proc tree: {} processes in {}",
+        spec.processes,
+        dir.display()
+    );
+    Ok(())
+}
+
 /// Generates a random test process with realistic memory and CPU values.
 fn generate_random_process(
     rng: &mut impl Rng,
@@ -5,7 +5,7 @@
 //! - `config`: Configuration file generation
 //! - `test`: Metrics collection testing
 //! - `subgroups`: Subgroup listing
-//! - `generate`: Test data generation
+//! - `generate`: Test data and synthetic /proc tree generation
 //! - `install`: System-wide installation
 //! - `uninstall`: System-wide uninstallation
 
@@ -20,7 +20,7 @@ pub mod uninstall;
 // Re-export command functions
 pub use check::command_check;
 pub use config::command_config;
-pub use generate::command_generate_testdata;
+pub use generate::{command_generate_proc_tree, command_generate_testdata};
 pub use install::command_install;
 pub use subgroups::command_subgroups;
 pub use test::command_test;
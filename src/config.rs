@@ -4,7 +4,9 @@
 //! and CLI arguments. It supports YAML, JSON, and TOML formats.
 
 use crate::cli::{Args, ConfigFormat};
+use crate::scheduler::{Collector, MAX_JITTER_PERCENT};
 use serde::{Deserialize, Serialize};
+use std::collections::BTreeMap;
 use std::fs;
 use std::path::{Path, PathBuf};
 use tracing::info;
@@ -13,6 +15,24 @@ use tracing::info;
 pub const DEFAULT_BIND_ADDR: &str = "0.0.0.0";
 pub const DEFAULT_PORT: u16 = 9215;
 pub const DEFAULT_CACHE_TTL: u64 = 30;
+pub const DEFAULT_CGROUP_ROOT: &str = "/sys/fs/cgroup";
+pub const DEFAULT_PROC_ROOT: &str = "/proc";
+pub const DEFAULT_MAX_CGROUPS: usize = 500;
+pub const DEFAULT_SMAPS_TOP_N: usize = 50;
+pub const DEFAULT_SMAPS_RSS_CHANGE_PERCENT: f64 = 10.0;
+pub const DEFAULT_SMAPS_REFRESH_CYCLES: u32 = 10;
+pub const DEFAULT_FILESYSTEM_TIMEOUT_MS: u64 = 500;
+
+/// How ringbuffer history is stored in memory.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default, Serialize, Deserialize)]
+#[serde(rename_all = "lowercase")]
+pub enum RingbufferStorage {
+    /// Fixed 256-byte entries
+    #[default]
+    Entries,
+    /// Delta-compressed columns (see `ringbuffer_columnar`)
+    Columnar,
+}
 
 /// Ringbuffer configuration for historical metrics tracking.
 #[derive(Debug, Clone, Serialize, Deserialize)]
@@ -25,13 +45,25 @@ pub struct RingbufferConfig {
     #[serde(default = "default_interval_seconds")]
     pub interval_seconds: u64,
 
-    /// Minimum entries per subgroup (default: 10)
+    /// Minimum entries per subgroup (default: 10). Columnar storage is
+    /// bounded by `max_memory_mb` alone.
     #[serde(default = "default_min_entries")]
     pub min_entries_per_subgroup: usize,
 
     /// Maximum entries per subgroup (default: 120)
     #[serde(default = "default_max_entries")]
     pub max_entries_per_subgroup: usize,
+
+    /// Storage layout: "entries" or "columnar" (default: entries)
+    #[serde(default)]
+    pub storage: RingbufferStorage,
+
+    /// File backing the entry ringbuffers so history survives restarts
+    /// (default: none, history is kept in memory only). Opened after
+    /// privileges are dropped, so it must be writable by the exporter user.
+    /// Ignored with columnar storage.
+    #[serde(default)]
+    pub persist_path: Option<PathBuf>,
 }
 
 fn default_max_memory_mb() -> usize {
@@ -54,10 +86,86 @@ impl Default for RingbufferConfig {
             interval_seconds: default_interval_seconds(),
             min_entries_per_subgroup: default_min_entries(),
             max_entries_per_subgroup: default_max_entries(),
+            storage: RingbufferStorage::default(),
+            persist_path: None,
+        }
+    }
+}
+
+/// Remote-write push configuration. Pushing is disabled unless `url` is set.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct RemoteWriteConfig {
+    /// Prometheus remote-write endpoint (default: none, push disabled)
+    #[serde(default)]
+    pub url: Option<String>,
+
+    /// Process scans collected into one request (default: 4)
+    #[serde(default = "default_batch_cycles")]
+    pub batch_cycles: usize,
+
+    /// Seconds after which an unchanged series is sent again so the
+    /// receiver does not mark it stale (default: 240)
+    #[serde(default = "default_resend_interval_seconds")]
+    pub resend_interval_seconds: u64,
+
+    /// Batches kept for retry while the endpoint is unreachable; the oldest
+    /// batch is dropped when full (default: 16)
+    #[serde(default = "default_max_queued_batches")]
+    pub max_queued_batches: usize,
+
+    /// Request timeout in seconds (default: 10)
+    #[serde(default = "default_remote_write_timeout_seconds")]
+    pub timeout_seconds: u64,
+
+    /// Labels added to every series; `job` and `instance` default to
+    /// "herakles-node-exporter" and the host name
+    #[serde(default)]
+    pub external_labels: BTreeMap<String, String>,
+
+    /// Extra HTTP headers, e.g. `Authorization`
+    #[serde(default)]
+    pub headers: BTreeMap<String, String>,
+}
+
+fn default_batch_cycles() -> usize {
+    4
+}
+fn default_resend_interval_seconds() -> u64 {
+    240
+}
+fn default_max_queued_batches() -> usize {
+    16
+}
+fn default_remote_write_timeout_seconds() -> u64 {
+    10
+}
+
+impl Default for RemoteWriteConfig {
+    fn default() -> Self {
+        Self {
+            url: None,
+            batch_cycles: default_batch_cycles(),
+            resend_interval_seconds: default_resend_interval_seconds(),
+            max_queued_batches: default_max_queued_batches(),
+            timeout_seconds: default_remote_write_timeout_seconds(),
+            external_labels: BTreeMap::new(),
+            headers: BTreeMap::new(),
         }
     }
 }
 
+/// Schedule overrides of one background collector; unset fields use the
+/// collector's defaults (see `scheduler::Collector`).
+#[derive(Debug, Clone, Default, Serialize, Deserialize)]
+pub struct CollectorSchedule {
+    /// Seconds between two runs
+    pub interval_seconds: Option<u64>,
+    /// Run time in milliseconds above which a run counts as an overrun
+    pub budget_ms: Option<u64>,
+    /// Random spread of the interval in percent, in either direction
+    pub jitter_percent: Option<u8>,
+}
+
 /// Enhanced configuration structure
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Config {
@@ -77,6 +185,24 @@ pub struct Config {
     pub io_buffer_kb: Option<usize>,
     pub smaps_buffer_kb: Option<usize>,
     pub smaps_rollup_buffer_kb: Option<usize>,
+    /// Keep per-process state and open /proc files across scans
+    #[serde(alias = "incremental-scan")]
+    pub incremental_scan: Option<bool>,
+    /// Read /proc files in batches through io_uring (single-pass scans only)
+    #[serde(alias = "io-uring")]
+    pub io_uring: Option<bool>,
+    /// Read smaps_rollup (PSS/USS) only for some processes per scan
+    #[serde(alias = "smaps-tiering")]
+    pub smaps_tiering: Option<bool>,
+    /// Tiered smaps: processes with the largest RSS, read every scan
+    #[serde(alias = "smaps-top-n")]
+    pub smaps_top_n: Option<usize>,
+    /// Tiered smaps: RSS change since the last read that triggers a new one
+    #[serde(alias = "smaps-rss-change-percent")]
+    pub smaps_rss_change_percent: Option<f64>,
+    /// Tiered smaps: every process is read at least once per this many scans
+    #[serde(alias = "smaps-refresh-cycles")]
+    pub smaps_refresh_cycles: Option<u32>,
 
     // Feature flags
     pub enable_health: Option<bool>,
@@ -112,6 +238,20 @@ pub struct Config {
     #[serde(alias = "details-top-n")]
     pub details_top_n: Option<usize>,
 
+    // cgroup aggregation
+    /// Group processes by cgroup v2 and export per-cgroup metrics
+    #[serde(alias = "enable-cgroups")]
+    pub enable_cgroups: Option<bool>,
+    /// Mount point of the cgroup v2 hierarchy
+    #[serde(alias = "cgroup-root")]
+    pub cgroup_root: Option<PathBuf>,
+    /// Cut cgroup paths to this many components (e.g. 3 for Kubernetes pods)
+    #[serde(alias = "cgroup-depth")]
+    pub cgroup_depth: Option<usize>,
+    /// Maximum number of cgroups exported, largest by RSS first
+    #[serde(alias = "max-cgroups")]
+    pub max_cgroups: Option<usize>,
+
     // Metrics enable flags
     #[serde(alias = "enable-rss")]
     pub enable_rss: Option<bool>,
@@ -125,6 +265,10 @@ pub struct Config {
     /// Path to JSON test data file (uses synthetic data instead of /proc)
     #[serde(alias = "test-data-file")]
     pub test_data_file: Option<PathBuf>,
+    /// Directory scanned for processes instead of /proc, e.g. a tree from
+    /// `generate-testdata --proc-tree`
+    #[serde(alias = "proc-root")]
+    pub proc_root: Option<PathBuf>,
 
     // TLS/SSL Configuration
     #[serde(alias = "enable-tls")]
@@ -143,18 +287,41 @@ pub struct Config {
     pub enable_ebpf_disk: Option<bool>,
     #[serde(alias = "enable-tcp-tracking")]
     pub enable_tcp_tracking: Option<bool>,
+    /// Use per-CPU eBPF maps for I/O counters (more memory, no cross-CPU atomics)
+    #[serde(alias = "ebpf-percpu-maps")]
+    pub ebpf_percpu_maps: Option<bool>,
+    /// Use LRU eBPF maps so new processes evict stale entries when full
+    #[serde(alias = "ebpf-lru-maps")]
+    pub ebpf_lru_maps: Option<bool>,
+    /// Capacity of the per-process eBPF stats maps
+    #[serde(alias = "ebpf-map-max-entries")]
+    pub ebpf_map_max_entries: Option<u32>,
+    /// Record network syscall latency histograms (traces syscall entry too)
+    #[serde(alias = "ebpf-net-latency")]
+    pub ebpf_net_latency: Option<bool>,
 
     // Collector enable flags
     #[serde(alias = "enable-filesystem-collector")]
     pub enable_filesystem_collector: Option<bool>,
+    /// Time to wait for statvfs of each filesystem before serving its last value
+    #[serde(alias = "filesystem-timeout-ms")]
+    pub filesystem_timeout_ms: Option<u64>,
     #[serde(alias = "enable-thermal-collector")]
     pub enable_thermal_collector: Option<bool>,
     #[serde(alias = "enable-psi-collector")]
     pub enable_psi_collector: Option<bool>,
 
+    // Collector scheduling, keyed by collector name
+    #[serde(default)]
+    pub collectors: BTreeMap<String, CollectorSchedule>,
+
     // Ringbuffer Configuration
     #[serde(default)]
     pub ringbuffer: RingbufferConfig,
+
+    // Remote-write push
+    #[serde(default, alias = "remote-write")]
+    pub remote_write: RemoteWriteConfig,
 }
 
 impl Default for Config {
@@ -171,6 +338,12 @@ impl Default for Config {
             io_buffer_kb: Some(256),
             smaps_buffer_kb: Some(512),
             smaps_rollup_buffer_kb: Some(256),
+            incremental_scan: Some(false),
+            io_uring: Some(false),
+            smaps_tiering: Some(false),
+            smaps_top_n: Some(DEFAULT_SMAPS_TOP_N),
+            smaps_rss_change_percent: Some(DEFAULT_SMAPS_RSS_CHANGE_PERCENT),
+            smaps_refresh_cycles: Some(DEFAULT_SMAPS_REFRESH_CYCLES),
             enable_health: Some(true),
             enable_telemetry: Some(true),
             enable_default_collectors: Some(true),
@@ -185,11 +358,16 @@ impl Default for Config {
             top_n_subgroup: Some(3),
             top_n_others: Some(10),
             details_top_n: Some(5),
+            enable_cgroups: Some(false),
+            cgroup_root: Some(PathBuf::from(DEFAULT_CGROUP_ROOT)),
+            cgroup_depth: None,
+            max_cgroups: Some(DEFAULT_MAX_CGROUPS),
             enable_rss: Some(true),
             enable_pss: Some(true),
             enable_uss: Some(true),
             enable_cpu: Some(true),
             test_data_file: None,
+            proc_root: Some(PathBuf::from(DEFAULT_PROC_ROOT)),
             enable_tls: Some(false),
             tls_cert_path: None,
             tls_key_path: None,
@@ -197,10 +375,17 @@ impl Default for Config {
             enable_ebpf_network: Some(true),
             enable_ebpf_disk: Some(true),
             enable_tcp_tracking: Some(true),
+            ebpf_percpu_maps: Some(false),
+            ebpf_lru_maps: Some(false),
+            ebpf_map_max_entries: Some(10240),
+            ebpf_net_latency: Some(false),
             enable_filesystem_collector: Some(true),
+            filesystem_timeout_ms: Some(DEFAULT_FILESYSTEM_TIMEOUT_MS),
             enable_thermal_collector: Some(true),
             enable_psi_collector: Some(true),
+            collectors: BTreeMap::new(),
             ringbuffer: RingbufferConfig::default(),
+            remote_write: RemoteWriteConfig::default(),
         }
     }
 }
@@ -242,6 +427,88 @@ pub fn validate_effective_config(cfg: &Config) -> Result<(), Box<dyn std::error:
         }
     }
 
+    // eBPF map capacity validation
+    if cfg.ebpf_map_max_entries == Some(0) {
+        return Err("ebpf_map_max_entries must be greater than 0".into());
+    }
+
+    // Tiered smaps validation
+    if cfg.smaps_refresh_cycles == Some(0) {
+        return Err("smaps_refresh_cycles must be greater than 0".into());
+    }
+    if cfg
+        .smaps_rss_change_percent
+        .is_some_and(|percent| percent.is_nan() || percent < 0.0)
+    {
+        return Err("smaps_rss_change_percent must be 0 or greater".into());
+    }
+
+    // Filesystem collector validation
+    if cfg.filesystem_timeout_ms == Some(0) {
+        return Err("filesystem_timeout_ms must be greater than 0".into());
+    }
+
+    // cgroup limits validation
+    if cfg.max_cgroups == Some(0) {
+        return Err("max_cgroups must be greater than 0".into());
+    }
+    if cfg.cgroup_depth == Some(0) {
+        return Err("cgroup_depth must be greater than 0".into());
+    }
+
+    // Collector schedule validation
+    for (name, schedule) in &cfg.collectors {
+        if Collector::from_name(name).is_none() {
+            return Err(format!(
+                "Unknown collector '{}' in collectors, expected one of: {}",
+                name,
+                Collector::ALL.map(Collector::name).join(", ")
+            )
+            .into());
+        }
+        if schedule.interval_seconds == Some(0) {
+            return Err(format!(
+                "collectors.{}.interval_seconds must be greater than 0",
+                name
+            )
+            .into());
+        }
+        if schedule.budget_ms == Some(0) {
+            return Err(format!("collectors.{}.budget_ms must be greater than 0", name).into());
+        }
+        if schedule
+            .jitter_percent
+            .is_some_and(|jitter| jitter > MAX_JITTER_PERCENT)
+        {
+            return Err(format!(
+                "collectors.{}.jitter_percent must be at most {}",
+                name, MAX_JITTER_PERCENT
+            )
+            .into());
+        }
+    }
+
+    // Remote-write validation
+    let remote_write = &cfg.remote_write;
+    if let Some(url) = remote_write.url.as_deref() {
+        if !(url.starts_with("http://") || url.starts_with("https://")) {
+            return Err(format!(
+                "remote_write.url '{}' must start with http:// or https://",
+                url
+            )
+            .into());
+        }
+    }
+    if remote_write.batch_cycles == 0 {
+        return Err("remote_write.batch_cycles must be greater than 0".into());
+    }
+    if remote_write.max_queued_batches == 0 {
+        return Err("remote_write.max_queued_batches must be greater than 0".into());
+    }
+    if remote_write.timeout_seconds == 0 {
+        return Err("remote_write.timeout_seconds must be greater than 0".into());
+    }
+
     // TLS validation
     if cfg.enable_tls.unwrap_or(false) {
         let cert_path = cfg.tls_cert_path.as_deref();
@@ -388,6 +655,12 @@ pub fn resolve_config(args: &Args) -> Result<Config, Box<dyn std::error::Error>>
     if let Some(test_file) = &args.test_data_file {
         config.test_data_file = Some(test_file.clone());
     }
+    if let Some(proc_root) = &args.proc_root {
+        config.proc_root = Some(proc_root.clone());
+    }
+    if let Some(url) = &args.remote_write_url {
+        config.remote_write.url = Some(url.clone());
+    }
 
     // TLS configuration: CLI wins if provided
     if args.enable_tls {
@@ -5,8 +5,52 @@
 #include <bpf/bpf_core_read.h>
 
 // Maximum number of processes to track
+// Userspace can resize the stats maps before load (ebpf_map_max_entries).
 #define MAX_ENTRIES 10240
 
+// Devices remembered per PID for exit-time blkio eviction
+#define MAX_DEVS_PER_PID 4
+
+// Length of task->comm, including the trailing NUL
+#define TASK_COMM_LEN 16
+
+// Log2 histogram slots: slot i counts values in [2^i, 2^(i+1)), slot 0 also
+// counts 0 and the last slot everything larger
+#define HIST_SLOTS 32
+
+// Subgroup classes histograms are kept for (IDs pushed by userspace)
+#define MAX_HIST_CLASSES 256
+
+// Size of the lifecycle_events ring buffer; holds ~16k events between polls
+#define LIFECYCLE_RINGBUF_BYTES (1 << 20)
+
+// Per-CPU map mode, patched by userspace before load (see EbpfOptions in
+// src/ebpf/mod.rs). When set, net_stats_map, blkio_stats_map and
+// event_counters are switched to BPF_MAP_TYPE_(LRU_)PERCPU_HASH/PERCPU_ARRAY and
+// every CPU owns its own copy of each value, so the hot path can use plain
+// adds instead of contended atomics. Userspace sums the per-CPU values.
+//
+// Userspace sets the .rodata variables by name, looking them up in the
+// object's BTF, so they may be declared in any order.
+const volatile bool percpu_maps = false;
+
+// Per-cgroup accounting into cgroup_io_map, patched by userspace before load
+// (EbpfOptions::cgroup_io). Off by default, cgroup_io_map is then created
+// with a single entry.
+const volatile bool cgroup_io = false;
+
+// Depth of the cgroups I/O is accounted to, patched by userspace before load
+// (EbpfOptions::cgroup_level, from cgroup_depth). 0 accounts to the task's
+// own cgroup. Tasks in a shallower cgroup are accounted to their own cgroup,
+// as userspace then keeps their whole path.
+const volatile u32 cgroup_level = 0;
+
+// Network syscall latency histograms, patched by userspace before load
+// (EbpfOptions::net_latency). Off by default: the sys_enter_* programs are
+// then not loaded, syscall_start_map is not created and the exit hooks skip
+// the latency code, which the verifier prunes.
+const volatile bool net_latency = false;
+
 // Process network I/O statistics
 struct net_stats {
     u64 rx_bytes;
@@ -14,6 +58,13 @@ struct net_stats {
     u64 rx_packets;
     u64 tx_packets;
     u64 dropped;
+    char comm[TASK_COMM_LEN]; // Captured when the entry is created
+};
+
+// Block I/O stats key: issuing process and target device
+struct blkio_key {
+    u32 pid;
+    u32 dev; // Kernel dev_t: major << 20 | minor
 };
 
 // Process block I/O statistics
@@ -22,14 +73,51 @@ struct blkio_stats {
     u64 write_bytes;
     u64 read_ops;
     u64 write_ops;
+    char comm[TASK_COMM_LEN]; // Captured when the entry is created
 };
 
-// Syscall pending info for tracking in-flight I/O syscalls
-struct io_syscall_info {
-    u64 ts;      // Timestamp
-    u32 fd;      // File descriptor
-    u64 count;   // Requested byte count
-    u8 is_write; // 0 = read, 1 = write
+// Devices a PID has blkio_stats_map entries for (0 = unused slot)
+struct pid_devs {
+    u32 dev[MAX_DEVS_PER_PID];
+};
+
+// Process lifecycle event types
+#define LIFECYCLE_EXEC 0
+#define LIFECYCLE_FORK 1
+#define LIFECYCLE_EXIT 2
+
+// Process lifecycle event, published through lifecycle_events.
+// Layout is mirrored by parse_lifecycle_event() in src/ebpf/mod.rs.
+struct lifecycle_event {
+    u32 type; // LIFECYCLE_*
+    u32 tgid;
+    u32 ppid;
+    u32 pad;
+    u64 start_ns;    // task->start_boottime, as /proc/<pid>/stat starttime
+    u64 cpu_ns;      // Exit only: user + system time of the thread group
+    u64 read_bytes;  // Exit only: storage bytes read by the thread group
+    u64 write_bytes; // Exit only: storage bytes written by the thread group
+    char comm[TASK_COMM_LEN];
+};
+
+// I/O of one cgroup, keyed by cgroup ID (the cgroup directory inode)
+struct cgroup_io {
+    u64 rx_bytes;
+    u64 tx_bytes;
+    u64 read_bytes;
+    u64 write_bytes;
+};
+
+// cgroup_io fields, in layout order
+#define CGROUP_IO_RX 0
+#define CGROUP_IO_TX 1
+#define CGROUP_IO_READ 2
+#define CGROUP_IO_WRITE 3
+
+// Log2 histogram of one quantity for one subgroup class
+struct hist {
+    u64 slots[HIST_SLOTS];
+    u64 sum; // Sum of all recorded values
 };
 
 // BPF maps
@@ -43,17 +131,31 @@ struct {
 struct {
     __uint(type, BPF_MAP_TYPE_HASH);
     __uint(max_entries, MAX_ENTRIES);
-    __type(key, u32); // PID
+    __type(key, struct blkio_key);
     __type(value, struct blkio_stats);
 } blkio_stats_map SEC(".maps");
 
-// Pending syscalls map to correlate entry/exit
+// PID -> devices index into blkio_stats_map, used on process exit
 struct {
     __uint(type, BPF_MAP_TYPE_HASH);
     __uint(max_entries, MAX_ENTRIES);
-    __type(key, u64); // pid_tgid
-    __type(value, struct io_syscall_info);
-} syscall_pending SEC(".maps");
+    __type(key, u32); // PID
+    __type(value, struct pid_devs);
+} pid_devs_map SEC(".maps");
+
+// Stats entries of exited processes, keyed like blkio_stats_map; dev 0
+// stands for the PID's net_stats_map entry (0 is never a tracked device).
+// The exit hook claims an entry by inserting its key, which is atomic across
+// CPUs, and userspace flushes the stats entry and then deletes the key. A
+// shared map rather than a flag in the stats values, since per-CPU values
+// only hold one CPU's copy. Sized by userspace to hold a key for every
+// entry of both stats maps, switched to LRU_HASH with them.
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 2 * MAX_ENTRIES);
+    __type(key, struct blkio_key);
+    __type(value, u8);
+} exited_map SEC(".maps");
 
 // TCP connection state tracking
 struct {
@@ -77,21 +179,210 @@ struct {
 #define EVENT_BLKIO_READ 2
 #define EVENT_BLKIO_WRITE 3
 
+// Start of the traced network syscall each thread is in, only with
+// net_latency. Task storage lives and dies with the thread, so there is no
+// capacity limit, no hash lookup keyed by pid_tgid and nothing to clean up.
+struct {
+    __uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, int);
+    __type(value, u64); // bpf_ktime_get_ns() at sys_enter, 0 when consumed
+} syscall_start_map SEC(".maps");
+
+// TGID -> subgroup class, pushed by userspace after every process scan.
+// Unclassified TGIDs are counted in class 0 (other/unknown).
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_ENTRIES);
+    __type(key, u32);   // TGID
+    __type(value, u32); // Subgroup ID, < MAX_HIST_CLASSES
+} pid_class_map SEC(".maps");
+
+// Histogram kinds kept per class
+#define HIST_NET_LATENCY 0 // Network syscall latency in nanoseconds
+#define HIST_NET_SIZE 1    // Bytes per network syscall
+#define HIST_BLKIO_SIZE 2  // Bytes per block request
+#define HIST_KINDS 3
+
+// Log2 histograms, indexed by class * HIST_KINDS + kind. Fixed size, so
+// userspace reads the same amount of data regardless of the event rate.
+// Always per-CPU: every traced syscall bumps two values of its class, and
+// userspace sums the copies on read anyway.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, MAX_HIST_CLASSES * HIST_KINDS);
+    __type(key, u32);
+    __type(value, struct hist);
+} io_hists SEC(".maps");
+
+// cgroup ID -> I/O of the tasks in that cgroup. LRU, so removed cgroups age
+// out without userspace deleting them. Switched to LRU_PERCPU_HASH in
+// per-CPU mode.
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, MAX_ENTRIES);
+    __type(key, u64); // cgroup ID
+    __type(value, struct cgroup_io);
+} cgroup_io_map SEC(".maps");
+
+// Stats map bookkeeping, so userspace doesn't have to walk keys.
+// Only touched when entries are created or can't be created, so this stays
+// a shared array even in per-CPU mode.
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 5);
+    __type(key, u32);
+    __type(value, u64);
+} map_state SEC(".maps");
+
+// Map state indices
+#define MAP_NET_ENTRIES 0   // Live entries in net_stats_map
+#define MAP_BLKIO_ENTRIES 1 // Live entries in blkio_stats_map
+#define MAP_NET_FULL 2      // Events dropped because net_stats_map was full
+#define MAP_BLKIO_FULL 3    // Events dropped because blkio_stats_map was full
+#define MAP_LIFECYCLE_LOST 4 // Lifecycle events dropped, lifecycle_events was full
+
+// Process exec/fork/exit events for userspace process discovery
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, LIFECYCLE_RINGBUF_BYTES);
+} lifecycle_events SEC(".maps");
+
 // Helper to get current PID
 static __always_inline u32 get_current_pid() {
     return bpf_get_current_pid_tgid() >> 32;
 }
 
+// Helper to add to a map value counter.
+// Per-CPU values are only ever touched by the CPU running the program, so a
+// plain add is safe there. Shared values need an atomic add.
+static __always_inline void counter_add(u64 *counter, u64 value) {
+    if (percpu_maps) {
+        *counter += value;
+    } else {
+        __sync_fetch_and_add(counter, value);
+    }
+}
+
+// Helper to bump one of the event_counters slots
+static __always_inline void count_event(u32 idx) {
+    u64 *counter = bpf_map_lookup_elem(&event_counters, &idx);
+    if (counter) {
+        counter_add(counter, 1);
+    }
+}
+
+// Helper to mark a stats entry exited. Returns true for the one caller that
+// claimed it, which then owns dropping it from the map_state entry count.
+static __always_inline bool claim_exited(struct blkio_key *key) {
+    u8 one = 1;
+    return bpf_map_update_elem(&exited_map, key, &one, BPF_NOEXIST) == 0;
+}
+
+// Helper to adjust one of the map_state slots
+static __always_inline void map_state_add(u32 idx, s64 delta) {
+    u64 *value = bpf_map_lookup_elem(&map_state, &idx);
+    if (value) {
+        __sync_fetch_and_add(value, delta);
+    }
+}
+
+// Helper to account bytes to the current task's cgroup, or to its ancestor
+// at cgroup_level
+static __always_inline void cgroup_io_add(u32 field, u64 bytes) {
+    if (!cgroup_io || field > CGROUP_IO_WRITE) {
+        return;
+    }
+
+    u64 id = 0;
+    if (cgroup_level) {
+        // 0 if the task's cgroup is above that level
+        id = bpf_get_current_ancestor_cgroup_id(cgroup_level);
+    }
+    if (!id) {
+        id = bpf_get_current_cgroup_id();
+    }
+    struct cgroup_io *io = bpf_map_lookup_elem(&cgroup_io_map, &id);
+    if (!io) {
+        struct cgroup_io new_io = {0};
+        ((u64 *)&new_io)[field] = bytes;
+        if (bpf_map_update_elem(&cgroup_io_map, &id, &new_io, BPF_NOEXIST) == 0) {
+            return;
+        }
+        // Another CPU created the entry first
+        io = bpf_map_lookup_elem(&cgroup_io_map, &id);
+        if (!io) {
+            return;
+        }
+    }
+    counter_add(&((u64 *)io)[field], bytes);
+}
+
+// Helper to compute floor(log2(v)) of a 32-bit value, branch-free
+static __always_inline u32 log2_u32(u32 v) {
+    u32 r, shift;
+
+    r = (v > 0xFFFF) << 4;
+    v >>= r;
+    shift = (v > 0xFF) << 3;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0xF) << 2;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0x3) << 1;
+    v >>= shift;
+    r |= shift;
+    r |= (v >> 1);
+    return r;
+}
+
+// Helper to map a value to its log2 histogram slot
+static __always_inline u32 hist_slot(u64 v) {
+    u32 hi = v >> 32;
+    u32 slot = hi ? log2_u32(hi) + 32 : log2_u32((u32)v);
+    return slot < HIST_SLOTS ? slot : HIST_SLOTS - 1;
+}
+
+// Helper to look up the histogram class userspace pushed for a TGID
+static __always_inline u32 pid_class(u32 tgid) {
+    u32 *class = bpf_map_lookup_elem(&pid_class_map, &tgid);
+    if (class && *class < MAX_HIST_CLASSES) {
+        return *class;
+    }
+    return 0;
+}
+
+// Helper to record a value in one of a class's histograms.
+// io_hists is per-CPU, so plain adds are safe.
+static __always_inline void hist_add(u32 class, u32 kind, u64 value) {
+    u32 idx = class * HIST_KINDS + kind;
+    struct hist *hist = bpf_map_lookup_elem(&io_hists, &idx);
+    if (!hist) {
+        return;
+    }
+
+    u32 slot = hist_slot(value);
+    // Re-check the bound for the verifier
+    if (slot >= HIST_SLOTS) {
+        return;
+    }
+    hist->slots[slot] += 1;
+    hist->sum += value;
+}
+
 // Helper to update network stats for a PID
 // Updates the net_stats_map with receive or transmit I/O statistics for a given process.
-// If the PID doesn't exist in the map, creates a new entry. Otherwise, atomically
-// increments the existing counters.
+// If the PID doesn't exist in the map, creates a new entry tagged with the current
+// comm. Otherwise, increments the existing counters (atomically unless the map
+// is per-CPU).
 //
 // Parameters:
 //   pid: Process ID
 //   bytes: Number of bytes received or transmitted
 //   is_tx: true for transmit operations, false for receive operations
 static __always_inline void update_net_stats(u32 pid, u64 bytes, bool is_tx) {
+    u32 event = is_tx ? EVENT_NET_TX : EVENT_NET_RX;
     struct net_stats *stats = bpf_map_lookup_elem(&net_stats_map, &pid);
     if (!stats) {
         struct net_stats new_stats = {0};
@@ -102,249 +393,214 @@ static __always_inline void update_net_stats(u32 pid, u64 bytes, bool is_tx) {
             new_stats.rx_bytes = bytes;
             new_stats.rx_packets = 1;
         }
-        bpf_map_update_elem(&net_stats_map, &pid, &new_stats, BPF_ANY);
-        
-        // Update event counter for new entry
-        u32 idx = is_tx ? EVENT_NET_TX : EVENT_NET_RX;
-        u64 *counter = bpf_map_lookup_elem(&event_counters, &idx);
-        if (counter) {
-            __sync_fetch_and_add(counter, 1);
+        bpf_get_current_comm(&new_stats.comm, sizeof(new_stats.comm));
+
+        if (bpf_map_update_elem(&net_stats_map, &pid, &new_stats, BPF_NOEXIST) == 0) {
+            map_state_add(MAP_NET_ENTRIES, 1);
+            count_event(event);
+            return;
         }
-    } else {
-        if (is_tx) {
-            __sync_fetch_and_add(&stats->tx_bytes, bytes);
-            __sync_fetch_and_add(&stats->tx_packets, 1);
-            
-            u32 idx = EVENT_NET_TX;
-            u64 *counter = bpf_map_lookup_elem(&event_counters, &idx);
-            if (counter) {
-                __sync_fetch_and_add(counter, 1);
-            }
-        } else {
-            __sync_fetch_and_add(&stats->rx_bytes, bytes);
-            __sync_fetch_and_add(&stats->rx_packets, 1);
-            
-            u32 idx = EVENT_NET_RX;
-            u64 *counter = bpf_map_lookup_elem(&event_counters, &idx);
-            if (counter) {
-                __sync_fetch_and_add(counter, 1);
-            }
+
+        // Either another CPU created the entry first, or the map is full
+        stats = bpf_map_lookup_elem(&net_stats_map, &pid);
+        if (!stats) {
+            map_state_add(MAP_NET_FULL, 1);
+            return;
         }
     }
+
+    if (is_tx) {
+        counter_add(&stats->tx_bytes, bytes);
+        counter_add(&stats->tx_packets, 1);
+    } else {
+        counter_add(&stats->rx_bytes, bytes);
+        counter_add(&stats->rx_packets, 1);
+    }
+
+    count_event(event);
 }
 
 // ========== SYSCALL TRACEPOINT HOOKS FOR NETWORK I/O ==========
 // These syscall tracepoints track actual network I/O at the syscall level,
 // providing accurate per-process accounting in the correct process context.
+//
+// sys_exit_* identifies the direction and ctx->ret carries the transferred
+// byte count. sys_enter_* only records the start time, so the exit hook can
+// also record the syscall latency; they are only loaded with net_latency.
+
+// Helper for every traced sys_enter_*: remember when the syscall started
+static __always_inline void net_syscall_enter(void) {
+    if (!net_latency) {
+        return;
+    }
+
+    u64 *start_ts = bpf_task_storage_get(&syscall_start_map, bpf_get_current_task_btf(), 0,
+                                         BPF_LOCAL_STORAGE_GET_F_CREATE);
+    if (start_ts) {
+        *start_ts = bpf_ktime_get_ns();
+    }
+}
+
+// Helper for every traced sys_exit_*: account the transfer and record its
+// latency and size in the process's class histograms
+static __always_inline void net_syscall_exit(long ret, bool is_tx) {
+    u64 pid_tgid = bpf_get_current_pid_tgid();
+    u64 start = 0;
+    if (net_latency) {
+        // No storage without a create, so a missing slot costs no allocation
+        u64 *start_ts =
+            bpf_task_storage_get(&syscall_start_map, bpf_get_current_task_btf(), 0, 0);
+        if (start_ts) {
+            start = *start_ts;
+            *start_ts = 0;
+        }
+    }
+
+    // Ignore errors and zero-byte operations
+    if (ret <= 0) {
+        return;
+    }
+
+    u32 tgid = pid_tgid >> 32;
+    update_net_stats(tgid, (u64)ret, is_tx);
+    cgroup_io_add(is_tx ? CGROUP_IO_TX : CGROUP_IO_RX, (u64)ret);
+
+    u32 class = pid_class(tgid);
+    // No start time without net_latency or if the hooks were attached mid-syscall
+    if (start) {
+        hist_add(class, HIST_NET_LATENCY, bpf_ktime_get_ns() - start);
+    }
+    hist_add(class, HIST_NET_SIZE, (u64)ret);
+}
 
 // recvfrom syscall entry
 SEC("tracepoint/syscalls/sys_enter_recvfrom")
 int trace_recvfrom_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // sockfd
-    info.count = ctx->args[2];   // len
-    info.is_write = 0;           // receive operation
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+    net_syscall_enter();
     return 0;
 }
 
 // recvfrom syscall exit
 SEC("tracepoint/syscalls/sys_exit_recvfrom")
 int trace_recvfrom_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    // Ignore errors and zero-byte operations
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
-    }
-    
-    update_net_stats(pid, (u64)ret, false);
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    net_syscall_exit(ctx->ret, false);
     return 0;
 }
 
 // sendto syscall entry
 SEC("tracepoint/syscalls/sys_enter_sendto")
 int trace_sendto_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // sockfd
-    info.count = ctx->args[2];   // len
-    info.is_write = 1;           // send operation
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+    net_syscall_enter();
     return 0;
 }
 
 // sendto syscall exit
 SEC("tracepoint/syscalls/sys_exit_sendto")
 int trace_sendto_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    // Ignore errors and zero-byte operations
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
-    }
-    
-    update_net_stats(pid, (u64)ret, true);
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    net_syscall_exit(ctx->ret, true);
     return 0;
 }
 
 // recvmsg syscall entry
 SEC("tracepoint/syscalls/sys_enter_recvmsg")
 int trace_recvmsg_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // sockfd
-    info.is_write = 0;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+    net_syscall_enter();
     return 0;
 }
 
 // recvmsg syscall exit
 SEC("tracepoint/syscalls/sys_exit_recvmsg")
 int trace_recvmsg_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
-    }
-    
-    update_net_stats(pid, (u64)ret, false);
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    net_syscall_exit(ctx->ret, false);
     return 0;
 }
 
 // sendmsg syscall entry
 SEC("tracepoint/syscalls/sys_enter_sendmsg")
 int trace_sendmsg_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // sockfd
-    info.is_write = 1;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+    net_syscall_enter();
     return 0;
 }
 
 // sendmsg syscall exit
 SEC("tracepoint/syscalls/sys_exit_sendmsg")
 int trace_sendmsg_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
-    }
-    
-    update_net_stats(pid, (u64)ret, true);
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    net_syscall_exit(ctx->ret, true);
     return 0;
 }
 
 // recv syscall entry
 SEC("tracepoint/syscalls/sys_enter_recv")
 int trace_recv_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // sockfd
-    info.count = ctx->args[2];   // len
-    info.is_write = 0;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+    net_syscall_enter();
     return 0;
 }
 
 // recv syscall exit
 SEC("tracepoint/syscalls/sys_exit_recv")
 int trace_recv_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
-    }
-    
-    update_net_stats(pid, (u64)ret, false);
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    net_syscall_exit(ctx->ret, false);
     return 0;
 }
 
 // send syscall entry
 SEC("tracepoint/syscalls/sys_enter_send")
 int trace_send_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // sockfd
-    info.count = ctx->args[2];   // len
-    info.is_write = 1;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+    net_syscall_enter();
     return 0;
 }
 
 // send syscall exit
 SEC("tracepoint/syscalls/sys_exit_send")
 int trace_send_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
-    }
-    
-    update_net_stats(pid, (u64)ret, true);
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    net_syscall_exit(ctx->ret, true);
     return 0;
 }
 
-// ========== SYSCALL TRACEPOINT HOOKS FOR BLOCK I/O ==========
-// Note: struct trace_event_raw_sys_enter and trace_event_raw_sys_exit are defined
-// in vmlinux.h and represent the kernel tracepoint contexts for syscall entry/exit.
-// They provide access to syscall arguments via ctx->args[] and return value via ctx->ret.
+// ========== BLOCK LAYER TRACEPOINT HOOKS FOR BLOCK I/O ==========
+// Block I/O is accounted at block_rq_issue rather than at read/write syscall
+// exit, so only requests that actually reach a block device are counted
+// (no sockets, pipes, ttys or page-cache hits) and each one carries its
+// target device. The request is attributed to the task issuing it, which
+// for buffered writes is usually not the writer: dirty pages are written back
+// later by kernel flusher threads (kworker), which are charged for them.
+// Direct I/O, reads that miss the page cache and fsync-driven writeback are
+// usually issued in the caller's context and stay with the process.
+
+// Helper to remember which devices a PID has blkio entries for, so the exit
+// hook can find them without walking blkio_stats_map. Best effort: devices
+// beyond MAX_DEVS_PER_PID are not tracked and stay until the map is LRU'd.
+static __always_inline void track_pid_dev(u32 pid, u32 dev) {
+    struct pid_devs *devs = bpf_map_lookup_elem(&pid_devs_map, &pid);
+    if (!devs) {
+        struct pid_devs new_devs = {0};
+        new_devs.dev[0] = dev;
+        bpf_map_update_elem(&pid_devs_map, &pid, &new_devs, BPF_NOEXIST);
+        return;
+    }
 
-// Helper to update blkio stats for a PID
+#pragma unroll
+    for (int i = 0; i < MAX_DEVS_PER_PID; i++) {
+        if (devs->dev[i] == 0) {
+            devs->dev[i] = dev;
+            return;
+        }
+    }
+}
+
+// Helper to update blkio stats for a (PID, device) pair
 // Updates the blkio_stats_map with read or write I/O statistics for a given process.
-// If the PID doesn't exist in the map, creates a new entry. Otherwise, atomically
-// increments the existing counters.
+// If the key doesn't exist in the map, creates a new entry tagged with the current
+// comm. Otherwise, increments the existing counters (atomically unless the map
+// is per-CPU).
 //
 // Parameters:
-//   pid: Process ID
+//   key: Process ID and device
 //   bytes: Number of bytes read or written
 //   is_write: true for write operations, false for read operations
-static __always_inline void update_blkio_stats(u32 pid, u64 bytes, bool is_write) {
-    struct blkio_stats *stats = bpf_map_lookup_elem(&blkio_stats_map, &pid);
+static __always_inline void update_blkio_stats(struct blkio_key *key, u64 bytes, bool is_write) {
+    u32 event = is_write ? EVENT_BLKIO_WRITE : EVENT_BLKIO_READ;
+    struct blkio_stats *stats = bpf_map_lookup_elem(&blkio_stats_map, key);
     if (!stats) {
         struct blkio_stats new_stats = {0};
         if (is_write) {
@@ -354,245 +610,218 @@ static __always_inline void update_blkio_stats(u32 pid, u64 bytes, bool is_write
             new_stats.read_bytes = bytes;
             new_stats.read_ops = 1;
         }
-        bpf_map_update_elem(&blkio_stats_map, &pid, &new_stats, BPF_ANY);
-    } else {
-        if (is_write) {
-            __sync_fetch_and_add(&stats->write_bytes, bytes);
-            __sync_fetch_and_add(&stats->write_ops, 1);
-            
-            u32 idx = EVENT_BLKIO_WRITE;
-            u64 *counter = bpf_map_lookup_elem(&event_counters, &idx);
-            if (counter) {
-                __sync_fetch_and_add(counter, 1);
-            }
-        } else {
-            __sync_fetch_and_add(&stats->read_bytes, bytes);
-            __sync_fetch_and_add(&stats->read_ops, 1);
-            
-            u32 idx = EVENT_BLKIO_READ;
-            u64 *counter = bpf_map_lookup_elem(&event_counters, &idx);
-            if (counter) {
-                __sync_fetch_and_add(counter, 1);
-            }
+        bpf_get_current_comm(&new_stats.comm, sizeof(new_stats.comm));
+
+        if (bpf_map_update_elem(&blkio_stats_map, key, &new_stats, BPF_NOEXIST) == 0) {
+            map_state_add(MAP_BLKIO_ENTRIES, 1);
+            track_pid_dev(key->pid, key->dev);
+            count_event(event);
+            return;
+        }
+
+        // Either another CPU created the entry first, or the map is full
+        stats = bpf_map_lookup_elem(&blkio_stats_map, key);
+        if (!stats) {
+            map_state_add(MAP_BLKIO_FULL, 1);
+            return;
         }
     }
-}
 
-// Read syscall entry
-SEC("tracepoint/syscalls/sys_enter_read")
-int trace_read_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // fd
-    info.count = ctx->args[2];   // count
-    info.is_write = 0;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
-    return 0;
+    if (is_write) {
+        counter_add(&stats->write_bytes, bytes);
+        counter_add(&stats->write_ops, 1);
+    } else {
+        counter_add(&stats->read_bytes, bytes);
+        counter_add(&stats->read_ops, 1);
+    }
+
+    count_event(event);
 }
 
-// Read syscall exit
-SEC("tracepoint/syscalls/sys_exit_read")
-int trace_read_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    // Ignore errors and zero-byte operations
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
-    }
-    
-    struct io_syscall_info *info = bpf_map_lookup_elem(&syscall_pending, &pid_tgid);
-    if (info && !info->is_write) {
-        update_blkio_stats(pid, (u64)ret, false);
+// Helper to decode the request direction from the rwbs string
+// rwbs looks like "R", "WS", "FWFS" (flush + write + FUA + sync) or "D"
+// (discard). Returns 1 for writes, 0 for reads and -1 for anything else.
+static __always_inline int rwbs_direction(const char *rwbs) {
+#pragma unroll
+    for (int i = 0; i < 4; i++) {
+        char c = rwbs[i];
+        if (c == 'W') {
+            return 1;
+        }
+        if (c == 'R') {
+            return 0;
+        }
+        if (c != 'F') {
+            return -1;
+        }
     }
-    
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-    return 0;
+    return -1;
 }
 
-// Write syscall entry
-SEC("tracepoint/syscalls/sys_enter_write")
-int trace_write_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // fd
-    info.count = ctx->args[2];   // count
-    info.is_write = 1;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
-    return 0;
-}
+// Block request issue tracepoint
+SEC("tracepoint/block/block_rq_issue")
+int trace_block_rq_issue(struct trace_event_raw_block_rq *ctx) {
+    int dir = rwbs_direction(ctx->rwbs);
+    u64 bytes = ctx->bytes;
 
-// Write syscall exit
-SEC("tracepoint/syscalls/sys_exit_write")
-int trace_write_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    // Ignore errors and zero-byte operations
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    // Ignore flushes, discards and empty requests
+    if (dir < 0 || bytes == 0) {
         return 0;
     }
-    
-    struct io_syscall_info *info = bpf_map_lookup_elem(&syscall_pending, &pid_tgid);
-    if (info && info->is_write) {
-        update_blkio_stats(pid, (u64)ret, true);
-    }
-    
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+
+    struct blkio_key key = {
+        .pid = get_current_pid(),
+        .dev = ctx->dev,
+    };
+    update_blkio_stats(&key, bytes, dir == 1);
+    cgroup_io_add(dir == 1 ? CGROUP_IO_WRITE : CGROUP_IO_READ, bytes);
+    hist_add(pid_class(key.pid), HIST_BLKIO_SIZE, bytes);
     return 0;
 }
 
-// pread64 syscall entry
-SEC("tracepoint/syscalls/sys_enter_pread64")
-int trace_pread64_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // fd
-    info.count = ctx->args[2];   // count
-    info.is_write = 0;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
-    return 0;
+// ========== PROCESS LIFECYCLE HOOKS ==========
+// exec, fork and exit of processes (not threads) are published through the
+// lifecycle_events ring buffer, so userspace discovers processes from the
+// churn instead of listing /proc and sees the final counters of processes
+// that exit between two scans.
+
+// Helper to check whether the exiting task is the last live thread of its
+// thread group. signal->live is decremented before the exit tracepoint.
+static __always_inline bool thread_group_dead(struct task_struct *task) {
+    return BPF_CORE_READ(task, signal, live.counter) == 0;
 }
 
-// pread64 syscall exit
-SEC("tracepoint/syscalls/sys_exit_pread64")
-int trace_pread64_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-        return 0;
+// Helper to publish a lifecycle event. `task` is the thread group leader,
+// except for exits, where it is the last thread of the group to exit; the
+// event then still describes the leader.
+static __always_inline void emit_lifecycle(struct task_struct *task, u32 type) {
+    struct lifecycle_event *event =
+        bpf_ringbuf_reserve(&lifecycle_events, sizeof(*event), 0);
+    if (!event) {
+        map_state_add(MAP_LIFECYCLE_LOST, 1);
+        return;
     }
-    
-    struct io_syscall_info *info = bpf_map_lookup_elem(&syscall_pending, &pid_tgid);
-    if (info && !info->is_write) {
-        update_blkio_stats(pid, (u64)ret, false);
+
+    struct task_struct *leader = BPF_CORE_READ(task, group_leader);
+    event->type = type;
+    event->tgid = BPF_CORE_READ(leader, tgid);
+    event->ppid = BPF_CORE_READ(leader, real_parent, tgid);
+    event->pad = 0;
+    event->start_ns = BPF_CORE_READ(leader, start_boottime);
+    BPF_CORE_READ_STR_INTO(&event->comm, leader, comm);
+
+    if (type == LIFECYCLE_EXIT) {
+        // The exiting thread's own counters plus those of already reaped
+        // threads. A leader that exited earlier stays a zombie until the
+        // group is dead, so its counters are not in the signal totals yet.
+        struct signal_struct *sig = BPF_CORE_READ(task, signal);
+        u64 cpu_ns = BPF_CORE_READ(task, utime) + BPF_CORE_READ(task, stime) +
+                     BPF_CORE_READ(sig, utime) + BPF_CORE_READ(sig, stime);
+        u64 read_bytes =
+            BPF_CORE_READ(task, ioac.read_bytes) + BPF_CORE_READ(sig, ioac.read_bytes);
+        u64 write_bytes =
+            BPF_CORE_READ(task, ioac.write_bytes) + BPF_CORE_READ(sig, ioac.write_bytes);
+        if (leader != task) {
+            cpu_ns += BPF_CORE_READ(leader, utime) + BPF_CORE_READ(leader, stime);
+            read_bytes += BPF_CORE_READ(leader, ioac.read_bytes);
+            write_bytes += BPF_CORE_READ(leader, ioac.write_bytes);
+        }
+        event->cpu_ns = cpu_ns;
+        event->read_bytes = read_bytes;
+        event->write_bytes = write_bytes;
+    } else {
+        event->cpu_ns = 0;
+        event->read_bytes = 0;
+        event->write_bytes = 0;
     }
-    
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-    return 0;
+
+    bpf_ringbuf_submit(event, 0);
 }
 
-// pwrite64 syscall entry
-SEC("tracepoint/syscalls/sys_enter_pwrite64")
-int trace_pwrite64_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // fd
-    info.count = ctx->args[2];   // count
-    info.is_write = 1;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+// exec replaces the process image (and comm) of the calling thread group
+SEC("tracepoint/sched/sched_process_exec")
+int trace_sched_process_exec(struct trace_event_raw_sched_process_exec *ctx) {
+    emit_lifecycle((struct task_struct *)bpf_get_current_task(), LIFECYCLE_EXEC);
     return 0;
 }
 
-// pwrite64 syscall exit
-SEC("tracepoint/syscalls/sys_exit_pwrite64")
-int trace_pwrite64_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+// fork also fires for new threads; the BTF tracepoint gives access to the
+// child task so those can be skipped
+SEC("tp_btf/sched_process_fork")
+int BPF_PROG(trace_sched_process_fork, struct task_struct *parent, struct task_struct *child) {
+    if (BPF_CORE_READ(child, pid) != BPF_CORE_READ(child, tgid)) {
         return 0;
     }
-    
-    struct io_syscall_info *info = bpf_map_lookup_elem(&syscall_pending, &pid_tgid);
-    if (info && info->is_write) {
-        update_blkio_stats(pid, (u64)ret, true);
-    }
-    
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    emit_lifecycle(child, LIFECYCLE_FORK);
     return 0;
 }
 
-// readv syscall entry
-SEC("tracepoint/syscalls/sys_enter_readv")
-int trace_readv_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // fd
-    // Note: count not set for readv as total size is unknown until syscall returns
-    info.is_write = 0;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
+// exit of the last thread of a process, with the process's final totals.
+// The leader may exit before its threads, so the process is only gone once
+// the whole thread group is. Threads exiting concurrently can each see the
+// group dead, userspace keeps one exit per process.
+// Separate from trace_sched_process_exit so the stats eviction keeps working
+// when userspace disables the lifecycle programs (no ring buffer support).
+SEC("tracepoint/sched/sched_process_exit")
+int trace_sched_process_exit_event(struct trace_event_raw_sched_process_template *ctx) {
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    if (!thread_group_dead(task)) {
+        return 0;
+    }
+    emit_lifecycle(task, LIFECYCLE_EXIT);
     return 0;
 }
 
-// readv syscall exit
-SEC("tracepoint/syscalls/sys_exit_readv")
-int trace_readv_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+// ========== PROCESS EXIT HOOK ==========
+// Marks the exiting process's stats entries in exited_map instead of
+// deleting them, so
+// userspace can fold their final counters into its exited-process totals
+// (keeping group counters monotonic) before removing them. Per-CPU values
+// can't be summed in-kernel, which is why the flush happens in userspace.
+
+SEC("tracepoint/sched/sched_process_exit")
+int trace_sched_process_exit(struct trace_event_raw_sched_process_template *ctx) {
+    u32 tgid = bpf_get_current_pid_tgid() >> 32;
+
+    // Only act once the whole thread group is gone; threads keep accounting
+    // to the TGID's entries after an early leader exit
+    if (!thread_group_dead((struct task_struct *)bpf_get_current_task())) {
         return 0;
     }
-    
-    struct io_syscall_info *info = bpf_map_lookup_elem(&syscall_pending, &pid_tgid);
-    if (info && !info->is_write) {
-        update_blkio_stats(pid, (u64)ret, false);
-    }
-    
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
-    return 0;
-}
 
-// writev syscall entry
-SEC("tracepoint/syscalls/sys_enter_writev")
-int trace_writev_enter(struct trace_event_raw_sys_enter *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    
-    struct io_syscall_info info = {0};
-    info.ts = bpf_ktime_get_ns();
-    info.fd = ctx->args[0];      // fd
-    // Note: count not set for writev as total size is unknown until syscall returns
-    info.is_write = 1;
-    
-    bpf_map_update_elem(&syscall_pending, &pid_tgid, &info, BPF_ANY);
-    return 0;
-}
+    // The TGID may be reused before userspace pushes the next classification
+    bpf_map_delete_elem(&pid_class_map, &tgid);
+
+    // Concurrently exiting threads can both see the group dead, only the
+    // one claiming an entry in exited_map drops it from the entry count
+    struct blkio_key net_key = {
+        .pid = tgid,
+        .dev = 0,
+    };
+    if (bpf_map_lookup_elem(&net_stats_map, &tgid) && claim_exited(&net_key)) {
+        map_state_add(MAP_NET_ENTRIES, -1);
+    }
 
-// writev syscall exit
-SEC("tracepoint/syscalls/sys_exit_writev")
-int trace_writev_exit(struct trace_event_raw_sys_exit *ctx) {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = pid_tgid >> 32;
-    long ret = ctx->ret;
-    
-    if (ret <= 0) {
-        bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+    struct pid_devs *devs = bpf_map_lookup_elem(&pid_devs_map, &tgid);
+    if (!devs) {
         return 0;
     }
-    
-    struct io_syscall_info *info = bpf_map_lookup_elem(&syscall_pending, &pid_tgid);
-    if (info && info->is_write) {
-        update_blkio_stats(pid, (u64)ret, true);
+
+#pragma unroll
+    for (int i = 0; i < MAX_DEVS_PER_PID; i++) {
+        if (devs->dev[i] == 0) {
+            break;
+        }
+        struct blkio_key key = {
+            .pid = tgid,
+            .dev = devs->dev[i],
+        };
+        if (bpf_map_lookup_elem(&blkio_stats_map, &key) && claim_exited(&key)) {
+            map_state_add(MAP_BLKIO_ENTRIES, -1);
+        }
     }
-    
-    bpf_map_delete_elem(&syscall_pending, &pid_tgid);
+
+    bpf_map_delete_elem(&pid_devs_map, &tgid);
     return 0;
 }
 
@@ -1,14 +1,20 @@
 //! eBPF manager module for process I/O tracking.
 //!
-//! This module provides eBPF-based tracking of per-process network and block I/O.
+//! This module provides eBPF-based tracking of per-process network and block I/O,
+//! and of per-subgroup log2 histograms of network syscall latency and I/O sizes.
+//! The histograms are bucketed in the kernel by the subgroup IDs userspace
+//! pushes after each process scan (see [`EbpfManager::push_pid_classes`]).
 //! When eBPF is not available (old kernel, missing permissions, or feature disabled),
 //! it gracefully degrades and returns empty results.
 
 use std::collections::HashMap;
 use std::sync::{Arc, Mutex};
 
+use crate::cache::ProcMem;
+use crate::process::{classify_pid, SubgroupId};
+
 #[cfg(feature = "ebpf")]
-use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
 
 #[cfg(not(feature = "ebpf"))]
 use tracing::debug;
@@ -22,13 +28,87 @@ use std::time::Instant;
 use tracing::{debug, info, warn};
 
 #[cfg(feature = "ebpf")]
-use libbpf_rs::{MapCore, MapFlags, Object, ObjectBuilder};
+use libbpf_rs::{MapCore, MapFlags, MapType, Object, ObjectBuilder, OpenObject};
+
+/// BTF kind of a data section (BTF_KIND_DATASEC in linux/btf.h).
+#[cfg(feature = "ebpf")]
+const BTF_KIND_DATASEC: u32 = 15;
+
+/// eBPF object embedded at build time (see build.rs).
+#[cfg(feature = "ebpf")]
+const EBPF_OBJECT: &[u8] = include_bytes!(concat!(
+    env!("CARGO_MANIFEST_DIR"),
+    "/src/ebpf/bpf/process_io.bpf.o"
+));
+
+/// Number of entries fetched per BPF_MAP_LOOKUP_BATCH call.
+#[cfg(feature = "ebpf")]
+const MAP_BATCH_SIZE: u32 = 1024;
+
+/// Length of the in-kernel comm buffer (TASK_COMM_LEN).
+const COMM_LEN: usize = 16;
+/// Offset of `comm` in struct net_stats (after 5 u64 counters).
+const NET_STATS_COMM_OFFSET: usize = 40;
+/// Offset of `comm` in struct blkio_stats (after 4 u64 counters).
+const BLKIO_STATS_COMM_OFFSET: usize = 32;
+
+/// Indices into the map_state array (see process_io.bpf.c).
+#[cfg(feature = "ebpf")]
+const MAP_NET_ENTRIES: usize = 0;
+#[cfg(feature = "ebpf")]
+const MAP_BLKIO_ENTRIES: usize = 1;
+#[cfg(feature = "ebpf")]
+const MAP_NET_FULL: usize = 2;
+#[cfg(feature = "ebpf")]
+const MAP_BLKIO_FULL: usize = 3;
+#[cfg(feature = "ebpf")]
+const MAP_LIFECYCLE_LOST: usize = 4;
+/// Number of slots in map_state.
+#[cfg(feature = "ebpf")]
+const MAP_STATE_SLOTS: usize = 5;
+
+/// Slots per in-kernel log2 histogram (HIST_SLOTS in process_io.bpf.c).
+pub const HIST_SLOTS: usize = 32;
+/// Subgroup classes the in-kernel histograms are kept for (MAX_HIST_CLASSES).
+///
+/// Subgroups with larger IDs are counted as other/unknown.
+pub const MAX_HIST_CLASSES: u32 = 256;
+/// Histograms per class in io_hists (HIST_KINDS), see SubgroupIoHistograms.
+const HIST_KINDS: usize = 3;
+/// u64 fields of struct hist: the slots, then the sum.
+const HIST_FIELDS: usize = HIST_SLOTS + 1;
+
+/// Size of struct lifecycle_event (see process_io.bpf.c).
+const LIFECYCLE_EVENT_SIZE: usize = 64;
+/// Offset of `comm` in struct lifecycle_event (after 4 u32 and 4 u64 fields).
+const LIFECYCLE_EVENT_COMM_OFFSET: usize = 48;
+/// Lifecycle events buffered between two process scans; more are dropped and
+/// the next scan falls back to listing /proc.
+#[cfg(feature = "ebpf")]
+const MAX_PENDING_LIFECYCLE_EVENTS: usize = 1 << 16;
+/// Lifecycle programs, disabled together with lifecycle_events when the
+/// kernel has no ring buffers (< 5.8).
+#[cfg(feature = "ebpf")]
+const LIFECYCLE_PROGRAMS: [&str; 3] = [
+    "trace_sched_process_exec",
+    "trace_sched_process_fork",
+    "trace_sched_process_exit_event",
+];
+
+/// PID reported for the accumulated totals of exited processes.
+///
+/// The exporter folds the final counters of exited processes into
+/// per-subgroup totals so group counters stay monotonic after their map
+/// entries are evicted.
+pub const EXITED_PID: u32 = 0;
 
 /// Process network I/O statistics from eBPF.
 #[derive(Debug, Clone, Default)]
 pub struct ProcessNetStats {
     pub pid: u32,
     pub comm: String,
+    /// Subgroup of the exited-process totals reported as [`EXITED_PID`]
+    pub exited_subgroup: Option<SubgroupId>,
     pub rx_bytes: u64,
     #[allow(dead_code)] // Collected for future packet-level analysis
     pub rx_packets: u64,
@@ -45,6 +125,8 @@ pub struct ProcessBlkioStats {
     #[allow(dead_code)] // Used for aggregation classification
     pub pid: u32,
     pub comm: String,
+    /// Subgroup of the exited-process totals reported as [`EXITED_PID`]
+    pub exited_subgroup: Option<SubgroupId>,
     #[allow(dead_code)] // Future enhancement for per-device breakdown
     pub device: String,
     pub read_bytes: u64,
@@ -55,6 +137,26 @@ pub struct ProcessBlkioStats {
     pub write_ops: u64,
 }
 
+impl ProcessNetStats {
+    /// Subgroup of the counters: the folded one of exited-process totals,
+    /// otherwise the scan's classification of the PID.
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub fn subgroup_id(&self, processes: &ahash::AHashMap<u32, ProcMem>) -> SubgroupId {
+        self.exited_subgroup
+            .unwrap_or_else(|| classify_pid(processes, self.pid, &self.comm))
+    }
+}
+
+impl ProcessBlkioStats {
+    /// Subgroup of the counters: the folded one of exited-process totals,
+    /// otherwise the scan's classification of the PID.
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub fn subgroup_id(&self, processes: &ahash::AHashMap<u32, ProcMem>) -> SubgroupId {
+        self.exited_subgroup
+            .unwrap_or_else(|| classify_pid(processes, self.pid, &self.comm))
+    }
+}
+
 /// TCP connection statistics from eBPF.
 #[allow(dead_code)] // Used when eBPF feature is enabled and TCP tracking is active
 #[derive(Debug, Clone, Default)]
@@ -72,6 +174,96 @@ pub struct TcpStats {
     pub closing: u64,
 }
 
+/// Log2 histogram aggregated in the kernel.
+///
+/// Bucket `i` counts values in `[2^i, 2^(i+1))`; bucket 0 also counts 0 and
+/// the last bucket everything larger.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct Log2Histogram {
+    pub buckets: [u64; HIST_SLOTS],
+    /// Sum of all recorded values
+    pub sum: u64,
+}
+
+impl Log2Histogram {
+    /// Number of recorded values.
+    pub fn count(&self) -> u64 {
+        self.buckets
+            .iter()
+            .fold(0u64, |count, &bucket| count.wrapping_add(bucket))
+    }
+
+    /// Largest value counted in bucket `i`, or None for the last bucket,
+    /// which is unbounded.
+    pub fn upper_bound(i: usize) -> Option<u64> {
+        (i + 1 < HIST_SLOTS).then(|| (1u64 << (i + 1)) - 1)
+    }
+}
+
+/// In-kernel I/O histograms of one subgroup, since the programs were loaded.
+#[derive(Debug, Clone, Default)]
+pub struct SubgroupIoHistograms {
+    pub subgroup_id: u32,
+    /// Latency of successful network syscalls, in nanoseconds
+    pub net_latency_ns: Log2Histogram,
+    /// Bytes per successful network syscall
+    pub net_size_bytes: Log2Histogram,
+    /// Bytes per block request
+    pub blkio_size_bytes: Log2Histogram,
+}
+
+/// I/O of one cgroup, since the programs were loaded.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct CgroupIoStats {
+    /// cgroup ID, the inode of the cgroup directory
+    pub cgroup_id: u64,
+    pub rx_bytes: u64,
+    pub tx_bytes: u64,
+    pub read_bytes: u64,
+    pub write_bytes: u64,
+}
+
+/// Kind of a process lifecycle event.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum LifecycleKind {
+    /// The process replaced its image; its name may have changed
+    Exec,
+    /// A new process was forked
+    Fork,
+    /// The process exited
+    Exit,
+}
+
+/// Process lifecycle event published by the kernel through lifecycle_events.
+#[derive(Debug, Clone, PartialEq)]
+pub struct LifecycleEvent {
+    pub kind: LifecycleKind,
+    pub tgid: u32,
+    #[allow(dead_code)] // Collected for future process tree analysis
+    pub ppid: u32,
+    /// Process name (comm) at the time of the event
+    pub comm: String,
+    /// Start time in clock ticks since boot, as in /proc/<pid>/stat
+    pub start_ticks: u64,
+    /// Exit only: total user + system CPU time of the process
+    pub cpu_time_seconds: f64,
+    /// Exit only: storage bytes read by the process
+    #[allow(dead_code)] // Block I/O of exited processes is folded through blkio_stats_map
+    pub read_bytes: u64,
+    /// Exit only: storage bytes written by the process
+    #[allow(dead_code)] // Block I/O of exited processes is folded through blkio_stats_map
+    pub write_bytes: u64,
+}
+
+/// Lifecycle events taken since the previous batch.
+#[derive(Debug, Clone, Default)]
+pub struct LifecycleBatch {
+    pub events: Vec<LifecycleEvent>,
+    /// False if events were dropped since the previous batch, in which case
+    /// the process set has to be rebuilt from /proc.
+    pub complete: bool,
+}
+
 /// Performance statistics for eBPF programs.
 #[derive(Debug, Clone, Copy)]
 pub struct EbpfPerfStats {
@@ -88,6 +280,51 @@ pub struct EbpfPerfStats {
     pub ebpf_cpu_seconds_total: f64,
 }
 
+/// Default capacity of the per-process stats maps (MAX_ENTRIES in process_io.bpf.c).
+pub const DEFAULT_MAP_MAX_ENTRIES: u32 = 10240;
+
+/// Load-time options for the eBPF programs.
+#[derive(Debug, Clone, Copy)]
+pub struct EbpfOptions {
+    /// Use per-CPU maps for the hot-path I/O counters.
+    ///
+    /// Removes cross-CPU atomics from every traced syscall at the cost of one
+    /// value slot per CPU per map entry; values are summed across CPUs on read.
+    pub percpu_maps: bool,
+    /// Use LRU hash maps for the per-process stats maps.
+    ///
+    /// When full, the least recently updated entry is evicted instead of new
+    /// processes going untracked. Evicted counters are lost.
+    pub lru_maps: bool,
+    /// Capacity of the per-process stats maps.
+    pub map_max_entries: u32,
+    /// Account network and block I/O per cgroup as well.
+    ///
+    /// Keyed by cgroup ID in its own LRU map of `map_max_entries` entries.
+    pub cgroup_io: bool,
+    /// Account cgroup I/O to the ancestor cgroup this many levels below the
+    /// root, matching paths cut by `cgroup_depth`; 0 uses the task's cgroup.
+    pub cgroup_level: u32,
+    /// Record network syscall latency in the subgroup histograms.
+    ///
+    /// Attaches the sys_enter_* programs, which keep the syscall start in
+    /// task storage. Off, only the sys_exit_* programs run.
+    pub net_latency: bool,
+}
+
+impl Default for EbpfOptions {
+    fn default() -> Self {
+        Self {
+            percpu_maps: false,
+            lru_maps: false,
+            map_max_entries: DEFAULT_MAP_MAX_ENTRIES,
+            cgroup_io: false,
+            cgroup_level: 0,
+            net_latency: false,
+        }
+    }
+}
+
 /// eBPF manager for loading and managing eBPF programs.
 pub struct EbpfManager {
     enabled: bool,
@@ -96,6 +333,10 @@ pub struct EbpfManager {
 }
 
 struct EbpfInner {
+    #[cfg(feature = "ebpf")]
+    /// Lifecycle ring buffer consumer; declared before `object` so it is
+    /// dropped first. None if the kernel has no ring buffers
+    lifecycle: Option<LifecycleConsumer>,
     #[cfg(feature = "ebpf")]
     object: Object,
     #[cfg(feature = "ebpf")]
@@ -112,11 +353,36 @@ struct EbpfInner {
     #[cfg(feature = "ebpf")]
     #[allow(dead_code)] // CRITICAL: Must be kept alive to prevent eBPF detachment
     links: Vec<libbpf_rs::Link>,
+    #[cfg(feature = "ebpf")]
+    /// Resolved block device names, keyed by kernel dev_t
+    device_names: HashMap<u32, String>,
+    #[cfg(feature = "ebpf")]
+    /// Final net counters of exited processes, keyed by subgroup ID
+    exited_net: HashMap<SubgroupId, [u64; 5]>,
+    #[cfg(feature = "ebpf")]
+    /// Final blkio counters of exited processes, keyed by subgroup ID
+    exited_blkio: HashMap<SubgroupId, [u64; 4]>,
+    #[cfg(feature = "ebpf")]
+    /// TGID -> subgroup ID of the last push; those with a histogram class
+    /// are in pid_class_map
+    pid_subgroups: HashMap<u32, SubgroupId>,
     #[cfg(not(feature = "ebpf"))]
     #[allow(dead_code)]
     loaded: bool,
 }
 
+/// Userspace side of the lifecycle_events ring buffer.
+#[cfg(feature = "ebpf")]
+struct LifecycleConsumer {
+    ring: libbpf_rs::RingBuffer<'static>,
+    /// Events consumed from the ring but not yet taken by the cache updater
+    pending: Arc<Mutex<Vec<LifecycleEvent>>>,
+    /// Set when `pending` was full and events were dropped
+    overflowed: Arc<AtomicBool>,
+    /// map_state[MAP_LIFECYCLE_LOST] when the previous batch was taken
+    lost_seen: u64,
+}
+
 // SAFETY: EbpfInner is only accessed through a Mutex, ensuring exclusive access.
 // The Object and Link types from libbpf-rs are safe to send between threads when
 // properly synchronized, which the Mutex provides.
@@ -124,14 +390,21 @@ struct EbpfInner {
 unsafe impl Send for EbpfInner {}
 
 impl EbpfManager {
-    /// Creates a new eBPF manager.
+    /// Creates a new eBPF manager with default options.
     ///
     /// Returns an error if eBPF cannot be initialized. The caller should
     /// handle this gracefully and continue without eBPF metrics.
+    #[allow(dead_code)] // Convenience constructor, main uses with_options()
     pub fn new() -> Result<Self, anyhow::Error> {
+        Self::with_options(EbpfOptions::default())
+    }
+
+    /// Creates a new eBPF manager with the given load-time options.
+    #[cfg_attr(not(feature = "ebpf"), allow(unused_variables))]
+    pub fn with_options(options: EbpfOptions) -> Result<Self, anyhow::Error> {
         #[cfg(feature = "ebpf")]
         {
-            match Self::try_init_ebpf() {
+            match Self::try_init_ebpf(options) {
                 Ok(inner) => {
                     info!("eBPF initialized successfully");
                     Ok(Self {
@@ -163,31 +436,33 @@ impl EbpfManager {
     }
 
     #[cfg(feature = "ebpf")]
-    fn try_init_ebpf() -> Result<EbpfInner, anyhow::Error> {
-        // Load eBPF object from embedded bytes (compiled at build time)
-        const EBPF_OBJECT: &[u8] = include_bytes!(concat!(
-            env!("CARGO_MANIFEST_DIR"),
-            "/src/ebpf/bpf/process_io.bpf.o"
-        ));
-
+    fn try_init_ebpf(options: EbpfOptions) -> Result<EbpfInner, anyhow::Error> {
         let mut builder = ObjectBuilder::default();
         builder.debug(cfg!(debug_assertions));
 
         // Load from memory instead of file
-        let open_obj = builder.open_memory(EBPF_OBJECT)?;
+        let mut open_obj = builder.open_memory(EBPF_OBJECT)?;
+        Self::configure_maps(&mut open_obj, &options)?;
+        let lifecycle_supported = Self::configure_lifecycle(&mut open_obj)?;
         let obj = open_obj.load()?;
 
         // Attach all programs and categorize by functionality
         let mut links = Vec::new();
         let mut rx_syscalls = HashSet::new();
         let mut tx_syscalls = HashSet::new();
-        let mut read_syscalls = HashSet::new();
-        let mut write_syscalls = HashSet::new();
+        let mut blkio_programs = HashSet::new();
+        let mut lifecycle_programs = HashSet::new();
         let mut other_programs = HashSet::new();
         let mut failed_programs = Vec::new();
 
         for prog in obj.progs_mut() {
             let name = prog.name().to_string_lossy().to_string();
+            if !lifecycle_supported && LIFECYCLE_PROGRAMS.contains(&name.as_str()) {
+                continue;
+            }
+            if !options.net_latency && name.ends_with("_enter") {
+                continue;
+            }
 
             match prog.attach() {
                 Ok(link) => {
@@ -202,10 +477,10 @@ impl EbpfManager {
                         rx_syscalls.insert(syscall_name);
                     } else if name.contains("send") {
                         tx_syscalls.insert(syscall_name);
-                    } else if name.contains("read") {
-                        read_syscalls.insert(syscall_name);
-                    } else if name.contains("write") {
-                        write_syscalls.insert(syscall_name);
+                    } else if name.contains("block_rq") {
+                        blkio_programs.insert(syscall_name);
+                    } else if name.contains("sched_process") {
+                        lifecycle_programs.insert(syscall_name);
                     } else {
                         other_programs.insert(syscall_name);
                     }
@@ -221,14 +496,14 @@ impl EbpfManager {
         // Convert HashSets to sorted Vecs for consistent output
         let mut rx_syscalls: Vec<_> = rx_syscalls.into_iter().collect();
         let mut tx_syscalls: Vec<_> = tx_syscalls.into_iter().collect();
-        let mut read_syscalls: Vec<_> = read_syscalls.into_iter().collect();
-        let mut write_syscalls: Vec<_> = write_syscalls.into_iter().collect();
+        let mut blkio_programs: Vec<_> = blkio_programs.into_iter().collect();
+        let mut lifecycle_programs: Vec<_> = lifecycle_programs.into_iter().collect();
         let mut other_programs: Vec<_> = other_programs.into_iter().collect();
 
         rx_syscalls.sort();
         tx_syscalls.sort();
-        read_syscalls.sort();
-        write_syscalls.sort();
+        blkio_programs.sort();
+        lifecycle_programs.sort();
         other_programs.sort();
 
         // Log grouped results
@@ -246,18 +521,13 @@ impl EbpfManager {
                 tx_syscalls.len()
             );
         }
-        if !read_syscalls.is_empty() {
-            info!(
-                "✅ Block I/O read tracking: {} ({} syscalls)",
-                read_syscalls.join(", "),
-                read_syscalls.len()
-            );
+        if !blkio_programs.is_empty() {
+            info!("✅ Block I/O tracking: {}", blkio_programs.join(", "));
         }
-        if !write_syscalls.is_empty() {
+        if !lifecycle_programs.is_empty() {
             info!(
-                "✅ Block I/O write tracking: {} ({} syscalls)",
-                write_syscalls.join(", "),
-                write_syscalls.len()
+                "✅ Process lifecycle tracking: {}",
+                lifecycle_programs.join(", ")
             );
         }
         if !other_programs.is_empty() {
@@ -267,12 +537,8 @@ impl EbpfManager {
         // Handle failed programs with explanations
         if !failed_programs.is_empty() {
             // Helper to check if a program is an expected recv/send failure
-            let is_expected_recv_send_failure = |p: &str| -> bool {
-                p.contains("recv_enter")
-                    || p.contains("recv_exit")
-                    || p.contains("send_enter")
-                    || p.contains("send_exit")
-            };
+            let is_expected_recv_send_failure =
+                |p: &str| -> bool { p.starts_with("trace_recv_") || p.starts_with("trace_send_") };
 
             // Check if recv/send failed (this is normal and expected)
             let recv_send_failed = failed_programs
@@ -309,7 +575,7 @@ impl EbpfManager {
         if !rx_syscalls.is_empty() || !tx_syscalls.is_empty() {
             features.push("Network RX/TX tracking enabled");
         }
-        if !read_syscalls.is_empty() || !write_syscalls.is_empty() {
+        if !blkio_programs.is_empty() {
             features.push("Block I/O tracking enabled");
         }
         if !other_programs.is_empty() {
@@ -320,17 +586,487 @@ impl EbpfManager {
             info!("   - {}", feature);
         }
 
+        // Discovery from events needs all of exec, fork and exit
+        let lifecycle_attached = lifecycle_supported
+            && !failed_programs
+                .iter()
+                .any(|p| LIFECYCLE_PROGRAMS.contains(&p.as_str()));
+        let lifecycle = if lifecycle_attached {
+            match Self::open_lifecycle_consumer(&obj) {
+                Ok(consumer) => {
+                    info!("   - Process discovery from lifecycle events enabled");
+                    Some(consumer)
+                }
+                Err(e) => {
+                    warn!("Failed to open lifecycle ring buffer: {}", e);
+                    None
+                }
+            }
+        } else {
+            None
+        };
+
         let now = Instant::now();
         Ok(EbpfInner {
+            lifecycle,
             object: obj,
             start_time: now,
             last_event_count: 0,
             last_check: now,
             ebpf_cpu_seconds_total: AtomicU64::new(0),
             links,
+            device_names: HashMap::new(),
+            exited_net: HashMap::new(),
+            exited_blkio: HashMap::new(),
+            pid_subgroups: HashMap::new(),
+        })
+    }
+
+    /// Disables the lifecycle programs and ring buffer if the kernel has no
+    /// BPF ring buffers, so the rest of the object still loads.
+    ///
+    /// Returns whether lifecycle events are supported.
+    #[cfg(feature = "ebpf")]
+    fn configure_lifecycle(open_obj: &mut OpenObject) -> Result<bool, anyhow::Error> {
+        // SAFETY: probing a map type has no preconditions; opts may be NULL
+        let supported = unsafe {
+            libbpf_sys::libbpf_probe_bpf_map_type(
+                libbpf_sys::BPF_MAP_TYPE_RINGBUF,
+                std::ptr::null(),
+            )
+        } == 1;
+        if supported {
+            return Ok(true);
+        }
+
+        for mut prog in open_obj.progs_mut() {
+            if LIFECYCLE_PROGRAMS.contains(&prog.name().to_str().unwrap_or_default()) {
+                prog.set_autoload(false)?;
+            }
+        }
+        for mut map in open_obj.maps_mut() {
+            if map.name().to_str() == Some("lifecycle_events") {
+                map.set_autocreate(false)?;
+            }
+        }
+        info!("BPF ring buffers not supported, process discovery keeps listing /proc");
+        Ok(false)
+    }
+
+    /// Sets up the consumer of lifecycle_events.
+    ///
+    /// The callback runs inside `poll_lifecycle_events` and only moves the
+    /// parsed events to the pending list, which is capped so a cache updater
+    /// that stopped running cannot grow it without bound.
+    #[cfg(feature = "ebpf")]
+    fn open_lifecycle_consumer(object: &Object) -> Result<LifecycleConsumer, anyhow::Error> {
+        let map = Self::find_map(object, "lifecycle_events")
+            .ok_or_else(|| anyhow::anyhow!("lifecycle_events not found"))?;
+        let pending = Arc::new(Mutex::new(Vec::new()));
+        let overflowed = Arc::new(AtomicBool::new(false));
+
+        let mut builder = libbpf_rs::RingBufferBuilder::new();
+        {
+            let pending = Arc::clone(&pending);
+            let overflowed = Arc::clone(&overflowed);
+            builder.add(&map, move |data: &[u8]| {
+                let mut pending = pending.lock().unwrap();
+                match parse_lifecycle_event(data) {
+                    Some(_) if pending.len() >= MAX_PENDING_LIFECYCLE_EVENTS => {
+                        overflowed.store(true, Ordering::Relaxed);
+                    }
+                    Some(event) => pending.push(event),
+                    None => overflowed.store(true, Ordering::Relaxed),
+                }
+                0
+            })?;
+        }
+        let ring = builder.build()?;
+
+        let lost_seen = Self::read_map_state(object).map_or(0, |state| state[MAP_LIFECYCLE_LOST]);
+        Ok(LifecycleConsumer {
+            ring,
+            pending,
+            overflowed,
+            lost_seen,
         })
     }
 
+    /// Applies the load-time options to the maps before load.
+    ///
+    /// Resizes the per-process maps and switches them to LRU and/or per-CPU
+    /// variants. Per-CPU mode also sets `percpu_maps` in .rodata so the
+    /// programs drop the atomic adds; the verifier prunes the unused branch.
+    /// `cgroup_io` is set the same way, and cgroup_io_map shrunk to a single
+    /// entry when it is off. Without `net_latency` the sys_enter_* programs
+    /// are not loaded and syscall_start_map is not created; the exit programs
+    /// only reference it in code the verifier prunes.
+    #[cfg(feature = "ebpf")]
+    fn configure_maps(
+        open_obj: &mut OpenObject,
+        options: &EbpfOptions,
+    ) -> Result<(), anyhow::Error> {
+        let stats_map_type = match (options.percpu_maps, options.lru_maps) {
+            (false, false) => MapType::Hash,
+            (true, false) => MapType::PercpuHash,
+            (false, true) => MapType::LruHash,
+            (true, true) => MapType::LruPercpuHash,
+        };
+        let max_entries = options.map_max_entries.max(1);
+
+        for mut map in open_obj.maps_mut() {
+            let name = map.name().to_string_lossy().to_string();
+            match name.as_str() {
+                "net_stats_map" | "blkio_stats_map" => {
+                    map.set_type(stats_map_type)?;
+                    map.set_max_entries(max_entries)?;
+                }
+                "pid_devs_map" => {
+                    if options.lru_maps {
+                        map.set_type(MapType::LruHash)?;
+                    }
+                    map.set_max_entries(max_entries)?;
+                }
+                "exited_map" => {
+                    if options.lru_maps {
+                        map.set_type(MapType::LruHash)?;
+                    }
+                    // One key for every entry of both stats maps
+                    map.set_max_entries(max_entries.saturating_mul(2))?;
+                }
+                "pid_class_map" => map.set_max_entries(max_entries)?,
+                "syscall_start_map" if !options.net_latency => map.set_autocreate(false)?,
+                "event_counters" if options.percpu_maps => map.set_type(MapType::PercpuArray)?,
+                "cgroup_io_map" => {
+                    if options.percpu_maps {
+                        map.set_type(MapType::LruPercpuHash)?;
+                    }
+                    map.set_max_entries(if options.cgroup_io { max_entries } else { 1 })?;
+                }
+                _ => {}
+            }
+        }
+
+        if !options.net_latency {
+            for mut prog in open_obj.progs_mut() {
+                if prog.name().to_string_lossy().ends_with("_enter") {
+                    prog.set_autoload(false)?;
+                }
+            }
+        }
+
+        Self::set_rodata(
+            open_obj,
+            &[
+                ("percpu_maps", &[options.percpu_maps as u8]),
+                ("cgroup_io", &[options.cgroup_io as u8]),
+                ("cgroup_level", &options.cgroup_level.to_ne_bytes()),
+                ("net_latency", &[options.net_latency as u8]),
+            ],
+        )?;
+
+        info!(
+            "eBPF stats maps: {:?}, {} entries",
+            stats_map_type, max_entries
+        );
+
+        Ok(())
+    }
+
+    /// Writes load-time settings into `const volatile` variables of .rodata.
+    ///
+    /// Each variable is found by name in the object's BTF, so the variables
+    /// can be declared in any order; a missing variable or one of a
+    /// different size is an error instead of a silently patched neighbour.
+    #[cfg(feature = "ebpf")]
+    fn set_rodata(
+        open_obj: &mut OpenObject,
+        values: &[(&str, &[u8])],
+    ) -> Result<(), anyhow::Error> {
+        let layout = Self::rodata_layout(open_obj)?;
+        let mut map = open_obj
+            .maps_mut()
+            .find(|map| map.name().to_string_lossy().ends_with(".rodata"))
+            .ok_or_else(|| anyhow::anyhow!(".rodata not found in eBPF object"))?;
+        let data = map
+            .initial_value_mut()
+            .ok_or_else(|| anyhow::anyhow!(".rodata of eBPF object has no data"))?;
+
+        for (name, value) in values {
+            let &(offset, size) = layout
+                .get(*name)
+                .ok_or_else(|| anyhow::anyhow!("{} not found in eBPF object .rodata", name))?;
+            if size != value.len() || offset + size > data.len() {
+                return Err(anyhow::anyhow!(
+                    "{} in eBPF object .rodata is {} bytes at offset {}, expected {} bytes",
+                    name,
+                    size,
+                    offset,
+                    value.len()
+                ));
+            }
+            data[offset..offset + size].copy_from_slice(value);
+        }
+        Ok(())
+    }
+
+    /// Reads offset and size of every .rodata variable from the object's
+    /// BTF DATASEC.
+    #[cfg(feature = "ebpf")]
+    fn rodata_layout(
+        open_obj: &OpenObject,
+    ) -> Result<HashMap<String, (usize, usize)>, anyhow::Error> {
+        use libbpf_rs::AsRawLibbpf;
+        use std::ffi::CStr;
+        use std::os::raw::c_char;
+
+        let mut layout = HashMap::new();
+        // SAFETY: the BTF is owned by the open object and outlives this
+        // function. A DATASEC type is followed by `vlen` btf_var_secinfo
+        // records, and every record's type is a BTF_KIND_VAR with a name.
+        unsafe {
+            let btf = libbpf_sys::bpf_object__btf(open_obj.as_libbpf_object().as_ptr());
+            if btf.is_null() {
+                return Err(anyhow::anyhow!("eBPF object has no BTF"));
+            }
+            let id = libbpf_sys::btf__find_by_name_kind(
+                btf,
+                b".rodata\0".as_ptr() as *const c_char,
+                BTF_KIND_DATASEC,
+            );
+            if id < 0 {
+                return Err(anyhow::anyhow!("eBPF object BTF has no .rodata section"));
+            }
+            let section = libbpf_sys::btf__type_by_id(btf, id as u32);
+            let vlen = ((*section).info & 0xffff) as usize;
+            let vars = std::slice::from_raw_parts(
+                section.add(1) as *const libbpf_sys::btf_var_secinfo,
+                vlen,
+            );
+            for var in vars {
+                let var_type = libbpf_sys::btf__type_by_id(btf, var.type_);
+                if var_type.is_null() {
+                    continue;
+                }
+                let name = libbpf_sys::btf__name_by_offset(btf, (*var_type).name_off);
+                if name.is_null() {
+                    continue;
+                }
+                layout.insert(
+                    CStr::from_ptr(name).to_string_lossy().into_owned(),
+                    (var.offset as usize, var.size as usize),
+                );
+            }
+        }
+        Ok(layout)
+    }
+
+    /// Reads all entries of a map in bulk with BPF_MAP_LOOKUP_BATCH.
+    ///
+    /// This takes one syscall per MAP_BATCH_SIZE entries instead of two per
+    /// entry. Kernels without batch support (< 5.6) fall back to a key walk.
+    #[cfg(feature = "ebpf")]
+    fn dump_map(map: &libbpf_rs::Map) -> Result<MapDump, anyhow::Error> {
+        use std::os::fd::{AsFd, AsRawFd};
+        use std::os::raw::c_void;
+
+        let key_size = map.key_size() as usize;
+        let value_size = map.value_size() as usize;
+        // Per-CPU values come back once per possible CPU, each padded to 8 bytes
+        let (copies, value_stride) = if map.map_type().is_percpu() {
+            (libbpf_rs::num_possible_cpus()?, (value_size + 7) & !7)
+        } else {
+            (1, value_size)
+        };
+
+        let mut dump = MapDump::new(key_size, value_stride, copies);
+        let batch = MAP_BATCH_SIZE as usize;
+        let mut keys = vec![0u8; batch * key_size];
+        let mut values = vec![0u8; batch * copies * value_stride];
+        // Opaque iteration token, at least key-sized (hash maps use a u32 bucket index)
+        let mut token = vec![0u8; key_size.max(8)];
+        let fd = map.as_fd().as_raw_fd();
+        let mut first = true;
+
+        loop {
+            let mut count = MAP_BATCH_SIZE;
+            let in_batch = if first {
+                std::ptr::null_mut()
+            } else {
+                token.as_mut_ptr() as *mut c_void
+            };
+
+            // SAFETY: keys/values hold MAP_BATCH_SIZE entries of the sizes the
+            // kernel uses for this map, token is large enough for the batch cursor.
+            let ret = unsafe {
+                libbpf_sys::bpf_map_lookup_batch(
+                    fd,
+                    in_batch,
+                    token.as_mut_ptr() as *mut c_void,
+                    keys.as_mut_ptr() as *mut c_void,
+                    values.as_mut_ptr() as *mut c_void,
+                    &mut count,
+                    std::ptr::null(),
+                )
+            };
+
+            // ENOENT marks the end of the map; count still holds the last batch
+            let done = ret < 0 && -ret == libc::ENOENT;
+            if ret < 0 && !done {
+                if first {
+                    debug!(
+                        "Batch map lookup unavailable ({}), walking keys",
+                        std::io::Error::from_raw_os_error(-ret)
+                    );
+                    return Self::dump_map_by_keys(map, dump);
+                }
+                return Err(anyhow::anyhow!(
+                    "bpf_map_lookup_batch failed: {}",
+                    std::io::Error::from_raw_os_error(-ret)
+                ));
+            }
+
+            let n = count as usize;
+            dump.keys.extend_from_slice(&keys[..n * key_size]);
+            dump.values
+                .extend_from_slice(&values[..n * copies * value_stride]);
+
+            if done {
+                return Ok(dump);
+            }
+            first = false;
+        }
+    }
+
+    /// Fallback for dump_map() using one lookup per key.
+    #[cfg(feature = "ebpf")]
+    fn dump_map_by_keys(map: &libbpf_rs::Map, mut dump: MapDump) -> Result<MapDump, anyhow::Error> {
+        for key in map.keys() {
+            let copies = if map.map_type().is_percpu() {
+                map.lookup_percpu(&key, MapFlags::ANY)?
+            } else {
+                map.lookup(&key, MapFlags::ANY)?.map(|value| vec![value])
+            };
+
+            if let Some(copies) = copies {
+                dump.push(&key, &copies);
+            }
+        }
+        Ok(dump)
+    }
+
+    /// Deletes the given keys (concatenated, `key_size` bytes each) in one
+    /// BPF_MAP_DELETE_BATCH call, falling back to per-key deletes.
+    #[cfg(feature = "ebpf")]
+    fn delete_keys(map: &libbpf_rs::Map, keys: &[u8]) -> Result<(), anyhow::Error> {
+        use std::os::fd::{AsFd, AsRawFd};
+        use std::os::raw::c_void;
+
+        let key_size = (map.key_size() as usize).max(1);
+        let mut count = (keys.len() / key_size) as u32;
+        if count == 0 {
+            return Ok(());
+        }
+
+        // SAFETY: keys holds `count` keys of the map's key size.
+        let ret = unsafe {
+            libbpf_sys::bpf_map_delete_batch(
+                map.as_fd().as_raw_fd(),
+                keys.as_ptr() as *const c_void,
+                &mut count,
+                std::ptr::null(),
+            )
+        };
+
+        if ret < 0 {
+            // Keys may already be gone (LRU eviction), so ignore per-key misses
+            for key in keys.chunks_exact(key_size) {
+                let _ = map.delete(key);
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Writes the given keys and values (concatenated, key/value size bytes
+    /// each) in one BPF_MAP_UPDATE_BATCH call, falling back to per-key updates.
+    ///
+    /// Returns the number of entries that could not be written.
+    #[cfg(feature = "ebpf")]
+    fn update_keys(map: &libbpf_rs::Map, keys: &[u8], values: &[u8]) -> usize {
+        use std::os::fd::{AsFd, AsRawFd};
+        use std::os::raw::c_void;
+
+        let key_size = (map.key_size() as usize).max(1);
+        let value_size = (map.value_size() as usize).max(1);
+        let mut count = (keys.len() / key_size) as u32;
+        if count == 0 {
+            return 0;
+        }
+
+        // SAFETY: keys and values hold `count` entries of the map's key and
+        // value sizes.
+        let ret = unsafe {
+            libbpf_sys::bpf_map_update_batch(
+                map.as_fd().as_raw_fd(),
+                keys.as_ptr() as *const c_void,
+                values.as_ptr() as *const c_void,
+                &mut count,
+                std::ptr::null(),
+            )
+        };
+
+        if ret < 0 {
+            // The batch stops at the first failure (usually a full map), so
+            // retry every entry individually
+            return keys
+                .chunks_exact(key_size)
+                .zip(values.chunks_exact(value_size))
+                .filter(|(key, value)| map.update(key, value, MapFlags::ANY).is_err())
+                .count();
+        }
+
+        0
+    }
+
+    /// Reads the keys of exited_map, the stats entries the exit hook marked
+    /// exited. Read before the stats map, so an entry is never seen exited
+    /// without its final counters.
+    #[cfg(feature = "ebpf")]
+    fn read_exited(object: &Object) -> Result<HashSet<[u8; 8]>, anyhow::Error> {
+        let map = Self::find_map(object, "exited_map")
+            .ok_or_else(|| anyhow::anyhow!("exited_map not found"))?;
+        let dump = Self::dump_map(&map)?;
+        Ok(dump
+            .entries()
+            .filter_map(|(key, _)| key.try_into().ok())
+            .collect())
+    }
+
+    /// Deletes flushed keys from exited_map. Called after the stats entries
+    /// are deleted: deleting the key first would let an exit of a reused PID
+    /// claim the old entry again and drop it from the entry count twice.
+    #[cfg(feature = "ebpf")]
+    fn delete_exited(object: &Object, keys: &[u8]) -> Result<(), anyhow::Error> {
+        let map = Self::find_map(object, "exited_map")
+            .ok_or_else(|| anyhow::anyhow!("exited_map not found"))?;
+        Self::delete_keys(&map, keys)
+    }
+
+    /// Reads the map_state bookkeeping array.
+    #[cfg(feature = "ebpf")]
+    fn read_map_state(object: &Object) -> Option<[u64; MAP_STATE_SLOTS]> {
+        let map = Self::find_map(object, "map_state")?;
+        let dump = Self::dump_map(&map).ok()?;
+        let mut state = [0u64; MAP_STATE_SLOTS];
+        for (slot, (_, value)) in state.iter_mut().zip(dump.entries()) {
+            if let Some([v]) = sum_u64_fields::<1>(dump.copies(value)) {
+                *slot = v;
+            }
+        }
+        Some(state)
+    }
+
     /// Returns true if eBPF is enabled and functional.
     pub fn is_enabled(&self) -> bool {
         self.enabled
@@ -365,42 +1101,67 @@ impl EbpfManager {
             let start = Instant::now();
             
             let stats = {
-                let inner = self.inner.lock().unwrap();
-                if let Some(ref inner) = *inner {
+                let mut inner = self.inner.lock().unwrap();
+                if let Some(ref mut inner) = *inner {
+                    let exited = Self::read_exited(&inner.object)?;
                     let map = Self::find_map(&inner.object, "net_stats_map")
                         .ok_or_else(|| anyhow::anyhow!("net_stats_map not found"))?;
-                    let mut stats = Vec::new();
-
-                    for key in map.keys() {
-                        if let Some(value) = map.lookup(&key, MapFlags::ANY)? {
-                            // Convert key Vec<u8> to u32
-                            if key.len() < 4 {
+                    let dump = Self::dump_map(&map)?;
+                    let mut stats = Vec::with_capacity(dump.len() + inner.exited_net.len());
+                    let mut exited_keys = Vec::new();
+                    let mut flushed = Vec::new();
+
+                    for (key, value) in dump.entries() {
+                        // Convert key bytes to u32
+                        if key.len() < 4 {
+                            continue;
+                        }
+                        let pid = u32::from_ne_bytes([key[0], key[1], key[2], key[3]]);
+
+                        // Parse the net_stats struct: 5 u64 fields (40 bytes) + comm
+                        if let Some(data) = sum_u64_fields::<5>(dump.copies(value)) {
+                            let comm = comm_from_copies(dump.copies(value), NET_STATS_COMM_OFFSET)
+                                .or_else(|| Self::read_process_name(pid))
+                                .unwrap_or_else(|| format!("pid_{}", pid));
+
+                            // Fold exited processes into the per-subgroup totals
+                            let flag_key = exited_key(pid, 0);
+                            if exited.contains(&flag_key) {
+                                let id = exited_subgroup(&inner.pid_subgroups, pid, &comm);
+                                add_counters(inner.exited_net.entry(id).or_default(), &data);
+                                exited_keys.extend_from_slice(key);
+                                flushed.extend_from_slice(&flag_key);
                                 continue;
                             }
-                            let pid = u32::from_ne_bytes([key[0], key[1], key[2], key[3]]);
-
-                            // Parse the net_stats struct: 5 u64 fields (40 bytes)
-                            if value.len() >= 40 {
-                                let mut data = [0u64; 5];
-                                for (i, chunk) in value.chunks_exact(8).take(5).enumerate() {
-                                    data[i] = u64::from_ne_bytes(chunk.try_into().unwrap());
-                                }
 
-                                let comm = Self::read_process_name(pid)
-                                    .unwrap_or_else(|| format!("pid_{}", pid));
-
-                                stats.push(ProcessNetStats {
-                                    pid,
-                                    comm,
-                                    rx_bytes: data[0],
-                                    tx_bytes: data[1],
-                                    rx_packets: data[2],
-                                    tx_packets: data[3],
-                                    dropped: data[4],
-                                });
-                            }
+                            stats.push(ProcessNetStats {
+                                pid,
+                                comm,
+                                exited_subgroup: None,
+                                rx_bytes: data[0],
+                                tx_bytes: data[1],
+                                rx_packets: data[2],
+                                tx_packets: data[3],
+                                dropped: data[4],
+                            });
                         }
                     }
+
+                    Self::delete_keys(&map, &exited_keys)?;
+                    Self::delete_exited(&inner.object, &flushed)?;
+
+                    for (&id, data) in &inner.exited_net {
+                        stats.push(ProcessNetStats {
+                            pid: EXITED_PID,
+                            comm: String::new(),
+                            exited_subgroup: Some(id),
+                            rx_bytes: data[0],
+                            tx_bytes: data[1],
+                            rx_packets: data[2],
+                            tx_packets: data[3],
+                            dropped: data[4],
+                        });
+                    }
                     
                     Some(stats)
                 } else {
@@ -433,41 +1194,76 @@ impl EbpfManager {
             let start = Instant::now();
             
             let stats = {
-                let inner = self.inner.lock().unwrap();
-                if let Some(ref inner) = *inner {
+                let mut inner = self.inner.lock().unwrap();
+                if let Some(ref mut inner) = *inner {
+                    let exited = Self::read_exited(&inner.object)?;
                     let map = Self::find_map(&inner.object, "blkio_stats_map")
                         .ok_or_else(|| anyhow::anyhow!("blkio_stats_map not found"))?;
-                    let mut stats = Vec::new();
-
-                    for key in map.keys() {
-                        if let Some(value) = map.lookup(&key, MapFlags::ANY)? {
-                            // Parse key: u32 (pid) = 4 bytes
-                            if key.len() >= 4 {
-                                let pid = u32::from_ne_bytes([key[0], key[1], key[2], key[3]]);
-
-                                // Parse blkio_stats struct: 4 u64 fields (32 bytes)
-                                if value.len() >= 32 {
-                                    let mut data = [0u64; 4];
-                                    for (i, chunk) in value.chunks_exact(8).take(4).enumerate() {
-                                        data[i] = u64::from_ne_bytes(chunk.try_into().unwrap());
-                                    }
-
-                                    let comm = Self::read_process_name(pid)
-                                        .unwrap_or_else(|| format!("pid_{}", pid));
-
-                                    stats.push(ProcessBlkioStats {
-                                        pid,
-                                        comm,
-                                        device: String::from("all"), // No per-device tracking with syscalls
-                                        read_bytes: data[0],
-                                        write_bytes: data[1],
-                                        read_ops: data[2],
-                                        write_ops: data[3],
-                                    });
-                                }
+                    let dump = Self::dump_map(&map)?;
+                    let mut stats = Vec::with_capacity(dump.len() + inner.exited_blkio.len());
+                    let mut exited_keys = Vec::new();
+
+                    for (key, value) in dump.entries() {
+                        // Parse key: struct blkio_key { u32 pid; u32 dev; } = 8 bytes
+                        if key.len() < 8 {
+                            continue;
+                        }
+                        let pid = u32::from_ne_bytes([key[0], key[1], key[2], key[3]]);
+                        let dev = u32::from_ne_bytes([key[4], key[5], key[6], key[7]]);
+
+                        // Parse blkio_stats struct: 4 u64 fields (32 bytes) + comm
+                        if let Some(data) = sum_u64_fields::<4>(dump.copies(value)) {
+                            let comm =
+                                comm_from_copies(dump.copies(value), BLKIO_STATS_COMM_OFFSET)
+                                    .or_else(|| Self::read_process_name(pid))
+                                    .unwrap_or_else(|| format!("pid_{}", pid));
+
+                            // Fold exited processes into the per-subgroup totals
+                            if exited.contains(&exited_key(pid, dev)) {
+                                let id = exited_subgroup(&inner.pid_subgroups, pid, &comm);
+                                add_counters(inner.exited_blkio.entry(id).or_default(), &data);
+                                exited_keys.extend_from_slice(key);
+                                continue;
                             }
+
+                            let device = inner
+                                .device_names
+                                .entry(dev)
+                                .or_insert_with(|| {
+                                    let (major, minor) = split_kernel_dev(dev);
+                                    Self::resolve_device_name(major, minor)
+                                })
+                                .clone();
+
+                            stats.push(ProcessBlkioStats {
+                                pid,
+                                comm,
+                                exited_subgroup: None,
+                                device,
+                                read_bytes: data[0],
+                                write_bytes: data[1],
+                                read_ops: data[2],
+                                write_ops: data[3],
+                            });
                         }
                     }
+
+                    Self::delete_keys(&map, &exited_keys)?;
+                    // blkio_stats_map keys double as exited_map keys
+                    Self::delete_exited(&inner.object, &exited_keys)?;
+
+                    for (&id, data) in &inner.exited_blkio {
+                        stats.push(ProcessBlkioStats {
+                            pid: EXITED_PID,
+                            comm: String::new(),
+                            exited_subgroup: Some(id),
+                            device: String::from("exited"),
+                            read_bytes: data[0],
+                            write_bytes: data[1],
+                            read_ops: data[2],
+                            write_ops: data[3],
+                        });
+                    }
                     
                     Some(stats)
                 } else {
@@ -559,10 +1355,206 @@ impl EbpfManager {
         Ok(TcpStats::default())
     }
 
+    /// Reads the in-kernel I/O histograms of every subgroup with events.
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub fn read_io_histograms(&self) -> Result<Vec<SubgroupIoHistograms>, anyhow::Error> {
+        if !self.enabled {
+            return Ok(Vec::new());
+        }
+
+        #[cfg(feature = "ebpf")]
+        {
+            let start = Instant::now();
+
+            let histograms = {
+                let inner = self.inner.lock().unwrap();
+                match *inner {
+                    Some(ref inner) => {
+                        let map = Self::find_map(&inner.object, "io_hists")
+                            .ok_or_else(|| anyhow::anyhow!("io_hists not found"))?;
+                        Some(parse_io_histograms(&Self::dump_map(&map)?))
+                    }
+                    None => None,
+                }
+            };
+
+            let elapsed_nanos = start.elapsed().as_nanos() as u64;
+            self.record_ebpf_cpu_time(elapsed_nanos);
+
+            if let Some(histograms) = histograms {
+                return Ok(histograms);
+            }
+        }
+
+        Ok(Vec::new())
+    }
+
+    /// Reads the per-cgroup I/O counters of every cgroup with events.
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub fn read_cgroup_io(&self) -> Result<Vec<CgroupIoStats>, anyhow::Error> {
+        if !self.enabled {
+            return Ok(Vec::new());
+        }
+
+        #[cfg(feature = "ebpf")]
+        {
+            let start = Instant::now();
+
+            let stats = {
+                let inner = self.inner.lock().unwrap();
+                match *inner {
+                    Some(ref inner) => {
+                        let map = Self::find_map(&inner.object, "cgroup_io_map")
+                            .ok_or_else(|| anyhow::anyhow!("cgroup_io_map not found"))?;
+                        Some(parse_cgroup_io(&Self::dump_map(&map)?))
+                    }
+                    None => None,
+                }
+            };
+
+            let elapsed_nanos = start.elapsed().as_nanos() as u64;
+            self.record_ebpf_cpu_time(elapsed_nanos);
+
+            if let Some(stats) = stats {
+                return Ok(stats);
+            }
+        }
+
+        Ok(Vec::new())
+    }
+
+    /// Pushes the TGID -> subgroup ID classification of a process scan into
+    /// pid_class_map, so the in-kernel histograms are kept per subgroup.
+    ///
+    /// TGIDs of the previous push that are missing now are removed. Processes
+    /// of the other/unknown subgroup, or with an ID of MAX_HIST_CLASSES or
+    /// more, are not pushed: the kernel counts unclassified TGIDs as
+    /// other/unknown. Every TGID's subgroup is also kept here, so the
+    /// counters of processes exiting before the next scan fold into it.
+    #[cfg_attr(not(feature = "ebpf"), allow(unused_variables))]
+    pub fn push_pid_classes(
+        &self,
+        classes: impl IntoIterator<Item = (u32, u32)>,
+    ) -> Result<(), anyhow::Error> {
+        if !self.enabled {
+            return Ok(());
+        }
+
+        #[cfg(feature = "ebpf")]
+        {
+            let start = Instant::now();
+
+            {
+                let mut inner = self.inner.lock().unwrap();
+                if let Some(ref mut inner) = *inner {
+                    let map = Self::find_map(&inner.object, "pid_class_map")
+                        .ok_or_else(|| anyhow::anyhow!("pid_class_map not found"))?;
+
+                    let has_class = |id: SubgroupId| id != 0 && id < MAX_HIST_CLASSES;
+                    let mut keys = Vec::new();
+                    let mut values = Vec::new();
+                    let mut subgroups = HashMap::new();
+                    for (tgid, id) in classes {
+                        subgroups.insert(tgid, id);
+                        if !has_class(id) {
+                            continue;
+                        }
+                        keys.extend_from_slice(&tgid.to_ne_bytes());
+                        values.extend_from_slice(&id.to_ne_bytes());
+                    }
+
+                    let stale: Vec<u8> = inner
+                        .pid_subgroups
+                        .iter()
+                        .filter(|&(tgid, &id)| {
+                            has_class(id) && !subgroups.get(tgid).is_some_and(|&now| has_class(now))
+                        })
+                        .flat_map(|(tgid, _)| tgid.to_ne_bytes())
+                        .collect();
+                    Self::delete_keys(&map, &stale)?;
+
+                    let failed = Self::update_keys(&map, &keys, &values);
+                    if failed > 0 {
+                        debug!(
+                            "pid_class_map full, {} processes counted as other/unknown",
+                            failed
+                        );
+                    }
+                    inner.pid_subgroups = subgroups;
+                }
+            }
+
+            let elapsed_nanos = start.elapsed().as_nanos() as u64;
+            self.record_ebpf_cpu_time(elapsed_nanos);
+        }
+
+        Ok(())
+    }
+
+    /// Consumes the lifecycle events available in the ring buffer.
+    ///
+    /// Called by the eBPF collector between process scans so the ring buffer
+    /// is drained before it fills up; the events are kept until
+    /// [`take_lifecycle_events`](Self::take_lifecycle_events).
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub fn poll_lifecycle_events(&self) {
+        #[cfg(feature = "ebpf")]
+        if self.enabled {
+            let start = Instant::now();
+
+            {
+                let inner = self.inner.lock().unwrap();
+                if let Some(consumer) = inner.as_ref().and_then(|i| i.lifecycle.as_ref()) {
+                    if let Err(e) = consumer.ring.consume() {
+                        debug!("Failed to consume lifecycle events: {}", e);
+                        consumer.overflowed.store(true, Ordering::Relaxed);
+                    }
+                }
+            }
+
+            let elapsed_nanos = start.elapsed().as_nanos() as u64;
+            self.record_ebpf_cpu_time(elapsed_nanos);
+        }
+    }
+
+    /// Takes the lifecycle events received since the previous call, in the
+    /// order the kernel published them.
+    ///
+    /// Returns None if lifecycle events are not available (eBPF disabled or
+    /// no ring buffer support).
+    pub fn take_lifecycle_events(&self) -> Option<LifecycleBatch> {
+        if !self.enabled {
+            return None;
+        }
+
+        #[cfg(feature = "ebpf")]
+        {
+            self.poll_lifecycle_events();
+
+            let mut inner = self.inner.lock().unwrap();
+            if let Some(ref mut inner) = *inner {
+                let lost = Self::read_map_state(&inner.object).map(|s| s[MAP_LIFECYCLE_LOST]);
+                if let Some(ref mut consumer) = inner.lifecycle {
+                    let events = std::mem::take(&mut *consumer.pending.lock().unwrap());
+                    // Events dropped in the kernel or in the pending list
+                    // leave holes in the process set
+                    let overflowed = consumer.overflowed.swap(false, Ordering::Relaxed);
+                    let complete = !overflowed && lost == Some(consumer.lost_seen);
+                    if let Some(lost) = lost {
+                        consumer.lost_seen = lost;
+                    }
+                    return Some(LifecycleBatch { events, complete });
+                }
+            }
+        }
+
+        None
+    }
+
     /// Resolves device name from major:minor numbers.
     ///
     /// This is used to convert kernel device numbers to names like "sda", "nvme0n1", etc.
-    #[allow(dead_code)]
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
     fn resolve_device_name(major: u32, minor: u32) -> String {
         // Try to read from /proc/diskstats or /sys/dev/block
         let path = format!("/sys/dev/block/{}:{}/uevent", major, minor);
@@ -584,7 +1576,7 @@ impl EbpfManager {
         object.maps().find(|m| m.name().to_str() == Some(name))
     }
 
-    /// Reads process information cache for name resolution.
+    /// Reads the process name from /proc, for entries without an in-kernel comm.
     #[allow(dead_code)]
     fn read_process_name(pid: u32) -> Option<String> {
         std::fs::read_to_string(format!("/proc/{}/comm", pid))
@@ -617,7 +1609,8 @@ impl EbpfManager {
                     &mut inner.last_check,
                     &mut inner.last_event_count,
                 );
-                let map_usage = Self::calculate_map_usage(&inner.object);
+                let map_state = Self::read_map_state(&inner.object).unwrap_or_default();
+                let map_usage = Self::calculate_map_usage(&inner.object, &map_state);
                 
                 // Convert nanoseconds to seconds for export
                 // Note: u64 -> f64 conversion may lose precision for very large values,
@@ -630,7 +1623,11 @@ impl EbpfManager {
                     programs_loaded: 4, // netif_receive_skb, dev_queue_xmit, block_rq_issue, inet_sock_set_state
                     events_per_sec,
                     events_processed_total: inner.last_event_count,
-                    lost_events_total: 0, // TODO: Implement from perf buffer if needed
+                    // Events dropped because a stats map or the lifecycle
+                    // ring buffer was full
+                    lost_events_total: map_state[MAP_NET_FULL]
+                        + map_state[MAP_BLKIO_FULL]
+                        + map_state[MAP_LIFECYCLE_LOST],
                     map_usage_percent: map_usage,
                     cpu_overhead_percent: 0.0, // Deprecated: use ebpf_cpu_seconds_total with rate()
                     ebpf_cpu_seconds_total: cpu_seconds_total,
@@ -660,12 +1657,10 @@ impl EbpfManager {
             let mut total_events = 0u64;
 
             // Sum all event counters (indices 0-3)
-            for idx in 0..4u32 {
-                let key = idx.to_ne_bytes();
-                if let Ok(Some(value)) = map.lookup(&key, MapFlags::ANY) {
-                    if value.len() >= 8 {
-                        let count = u64::from_ne_bytes(value[0..8].try_into().unwrap());
-                        total_events += count;
+            if let Ok(dump) = Self::dump_map(&map) {
+                for (_, value) in dump.entries() {
+                    if let Some([count]) = sum_u64_fields::<1>(dump.copies(value)) {
+                        total_events = total_events.wrapping_add(count);
                     }
                 }
             }
@@ -684,20 +1679,31 @@ impl EbpfManager {
     }
 
     #[cfg(feature = "ebpf")]
-    fn calculate_map_usage(object: &Object) -> f64 {
+    fn calculate_map_usage(object: &Object, map_state: &[u64; MAP_STATE_SLOTS]) -> f64 {
         // Calculate usage for the main maps
         let mut total_usage = 0.0;
         let mut map_count = 0;
 
         for map_name in ["net_stats_map", "blkio_stats_map", "tcp_state_map"] {
             if let Some(map) = Self::find_map(object, map_name) {
-                // Count entries in the map
-                let entry_count = map.keys().count();
-                let max_entries = match map_name {
-                    "net_stats_map" | "blkio_stats_map" => 10240,
-                    "tcp_state_map" => 12,
-                    _ => 1,
+                // Stats maps keep an in-kernel entry count, the TCP map has
+                // at most 12 keys and is dumped in one batch
+                let entry_count = match map_name {
+                    "net_stats_map" => map_state[MAP_NET_ENTRIES],
+                    "blkio_stats_map" => map_state[MAP_BLKIO_ENTRIES],
+                    _ => Self::dump_map(&map).map(|d| d.len() as u64).unwrap_or(0),
                 };
+                let max_entries = map.max_entries();
+                // LRU evictions are not seen by the in-kernel count, but it
+                // only ever overcounts by entries that were evicted; a count
+                // above the map size means it was dropped twice and wrapped
+                if entry_count > max_entries as u64 {
+                    warn!(
+                        "{} entry count {} exceeds its {} entries, not reporting its usage",
+                        map_name, entry_count, max_entries
+                    );
+                    continue;
+                }
 
                 if max_entries > 0 {
                     total_usage += (entry_count as f64 / max_entries as f64) * 100.0;
@@ -714,24 +1720,263 @@ impl EbpfManager {
     }
 }
 
+/// Entries of a BPF map read in bulk: keys and values as flat byte arrays.
+///
+/// Each value holds `copies` slots of `value_stride` bytes (one per possible
+/// CPU for per-CPU maps, a single one otherwise).
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+struct MapDump {
+    key_size: usize,
+    value_stride: usize,
+    copies: usize,
+    keys: Vec<u8>,
+    values: Vec<u8>,
+}
+
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+impl MapDump {
+    fn new(key_size: usize, value_stride: usize, copies: usize) -> Self {
+        Self {
+            key_size: key_size.max(1),
+            value_stride: value_stride.max(1),
+            copies: copies.max(1),
+            keys: Vec::new(),
+            values: Vec::new(),
+        }
+    }
+
+    /// Appends one entry; each copy is truncated or zero-padded to the stride.
+    fn push(&mut self, key: &[u8], copies: &[Vec<u8>]) {
+        self.keys.extend_from_slice(key);
+        self.keys
+            .resize(self.keys.len() - key.len() + self.key_size, 0);
+        for i in 0..self.copies {
+            let copy = copies.get(i).map(Vec::as_slice).unwrap_or(&[]);
+            let len = copy.len().min(self.value_stride);
+            self.values.extend_from_slice(&copy[..len]);
+            self.values
+                .resize(self.values.len() + self.value_stride - len, 0);
+        }
+    }
+
+    fn len(&self) -> usize {
+        self.keys.len() / self.key_size
+    }
+
+    /// Iterates over (key, value) pairs, with all CPU copies in the value.
+    fn entries(&self) -> impl Iterator<Item = (&[u8], &[u8])> {
+        self.keys
+            .chunks_exact(self.key_size)
+            .zip(self.values.chunks_exact(self.value_stride * self.copies))
+    }
+
+    /// Splits a value returned by entries() into its CPU copies.
+    fn copies<'a>(&self, value: &'a [u8]) -> std::slice::ChunksExact<'a, u8> {
+        value.chunks_exact(self.value_stride)
+    }
+}
+
+/// Parses a struct lifecycle_event published by the kernel.
+///
+/// Returns None for records of an unexpected size or type.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn parse_lifecycle_event(data: &[u8]) -> Option<LifecycleEvent> {
+    if data.len() < LIFECYCLE_EVENT_SIZE {
+        return None;
+    }
+    let u32_at = |offset: usize| u32::from_ne_bytes(data[offset..offset + 4].try_into().unwrap());
+    let u64_at = |offset: usize| u64::from_ne_bytes(data[offset..offset + 8].try_into().unwrap());
+
+    let kind = match u32_at(0) {
+        0 => LifecycleKind::Exec,
+        1 => LifecycleKind::Fork,
+        2 => LifecycleKind::Exit,
+        _ => return None,
+    };
+    let comm = &data[LIFECYCLE_EVENT_COMM_OFFSET..LIFECYCLE_EVENT_COMM_OFFSET + COMM_LEN];
+    let comm_len = comm.iter().position(|&b| b == 0).unwrap_or(COMM_LEN);
+
+    Some(LifecycleEvent {
+        kind,
+        tgid: u32_at(4),
+        ppid: u32_at(8),
+        comm: String::from_utf8_lossy(&comm[..comm_len]).into_owned(),
+        start_ticks: ns_to_ticks(u64_at(16), *crate::process::CLK_TCK_HZ),
+        cpu_time_seconds: u64_at(24) as f64 / 1e9,
+        read_bytes: u64_at(32),
+        write_bytes: u64_at(40),
+    })
+}
+
+/// Converts a `start_boottime` in nanoseconds to the clock ticks /proc
+/// reports as `starttime`.
+///
+/// Truncating integer division, as the kernel's `nsec_to_clock_t`, so the
+/// result matches /proc exactly: a float quotient rounds up across a tick
+/// boundary once uptimes exceed the 53-bit mantissa (about 100 days).
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn ns_to_ticks(ns: u64, clk_tck: u64) -> u64 {
+    ns / (1_000_000_000 / clk_tck.max(1))
+}
+
+/// Decodes a map value made of `N` native-endian u64 counters, summing it
+/// across all given copies (one per CPU for per-CPU maps, a single one
+/// otherwise).
+///
+/// Returns None if any copy is too short to hold `N` counters.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn sum_u64_fields<'a, const N: usize>(
+    values: impl IntoIterator<Item = &'a [u8]>,
+) -> Option<[u64; N]> {
+    let mut sums = [0u64; N];
+    for value in values {
+        if value.len() < N * 8 {
+            return None;
+        }
+        for (sum, chunk) in sums.iter_mut().zip(value.chunks_exact(8)) {
+            *sum = sum.wrapping_add(u64::from_ne_bytes(chunk.try_into().unwrap()));
+        }
+    }
+    Some(sums)
+}
+
+/// Groups an io_hists dump (index = class * HIST_KINDS + kind) into
+/// per-subgroup histograms, skipping subgroups without events.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn parse_io_histograms(dump: &MapDump) -> Vec<SubgroupIoHistograms> {
+    let mut classes: Vec<Option<SubgroupIoHistograms>> = vec![None; MAX_HIST_CLASSES as usize];
+
+    for (key, value) in dump.entries() {
+        if key.len() < 4 {
+            continue;
+        }
+        let index = u32::from_ne_bytes([key[0], key[1], key[2], key[3]]) as usize;
+        let fields = match sum_u64_fields::<HIST_FIELDS>(dump.copies(value)) {
+            Some(fields) => fields,
+            None => continue,
+        };
+        if fields[..HIST_SLOTS].iter().all(|&count| count == 0) {
+            continue;
+        }
+
+        let class = index / HIST_KINDS;
+        let histograms = match classes.get_mut(class) {
+            Some(slot) => slot.get_or_insert_with(|| SubgroupIoHistograms {
+                subgroup_id: class as u32,
+                ..Default::default()
+            }),
+            None => continue,
+        };
+        let histogram = match index % HIST_KINDS {
+            0 => &mut histograms.net_latency_ns,
+            1 => &mut histograms.net_size_bytes,
+            _ => &mut histograms.blkio_size_bytes,
+        };
+        histogram.buckets.copy_from_slice(&fields[..HIST_SLOTS]);
+        histogram.sum = fields[HIST_SLOTS];
+    }
+
+    classes.into_iter().flatten().collect()
+}
+
+/// Decodes a cgroup_io_map dump (cgroup ID -> struct cgroup_io).
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn parse_cgroup_io(dump: &MapDump) -> Vec<CgroupIoStats> {
+    dump.entries()
+        .filter_map(|(key, value)| {
+            let cgroup_id = u64::from_ne_bytes(key.get(..8)?.try_into().unwrap());
+            let [rx_bytes, tx_bytes, read_bytes, write_bytes] =
+                sum_u64_fields::<4>(dump.copies(value))?;
+            Some(CgroupIoStats {
+                cgroup_id,
+                rx_bytes,
+                tx_bytes,
+                read_bytes,
+                write_bytes,
+            })
+        })
+        .collect()
+}
+
+/// Returns the exited_map key (struct blkio_key) of a stats entry: the
+/// blkio_stats_map key, or device 0 for the PID's net_stats_map entry.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn exited_key(pid: u32, dev: u32) -> [u8; 8] {
+    let mut key = [0u8; 8];
+    key[..4].copy_from_slice(&pid.to_ne_bytes());
+    key[4..].copy_from_slice(&dev.to_ne_bytes());
+    key
+}
+
+/// Adds `data` to `totals` element-wise.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn add_counters<const N: usize>(totals: &mut [u64; N], data: &[u64; N]) {
+    for (total, value) in totals.iter_mut().zip(data) {
+        *total = total.wrapping_add(*value);
+    }
+}
+
+/// Returns the subgroup the counters of an exited process fold into: the one
+/// of the last classification push, or that of its `comm` if no scan saw it.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn exited_subgroup(pid_subgroups: &HashMap<u32, SubgroupId>, pid: u32, comm: &str) -> SubgroupId {
+    match pid_subgroups.get(&pid) {
+        Some(&id) => id,
+        None => crate::process::classify_comm(comm),
+    }
+}
+
+/// Extracts the NUL-terminated comm stored at `offset` in a map value.
+///
+/// For per-CPU maps only the CPU that created the entry has the comm set,
+/// so the first non-empty copy wins.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn comm_from_copies<'a>(
+    values: impl IntoIterator<Item = &'a [u8]>,
+    offset: usize,
+) -> Option<String> {
+    values.into_iter().find_map(|value| {
+        let raw = value.get(offset..offset + COMM_LEN)?;
+        let end = raw.iter().position(|&b| b == 0).unwrap_or(COMM_LEN);
+        if end == 0 {
+            None
+        } else {
+            Some(String::from_utf8_lossy(&raw[..end]).into_owned())
+        }
+    })
+}
+
+/// Splits a kernel-internal dev_t (as seen by BPF programs) into major and
+/// minor numbers. The kernel uses 12 bits for major and 20 bits for minor.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn split_kernel_dev(dev: u32) -> (u32, u32) {
+    (dev >> 20, dev & ((1 << 20) - 1))
+}
+
 /// Helper function to aggregate I/O stats by group/subgroup.
+///
+/// Processes found in `processes` keep their scan classification; others are
+/// classified by `comm`.
 #[allow(dead_code)] // Future enhancement for advanced I/O analysis
 pub fn aggregate_io_by_subgroup(
+    processes: &ahash::AHashMap<u32, ProcMem>,
     net_stats: &[ProcessNetStats],
     blkio_stats: &[ProcessBlkioStats],
 ) -> (
     HashMap<(String, String), (u64, u64)>, // (group, subgroup) -> (rx_bytes, tx_bytes)
     HashMap<(String, String), (u64, u64)>, // (group, subgroup) -> (read_bytes, write_bytes)
 ) {
-    use crate::process::classify_process_raw;
+    use crate::process::registered_subgroups;
+
+    let subgroups = registered_subgroups();
 
     let mut net_agg = HashMap::new();
     let mut blkio_agg = HashMap::new();
 
     // Aggregate network stats
     for stat in net_stats {
-        let (group, subgroup) = classify_process_raw(&stat.comm);
-        let key = (group.to_string(), subgroup.to_string());
+        let info = &subgroups[stat.subgroup_id(processes) as usize];
+        let key = (info.group.to_string(), info.subgroup.to_string());
         let entry = net_agg.entry(key).or_insert((0u64, 0u64));
         entry.0 += stat.rx_bytes;
         entry.1 += stat.tx_bytes;
@@ -739,8 +1984,8 @@ pub fn aggregate_io_by_subgroup(
 
     // Aggregate block I/O stats
     for stat in blkio_stats {
-        let (group, subgroup) = classify_process_raw(&stat.comm);
-        let key = (group.to_string(), subgroup.to_string());
+        let info = &subgroups[stat.subgroup_id(processes) as usize];
+        let key = (info.group.to_string(), info.subgroup.to_string());
         let entry = blkio_agg.entry(key).or_insert((0u64, 0u64));
         entry.0 += stat.read_bytes;
         entry.1 += stat.write_bytes;
@@ -752,6 +1997,7 @@ pub fn aggregate_io_by_subgroup(
 /// Calculate top-N processes by I/O.
 #[allow(dead_code)] // Future enhancement for I/O ranking
 pub fn calculate_top_io_processes(
+    processes: &ahash::AHashMap<u32, ProcMem>,
     net_stats: &[ProcessNetStats],
     blkio_stats: &[ProcessBlkioStats],
     n: usize,
@@ -759,36 +2005,37 @@ pub fn calculate_top_io_processes(
     Vec<ProcessNetStats>,   // Top-N by network I/O
     Vec<ProcessBlkioStats>, // Top-N by block I/O
 ) {
-    use crate::process::classify_process_raw;
+    use crate::process::registered_subgroups;
+    use crate::topk::TopK;
 
-    // Group by subgroup
-    let mut net_by_subgroup: HashMap<(String, String), Vec<ProcessNetStats>> = HashMap::new();
-    let mut blkio_by_subgroup: HashMap<(String, String), Vec<ProcessBlkioStats>> = HashMap::new();
+    let subgroups = registered_subgroups();
+
+    // Bounded top-N per subgroup, indexed by subgroup ID
+    let mut net_by_subgroup: Vec<TopK<u64, &ProcessNetStats>> =
+        (0..subgroups.len()).map(|_| TopK::new(n)).collect();
+    let mut blkio_by_subgroup: Vec<TopK<u64, &ProcessBlkioStats>> =
+        (0..subgroups.len()).map(|_| TopK::new(n)).collect();
 
     for stat in net_stats {
-        let (group, subgroup) = classify_process_raw(&stat.comm);
-        let key = (group.to_string(), subgroup.to_string());
-        net_by_subgroup.entry(key).or_default().push(stat.clone());
+        let id = stat.subgroup_id(processes) as usize;
+        net_by_subgroup[id].push(stat.rx_bytes + stat.tx_bytes, stat);
     }
 
     for stat in blkio_stats {
-        let (group, subgroup) = classify_process_raw(&stat.comm);
-        let key = (group.to_string(), subgroup.to_string());
-        blkio_by_subgroup.entry(key).or_default().push(stat.clone());
+        let id = stat.subgroup_id(processes) as usize;
+        blkio_by_subgroup[id].push(stat.read_bytes + stat.write_bytes, stat);
     }
 
-    // Get top-N from each subgroup
-    let mut top_net = Vec::new();
-    for (_, mut stats) in net_by_subgroup {
-        stats.sort_by_key(|s| std::cmp::Reverse(s.rx_bytes + s.tx_bytes));
-        top_net.extend(stats.into_iter().take(n));
-    }
-
-    let mut top_blkio = Vec::new();
-    for (_, mut stats) in blkio_by_subgroup {
-        stats.sort_by_key(|s| std::cmp::Reverse(s.read_bytes + s.write_bytes));
-        top_blkio.extend(stats.into_iter().take(n));
-    }
+    let top_net = net_by_subgroup
+        .into_iter()
+        .flat_map(TopK::into_vec)
+        .map(|(_, stat)| stat.clone())
+        .collect();
+    let top_blkio = blkio_by_subgroup
+        .into_iter()
+        .flat_map(TopK::into_vec)
+        .map(|(_, stat)| stat.clone())
+        .collect();
 
     (top_net, top_blkio)
 }
@@ -814,6 +2061,234 @@ mod tests {
         assert!(net_stats.is_empty());
         assert!(blkio_stats.is_empty());
         assert_eq!(tcp_stats.established, 0);
+        assert!(manager.read_io_histograms().unwrap().is_empty());
+        assert!(manager.push_pid_classes([(1, 3)]).is_ok());
+    }
+
+    fn u64_bytes(values: &[u64]) -> Vec<u8> {
+        values.iter().flat_map(|v| v.to_ne_bytes()).collect()
+    }
+
+    #[test]
+    fn test_sum_u64_fields_single_value() {
+        let value = u64_bytes(&[10, 20, 30]);
+        assert_eq!(sum_u64_fields::<3>([value.as_slice()]), Some([10, 20, 30]));
+    }
+
+    #[test]
+    fn test_sum_u64_fields_percpu_values() {
+        let cpu0 = u64_bytes(&[1, 2]);
+        let cpu1 = u64_bytes(&[100, 200]);
+        let cpu2 = vec![0u8; 16];
+        assert_eq!(
+            sum_u64_fields::<2>([cpu0.as_slice(), &cpu1, &cpu2]),
+            Some([101, 202])
+        );
+    }
+
+    #[test]
+    fn test_sum_u64_fields_short_value() {
+        assert_eq!(sum_u64_fields::<2>([&[0u8; 12][..]]), None);
+        assert_eq!(sum_u64_fields::<2>([]), Some([0, 0]));
+    }
+
+    #[test]
+    fn test_comm_from_copies() {
+        let mut with_comm = u64_bytes(&[1, 2, 3, 4]);
+        with_comm.extend_from_slice(b"postgres\0\0\0\0\0\0\0\0");
+        let without_comm = vec![0u8; 48];
+
+        assert_eq!(
+            comm_from_copies(
+                [without_comm.as_slice(), &with_comm],
+                BLKIO_STATS_COMM_OFFSET
+            ),
+            Some("postgres".to_string())
+        );
+        assert_eq!(
+            comm_from_copies([without_comm.as_slice()], BLKIO_STATS_COMM_OFFSET),
+            None
+        );
+    }
+
+    #[test]
+    fn test_exited_key() {
+        let key = exited_key(7, 0x0080_0001);
+        assert_eq!(&key[..4], &7u32.to_ne_bytes());
+        assert_eq!(&key[4..], &0x0080_0001u32.to_ne_bytes());
+        // The net entry of a PID never collides with one of its devices
+        assert_ne!(exited_key(7, 0), key);
+    }
+
+    #[test]
+    fn test_parse_lifecycle_event() {
+        let mut data = vec![0u8; LIFECYCLE_EVENT_SIZE];
+        data[0..4].copy_from_slice(&2u32.to_ne_bytes());
+        data[4..8].copy_from_slice(&1234u32.to_ne_bytes());
+        data[8..12].copy_from_slice(&1u32.to_ne_bytes());
+        data[16..24].copy_from_slice(&5_000_000_000u64.to_ne_bytes());
+        data[24..32].copy_from_slice(&1_500_000_000u64.to_ne_bytes());
+        data[32..40].copy_from_slice(&4096u64.to_ne_bytes());
+        data[40..48].copy_from_slice(&8192u64.to_ne_bytes());
+        data[LIFECYCLE_EVENT_COMM_OFFSET..LIFECYCLE_EVENT_COMM_OFFSET + 5]
+            .copy_from_slice(b"nginx");
+
+        let event = parse_lifecycle_event(&data).unwrap();
+        assert_eq!(event.kind, LifecycleKind::Exit);
+        assert_eq!(event.tgid, 1234);
+        assert_eq!(event.ppid, 1);
+        assert_eq!(event.comm, "nginx");
+        assert_eq!(event.start_ticks, 5 * *crate::process::CLK_TCK_HZ);
+        assert!((event.cpu_time_seconds - 1.5).abs() < 1e-9);
+        assert_eq!((event.read_bytes, event.write_bytes), (4096, 8192));
+
+        // Unknown types and short records are rejected
+        data[0..4].copy_from_slice(&7u32.to_ne_bytes());
+        assert!(parse_lifecycle_event(&data).is_none());
+        assert!(parse_lifecycle_event(&data[..32]).is_none());
+    }
+
+    #[test]
+    fn test_ns_to_ticks_truncates_at_tick_boundary() {
+        // About 115 days of uptime at 100 Hz, one nanosecond before a tick;
+        // `ns as f64` rounds this up to the next tick
+        let k = 1_000_000_000u64;
+        assert_eq!(ns_to_ticks(k * 10_000_000 - 1, 100), k - 1);
+        assert_eq!(ns_to_ticks(k * 10_000_000, 100), k);
+        assert_eq!(ns_to_ticks(5_000_000_000, 250), 1250);
+    }
+
+    #[test]
+    fn test_add_counters() {
+        let mut totals = [1u64, 2, 3, 4];
+        add_counters(&mut totals, &[10, 20, 30, 40]);
+        assert_eq!(totals, [11, 22, 33, 44]);
+    }
+
+    #[test]
+    fn test_map_dump_entries() {
+        // Per-CPU map with 2 CPUs, u32 keys and 12-byte values padded to 16
+        let mut dump = MapDump::new(4, 16, 2);
+        dump.push(&7u32.to_ne_bytes(), &[u64_bytes(&[5]), u64_bytes(&[6])]);
+        dump.push(&9u32.to_ne_bytes(), &[u64_bytes(&[1])]);
+
+        assert_eq!(dump.len(), 2);
+        let entries: Vec<_> = dump.entries().collect();
+        assert_eq!(entries[0].0, 7u32.to_ne_bytes());
+        assert_eq!(sum_u64_fields::<1>(dump.copies(entries[0].1)), Some([11]));
+        assert_eq!(entries[1].0, 9u32.to_ne_bytes());
+        assert_eq!(sum_u64_fields::<1>(dump.copies(entries[1].1)), Some([1]));
+    }
+
+    #[test]
+    fn test_parse_io_histograms() {
+        fn hist_value(slot: usize, count: u64, sum: u64) -> Vec<u8> {
+            let mut fields = [0u64; HIST_FIELDS];
+            fields[slot] = count;
+            fields[HIST_SLOTS] = sum;
+            u64_bytes(&fields)
+        }
+
+        // Per-CPU map with 2 CPUs: class 0 blkio size, class 5 net latency
+        // and size, class 2 without events
+        let stride = HIST_FIELDS * 8;
+        let mut dump = MapDump::new(4, stride, 2);
+        let index = |class: usize, kind: usize| ((class * HIST_KINDS + kind) as u32).to_ne_bytes();
+        dump.push(
+            &index(0, 2),
+            &[hist_value(12, 1, 4096), hist_value(12, 2, 8192)],
+        );
+        dump.push(&index(2, 0), &[vec![0u8; stride], vec![0u8; stride]]);
+        dump.push(
+            &index(5, 0),
+            &[hist_value(10, 3, 3000), hist_value(20, 1, 1 << 20)],
+        );
+        dump.push(&index(5, 1), &[hist_value(6, 4, 400)]);
+
+        let histograms = parse_io_histograms(&dump);
+        assert_eq!(histograms.len(), 2);
+
+        assert_eq!(histograms[0].subgroup_id, 0);
+        assert_eq!(histograms[0].blkio_size_bytes.buckets[12], 3);
+        assert_eq!(histograms[0].blkio_size_bytes.sum, 12288);
+        assert_eq!(histograms[0].net_latency_ns.count(), 0);
+
+        let latency = &histograms[1].net_latency_ns;
+        assert_eq!(histograms[1].subgroup_id, 5);
+        assert_eq!((latency.buckets[10], latency.buckets[20]), (3, 1));
+        assert_eq!(latency.count(), 4);
+        assert_eq!(latency.sum, 3000 + (1 << 20));
+        assert_eq!(histograms[1].net_size_bytes.count(), 4);
+    }
+
+    #[test]
+    fn test_parse_cgroup_io() {
+        // Per-CPU map with 2 CPUs
+        let mut dump = MapDump::new(8, 32, 2);
+        dump.push(
+            &42u64.to_ne_bytes(),
+            &[u64_bytes(&[100, 10, 4096, 0]), u64_bytes(&[50, 0, 0, 8192])],
+        );
+
+        assert_eq!(
+            parse_cgroup_io(&dump),
+            vec![CgroupIoStats {
+                cgroup_id: 42,
+                rx_bytes: 150,
+                tx_bytes: 10,
+                read_bytes: 4096,
+                write_bytes: 8192,
+            }]
+        );
+    }
+
+    #[test]
+    fn test_log2_histogram_upper_bounds() {
+        assert_eq!(Log2Histogram::upper_bound(0), Some(1));
+        assert_eq!(Log2Histogram::upper_bound(1), Some(3));
+        assert_eq!(Log2Histogram::upper_bound(9), Some(1023));
+        assert_eq!(
+            Log2Histogram::upper_bound(HIST_SLOTS - 2),
+            Some((1 << (HIST_SLOTS - 1)) - 1)
+        );
+        assert_eq!(Log2Histogram::upper_bound(HIST_SLOTS - 1), None);
+    }
+
+    #[cfg(feature = "ebpf")]
+    #[test]
+    fn test_rodata_layout_finds_settings() {
+        // Opening the object parses its BTF and needs no privileges
+        let open_obj = ObjectBuilder::default().open_memory(EBPF_OBJECT).unwrap();
+        let layout = EbpfManager::rodata_layout(&open_obj).unwrap();
+        for name in ["percpu_maps", "cgroup_io", "net_latency"] {
+            assert_eq!(layout.get(name).map(|&(_, size)| size), Some(1), "{}", name);
+        }
+        assert_eq!(layout.get("cgroup_level").map(|&(_, size)| size), Some(4));
+    }
+
+    #[test]
+    fn test_exited_subgroup() {
+        let pid_subgroups: HashMap<u32, SubgroupId> = [(7, 3)].into_iter().collect();
+        // The scan's classification wins over the comm
+        assert_eq!(exited_subgroup(&pid_subgroups, 7, "bash"), 3);
+        assert_eq!(
+            exited_subgroup(&pid_subgroups, 8, "bash"),
+            crate::process::classify_comm("bash")
+        );
+
+        let totals = ProcessNetStats {
+            pid: EXITED_PID,
+            exited_subgroup: Some(3),
+            ..Default::default()
+        };
+        assert_eq!(totals.subgroup_id(&ahash::AHashMap::new()), 3);
+    }
+
+    #[test]
+    fn test_split_kernel_dev() {
+        // sda = 8:0, nvme0n1p2 = 259:2
+        assert_eq!(split_kernel_dev(8 << 20), (8, 0));
+        assert_eq!(split_kernel_dev((259 << 20) | 2), (259, 2));
     }
 
     #[test]
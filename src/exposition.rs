@@ -0,0 +1,604 @@
+//! Rendered `/metrics` bodies and content negotiation.
+//!
+//! A render gathers the registry once. The text body is encoded right away;
+//! the protobuf and OpenMetrics formats and their gzip/zstd variants are
+//! encoded on first request and kept with the render, so each variant costs
+//! one encode per scrape generation no matter how many scrapers ask for it.
+
+use axum::body::Bytes;
+use axum::http::{header, HeaderMap, HeaderValue};
+use once_cell::sync::Lazy;
+use prometheus::proto::{LabelPair, Metric, MetricFamily, MetricType};
+use prometheus::{Encoder, ProtobufEncoder, TextEncoder, PROTOBUF_FORMAT, TEXT_FORMAT};
+use std::fmt::Write as _;
+use std::io::Write as _;
+use std::sync::OnceLock;
+use std::time::{Duration, Instant};
+use tracing::warn;
+
+/// Buffer capacity for metrics encoding.
+pub const BUFFER_CAP: usize = 512 * 1024;
+
+/// Content type of the OpenMetrics text format.
+const OPENMETRICS_FORMAT: &str = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+/// ETag prefix unique to this exporter run, so generations restarting at 1
+/// after a restart never match a client's cached ETag.
+static ETAG_PREFIX: Lazy<String> =
+    Lazy::new(|| format!("{:x}", chrono::Utc::now().timestamp_millis()));
+
+/// Exposition format selected from the `Accept` header.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Format {
+    Text,
+    Protobuf,
+    OpenMetrics,
+}
+
+impl Format {
+    pub fn content_type(self) -> &'static str {
+        match self {
+            Format::Text => TEXT_FORMAT,
+            Format::Protobuf => PROTOBUF_FORMAT,
+            Format::OpenMetrics => OPENMETRICS_FORMAT,
+        }
+    }
+
+    fn etag_suffix(self) -> &'static str {
+        match self {
+            Format::Text => "t",
+            Format::Protobuf => "p",
+            Format::OpenMetrics => "o",
+        }
+    }
+
+    /// Picks the format with the highest quality in `Accept`; text if none
+    /// of the supported formats is acceptable.
+    pub fn negotiate(headers: &HeaderMap) -> Format {
+        let mut best = (Format::Text, 0.0);
+        for range in media_ranges(headers, header::ACCEPT) {
+            let format = match range.value {
+                "application/vnd.google.protobuf"
+                    if range.param("proto") == Some("io.prometheus.client.MetricFamily")
+                        && range.param("encoding") == Some("delimited") =>
+                {
+                    Format::Protobuf
+                }
+                "application/openmetrics-text" => Format::OpenMetrics,
+                "text/plain" | "text/*" | "*/*" => Format::Text,
+                _ => continue,
+            };
+            if range.q > best.1 {
+                best = (format, range.q);
+            }
+        }
+        best.0
+    }
+}
+
+/// Content coding selected from the `Accept-Encoding` header.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Encoding {
+    Identity,
+    Gzip,
+    Zstd,
+}
+
+impl Encoding {
+    /// Value of the `Content-Encoding` header, if any.
+    pub fn header_value(self) -> Option<&'static str> {
+        match self {
+            Encoding::Identity => None,
+            Encoding::Gzip => Some("gzip"),
+            Encoding::Zstd => Some("zstd"),
+        }
+    }
+
+    fn etag_suffix(self) -> &'static str {
+        match self {
+            Encoding::Identity => "",
+            Encoding::Gzip => "-gz",
+            Encoding::Zstd => "-zst",
+        }
+    }
+
+    /// Picks the coding with the highest quality in `Accept-Encoding`,
+    /// preferring zstd over gzip on ties.
+    pub fn negotiate(headers: &HeaderMap) -> Encoding {
+        let mut best = (Encoding::Identity, 0.0);
+        for range in media_ranges(headers, header::ACCEPT_ENCODING) {
+            let encoding = match range.value {
+                "zstd" => Encoding::Zstd,
+                "gzip" | "x-gzip" => Encoding::Gzip,
+                _ => continue,
+            };
+            let better = range.q > best.1
+                || (range.q == best.1 && range.q > 0.0 && encoding == Encoding::Zstd);
+            if better {
+                best = (encoding, range.q);
+            }
+        }
+        best.0
+    }
+}
+
+/// One comma-separated element of an `Accept` style header.
+struct MediaRange<'a> {
+    value: &'a str,
+    params: Vec<(&'a str, &'a str)>,
+    q: f32,
+}
+
+impl<'a> MediaRange<'a> {
+    fn param(&self, name: &str) -> Option<&'a str> {
+        self.params
+            .iter()
+            .find(|(key, _)| key.eq_ignore_ascii_case(name))
+            .map(|(_, value)| *value)
+    }
+}
+
+/// Parses all values of header `name`; ranges with `q=0` are dropped.
+fn media_ranges(headers: &HeaderMap, name: header::HeaderName) -> Vec<MediaRange<'_>> {
+    headers
+        .get_all(name)
+        .iter()
+        .filter_map(|value| value.to_str().ok())
+        .flat_map(|value| value.split(','))
+        .filter_map(|element| {
+            let mut parts = element.split(';').map(str::trim);
+            let value = parts.next().filter(|v| !v.is_empty())?;
+            let mut range = MediaRange {
+                value,
+                params: Vec::new(),
+                q: 1.0,
+            };
+            for param in parts {
+                if let Some((key, val)) = param.split_once('=') {
+                    let (key, val) = (key.trim(), val.trim().trim_matches('"'));
+                    if key.eq_ignore_ascii_case("q") {
+                        range.q = val.parse().unwrap_or(0.0);
+                    } else {
+                        range.params.push((key, val));
+                    }
+                }
+            }
+            (range.q > 0.0).then_some(range)
+        })
+        .collect()
+}
+
+/// Pre-rendered `/metrics` bodies shared by all scrapes until the next render.
+pub struct RenderedMetrics {
+    families: Vec<MetricFamily>,
+    /// Bodies per format and encoding, encoded on first use.
+    /// `None` if compressing failed.
+    variants: [[OnceLock<Option<Bytes>>; 3]; 3],
+    /// Number of renders since startup; exported as `scrape_generation`.
+    pub generation: u64,
+    pub last_modified: HeaderValue,
+    /// `last_updated` of the cache snapshot the body was rendered from.
+    pub cache_updated: Option<Instant>,
+    /// Generation of the system snapshot the body was rendered from.
+    pub system_generation: u64,
+    /// When the body was rendered.
+    pub rendered_at: Instant,
+}
+
+impl RenderedMetrics {
+    /// Wraps a gathered registry and its already encoded text body.
+    pub fn new(
+        families: Vec<MetricFamily>,
+        text: Bytes,
+        generation: u64,
+        cache_updated: Option<Instant>,
+        system_generation: u64,
+    ) -> Self {
+        let last_modified = chrono::Utc::now()
+            .format("%a, %d %b %Y %H:%M:%S GMT")
+            .to_string();
+        let rendered = Self {
+            families,
+            variants: Default::default(),
+            generation,
+            last_modified: HeaderValue::from_str(&last_modified)
+                .expect("HTTP date is a valid header value"),
+            cache_updated,
+            system_generation,
+            rendered_at: Instant::now(),
+        };
+        rendered.variants[Format::Text as usize][Encoding::Identity as usize]
+            .get_or_init(|| Some(text));
+        rendered
+    }
+
+    /// The gathered registry the bodies are encoded from.
+    pub fn families(&self) -> &[MetricFamily] {
+        &self.families
+    }
+
+    /// Whether the body can still be served for the cache snapshot
+    /// `cache_updated` and system snapshot generation `system_generation`.
+    ///
+    /// A new cache snapshot always needs a render. System collectors publish
+    /// at staggered offsets, so newer system values only do once the body is
+    /// `coalesce` old: every publication within that window is picked up by
+    /// one render instead of one render each.
+    pub fn is_fresh(
+        &self,
+        cache_updated: Option<Instant>,
+        system_generation: u64,
+        coalesce: Duration,
+    ) -> bool {
+        self.cache_updated == cache_updated
+            && (self.system_generation == system_generation
+                || self.rendered_at.elapsed() < coalesce)
+    }
+
+    /// Strong ETag of one representation of this render.
+    pub fn etag(&self, format: Format, encoding: Encoding) -> HeaderValue {
+        HeaderValue::from_str(&format!(
+            "\"{}-{}{}{}\"",
+            *ETAG_PREFIX,
+            self.generation,
+            format.etag_suffix(),
+            encoding.etag_suffix()
+        ))
+        .expect("ETag is a valid header value")
+    }
+
+    /// Returns the body in `format` and `encoding`, encoding it on first use,
+    /// with the encoding it is in: identity if compressing it failed, so a
+    /// partial stream is never served.
+    pub fn body(&self, format: Format, encoding: Encoding) -> (Encoding, Bytes) {
+        let body =
+            self.variants[format as usize][encoding as usize].get_or_init(|| match encoding {
+                Encoding::Identity => Some(Bytes::from(self.encode(format))),
+                _ => {
+                    let (_, plain) = self.body(format, Encoding::Identity);
+                    compress(&plain, encoding)
+                        .map_err(|e| warn!("Failed to compress metrics with {:?}: {}", encoding, e))
+                        .ok()
+                        .map(Bytes::from)
+                }
+            });
+        match body {
+            Some(body) => (encoding, body.clone()),
+            None => self.body(format, Encoding::Identity),
+        }
+    }
+
+    /// Encodes the gathered families in `format`.
+    fn encode(&self, format: Format) -> Vec<u8> {
+        let mut buffer = Vec::with_capacity(BUFFER_CAP);
+        let result = match format {
+            Format::Text => TextEncoder::new().encode(&self.families, &mut buffer),
+            Format::Protobuf => ProtobufEncoder::new().encode(&self.families, &mut buffer),
+            Format::OpenMetrics => {
+                encode_openmetrics(&self.families, &mut buffer);
+                Ok(())
+            }
+        };
+        if let Err(e) = result {
+            warn!("Failed to encode metrics as {:?}: {}", format, e);
+        }
+        buffer
+    }
+
+    /// Number of variants encoded so far.
+    #[cfg(test)]
+    fn encoded_variants(&self) -> usize {
+        self.variants
+            .iter()
+            .flatten()
+            .filter(|variant| variant.get().is_some())
+            .count()
+    }
+}
+
+/// Compresses `plain` with `encoding`.
+fn compress(plain: &[u8], encoding: Encoding) -> std::io::Result<Vec<u8>> {
+    let mut out = Vec::with_capacity(plain.len() / 4);
+    let result = match encoding {
+        Encoding::Identity => {
+            out.extend_from_slice(plain);
+            Ok(())
+        }
+        Encoding::Gzip => {
+            let mut encoder =
+                flate2::write::GzEncoder::new(&mut out, flate2::Compression::default());
+            encoder
+                .write_all(plain)
+                .and_then(|_| encoder.finish().map(|_| ()))
+        }
+        Encoding::Zstd => zstd::stream::copy_encode(plain, &mut out, 0),
+    };
+    result.map(|_| out)
+}
+
+/// Encodes counter, gauge, untyped and histogram families as OpenMetrics
+/// text.
+///
+/// The registry holds no summaries; other family types are skipped. Counter
+/// families are named without their `_total` suffix, as OpenMetrics
+/// requires.
+fn encode_openmetrics(families: &[MetricFamily], out: &mut Vec<u8>) {
+    let mut text = String::with_capacity(BUFFER_CAP);
+    for family in families {
+        let name = family.get_name();
+        let (kind, base) = match family.get_field_type() {
+            MetricType::COUNTER => ("counter", name.strip_suffix("_total").unwrap_or(name)),
+            MetricType::GAUGE => ("gauge", name),
+            MetricType::UNTYPED => ("unknown", name),
+            MetricType::HISTOGRAM => ("histogram", name),
+            _ => continue,
+        };
+
+        if !family.get_help().is_empty() {
+            let _ = writeln!(text, "# HELP {} {}", base, escape(family.get_help()));
+        }
+        let _ = writeln!(text, "# TYPE {} {}", base, kind);
+
+        for metric in family.get_metric() {
+            let value = match family.get_field_type() {
+                MetricType::COUNTER => metric.get_counter().get_value(),
+                MetricType::GAUGE => metric.get_gauge().get_value(),
+                MetricType::HISTOGRAM => {
+                    push_histogram(&mut text, base, metric);
+                    continue;
+                }
+                _ => metric.get_untyped().get_value(),
+            };
+            let suffix = if kind == "counter" { "_total" } else { "" };
+            push_sample(&mut text, base, suffix, metric.get_label(), None, value);
+        }
+    }
+    text.push_str("# EOF\n");
+    out.extend_from_slice(text.as_bytes());
+}
+
+/// Appends the `_bucket`, `_count` and `_sum` samples of a histogram,
+/// adding the `+Inf` bucket if the metric has none.
+fn push_histogram(text: &mut String, base: &str, metric: &Metric) {
+    let histogram = metric.get_histogram();
+    let labels = metric.get_label();
+    let count = histogram.get_sample_count() as f64;
+
+    let mut inf_seen = false;
+    let mut le = String::new();
+    for bucket in histogram.get_bucket() {
+        let upper_bound = bucket.get_upper_bound();
+        inf_seen |= upper_bound == f64::INFINITY;
+        le.clear();
+        push_value(&mut le, upper_bound);
+        let cumulative = bucket.get_cumulative_count() as f64;
+        push_sample(text, base, "_bucket", labels, Some(&le), cumulative);
+    }
+    if !inf_seen {
+        push_sample(text, base, "_bucket", labels, Some("+Inf"), count);
+    }
+
+    push_sample(text, base, "_count", labels, None, count);
+    push_sample(text, base, "_sum", labels, None, histogram.get_sample_sum());
+}
+
+/// Appends one sample line of `base` + `suffix`, with an `le` label after
+/// the metric's labels for histogram buckets.
+fn push_sample(
+    text: &mut String,
+    base: &str,
+    suffix: &str,
+    labels: &[LabelPair],
+    le: Option<&str>,
+    value: f64,
+) {
+    text.push_str(base);
+    text.push_str(suffix);
+    if !labels.is_empty() || le.is_some() {
+        text.push('{');
+        for (i, label) in labels.iter().enumerate() {
+            if i > 0 {
+                text.push(',');
+            }
+            let _ = write!(
+                text,
+                "{}=\"{}\"",
+                label.get_name(),
+                escape(label.get_value())
+            );
+        }
+        if let Some(le) = le {
+            if !labels.is_empty() {
+                text.push(',');
+            }
+            let _ = write!(text, "le=\"{}\"", le);
+        }
+        text.push('}');
+    }
+    text.push(' ');
+    push_value(text, value);
+    text.push('\n');
+}
+
+/// Escapes backslashes, double quotes and newlines in HELP texts and label
+/// values.
+fn escape(value: &str) -> String {
+    value
+        .replace('\\', "\\\\")
+        .replace('"', "\\\"")
+        .replace('\n', "\\n")
+}
+
+fn push_value(text: &mut String, value: f64) {
+    if value.is_nan() {
+        text.push_str("NaN");
+    } else if value.is_infinite() {
+        text.push_str(if value > 0.0 { "+Inf" } else { "-Inf" });
+    } else {
+        let _ = write!(text, "{}", value);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use prometheus::{CounterVec, Gauge, HistogramOpts, HistogramVec, Opts, Registry};
+    use std::io::Read;
+
+    fn headers(name: header::HeaderName, value: &'static str) -> HeaderMap {
+        let mut headers = HeaderMap::new();
+        headers.insert(name, HeaderValue::from_static(value));
+        headers
+    }
+
+    fn rendered() -> RenderedMetrics {
+        let registry = Registry::new();
+        let gauge = Gauge::new("test_gauge", "A gauge").unwrap();
+        gauge.set(2.5);
+        let counter =
+            CounterVec::new(Opts::new("test_bytes_total", "Bytes \"read\""), &["device"]).unwrap();
+        counter.with_label_values(&["sd\"a"]).inc_by(4.0);
+        registry.register(Box::new(gauge)).unwrap();
+        registry.register(Box::new(counter)).unwrap();
+
+        let families = registry.gather();
+        let mut text = Vec::new();
+        TextEncoder::new().encode(&families, &mut text).unwrap();
+        RenderedMetrics::new(families, Bytes::from(text), 3, None, 7)
+    }
+
+    #[test]
+    fn test_is_fresh() {
+        let rendered = rendered();
+        let interval = Duration::from_secs(5);
+        assert!(rendered.is_fresh(None, 7, interval));
+        // Collector publications within the interval share the render
+        assert!(rendered.is_fresh(None, 8, interval));
+        assert!(!rendered.is_fresh(None, 8, Duration::ZERO));
+        // A new process scan always makes the body stale
+        assert!(!rendered.is_fresh(Some(Instant::now()), 7, interval));
+    }
+
+    #[test]
+    fn test_format_negotiation() {
+        assert_eq!(Format::negotiate(&HeaderMap::new()), Format::Text);
+        assert_eq!(
+            Format::negotiate(&headers(
+                header::ACCEPT,
+                "application/openmetrics-text;version=1.0.0,text/plain;version=0.0.4;q=0.5,*/*;q=0.1"
+            )),
+            Format::OpenMetrics
+        );
+        assert_eq!(
+            Format::negotiate(&headers(
+                header::ACCEPT,
+                "application/vnd.google.protobuf;proto=io.prometheus.client.MetricFamily;encoding=delimited;q=0.7,text/plain;version=0.0.4;q=0.3"
+            )),
+            Format::Protobuf
+        );
+        // Protobuf without the delimited encoding is not supported
+        assert_eq!(
+            Format::negotiate(&headers(header::ACCEPT, "application/vnd.google.protobuf")),
+            Format::Text
+        );
+    }
+
+    #[test]
+    fn test_encoding_negotiation() {
+        assert_eq!(Encoding::negotiate(&HeaderMap::new()), Encoding::Identity);
+        assert_eq!(
+            Encoding::negotiate(&headers(header::ACCEPT_ENCODING, "gzip, deflate")),
+            Encoding::Gzip
+        );
+        assert_eq!(
+            Encoding::negotiate(&headers(header::ACCEPT_ENCODING, "gzip, zstd")),
+            Encoding::Zstd
+        );
+        assert_eq!(
+            Encoding::negotiate(&headers(header::ACCEPT_ENCODING, "zstd;q=0, gzip;q=0.5")),
+            Encoding::Gzip
+        );
+    }
+
+    #[test]
+    fn test_openmetrics_body() {
+        let (_, body) = rendered().body(Format::OpenMetrics, Encoding::Identity);
+        let text = std::str::from_utf8(&body).unwrap();
+        assert!(text.contains(
+            "# HELP test_bytes Bytes \\\"read\\\"\n# TYPE test_bytes counter\n\
+             test_bytes_total{device=\"sd\\\"a\"} 4\n"
+        ));
+        assert!(
+            text.contains("# HELP test_gauge A gauge\n# TYPE test_gauge gauge\ntest_gauge 2.5\n")
+        );
+        assert!(text.ends_with("# EOF\n"));
+    }
+
+    #[test]
+    fn test_openmetrics_histogram() {
+        let registry = Registry::new();
+        let histogram = HistogramVec::new(
+            HistogramOpts::new("test_latency_seconds", "Latency").buckets(vec![0.5, 1.0]),
+            &["group"],
+        )
+        .unwrap();
+        for value in [0.25, 0.75, 3.0] {
+            histogram.with_label_values(&["db"]).observe(value);
+        }
+        registry.register(Box::new(histogram)).unwrap();
+
+        let mut out = Vec::new();
+        encode_openmetrics(&registry.gather(), &mut out);
+        let text = String::from_utf8(out).unwrap();
+        assert!(text.contains(
+            "# TYPE test_latency_seconds histogram\n\
+             test_latency_seconds_bucket{group=\"db\",le=\"0.5\"} 1\n\
+             test_latency_seconds_bucket{group=\"db\",le=\"1\"} 2\n\
+             test_latency_seconds_bucket{group=\"db\",le=\"+Inf\"} 3\n\
+             test_latency_seconds_count{group=\"db\"} 3\n\
+             test_latency_seconds_sum{group=\"db\"} 4\n"
+        ));
+    }
+
+    #[test]
+    fn test_variants_are_encoded_once() {
+        let rendered = rendered();
+        assert_eq!(rendered.encoded_variants(), 1);
+
+        let (encoding, gzip) = rendered.body(Format::Text, Encoding::Gzip);
+        assert_eq!(encoding, Encoding::Gzip);
+        let mut plain = Vec::new();
+        flate2::read::GzDecoder::new(&gzip[..])
+            .read_to_end(&mut plain)
+            .unwrap();
+        assert_eq!(plain, rendered.body(Format::Text, Encoding::Identity).1);
+
+        let (_, zstd) = rendered.body(Format::Text, Encoding::Zstd);
+        assert_eq!(
+            zstd::stream::decode_all(&zstd[..]).unwrap(),
+            plain.as_slice()
+        );
+
+        // Same Bytes on repeated requests, no re-encoding
+        assert_eq!(
+            rendered.body(Format::Text, Encoding::Gzip).1.as_ptr(),
+            gzip.as_ptr()
+        );
+        assert_eq!(rendered.encoded_variants(), 3);
+        assert_ne!(
+            rendered.etag(Format::Text, Encoding::Gzip),
+            rendered.etag(Format::Text, Encoding::Identity)
+        );
+    }
+
+    #[test]
+    fn test_failed_compression_serves_identity() {
+        let rendered = rendered();
+        rendered.variants[Format::Text as usize][Encoding::Zstd as usize]
+            .set(None)
+            .unwrap();
+        let (encoding, body) = rendered.body(Format::Text, Encoding::Zstd);
+        assert_eq!(encoding, Encoding::Identity);
+        assert_eq!(body, rendered.body(Format::Text, Encoding::Identity).1);
+    }
+}
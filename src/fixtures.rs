@@ -0,0 +1,504 @@
+//! Synthetic `/proc` trees for benchmarks and load tests.
+//!
+//! [`write_proc_tree`] writes a directory laid out like `/proc`: one
+//! directory per process with `comm`, `cmdline`, `stat`, `status`,
+//! `smaps_rollup`, `io` and `cgroup`, plus the system-wide `stat`,
+//! `meminfo`, `uptime` and `loadavg`. Processes are a mix of services the
+//! classifier knows, unclassified workers and kernel threads, with resident
+//! sizes spread from 1 MiB to 2 GiB. The contents follow from the spec
+//! alone, so trees generated on two commits are identical and benchmark
+//! numbers stay comparable.
+//!
+//! # Usage
+//!
+//! ```rust,no_run
+//! use herakles_node_exporter::fixtures::{write_proc_tree, ProcTreeSpec};
+//! use std::path::Path;
+//!
+//! write_proc_tree(Path::new("/tmp/proc-10k"), &ProcTreeSpec::new(10_000)).unwrap();
+//! ```
+//!
+//! [`app_state`] sets up an exporter scanning such a tree, for benchmarks of
+//! the scan, render and handler paths. [`proc_mem`] is a scan result for
+//! tests and benchmarks that need one without a tree.
+
+use rand::rngs::StdRng;
+use rand::{Rng, SeedableRng};
+use std::fmt::Write as _;
+use std::fs;
+use std::io;
+use std::path::Path;
+use std::sync::Arc;
+
+use crate::cache::ProcMem;
+use crate::config::Config;
+use crate::health_stats::HealthStats;
+use crate::process::{BufferConfig, SUBGROUPS};
+use crate::ringbuffer_manager::RingbufferManager;
+use crate::state::{AppState, SharedState};
+
+/// Tree sizes used by the benchmarks.
+pub const BENCH_PROCESS_COUNTS: [usize; 3] = [1_000, 10_000, 50_000];
+
+/// Seed of [`ProcTreeSpec::new`].
+pub const DEFAULT_SEED: u64 = 0x6865_7261_6b6c_6573;
+
+/// Uptime of the generated system; all processes started before it.
+pub const UPTIME_SECONDS: u64 = 864_000;
+
+/// Clock ticks per second of the `stat` times (USER_HZ).
+const CLK_TCK: u64 = 100;
+
+const CPUS: usize = 8;
+
+/// Services known to the classifier, with their command lines.
+const SERVICES: [(&str, &str); 16] = [
+    ("nginx", "nginx: worker process"),
+    (
+        "postgres",
+        "/usr/lib/postgresql/16/bin/postgres -D /var/lib/postgresql",
+    ),
+    ("java", "/usr/bin/java -Xmx4g -jar /opt/app/service.jar"),
+    ("sshd", "sshd: /usr/sbin/sshd -D"),
+    ("systemd", "/lib/systemd/systemd --system --deserialize 31"),
+    ("containerd", "/usr/bin/containerd"),
+    ("dockerd", "/usr/bin/dockerd -H fd://"),
+    ("mysqld", "/usr/sbin/mysqld"),
+    ("redis-server", "/usr/bin/redis-server 127.0.0.1:6379"),
+    (
+        "kubelet",
+        "/usr/bin/kubelet --config=/var/lib/kubelet/config.yaml",
+    ),
+    ("python3", "/usr/bin/python3 /opt/app/worker.py"),
+    ("node", "node /srv/app/server.js"),
+    ("chronyd", "/usr/sbin/chronyd -F 1"),
+    ("rsyslogd", "/usr/sbin/rsyslogd -n -iNONE"),
+    (
+        "prometheus",
+        "/usr/bin/prometheus --config.file=/etc/prometheus.yml",
+    ),
+    ("php-fpm", "php-fpm: pool www"),
+];
+
+/// Shape of a generated tree.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ProcTreeSpec {
+    /// Process directories, with PIDs from 1
+    pub processes: usize,
+    pub seed: u64,
+}
+
+impl ProcTreeSpec {
+    pub fn new(processes: usize) -> Self {
+        Self {
+            processes,
+            seed: DEFAULT_SEED,
+        }
+    }
+}
+
+/// One generated process; memory sizes are in kB, CPU times in ticks.
+struct Process {
+    pid: u32,
+    name: String,
+    cmdline: String,
+    kernel_thread: bool,
+    rss_kb: u64,
+    pss_kb: u64,
+    private_kb: u64,
+    swap_kb: u64,
+    utime: u64,
+    stime: u64,
+    start_ticks: u64,
+    threads: u32,
+    read_bytes: u64,
+    write_bytes: u64,
+    cgroup: String,
+}
+
+impl Process {
+    fn generate(pid: u32, rng: &mut StdRng) -> Self {
+        let kind = rng.gen_range(0..100);
+        let (name, cmdline, cgroup) = if kind < 15 {
+            let name = match rng.gen_range(0..3) {
+                0 => format!("kworker/{}:{}", pid as usize % CPUS, rng.gen_range(0..4)),
+                1 => format!("ksoftirqd/{}", pid as usize % CPUS),
+                _ => format!("irq/{}-nvme0q{}", 100 + pid % 64, pid as usize % CPUS),
+            };
+            (name, String::new(), "/".to_string())
+        } else if kind < 60 {
+            let (name, cmdline) = SERVICES[rng.gen_range(0..SERVICES.len())];
+            let cgroup = format!("/system.slice/{}.service", name);
+            (name.to_string(), cmdline.to_string(), cgroup)
+        } else {
+            let name = format!("worker-{}", pid % 97);
+            let cmdline = format!("/opt/batch/bin/{} --shard {}", name, pid % 16);
+            let cgroup = format!(
+                "/kubepods.slice/kubepods-burstable.slice/pod{:08x}.slice",
+                pid / 20
+            );
+            (name, cmdline, cgroup)
+        };
+        let kernel_thread = cmdline.is_empty();
+
+        // Log-uniform between 1 MiB and 2 GiB, as on a mixed server; whole
+        // pages so `stat` and `smaps_rollup` agree
+        let rss_kb = if kernel_thread {
+            0
+        } else {
+            2f64.powf(rng.gen_range(10.0..21.0)) as u64 & !3
+        };
+        let pss_kb = (rss_kb as f64 * rng.gen_range(0.3..1.0)) as u64;
+        let private_kb = (pss_kb as f64 * rng.gen_range(0.5..1.0)) as u64;
+        let swap_kb = if rng.gen_bool(0.2) { rss_kb / 4 } else { 0 };
+        let cpu = 1u64 << rng.gen_range(2..26);
+
+        Self {
+            pid,
+            name,
+            cmdline,
+            kernel_thread,
+            rss_kb,
+            pss_kb,
+            private_kb,
+            swap_kb,
+            utime: rng.gen_range(0..=cpu),
+            stime: rng.gen_range(0..=cpu / 4),
+            start_ticks: rng.gen_range(0..UPTIME_SECONDS * CLK_TCK),
+            threads: if kernel_thread {
+                1
+            } else {
+                rng.gen_range(1..64)
+            },
+            read_bytes: 1 << rng.gen_range(12..36),
+            write_bytes: 1 << rng.gen_range(12..34),
+            cgroup,
+        }
+    }
+
+    fn write_stat(&self, out: &mut String) {
+        let flags = if self.kernel_thread {
+            69238848
+        } else {
+            4194560
+        };
+        let vsize = self.rss_kb * 1024 * 4;
+        writeln!(
+            out,
+            "{pid} ({name}) S 1 {pid} {pid} 0 -1 {flags} 27631 0 69 0 {utime} {stime} 0 0 20 0 \
+             {threads} 0 {start} {vsize} {rss} 18446744073709551615 1 1 0 0 0 0 0 4096 1088 0 0 0 \
+             17 {cpu} 0 0 0 0 0 0 0 0 0 0 0 0 0",
+            pid = self.pid,
+            name = self.name,
+            utime = self.utime,
+            stime = self.stime,
+            threads = self.threads,
+            start = self.start_ticks,
+            rss = self.rss_kb / 4,
+            cpu = self.pid as usize % CPUS,
+        )
+        .ok();
+    }
+
+    fn write_status(&self, out: &mut String) {
+        write!(
+            out,
+            "Name:\t{name}\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t{pid}\nNgid:\t0\n\
+             Pid:\t{pid}\nPPid:\t1\nTracerPid:\t0\nUid:\t0\t0\t0\t0\nGid:\t0\t0\t0\t0\n\
+             FDSize:\t64\nGroups:\t \nNStgid:\t{pid}\nNSpid:\t{pid}\nNSpgid:\t{pid}\n\
+             NSsid:\t{pid}\nKthread:\t{kthread}\n",
+            name = self.name,
+            pid = self.pid,
+            kthread = u8::from(self.kernel_thread),
+        )
+        .ok();
+        if !self.kernel_thread {
+            let rss = self.rss_kb;
+            write!(
+                out,
+                "VmPeak:\t{:>8} kB\nVmSize:\t{:>8} kB\nVmLck:\t       0 kB\nVmPin:\t       0 kB\n\
+                 VmHWM:\t{:>8} kB\nVmRSS:\t{:>8} kB\nRssAnon:\t{:>8} kB\nRssFile:\t{:>8} kB\n\
+                 RssShmem:\t       0 kB\nVmData:\t{:>8} kB\nVmStk:\t     132 kB\n\
+                 VmExe:\t      20 kB\nVmLib:\t    1528 kB\nVmPTE:\t      40 kB\n\
+                 VmSwap:\t{:>8} kB\nHugetlbPages:\t       0 kB\nCoreDumping:\t0\nTHP_enabled:\t1\n",
+                rss * 4,
+                rss * 4,
+                rss,
+                rss,
+                self.private_kb,
+                rss - self.private_kb,
+                self.private_kb,
+                self.swap_kb,
+            )
+            .ok();
+        }
+        write!(
+            out,
+            "Threads:\t{}\nSigQ:\t0/63432\nSigPnd:\t0000000000000000\nShdPnd:\t0000000000000000\n\
+             SigBlk:\t0000000000000000\nSigIgn:\t0000000000001000\nSigCgt:\t0000000100004a02\n\
+             CapInh:\t0000000000000000\nCapPrm:\t000001ffffffffff\nCapEff:\t000001ffffffffff\n\
+             CapBnd:\t000001ffffffffff\nCapAmb:\t0000000000000000\nNoNewPrivs:\t0\nSeccomp:\t0\n\
+             Seccomp_filters:\t0\nSpeculation_Store_Bypass:\tthread vulnerable\n\
+             Cpus_allowed:\tff\nCpus_allowed_list:\t0-7\nMems_allowed:\t00000001\n\
+             Mems_allowed_list:\t0\nvoluntary_ctxt_switches:\t{}\nnonvoluntary_ctxt_switches:\t{}\n",
+            self.threads,
+            self.utime / 3,
+            self.stime / 7,
+        )
+        .ok();
+    }
+
+    /// Kernel threads have no address space and an empty smaps_rollup.
+    fn write_smaps_rollup(&self, out: &mut String) {
+        if self.kernel_thread {
+            return;
+        }
+        let private_clean = self.private_kb / 3;
+        writeln!(
+            out,
+            "55f69e3b2000-7fffb4bfd000 ---p 00000000 00:00 0                          [rollup]"
+        )
+        .ok();
+        for (key, kb) in [
+            ("Rss", self.rss_kb),
+            ("Pss", self.pss_kb),
+            ("Pss_Dirty", self.private_kb - private_clean),
+            ("Pss_Anon", self.private_kb),
+            ("Pss_File", self.pss_kb - self.private_kb),
+            ("Pss_Shmem", 0),
+            ("Shared_Clean", self.rss_kb - self.private_kb),
+            ("Shared_Dirty", 0),
+            ("Private_Clean", private_clean),
+            ("Private_Dirty", self.private_kb - private_clean),
+            ("Referenced", self.rss_kb),
+            ("Anonymous", self.private_kb),
+            ("KSM", 0),
+            ("LazyFree", 0),
+            ("AnonHugePages", 0),
+            ("ShmemPmdMapped", 0),
+            ("FilePmdMapped", 0),
+            ("Shared_Hugetlb", 0),
+            ("Private_Hugetlb", 0),
+            ("Swap", self.swap_kb),
+            ("SwapPss", self.swap_kb),
+            ("Locked", 0),
+        ] {
+            writeln!(out, "{:<16}{:>8} kB", format!("{}:", key), kb).ok();
+        }
+    }
+
+    fn write_io(&self, out: &mut String) {
+        write!(
+            out,
+            "rchar: {}\nwchar: {}\nsyscr: {}\nsyscw: {}\nread_bytes: {}\nwrite_bytes: {}\n\
+             cancelled_write_bytes: 0\n",
+            self.read_bytes * 2,
+            self.write_bytes * 2,
+            self.read_bytes / 4096,
+            self.write_bytes / 4096,
+            self.read_bytes,
+            self.write_bytes,
+        )
+        .ok();
+    }
+}
+
+/// Writes the tree for `spec` under `root`, creating `root` if needed.
+/// Existing files of an earlier tree are overwritten.
+pub fn write_proc_tree(root: &Path, spec: &ProcTreeSpec) -> io::Result<()> {
+    fs::create_dir_all(root)?;
+    let mut rng = StdRng::seed_from_u64(spec.seed);
+    let mut buf = String::with_capacity(4096);
+
+    let mut processes = 0u64;
+    for pid in 1..=spec.processes as u32 {
+        let process = Process::generate(pid, &mut rng);
+        let dir = root.join(pid.to_string());
+        fs::create_dir_all(&dir)?;
+
+        let mut write = |name: &str, fill: &dyn Fn(&mut String)| {
+            buf.clear();
+            fill(&mut buf);
+            fs::write(dir.join(name), &buf)
+        };
+        write("comm", &|out| {
+            writeln!(out, "{}", process.name).ok();
+        })?;
+        write("cmdline", &|out| {
+            for arg in process.cmdline.split(' ').filter(|a| !a.is_empty()) {
+                out.push_str(arg);
+                out.push('\0');
+            }
+        })?;
+        write("stat", &|out| process.write_stat(out))?;
+        write("status", &|out| process.write_status(out))?;
+        write("smaps_rollup", &|out| process.write_smaps_rollup(out))?;
+        write("io", &|out| process.write_io(out))?;
+        write("cgroup", &|out| {
+            writeln!(out, "0::{}", process.cgroup).ok();
+        })?;
+        processes += u64::from(process.threads);
+    }
+
+    write_system_files(root, spec, processes, &mut rng)
+}
+
+/// Returns the state of an exporter scanning the tree at `root`, set up as
+/// the binary does with the default configuration but without eBPF, io_uring
+/// or a persisted ringbuffer, so benchmarks run the same scan, render and
+/// handler code as a scrape.
+pub fn app_state(root: &Path) -> Result<SharedState, Box<dyn std::error::Error>> {
+    let config = Config {
+        proc_root: Some(root.to_path_buf()),
+        ..Config::default()
+    };
+    let buffer_config = BufferConfig {
+        io_kb: config.io_buffer_kb.unwrap_or(256),
+        smaps_kb: config.smaps_buffer_kb.unwrap_or(512),
+        smaps_rollup_kb: config.smaps_rollup_buffer_kb.unwrap_or(256),
+    };
+    let ringbuffer_manager = Arc::new(RingbufferManager::new(
+        config.ringbuffer.clone(),
+        SUBGROUPS.len().max(1),
+    ));
+    let state = AppState::new(
+        config,
+        buffer_config,
+        prometheus::Registry::new(),
+        Arc::new(HealthStats::new()),
+        None,
+        ringbuffer_manager,
+        None,
+    )?;
+    Ok(Arc::new(state))
+}
+
+/// An unclassified process with every counter zero; set the fields a test
+/// needs with struct update syntax.
+pub fn proc_mem(pid: u32) -> ProcMem {
+    ProcMem {
+        pid,
+        name: format!("proc-{}", pid),
+        group: Arc::from("other"),
+        subgroup: Arc::from("unknown"),
+        ..ProcMem::default()
+    }
+}
+
+/// Writes `stat`, `meminfo`, `uptime` and `loadavg` of the generated system.
+fn write_system_files(
+    root: &Path,
+    spec: &ProcTreeSpec,
+    threads: u64,
+    rng: &mut StdRng,
+) -> io::Result<()> {
+    let ticks = UPTIME_SECONDS * CLK_TCK;
+    let mut stat = String::new();
+    let cpu_line = |out: &mut String, name: &str, scale: u64, rng: &mut StdRng| {
+        let busy = ticks * scale / 4;
+        writeln!(
+            out,
+            "{} {} {} {} {} {} {} {} {} 0 0",
+            name,
+            busy / 2,
+            busy / 50,
+            busy / 4,
+            ticks * scale - busy,
+            rng.gen_range(0..ticks / 100) * scale,
+            busy / 100,
+            busy / 40,
+            busy / 200,
+        )
+        .ok();
+    };
+    cpu_line(&mut stat, "cpu ", CPUS as u64, rng);
+    for cpu in 0..CPUS {
+        cpu_line(&mut stat, &format!("cpu{}", cpu), 1, rng);
+    }
+    write!(
+        stat,
+        "intr {}\nctxt {}\nbtime 1700000000\nprocesses {}\nprocs_running 3\nprocs_blocked 0\n\
+         softirq {} 0 0 0 0 0 0 0 0 0 0\n",
+        ticks * 40,
+        ticks * 900,
+        spec.processes as u64 * 13,
+        ticks * 20,
+    )
+    .ok();
+    fs::write(root.join("stat"), stat)?;
+
+    fs::write(
+        root.join("meminfo"),
+        "MemTotal:       65747808 kB\nMemFree:         3799524 kB\nMemAvailable:   41164756 kB\n\
+         Buffers:         1573632 kB\nCached:         34314356 kB\nSwapCached:        14928 kB\n\
+         Active:         27364532 kB\nInactive:       27336308 kB\nSwapTotal:       8388604 kB\n\
+         SwapFree:        8102908 kB\nDirty:              1040 kB\nShmem:            624100 kB\n",
+    )?;
+    fs::write(
+        root.join("uptime"),
+        format!(
+            "{}.00 {}.00\n",
+            UPTIME_SECONDS,
+            UPTIME_SECONDS * CPUS as u64 * 3 / 4
+        ),
+    )?;
+    fs::write(
+        root.join("loadavg"),
+        format!("2.41 2.17 1.98 3/{} {}\n", threads, spec.processes),
+    )
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::procfs;
+
+    #[test]
+    fn test_write_proc_tree_is_deterministic() {
+        let first = tempfile::tempdir().unwrap();
+        let second = tempfile::tempdir().unwrap();
+        let spec = ProcTreeSpec::new(50);
+        write_proc_tree(first.path(), &spec).unwrap();
+        write_proc_tree(second.path(), &spec).unwrap();
+
+        for file in ["stat", "loadavg", "7/stat", "23/smaps_rollup", "50/cmdline"] {
+            assert_eq!(
+                fs::read(first.path().join(file)).unwrap(),
+                fs::read(second.path().join(file)).unwrap(),
+                "{} differs",
+                file
+            );
+        }
+    }
+
+    #[test]
+    fn test_write_proc_tree_files_parse() {
+        let root = tempfile::tempdir().unwrap();
+        write_proc_tree(root.path(), &ProcTreeSpec::new(200)).unwrap();
+
+        let mut kernel_threads = 0;
+        for pid in 1..=200 {
+            let dir = root.path().join(pid.to_string());
+            let read = |name: &str| fs::read(dir.join(name)).unwrap();
+
+            let stat = procfs::parse_stat(&read("stat")).unwrap();
+            assert!(stat.start_ticks < UPTIME_SECONDS * CLK_TCK);
+            let (rss, pss, uss) = procfs::parse_smaps_rollup(&read("smaps_rollup"));
+            assert!(uss <= pss && pss <= rss);
+            assert_eq!(rss, stat.rss_pages * 4096);
+            if rss == 0 {
+                kernel_threads += 1;
+                assert!(read("cmdline").is_empty());
+            } else {
+                let vmrss =
+                    procfs::find_field(&read("status"), b"VmRSS:").and_then(procfs::parse_u64);
+                assert_eq!(vmrss, Some(rss / 1024));
+            }
+            procfs::parse_io(&read("io"));
+        }
+        assert!(kernel_threads > 0 && kernel_threads < 100);
+        assert!(fs::read_to_string(root.path().join("stat"))
+            .unwrap()
+            .contains("\nctxt "));
+    }
+}
@@ -5,10 +5,12 @@
 
 use axum::{extract::State, http::StatusCode, response::IntoResponse};
 use std::fmt::Write as FmtWrite;
+use std::path::Path;
 use tracing::{debug, instrument};
 
-use crate::config::{DEFAULT_BIND_ADDR, DEFAULT_CACHE_TTL, DEFAULT_PORT};
+use crate::config::{DEFAULT_BIND_ADDR, DEFAULT_CACHE_TTL, DEFAULT_PORT, DEFAULT_PROC_ROOT};
 use crate::handlers::health::FOOTER_TEXT;
+use crate::scheduler::{Collector, Schedule};
 use crate::state::SharedState;
 
 /// Handler for the /config endpoint.
@@ -149,6 +151,22 @@ pub async fn config_handler(State(state): State<SharedState>) -> impl IntoRespon
     .ok();
     writeln!(out).ok();
 
+    writeln!(out, "COLLECTOR SCHEDULE").ok();
+    writeln!(out, "------------------").ok();
+    for collector in Collector::ALL {
+        let schedule = Schedule::resolve(collector, cfg);
+        writeln!(
+            out,
+            "{:<28}every {}s, budget {}ms, jitter {}%",
+            format!("{}:", collector.name()),
+            schedule.interval.as_secs(),
+            schedule.budget.as_millis(),
+            schedule.jitter_percent
+        )
+        .ok();
+    }
+    writeln!(out).ok();
+
     writeln!(out, "FEATURE FLAGS").ok();
     writeln!(out, "-------------").ok();
     writeln!(
@@ -264,6 +282,48 @@ pub async fn config_handler(State(state): State<SharedState>) -> impl IntoRespon
     .ok();
     writeln!(out).ok();
 
+    let remote_write = &cfg.remote_write;
+    writeln!(out, "REMOTE WRITE").ok();
+    writeln!(out, "------------").ok();
+    writeln!(
+        out,
+        "url:                        {}",
+        remote_write.url.as_deref().unwrap_or("none")
+    )
+    .ok();
+    writeln!(
+        out,
+        "batch_cycles:               {}",
+        remote_write.batch_cycles
+    )
+    .ok();
+    writeln!(
+        out,
+        "resend_interval_seconds:    {}",
+        remote_write.resend_interval_seconds
+    )
+    .ok();
+    writeln!(
+        out,
+        "max_queued_batches:         {}",
+        remote_write.max_queued_batches
+    )
+    .ok();
+    writeln!(
+        out,
+        "timeout_seconds:            {}",
+        remote_write.timeout_seconds
+    )
+    .ok();
+    for (name, value) in &remote_write.external_labels {
+        writeln!(out, "external_label:             {}={}", name, value).ok();
+    }
+    // Header values usually carry credentials, so only names are shown
+    for name in remote_write.headers.keys() {
+        writeln!(out, "header:                     {}", name).ok();
+    }
+    writeln!(out).ok();
+
     writeln!(out, "TEST DATA").ok();
     writeln!(out, "---------").ok();
     writeln!(
@@ -275,6 +335,15 @@ pub async fn config_handler(State(state): State<SharedState>) -> impl IntoRespon
             .unwrap_or_else(|| "none".to_string())
     )
     .ok();
+    writeln!(
+        out,
+        "proc_root:                  {}",
+        cfg.proc_root
+            .as_deref()
+            .unwrap_or(Path::new(DEFAULT_PROC_ROOT))
+            .display()
+    )
+    .ok();
     writeln!(out).ok();
     writeln!(out, "{FOOTER_TEXT}").ok();
 
@@ -17,8 +17,8 @@ use tracing::{debug, instrument};
 
 use crate::cache::ProcMem;
 use crate::handlers::health::FOOTER_TEXT;
-use crate::process::classifier::classify_process_raw;
-use crate::ringbuffer::RingbufferEntry;
+use crate::ringbuffer::Metric;
+use crate::ringbuffer_stats::SubgroupStats;
 use crate::state::SharedState;
 
 // Temporal zone thresholds
@@ -64,7 +64,7 @@ struct ProcessInfo {
 }
 
 /// Metric value with timestamp for peak tracking.
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Copy)]
 struct MetricWithTimestamp {
     value: u64,
     timestamp: i64,
@@ -168,65 +168,35 @@ fn classify_temporal_phase(uptime_seconds: f64, history_window_seconds: u64) ->
     }
 }
 
-/// Calculate 5-minute rolling average for a metric from ringbuffer history.
+/// 5-minute rolling average for a metric, from the subgroup's rolling stats.
 /// Returns None if insufficient data.
-fn get_5min_rolling_avg(
-    history: &[RingbufferEntry],
-    interval_seconds: u64,
-    extract_value: impl Fn(&RingbufferEntry) -> u64,
-) -> Option<u64> {
-    if history.is_empty() {
+fn get_5min_rolling_avg(stats: &SubgroupStats, metric: Metric) -> Option<u64> {
+    if stats.len == 0 {
         return None;
     }
-
-    // Calculate how many entries cover 5 minutes
-    let entries_in_5min = (300 / interval_seconds).max(1) as usize;
-
-    // Take the most recent entries up to 5 minutes
-    let entries_to_use = history.len().min(entries_in_5min);
-    let recent_entries = &history[history.len() - entries_to_use..];
-
-    let sum: u64 = recent_entries.iter().map(&extract_value).sum();
-    Some(sum / entries_to_use as u64)
+    Some(stats.get(metric).avg_5min)
 }
 
 /// Extract min/max/avg with timestamps for a metric (stabilization phase).
 fn extract_min_max_avg_with_timestamps(
-    history: &[RingbufferEntry],
-    extract_value: impl Fn(&RingbufferEntry) -> u64,
+    stats: &SubgroupStats,
+    metric: Metric,
 ) -> Option<MetricTriplet> {
-    if history.is_empty() {
+    if stats.len == 0 {
         return None;
     }
 
-    let mut min_entry = &history[0];
-    let mut max_entry = &history[0];
-    let mut sum: u64 = 0;
-
-    for entry in history {
-        let value = extract_value(entry);
-        sum += value;
-
-        if extract_value(entry) < extract_value(min_entry) {
-            min_entry = entry;
-        }
-        if extract_value(entry) > extract_value(max_entry) {
-            max_entry = entry;
-        }
-    }
-
-    let avg = sum / history.len() as u64;
-
+    let m = stats.get(metric);
     Some(MetricTriplet {
         min: MetricWithTimestamp {
-            value: extract_value(min_entry),
-            timestamp: min_entry.timestamp,
+            value: m.min.bytes,
+            timestamp: m.min.timestamp,
         },
         max: MetricWithTimestamp {
-            value: extract_value(max_entry),
-            timestamp: max_entry.timestamp,
+            value: m.max.bytes,
+            timestamp: m.max.timestamp,
         },
-        avg,
+        avg: m.avg,
     })
 }
 
@@ -240,54 +210,26 @@ fn extract_min_max_avg_with_timestamps(
 fn calculate_io_delta_5min(
     _current_read: u64,
     _current_write: u64,
-    _history: &[RingbufferEntry],
-    _interval_seconds: u64,
+    _stats: &SubgroupStats,
 ) -> Option<(u64, u64)> {
     // Note: RingbufferEntry doesn't have I/O data, so we can't calculate delta from current structure
     // This would require adding I/O tracking to the ringbuffer entries
     None
 }
 
-/// Calculate long-term average (for Historical phase).
-fn calculate_longterm_avg(
-    history: &[RingbufferEntry],
-    extract_value: impl Fn(&RingbufferEntry) -> u64,
-) -> Option<u64> {
-    if history.is_empty() {
+/// Long-term average over the whole history (for Historical phase).
+fn calculate_longterm_avg(stats: &SubgroupStats, metric: Metric) -> Option<u64> {
+    if stats.len == 0 {
         return None;
     }
-
-    let sum: u64 = history.iter().map(&extract_value).sum();
-    Some(sum / history.len() as u64)
+    Some(stats.get(metric).avg)
 }
 
-/// Calculate growth rate (MB/sec) over the last hour.
-fn calculate_growth_rate(
-    current_value: u64,
-    history: &[RingbufferEntry],
-    interval_seconds: u64,
-    extract_value: impl Fn(&RingbufferEntry) -> u64,
-) -> Option<f64> {
-    if history.is_empty() {
-        return None;
-    }
-
-    // Calculate how many entries cover 1 hour
-    let entries_in_hour = (3600 / interval_seconds).max(1) as usize;
-
-    if history.len() < entries_in_hour {
-        return None; // Not enough history
-    }
-
-    // Get value from 1 hour ago
-    let index_1h_ago = history.len() - entries_in_hour;
-    let value_1h_ago = extract_value(&history[index_1h_ago]);
-
-    // Calculate growth rate in bytes per second
-    let delta_bytes = current_value.saturating_sub(value_1h_ago) as f64;
-    let delta_seconds = 3600.0;
-
-    Some(delta_bytes / delta_seconds)
+/// Growth rate (bytes/sec) over the last hour: the slope of a linear fit,
+/// so a single outlier at either end does not dominate it.
+/// Returns None until an hour of history has been recorded.
+fn calculate_growth_rate(stats: &SubgroupStats, metric: Metric) -> Option<f64> {
+    stats.get(metric).slope_1h
 }
 
 /// Detect anomaly severity based on deviation ratio.
@@ -322,15 +264,14 @@ async fn compute_live_snapshots(
     state: &SharedState,
     history_window_seconds: u64,
 ) -> HashMap<String, SubgroupSnapshot> {
-    let cache = state.cache.read().await;
+    let processes_snapshot = state.cache.read().await.snapshot();
     let system_uptime = crate::system::read_uptime().unwrap_or(0.0);
 
     // Group processes by subgroup
     let mut subgroup_procs: HashMap<String, Vec<ProcMem>> = HashMap::new();
 
-    for proc in cache.processes.values() {
-        let (group, subgroup) = classify_process_raw(&proc.name);
-        let key = format!("{}:{}", group, subgroup);
+    for proc in processes_snapshot.values() {
+        let key = format!("{}:{}", proc.group, proc.subgroup);
         subgroup_procs
             .entry(key)
             .or_insert_with(Vec::new)
@@ -398,11 +339,7 @@ async fn compute_live_snapshots(
 }
 
 /// Analyze processes and identify anomalies by temporal phase.
-fn analyze_anomalies(
-    snapshot: &SubgroupSnapshot,
-    history: &[RingbufferEntry],
-    interval_seconds: u64,
-) -> Vec<ProcessAnomaly> {
+fn analyze_anomalies(snapshot: &SubgroupSnapshot, stats: &SubgroupStats) -> Vec<ProcessAnomaly> {
     let mut anomalies = Vec::new();
 
     for proc in &snapshot.all_processes {
@@ -412,11 +349,9 @@ fn analyze_anomalies(
         }
 
         let anomaly = match proc.phase {
-            TemporalPhase::Live => analyze_live_phase(proc, history, interval_seconds),
-            TemporalPhase::Stabilization => {
-                analyze_stabilization_phase(proc, history, interval_seconds)
-            }
-            TemporalPhase::Historical => analyze_historical_phase(proc, history, interval_seconds),
+            TemporalPhase::Live => analyze_live_phase(proc, stats),
+            TemporalPhase::Stabilization => analyze_stabilization_phase(proc, stats),
+            TemporalPhase::Historical => analyze_historical_phase(proc, stats),
             TemporalPhase::Newborn => continue, // Already checked above
         };
 
@@ -435,15 +370,11 @@ fn analyze_anomalies(
 
 /// Analyze a process in Live phase (0-5 minutes).
 /// Compare against 5-minute rolling average.
-fn analyze_live_phase(
-    proc: &ProcessInfo,
-    history: &[RingbufferEntry],
-    interval_seconds: u64,
-) -> Option<ProcessAnomaly> {
+fn analyze_live_phase(proc: &ProcessInfo, stats: &SubgroupStats) -> Option<ProcessAnomaly> {
     // Get 5-minute rolling averages
-    let baseline_rss = get_5min_rolling_avg(history, interval_seconds, |e| e.rss_kb * 1024)?;
-    let baseline_pss = get_5min_rolling_avg(history, interval_seconds, |e| e.pss_kb * 1024)?;
-    let baseline_uss = get_5min_rolling_avg(history, interval_seconds, |e| e.uss_kb * 1024)?;
+    let baseline_rss = get_5min_rolling_avg(stats, Metric::Rss)?;
+    let baseline_pss = get_5min_rolling_avg(stats, Metric::Pss)?;
+    let baseline_uss = get_5min_rolling_avg(stats, Metric::Uss)?;
 
     // Calculate ratios
     let rss_ratio = if baseline_rss > 0 {
@@ -492,13 +423,12 @@ fn analyze_live_phase(
 /// Look for pattern deviations.
 fn analyze_stabilization_phase(
     proc: &ProcessInfo,
-    history: &[RingbufferEntry],
-    _interval_seconds: u64,
+    stats: &SubgroupStats,
 ) -> Option<ProcessAnomaly> {
     // Get long-term averages for comparison
-    let baseline_rss = calculate_longterm_avg(history, |e| e.rss_kb * 1024)?;
-    let baseline_pss = calculate_longterm_avg(history, |e| e.pss_kb * 1024)?;
-    let baseline_uss = calculate_longterm_avg(history, |e| e.uss_kb * 1024)?;
+    let baseline_rss = calculate_longterm_avg(stats, Metric::Rss)?;
+    let baseline_pss = calculate_longterm_avg(stats, Metric::Pss)?;
+    let baseline_uss = calculate_longterm_avg(stats, Metric::Uss)?;
 
     // Calculate ratios
     let rss_ratio = if baseline_rss > 0 {
@@ -545,15 +475,11 @@ fn analyze_stabilization_phase(
 
 /// Analyze a process in Historical phase (>60 minutes).
 /// Compare against long-term trend.
-fn analyze_historical_phase(
-    proc: &ProcessInfo,
-    history: &[RingbufferEntry],
-    interval_seconds: u64,
-) -> Option<ProcessAnomaly> {
+fn analyze_historical_phase(proc: &ProcessInfo, stats: &SubgroupStats) -> Option<ProcessAnomaly> {
     // Get long-term averages
-    let baseline_rss = calculate_longterm_avg(history, |e| e.rss_kb * 1024)?;
-    let baseline_pss = calculate_longterm_avg(history, |e| e.pss_kb * 1024)?;
-    let baseline_uss = calculate_longterm_avg(history, |e| e.uss_kb * 1024)?;
+    let baseline_rss = calculate_longterm_avg(stats, Metric::Rss)?;
+    let baseline_pss = calculate_longterm_avg(stats, Metric::Pss)?;
+    let baseline_uss = calculate_longterm_avg(stats, Metric::Uss)?;
 
     // Calculate ratios
     let rss_ratio = if baseline_rss > 0 {
@@ -576,8 +502,7 @@ fn analyze_historical_phase(
     let severity = detect_anomaly_severity(max_ratio);
 
     // Calculate growth rate (important for detecting memory leaks)
-    let rss_growth_rate =
-        calculate_growth_rate(proc.rss, history, interval_seconds, |e| e.rss_kb * 1024);
+    let rss_growth_rate = calculate_growth_rate(stats, Metric::Rss);
 
     Some(ProcessAnomaly {
         pid: proc.pid,
@@ -662,6 +587,20 @@ fn format_growth_rate(bytes_per_sec: f64) -> String {
     }
 }
 
+/// Render the subgroup's RSS trend from its rolling statistics.
+fn render_trend(out: &mut String, stats: &SubgroupStats) {
+    let rss = stats.get(Metric::Rss);
+    writeln!(out, "RSS TREND ({} samples)", stats.len).ok();
+    writeln!(out, "---------------------").ok();
+    writeln!(out, "  5min avg:       {}", format_bytes(rss.avg_5min)).ok();
+    writeln!(out, "  1h avg:         {}", format_bytes(rss.avg_1h)).ok();
+    writeln!(out, "  EWMA (5min):    {}", format_bytes(rss.ewma as u64)).ok();
+    if let Some(rate) = rss.slope_1h {
+        writeln!(out, "  Growth (1h):    {}", format_growth_rate(rate)).ok();
+    }
+    writeln!(out).ok();
+}
+
 /// Render newborn processes (those with uptime < history_window).
 fn render_newborn_processes(out: &mut String, snapshot: &SubgroupSnapshot) {
     let newborns: Vec<_> = snapshot
@@ -706,12 +645,7 @@ fn render_newborn_processes(out: &mut String, snapshot: &SubgroupSnapshot) {
 }
 
 /// Render Live Phase (0-5 minutes) anomalies.
-fn render_live_phase(
-    out: &mut String,
-    anomalies: &[ProcessAnomaly],
-    history: &[RingbufferEntry],
-    interval_seconds: u64,
-) {
+fn render_live_phase(out: &mut String, anomalies: &[ProcessAnomaly], stats: &SubgroupStats) {
     let live_anomalies: Vec<_> = anomalies
         .iter()
         .filter(|a| a.phase == TemporalPhase::Live)
@@ -761,11 +695,7 @@ fn render_live_phase(
             .ok();
 
             // Calculate growth rate
-            if let Some(rate) =
-                calculate_growth_rate(anomaly.current_rss, history, interval_seconds, |e| {
-                    e.rss_kb * 1024
-                })
-            {
+            if let Some(rate) = calculate_growth_rate(stats, Metric::Rss) {
                 if rate > 0.0 {
                     writeln!(out, "  Growth rate:    {}", format_growth_rate(rate)).ok();
                 }
@@ -834,7 +764,7 @@ fn render_live_phase(
 fn render_stabilization_phase(
     out: &mut String,
     anomalies: &[ProcessAnomaly],
-    history: &[RingbufferEntry],
+    stats: &SubgroupStats,
 ) {
     let stab_anomalies: Vec<_> = anomalies
         .iter()
@@ -868,7 +798,7 @@ fn render_stabilization_phase(
         writeln!(out).ok();
 
         // Show triplets for RSS
-        if let Some(triplet) = extract_min_max_avg_with_timestamps(history, |e| e.rss_kb * 1024) {
+        if let Some(triplet) = extract_min_max_avg_with_timestamps(stats, Metric::Rss) {
             writeln!(out, "  RSS:").ok();
             writeln!(
                 out,
@@ -996,6 +926,7 @@ pub async fn details_handler(
     writeln!(out, "RINGBUFFER CONFIGURATION").ok();
     writeln!(out, "========================").ok();
     writeln!(out, "max_memory_mb:            {}", stats.max_memory_mb).ok();
+    writeln!(out, "storage:                  {:?}", stats.storage).ok();
     writeln!(out, "entry_size_bytes:         {}", stats.entry_size_bytes).ok();
     writeln!(out, "interval_seconds:         {}", stats.interval_seconds).ok();
     writeln!(
@@ -1011,6 +942,8 @@ pub async fn details_handler(
         stats.estimated_ram_bytes
     )
     .ok();
+    writeln!(out, "used_ram_bytes:           {}", stats.used_ram_bytes).ok();
+    writeln!(out, "persistent:               {}", stats.persistent).ok();
     writeln!(
         out,
         "history_seconds:          {} ({} min)",
@@ -1036,9 +969,9 @@ pub async fn details_handler(
         writeln!(out, "{}", "-".repeat(66)).ok();
 
         for subgroup_name in subgroups.iter().take(MAX_DISPLAYED_SUBGROUPS) {
-            if let Some(buffer) = _state.ringbuffer_manager.get_subgroup_buffer(subgroup_name) {
-                let len = buffer.len();
-                let capacity = buffer.capacity();
+            if let Some((len, capacity)) =
+                _state.ringbuffer_manager.get_subgroup_fill(subgroup_name)
+            {
                 let fill_percent = if capacity > 0 {
                     (len as f64 / capacity as f64) * 100.0
                 } else {
@@ -1075,17 +1008,16 @@ pub async fn details_handler(
         // Get live snapshot
         let snapshot_opt = snapshots.get(&subgroup_name);
 
-        // Get historical data if available
-        let history_opt = _state
-            .ringbuffer_manager
-            .get_subgroup_history(&subgroup_name);
+        // Get precomputed history statistics if available
+        let history_opt = _state.ringbuffer_manager.get_subgroup_stats(&subgroup_name);
 
         match (history_opt.as_ref(), snapshot_opt) {
-            (Some(history), Some(snapshot)) if !history.is_empty() => {
+            (Some(history), Some(snapshot)) if history.len > 0 => {
                 // Full temporal zone analysis
+                render_trend(&mut out, history);
 
                 // Analyze anomalies by phase
-                let anomalies = analyze_anomalies(snapshot, history, stats.interval_seconds);
+                let anomalies = analyze_anomalies(snapshot, history);
 
                 // Show newborn processes first (informational)
                 render_newborn_processes(&mut out, snapshot);
@@ -1119,7 +1051,7 @@ pub async fn details_handler(
                     .ok();
                 } else {
                     // Show anomalies by temporal zone
-                    render_live_phase(&mut out, &anomalies, history, stats.interval_seconds);
+                    render_live_phase(&mut out, &anomalies, history);
                     render_stabilization_phase(&mut out, &anomalies, history);
                     render_historical_phase(&mut out, &anomalies);
                 }
@@ -1128,7 +1060,7 @@ pub async fn details_handler(
                 // No processes
                 writeln!(out, "No processes currently running in this subgroup.").ok();
             }
-            (Some(history), Some(snapshot)) if history.is_empty() => {
+            (Some(history), Some(snapshot)) if history.len == 0 => {
                 // Empty history, treat as no history
                 writeln!(out, "No baseline available yet (insufficient history).").ok();
                 writeln!(
@@ -1340,7 +1272,13 @@ pub async fn details_handler(
 #[cfg(test)]
 mod tests {
     use super::*;
-    use crate::ringbuffer::{RingbufferEntry, TopProcessInfo};
+    use crate::ringbuffer::{HistoryView, RingbufferEntry, TopProcessInfo};
+    use crate::ringbuffer_stats::RollingStats;
+
+    /// Rolling stats of a full buffer holding `history`.
+    fn stats_of(history: &dyn HistoryView, interval_seconds: u64) -> SubgroupStats {
+        RollingStats::from_history(history, history.len(), interval_seconds).snapshot()
+    }
 
     #[test]
     fn test_calculate_process_uptime() {
@@ -1446,7 +1384,7 @@ mod tests {
             });
         }
 
-        let avg = get_5min_rolling_avg(&history, 30, |e| e.rss_kb * 1024);
+        let avg = get_5min_rolling_avg(&stats_of(&history, 30), Metric::Rss);
         assert!(avg.is_some());
 
         // Average of entries 0-9: 100, 110, 120, ... 190
@@ -1477,7 +1415,7 @@ mod tests {
             });
         }
 
-        let triplet = extract_min_max_avg_with_timestamps(&history, |e| e.rss_kb * 1024);
+        let triplet = extract_min_max_avg_with_timestamps(&stats_of(&history, 60), Metric::Rss);
         assert!(triplet.is_some());
 
         let t = triplet.unwrap();
@@ -1506,13 +1444,11 @@ mod tests {
             });
         }
 
-        // Current value is at entry 119 (last entry would be 120, so 119 is the most recent)
-        let current_value = (1000 + 119 * 10) * 1024; // in bytes
-        let rate = calculate_growth_rate(current_value, &history, 60, |e| e.rss_kb * 1024);
+        let rate = calculate_growth_rate(&stats_of(&history, 60), Metric::Rss);
         assert!(rate.is_some());
 
-        // Expected: growth from entry 59 (1590KB) to entry 119 (2190KB) = 600KB over 3600 seconds
-        // = 600*1024 / 3600 bytes/sec ≈ 170.67 bytes/sec
+        // Expected: linear fit over entries 60-119, 10KB per 60 seconds
+        // = 10*1024 / 60 bytes/sec ≈ 170.67 bytes/sec
         let r = rate.unwrap();
         assert!(r > 160.0 && r < 180.0); // Roughly 170 bytes/sec
     }
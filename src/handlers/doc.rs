@@ -66,7 +66,8 @@ Config file locations (in order):
 Key configuration options:
 - port: HTTP listen port (default: 9215)
 - bind: Bind address (default: 0.0.0.0)
-- cache_ttl: Cache TTL in seconds (default: 30)
+- cache_ttl: Seconds between background process scans (default: 30)
+- collectors: Per-collector interval_seconds, budget_ms and jitter_percent
 - min_uss_kb: Minimum USS threshold (default: 0)
 - top_n_subgroup: Top-N processes per subgroup (default: 3)
 - top_n_others: Top-N processes for "other" group (default: 10)
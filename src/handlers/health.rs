@@ -4,10 +4,10 @@
 //! exporter health statistics and buffer status.
 
 use axum::{extract::State, http::StatusCode, response::IntoResponse};
-use herakles_node_exporter::HealthResponse;
 use std::fmt::Write as FmtWrite;
 use tracing::{debug, instrument};
 
+use crate::health::HealthResponse;
 use crate::state::SharedState;
 
 // Time conversion constants
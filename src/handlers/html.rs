@@ -13,8 +13,10 @@ use tracing::{debug, instrument};
 
 use crate::cache::ProcMem;
 use crate::handlers::health::FOOTER_TEXT;
-use crate::process::classify_process_raw;
+use crate::process::SUBGROUP_REGISTRY;
+use crate::ringbuffer::{HistoryView, Metric};
 use crate::state::SharedState;
+use crate::topk::{Ranking, SubgroupTop};
 
 /// CPU percentage scaling factor (must match the constant in main.rs).
 const CPU_SCALE_FACTOR: f32 = 1000.0;
@@ -250,11 +252,74 @@ fn format_bytes(bytes: u64) -> String {
     }
 }
 
+/// Display label for a ranking.
+fn ranking_label(ranking: Ranking) -> &'static str {
+    match ranking {
+        Ranking::Cpu => "CPU",
+        Ranking::Rss => "RSS",
+        Ranking::Pss => "PSS",
+        Ranking::ReadBytes => "Read",
+        Ranking::WriteBytes => "Write",
+        Ranking::RxBytes => "Net RX",
+        Ranking::TxBytes => "Net TX",
+    }
+}
+
+/// Formats a ranking value: CPU in thousandths of a percent, the rest in bytes.
+fn format_ranked_value(ranking: Ranking, value: u64) -> String {
+    match ranking {
+        Ranking::Cpu => format!("{:.2}%", value as f32 / CPU_SCALE_FACTOR),
+        _ => format_bytes(value),
+    }
+}
+
+/// Renders the live top-N table of a subgroup, one row per ranking.
+///
+/// Processes with a zero value are left out, so rankings without data (e.g.
+/// network I/O without eBPF) show as empty.
+fn render_top_processes(
+    html: &mut String,
+    top: &SubgroupTop,
+    processes: &ahash::AHashMap<u32, ProcMem>,
+    top_n: usize,
+) {
+    html.push_str(&format!("<h3>Current Top-{}</h3>\n", top_n));
+    html.push_str("<table>\n");
+    html.push_str("<tr><th>Metric</th><th>Processes</th></tr>\n");
+    for ranking in Ranking::ALL {
+        let ranked: Vec<String> = top
+            .get(ranking)
+            .iter()
+            .take(top_n)
+            .filter(|r| r.value > 0)
+            .map(|r| {
+                let name = processes.get(&r.pid).map_or("?", |p| p.name.as_str());
+                format!(
+                    "{} ({}): {}",
+                    name,
+                    r.pid,
+                    format_ranked_value(ranking, r.value)
+                )
+            })
+            .collect();
+        html.push_str(&format!(
+            "<tr><td>{}</td><td>{}</td></tr>\n",
+            ranking_label(ranking),
+            if ranked.is_empty() {
+                "-".to_string()
+            } else {
+                ranked.join("<br>")
+            }
+        ));
+    }
+    html.push_str("</table>\n");
+}
+
 /// Render interactive HTML table for a specific subgroup.
 async fn render_interactive_table(state: SharedState, subgroup_name: &str) -> Html<String> {
     use chrono::{Local, TimeZone};
 
-    let cache = state.cache.read().await;
+    let processes_snapshot = state.cache.read().await.snapshot();
     let current_timestamp = chrono::Utc::now().timestamp();
 
     // Parse subgroup_name once (format: "group:subgroup")
@@ -269,10 +334,8 @@ async fn render_interactive_table(state: SharedState, subgroup_name: &str) -> Ht
 
     // Collect all processes for the subgroup
     let mut processes: Vec<&ProcMem> = Vec::new();
-    for proc in cache.processes.values() {
-        let (group, subgroup) = classify_process_raw(&proc.name);
-
-        if group.as_ref() == expected_group && subgroup.as_ref() == expected_subgroup {
+    for proc in processes_snapshot.values() {
+        if proc.group.as_ref() == expected_group && proc.subgroup.as_ref() == expected_subgroup {
             processes.push(proc);
         }
     }
@@ -656,8 +719,16 @@ pub async fn html_details_handler(
         return render_interactive_table(state, subgroup_name).await;
     }
 
-    let cache = state.cache.read().await;
+    let (processes_snapshot, top_processes) = {
+        let cache = state.cache.read().await;
+        (
+            cache.snapshot(),
+            std::sync::Arc::clone(&cache.top_processes),
+        )
+    };
     let stats = state.ringbuffer_manager.get_stats();
+    let top_n_subgroup = state.config.top_n_subgroup.unwrap_or(3);
+    let top_n_others = state.config.top_n_others.unwrap_or(10);
 
     let mut html = html_header("Details");
     html.push_str("<h1>Details - All Subgroups</h1>\n");
@@ -725,16 +796,15 @@ function collapseAll() {
 
     // Render each subgroup in a collapsible section
     for subgroup_name in subgroups {
-        // Get history for this subgroup
-        let history = state
-            .ringbuffer_manager
-            .get_subgroup_history(&subgroup_name);
+        // Get history for this subgroup: averages from the rolling stats, the
+        // latest entry and CPU from a view, without decoding every entry
+        let stats = state.ringbuffer_manager.get_subgroup_stats(&subgroup_name);
+        let history = state.ringbuffer_manager.get_subgroup_view(&subgroup_name);
 
         // Calculate current aggregated values from cache
         let mut subgroup_processes: Vec<&ProcMem> = Vec::new();
-        for proc in cache.processes.values() {
-            let (_, sg) = classify_process_raw(&proc.name);
-            let key = format!("{}:{}", classify_process_raw(&proc.name).0, sg);
+        for proc in processes_snapshot.values() {
+            let key = format!("{}:{}", proc.group, proc.subgroup);
             if key == subgroup_name {
                 subgroup_processes.push(proc);
             }
@@ -792,6 +862,19 @@ function collapseAll() {
             ));
             html.push_str("</table>\n");
 
+            // Rankings computed during the cache update for this snapshot
+            let top = SUBGROUP_REGISTRY
+                .get_by_key(&subgroup_name)
+                .and_then(|info| top_processes.get(info.id as usize).map(|top| (info, top)));
+            if let Some((info, top)) = top {
+                let top_n = if info.group.as_ref() == "other" {
+                    top_n_others
+                } else {
+                    top_n_subgroup
+                };
+                render_top_processes(&mut html, top, &processes_snapshot, top_n);
+            }
+
             // Add sortable table showing ALL processes
             let current_timestamp = chrono::Utc::now().timestamp();
 
@@ -1012,24 +1095,22 @@ function collapseAll() {
         }
 
         // Show ringbuffer history with top-N data
-        if let Some(history) = history {
-            if !history.is_empty() {
+        if let (Some(stats), Some(history)) = (stats, history) {
+            if let Some(latest) = history.latest() {
                 html.push_str("<h3>Historical Ringbuffer Data</h3>\n");
                 html.push_str(&format!(
                     "<p>Showing {} historical entries.</p>\n",
                     history.len()
                 ));
 
-                // Calculate averages
-                let avg_rss = history.iter().map(|e| e.rss_kb).sum::<u64>() / history.len() as u64;
-                let avg_pss = history.iter().map(|e| e.pss_kb).sum::<u64>() / history.len() as u64;
-                let avg_uss = history.iter().map(|e| e.uss_kb).sum::<u64>() / history.len() as u64;
-                let avg_cpu =
-                    history.iter().map(|e| e.cpu_percent).sum::<f32>() / history.len() as f32;
+                // Averages over the whole history
+                let avg_rss = stats.get(Metric::Rss).avg / 1024;
+                let avg_pss = stats.get(Metric::Pss).avg / 1024;
+                let avg_uss = stats.get(Metric::Uss).avg / 1024;
+                let avg_cpu = history.mean_cpu_percent();
 
                 html.push_str("<table>\n");
                 html.push_str("<tr><th>Metric</th><th>Average</th><th>Latest</th></tr>\n");
-                let latest = &history[history.len() - 1];
                 html.push_str(&format!(
                     "<tr><td>RSS</td><td>{} KB</td><td>{} KB</td></tr>\n",
                     avg_rss, latest.rss_kb
@@ -1244,15 +1325,14 @@ pub async fn html_subgroups_handler(
     debug!("Processing /html/subgroups request");
     state.health_stats.record_http_request();
 
-    let cache = state.cache.read().await;
+    let processes_snapshot = state.cache.read().await.snapshot();
 
     // Aggregate data by subgroup
     let mut subgroup_data: std::collections::HashMap<String, (u64, u64, u64, f64, usize)> =
         std::collections::HashMap::new();
 
-    for proc in cache.processes.values() {
-        let (group, subgroup) = classify_process_raw(&proc.name);
-        let key = format!("{}:{}", group, subgroup);
+    for proc in processes_snapshot.values() {
+        let key = format!("{}:{}", proc.group, proc.subgroup);
 
         let entry = subgroup_data.entry(key).or_insert((0, 0, 0, 0.0, 0));
         entry.0 += proc.rss;
@@ -1538,6 +1618,18 @@ pub async fn html_config_handler(State(state): State<SharedState>) -> impl IntoR
         "<tr><td>Max Entries per Subgroup</td><td>{}</td></tr>\n",
         cfg.ringbuffer.max_entries_per_subgroup
     ));
+    html.push_str(&format!(
+        "<tr><td>Storage</td><td>{:?}</td></tr>\n",
+        cfg.ringbuffer.storage
+    ));
+    html.push_str(&format!(
+        "<tr><td>Persist Path</td><td>{}</td></tr>\n",
+        cfg.ringbuffer
+            .persist_path
+            .as_ref()
+            .map(|p| p.display().to_string())
+            .unwrap_or_else(|| "none".to_string())
+    ));
     html.push_str("</table>\n");
 
     // Metrics Collection
@@ -1709,6 +1801,8 @@ pub async fn html_docs_handler(State(state): State<SharedState>) -> impl IntoRes
     html.push_str(r#"<div class="info-box">
         <p>Ringbuffers use a fixed amount of RAM to prevent unbounded memory growth. The <code>max_memory_mb</code> setting controls the total RAM budget. This is divided across all subgroups to provide a predictable memory footprint.</p>
         <p>As new data arrives, the oldest entries are overwritten. This ensures the exporter itself remains lightweight.</p>
+        <p>With <code>storage: columnar</code> each field is delta-compressed in its own column, so a typical sample takes 30-40 bytes instead of 256. Each subgroup gets an equal share of <code>max_memory_mb</code> and drops its oldest samples once their encoded size exceeds it, so the same budget holds six to eight times more history. <code>max_entries_per_subgroup</code> still caps the sample count; raise it to make use of the budget.</p>
+        <p>With <code>persist_path</code> set, entry ringbuffers are kept in a memory-mapped file and history survives a restart. The file is discarded if it was written with a different <code>interval_seconds</code> or entry count, or is older than one history window.</p>
     </div>"#);
 
     // Warm-up vs Memory Leak
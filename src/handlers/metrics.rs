@@ -3,23 +3,37 @@
 //! This module provides the `/metrics` endpoint handler that formats and returns
 //! system and group-level metrics in Prometheus text format according to the system specification.
 //! NO per-process or Top-N metrics are exported.
+//!
+//! The registry is rendered at most once per cache update, on the first
+//! scrape after it, and at most once per shortest system collector interval
+//! for new system values; all scrapes in between are served the same
+//! pre-rendered bodies (see `crate::exposition`), negotiated by `Accept` and
+//! `Accept-Encoding`, with an `ETag` per generation and representation.
+//!
+//! Scrapes never trigger collection: the process cache and the system
+//! snapshot are refreshed by the background collectors (see
+//! `crate::scheduler`), and a render only copies their latest values into the
+//! registry.
 
 use ahash::AHashMap as HashMap;
-use axum::{extract::State, http::StatusCode, response::IntoResponse};
+use axum::{
+    body::Bytes,
+    extract::State,
+    http::{header, HeaderMap, HeaderValue, StatusCode},
+    response::{IntoResponse, Response},
+};
 use prometheus::{Encoder, TextEncoder};
+use std::sync::Arc;
 use std::time::Instant;
-use tracing::{debug, error, instrument, warn};
-
-use crate::collectors;
-use crate::process::classify_process_with_config;
+use tracing::{debug, error, instrument};
+
+use crate::collectors::cgroup::CgroupStats;
+use crate::ebpf::CgroupIoStats;
+use crate::exposition::{Encoding, Format, RenderedMetrics, BUFFER_CAP};
+use crate::health_stats::Phase;
+use crate::process::{apply_config_rules, registered_subgroups};
+use crate::scheduler::shortest_system_interval;
 use crate::state::SharedState;
-use crate::system;
-
-/// Buffer capacity for metrics encoding.
-const BUFFER_CAP: usize = 512 * 1024;
-
-/// Minimum seconds between cache updates to prevent excessive updates.
-const CACHE_UPDATE_THROTTLE_SECS: u64 = 5;
 
 /// Error type for metrics endpoint failures.
 #[derive(Debug)]
@@ -40,6 +54,7 @@ impl IntoResponse for MetricsError {
 /// Aggregated metrics for a group/subgroup.
 #[derive(Default, Debug)]
 struct GroupMetrics {
+    process_count: usize,
     rss_sum: u64,
     pss_sum: u64,
     swap_sum: u64,
@@ -48,56 +63,196 @@ struct GroupMetrics {
     cpu_time_system_sum: f64,
 }
 
+impl GroupMetrics {
+    /// Adds the sums of another subgroup exported under the same labels.
+    fn merge(&mut self, other: &GroupMetrics) {
+        self.process_count += other.process_count;
+        self.rss_sum += other.rss_sum;
+        self.pss_sum += other.pss_sum;
+        self.swap_sum += other.swap_sum;
+        self.cpu_percent_sum += other.cpu_percent_sum;
+        self.cpu_time_user_sum += other.cpu_time_user_sum;
+        self.cpu_time_system_sum += other.cpu_time_system_sum;
+    }
+}
+
 /// Handler for the /metrics endpoint.
-#[instrument(skip(state))]
-pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String, MetricsError> {
+#[instrument(skip(state, headers))]
+pub async fn metrics_handler(
+    State(state): State<SharedState>,
+    headers: HeaderMap,
+) -> Result<Response, MetricsError> {
     let start = Instant::now();
     debug!("Processing /metrics request");
 
-    // Trigger cache update with time-based throttling (fire-and-forget)
-    // Only trigger if:
-    // 1. No update is currently in progress (is_updating = false)
-    // 2. Cache is stale (>= CACHE_UPDATE_THROTTLE_SECS since last update) OR never updated
-    //
-    // This prevents excessive cache updates while keeping data reasonably fresh.
-    let should_trigger_update = {
-        let cache = state.cache.read().await;
-        !cache.is_updating
-            && cache
-                .last_updated
-                .map(|t| t.elapsed().as_secs() >= CACHE_UPDATE_THROTTLE_SECS)
-                .unwrap_or(true)
-    };
+    let rendered = latest_metrics(&state).await?;
 
-    if should_trigger_update {
-        debug!("Triggering on-demand cache update");
-        let state_clone = state.clone();
-        tokio::spawn(async move {
-            if let Err(e) = crate::cache_updater::update_cache(&state_clone).await {
-                error!("On-demand cache update failed: {}", e);
-            }
-        });
-    } else {
-        debug!("Cache update already in progress or recently updated, serving stale data");
+    // Record metrics request statistics
+    let request_duration_ms = start.elapsed().as_secs_f64() * 1000.0;
+    state.health_stats.record_metrics_endpoint_call();
+    state
+        .health_stats
+        .record_request_duration(request_duration_ms);
+    state.health_stats.record_http_request();
+
+    state.scrape_duration.set(start.elapsed().as_secs_f64());
+
+    let format = Format::negotiate(&headers);
+    // Encoded once per generation and representation, then shared. The
+    // encoding falls back to identity if compressing failed.
+    let (encoding, body) = rendered.body(format, Encoding::negotiate(&headers));
+    let etag = rendered.etag(format, encoding);
+    let validators = [
+        (header::ETAG, etag.clone()),
+        (header::LAST_MODIFIED, rendered.last_modified.clone()),
+        (
+            header::VARY,
+            HeaderValue::from_static("Accept, Accept-Encoding"),
+        ),
+    ];
+    if etag_matches(&headers, &etag) {
+        debug!(
+            "Metrics request completed: generation {} not modified, {:.3}ms",
+            rendered.generation, request_duration_ms
+        );
+        return Ok((StatusCode::NOT_MODIFIED, validators).into_response());
     }
 
-    // Serve current cache data immediately (may be stale if update is running)
-    // Note: We keep the cache_guard alive during aggregation to use references.
-    // This is safe because we're only reading the data, and it's more efficient
-    // than cloning hundreds or thousands of ProcMem structs.
+    state
+        .health_stats
+        .record_metrics_response_size_kb(body.len() as f64 / 1024.0);
+
+    debug!(
+        "Metrics request completed: generation {}, {:?}/{:?}, {} bytes, {:.3}ms",
+        rendered.generation,
+        format,
+        encoding,
+        body.len(),
+        request_duration_ms
+    );
+
+    let mut response = (validators, body).into_response();
+    let response_headers = response.headers_mut();
+    response_headers.insert(
+        header::CONTENT_TYPE,
+        HeaderValue::from_static(format.content_type()),
+    );
+    if let Some(content_encoding) = encoding.header_value() {
+        response_headers.insert(
+            header::CONTENT_ENCODING,
+            HeaderValue::from_static(content_encoding),
+        );
+    }
+    Ok(response)
+}
+
+/// Whether an `If-None-Match` header of the request matches `etag`.
+fn etag_matches(headers: &HeaderMap, etag: &HeaderValue) -> bool {
+    let etag = etag.to_str().unwrap_or_default();
+    headers
+        .get_all(header::IF_NONE_MATCH)
+        .iter()
+        .filter_map(|value| value.to_str().ok())
+        .flat_map(|value| value.split(','))
+        .map(str::trim)
+        .any(|tag| tag == "*" || tag.trim_start_matches("W/") == etag)
+}
+
+/// Returns a render of the latest cache update, shared with the push task
+/// (see `crate::remote_write`).
+pub async fn latest_metrics(state: &SharedState) -> Result<Arc<RenderedMetrics>, MetricsError> {
+    let cache_updated = state.cache.read().await.last_updated;
+    rendered_metrics(state, cache_updated).await
+}
+
+/// Returns the current render, rendering a new one if it is stale.
+///
+/// Renders are serialized: concurrent scrapes of a stale body wait for the
+/// one render in progress and then share its result.
+async fn rendered_metrics(
+    state: &SharedState,
+    cache_updated: Option<Instant>,
+) -> Result<Arc<RenderedMetrics>, MetricsError> {
+    let coalesce = shortest_system_interval(state);
+    if let Some(rendered) = current_render(state) {
+        if rendered.is_fresh(cache_updated, system_generation(state), coalesce) {
+            state.health_stats.record_cache_hit();
+            return Ok(rendered);
+        }
+    }
+
+    // Another scrape may have rendered while this one waited for the lock
+    let _render_guard = state.render_lock.lock().await;
+    let cache_updated = state.cache.read().await.last_updated;
+    let previous = current_render(state);
+    if let Some(rendered) = &previous {
+        if rendered.is_fresh(cache_updated, system_generation(state), coalesce) {
+            state.health_stats.record_cache_hit();
+            return Ok(Arc::clone(rendered));
+        }
+    }
+    state.health_stats.record_cache_miss();
+
+    let generation = previous.map_or(1, |r| r.generation + 1);
+    state.scrape_generation.set(generation as f64);
+    let rendered = Arc::new(render_metrics(state, generation).await?);
+    *state
+        .rendered_metrics
+        .write()
+        .expect("rendered_metrics lock poisoned") = Some(Arc::clone(&rendered));
+
+    Ok(rendered)
+}
+
+/// Returns the generation of the current system snapshot.
+fn system_generation(state: &SharedState) -> u64 {
+    state
+        .system_snapshot
+        .read()
+        .expect("system snapshot lock poisoned")
+        .generation
+}
+
+/// Returns the last rendered body, if any.
+fn current_render(state: &SharedState) -> Option<Arc<RenderedMetrics>> {
+    state
+        .rendered_metrics
+        .read()
+        .expect("rendered_metrics lock poisoned")
+        .clone()
+}
+
+/// Updates the registry from the cache and the system snapshot, gathers it
+/// and encodes the text body.
+pub async fn render_metrics(
+    state: &SharedState,
+    generation: u64,
+) -> Result<RenderedMetrics, MetricsError> {
+    let start = Instant::now();
+
+    // Render from the current cache data (may be stale if update is running).
+    // The lock is only held to copy the metadata and the snapshot `Arc`; the
+    // aggregation below reads the immutable snapshot without blocking updates.
+    let mut clock = state.health_stats.phases.clock();
     let lock_wait_start = Instant::now();
-    let cache_guard = state.cache.read().await;
+    let (processes, exited, cache_updated, meta) = {
+        let cache = state.cache.read().await;
+        (
+            cache.snapshot(),
+            Arc::clone(&cache.exited),
+            cache.last_updated,
+            (
+                cache.update_duration_seconds,
+                cache.update_success,
+                cache.is_updating,
+            ),
+        )
+    };
     let lock_wait_ms = lock_wait_start.elapsed().as_secs_f64() * 1000.0;
     state
         .health_stats
         .record_lock_wait_duration_ms(lock_wait_ms);
-
-    // Extract metadata before aggregation
-    let meta = (
-        cache_guard.update_duration_seconds,
-        cache_guard.update_success,
-        cache_guard.is_updating,
-    );
+    clock.lap(Phase::RenderSnapshot);
 
     // Update cache metadata metrics
     state.cache_update_duration.set(meta.0);
@@ -107,8 +262,8 @@ pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String,
     state.cache_updating.set(if meta.2 { 1.0 } else { 0.0 });
 
     // Reset only group-level metrics before populating with fresh data.
-    // System-level metrics (disk, network, etc.) are queried fresh on every scrape
-    // and don't need to be reset, improving performance.
+    // System-level metrics (disk, network, etc.) are overwritten from the
+    // system snapshot below and don't need to be reset.
     state.metrics.reset_group_metrics();
 
     let cfg = &state.config;
@@ -116,33 +271,52 @@ pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String,
     let enable_pss = cfg.enable_pss.unwrap_or(true);
     let enable_cpu = cfg.enable_cpu.unwrap_or(true);
 
-    // ========== PHASE 1: Aggregate processes by (group, subgroup) ==========
-    let mut group_aggregations: HashMap<(String, String), GroupMetrics> = HashMap::new();
-    let mut exported_count = 0usize;
+    // ========== PHASE 1: Aggregate processes by subgroup ID ==========
+    let subgroups = registered_subgroups();
+    let mut by_subgroup: Vec<GroupMetrics> = Vec::new();
+    by_subgroup.resize_with(subgroups.len(), GroupMetrics::default);
 
     // Iterate using references since we only need read access for aggregation.
     // This avoids expensive cloning of process data on every metrics scrape.
-    for p in cache_guard.processes.values() {
-        if let Some((group, subgroup)) = classify_process_with_config(&p.name, &state.config) {
-            exported_count += 1;
-
-            let entry = group_aggregations
-                .entry((group.to_string(), subgroup.to_string()))
-                .or_insert_with(GroupMetrics::default);
-
-            entry.rss_sum += p.rss;
-            entry.pss_sum += p.pss;
-            entry.swap_sum += p.vmswap;
-            entry.cpu_percent_sum += p.cpu_percent as f64;
-            entry.cpu_time_user_sum += p.cpu_time_seconds as f64; // TODO: split user/system
-            entry.cpu_time_system_sum += 0.0; // TODO: split user/system
+    for p in processes.values() {
+        let entry = &mut by_subgroup[p.subgroup_id as usize];
+
+        entry.process_count += 1;
+        entry.rss_sum += p.rss;
+        entry.pss_sum += p.pss;
+        entry.swap_sum += p.vmswap;
+        entry.cpu_percent_sum += p.cpu_percent as f64;
+        entry.cpu_time_user_sum += p.cpu_time_seconds as f64; // TODO: split user/system
+        entry.cpu_time_system_sum += 0.0; // TODO: split user/system
+    }
+
+    // CPU time of exited processes keeps the group counters monotonic
+    for (entry, totals) in by_subgroup.iter_mut().zip(exited.iter()) {
+        entry.cpu_time_user_sum += totals.cpu_time_seconds;
+    }
+
+    // Config rules depend only on the subgroup, so they run once per ID.
+    // Subgroups exported under the same labels (every "other" subgroup
+    // becomes other/other) are merged.
+    let mut group_aggregations: HashMap<(Arc<str>, Arc<str>), GroupMetrics> = HashMap::new();
+    let mut exported_count = 0usize;
+    for (info, metrics) in subgroups.iter().zip(&by_subgroup) {
+        if metrics.process_count == 0 && metrics.cpu_time_user_sum == 0.0 {
+            continue;
+        }
+        let labels = apply_config_rules(Arc::clone(&info.group), Arc::clone(&info.subgroup), cfg);
+        if let Some(labels) = labels {
+            exported_count += metrics.process_count;
+            group_aggregations.entry(labels).or_default().merge(metrics);
         }
     }
 
-    // Done with cache - release the read lock
-    drop(cache_guard);
+    // The snapshot stays alive for the eBPF phases, which classify by PID
+    #[cfg(not(feature = "ebpf"))]
+    drop(processes);
 
     state.processes_total.set(exported_count as f64);
+    clock.lap(Phase::RenderAggregate);
 
     // ========== PHASE 2: Export Group-Level Metrics ==========
     for ((group, subgroup), metrics) in group_aggregations {
@@ -189,7 +363,7 @@ pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String,
             let user_counter = state
                 .metrics
                 .group_cpu_seconds_total
-                .with_label_values(&[group.as_str(), subgroup.as_str(), "user"]);
+                .with_label_values(&[group.as_ref(), subgroup.as_ref(), "user"]);
             user_counter.reset();
             user_counter.inc_by(metrics.cpu_time_user_sum);
 
@@ -197,462 +371,503 @@ pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String,
             let system_counter = state
                 .metrics
                 .group_cpu_seconds_total
-                .with_label_values(&[group.as_str(), subgroup.as_str(), "system"]);
+                .with_label_values(&[group.as_ref(), subgroup.as_ref(), "system"]);
             system_counter.reset();
             system_counter.inc_by(metrics.cpu_time_system_sum);
         }
     }
+    clock.lap(Phase::RenderGroups);
+
+    // System readings published by the collectors; held only while they are
+    // copied into the registry, no I/O happens under the lock
+    let system = state
+        .system_snapshot
+        .read()
+        .expect("system snapshot lock poisoned");
+    let system_generation = system.generation;
 
     // ========== PHASE 2.5: Block I/O Group Metrics (from eBPF) ==========
     #[cfg(feature = "ebpf")]
-    if let Some(ebpf) = &state.ebpf {
-        match ebpf.read_process_blkio_stats() {
-            Ok(blkio_stats) => {
-                // Aggregate per (group, subgroup)
-                // Tuple format: (read_bytes, write_bytes, read_ops, write_ops)
-                let mut blkio_groups: HashMap<(String, String), (u64, u64, u64, u64)> =
-                    HashMap::new();
-
-                for stat in blkio_stats {
-                    let (group, subgroup) = crate::process::classify_process_raw(&stat.comm);
-                    let entry = blkio_groups
-                        .entry((group.to_string(), subgroup.to_string()))
-                        .or_insert((0, 0, 0, 0));
-
-                    entry.0 += stat.read_bytes;
-                    entry.1 += stat.write_bytes;
-                    entry.2 += stat.read_ops;
-                    entry.3 += stat.write_ops;
-                }
+    if let Some(blkio_stats) = &system.ebpf_blkio {
+        // Aggregate per subgroup ID
+        // Tuple format: (read_bytes, write_bytes, read_ops, write_ops)
+        let mut blkio_groups: Vec<Option<(u64, u64, u64, u64)>> = vec![None; subgroups.len()];
+
+        for stat in blkio_stats {
+            let id = stat.subgroup_id(&processes);
+            let entry = blkio_groups[id as usize].get_or_insert((0, 0, 0, 0));
+
+            entry.0 += stat.read_bytes;
+            entry.1 += stat.write_bytes;
+            entry.2 += stat.read_ops;
+            entry.3 += stat.write_ops;
+        }
 
-                for ((group, subgroup), (read_bytes, write_bytes, read_ops, write_ops)) in
-                    blkio_groups
-                {
-                    // For counters reporting cumulative eBPF values, use reset + inc_by pattern
-                    let read_bytes_counter = state
-                        .metrics
-                        .group_blkio_read_bytes_total
-                        .with_label_values(&[&group, &subgroup]);
-                    read_bytes_counter.reset();
-                    read_bytes_counter.inc_by(read_bytes as f64);
+        for (info, totals) in subgroups.iter().zip(blkio_groups) {
+            let (read_bytes, write_bytes, read_ops, write_ops) = match totals {
+                Some(totals) => totals,
+                None => continue,
+            };
+            let (group, subgroup) = (info.group.as_ref(), info.subgroup.as_ref());
+
+            // For counters reporting cumulative eBPF values, use reset + inc_by pattern
+            let read_bytes_counter = state
+                .metrics
+                .group_blkio_read_bytes_total
+                .with_label_values(&[&group, &subgroup]);
+            read_bytes_counter.reset();
+            read_bytes_counter.inc_by(read_bytes as f64);
                     
-                    let write_bytes_counter = state
-                        .metrics
-                        .group_blkio_write_bytes_total
-                        .with_label_values(&[&group, &subgroup]);
-                    write_bytes_counter.reset();
-                    write_bytes_counter.inc_by(write_bytes as f64);
+            let write_bytes_counter = state
+                .metrics
+                .group_blkio_write_bytes_total
+                .with_label_values(&[&group, &subgroup]);
+            write_bytes_counter.reset();
+            write_bytes_counter.inc_by(write_bytes as f64);
                     
-                    let read_ops_counter = state
-                        .metrics
-                        .group_blkio_read_syscalls_total
-                        .with_label_values(&[&group, &subgroup]);
-                    read_ops_counter.reset();
-                    read_ops_counter.inc_by(read_ops as f64);
+            let read_ops_counter = state
+                .metrics
+                .group_blkio_read_syscalls_total
+                .with_label_values(&[&group, &subgroup]);
+            read_ops_counter.reset();
+            read_ops_counter.inc_by(read_ops as f64);
                     
-                    let write_ops_counter = state
-                        .metrics
-                        .group_blkio_write_syscalls_total
-                        .with_label_values(&[&group, &subgroup]);
-                    write_ops_counter.reset();
-                    write_ops_counter.inc_by(write_ops as f64);
-                }
-            }
-            Err(e) => {
-                warn!("Failed to read eBPF block I/O statistics: {}", e);
-            }
+            let write_ops_counter = state
+                .metrics
+                .group_blkio_write_syscalls_total
+                .with_label_values(&[&group, &subgroup]);
+            write_ops_counter.reset();
+            write_ops_counter.inc_by(write_ops as f64);
         }
     }
+    clock.lap(Phase::RenderBlkio);
 
     // ========== PHASE 3: System-Level CPU Metrics ==========
-    match state.system_cpu_cache.calculate_usage_ratios() {
-        Ok(cpu_ratios) => {
-            // Get the "cpu" (total) values for system ratios
-            if let Some(&usage_ratio) = cpu_ratios.usage.get("cpu") {
-                state.metrics.system_cpu_usage_ratio.set(usage_ratio);
-            }
-            if let Some(&idle_ratio) = cpu_ratios.idle.get("cpu") {
-                state.metrics.system_cpu_idle_ratio.set(idle_ratio);
-            }
-            if let Some(&iowait_ratio) = cpu_ratios.iowait.get("cpu") {
-                state.metrics.system_cpu_iowait_ratio.set(iowait_ratio);
-            }
-            if let Some(&steal_ratio) = cpu_ratios.steal.get("cpu") {
-                state.metrics.system_cpu_steal_ratio.set(steal_ratio);
-            }
-        }
-        Err(e) => {
-            warn!("Failed to calculate CPU ratios: {}", e);
-        }
+    if let Some(cpu_ratios) = system.cpu_ratios {
+        state.metrics.system_cpu_usage_ratio.set(cpu_ratios.usage);
+        state.metrics.system_cpu_idle_ratio.set(cpu_ratios.idle);
+        state.metrics.system_cpu_iowait_ratio.set(cpu_ratios.iowait);
+        state.metrics.system_cpu_steal_ratio.set(cpu_ratios.steal);
     }
 
     // Load averages
-    match system::read_load_average() {
-        Ok(load_avg) => {
-            state.metrics.system_cpu_load_1.set(load_avg.one_min);
-            state.metrics.system_cpu_load_5.set(load_avg.five_min);
-            state.metrics.system_cpu_load_15.set(load_avg.fifteen_min);
-        }
-        Err(e) => {
-            warn!("Failed to read load average: {}", e);
-        }
+    if let Some(load_avg) = system.load_average {
+        state.metrics.system_cpu_load_1.set(load_avg.one_min);
+        state.metrics.system_cpu_load_5.set(load_avg.five_min);
+        state.metrics.system_cpu_load_15.set(load_avg.fifteen_min);
     }
+    clock.lap(Phase::RenderCpu);
 
     // ========== PHASE 4: System-Level Memory Metrics ==========
-    match system::read_extended_memory_info() {
-        Ok(mem_info) => {
-            state
-                .metrics
-                .system_memory_total_bytes
-                .set(mem_info.total_bytes as f64);
-            state
-                .metrics
-                .system_memory_available_bytes
-                .set(mem_info.available_bytes as f64);
-            state
-                .metrics
-                .system_memory_cached_bytes
-                .set(mem_info.cached_bytes as f64);
-            state
-                .metrics
-                .system_memory_buffers_bytes
-                .set(mem_info.buffers_bytes as f64);
-
-            // Calculate memory used ratio
-            if mem_info.total_bytes > 0 {
-                let mem_used_ratio = (mem_info.total_bytes - mem_info.available_bytes) as f64
-                    / mem_info.total_bytes as f64;
-                state.metrics.system_memory_used_ratio.set(mem_used_ratio);
-            }
-
-            // Calculate swap used ratio
-            if mem_info.swap_total_bytes > 0 {
-                let swap_used_ratio = (mem_info.swap_total_bytes - mem_info.swap_free_bytes) as f64
-                    / mem_info.swap_total_bytes as f64;
-                state.metrics.system_swap_used_ratio.set(swap_used_ratio);
-            } else {
-                state.metrics.system_swap_used_ratio.set(0.0);
-            }
+    if let Some(mem_info) = system.memory {
+        state
+            .metrics
+            .system_memory_total_bytes
+            .set(mem_info.total_bytes as f64);
+        state
+            .metrics
+            .system_memory_available_bytes
+            .set(mem_info.available_bytes as f64);
+        state
+            .metrics
+            .system_memory_cached_bytes
+            .set(mem_info.cached_bytes as f64);
+        state
+            .metrics
+            .system_memory_buffers_bytes
+            .set(mem_info.buffers_bytes as f64);
+
+        // Calculate memory used ratio
+        if mem_info.total_bytes > 0 {
+            let mem_used_ratio = (mem_info.total_bytes - mem_info.available_bytes) as f64
+                / mem_info.total_bytes as f64;
+            state.metrics.system_memory_used_ratio.set(mem_used_ratio);
         }
-        Err(e) => {
-            warn!("Failed to read memory info: {}", e);
+
+        // Calculate swap used ratio
+        if mem_info.swap_total_bytes > 0 {
+            let swap_used_ratio = (mem_info.swap_total_bytes - mem_info.swap_free_bytes) as f64
+                / mem_info.swap_total_bytes as f64;
+            state.metrics.system_swap_used_ratio.set(swap_used_ratio);
+        } else {
+            state.metrics.system_swap_used_ratio.set(0.0);
         }
     }
+    clock.lap(Phase::RenderMemory);
 
     // ========== PHASE 5: System-Level Disk Metrics ==========
-    match collectors::diskstats::read_diskstats() {
-        Ok(diskstats) => {
-            for (device, stats) in diskstats {
-                // For counters reporting cumulative disk stats, use reset + inc_by pattern
-                // Read bytes
-                let read_counter = state
-                    .metrics
-                    .system_disk_read_bytes_total
-                    .with_label_values(&[&device]);
-                read_counter.reset();
-                read_counter.inc_by(stats.sectors_read as f64 * 512.0);
-
-                // Write bytes
-                let write_counter = state
-                    .metrics
-                    .system_disk_write_bytes_total
-                    .with_label_values(&[&device]);
-                write_counter.reset();
-                write_counter.inc_by(stats.sectors_written as f64 * 512.0);
-
-                // I/O time in seconds (convert from milliseconds)
-                let io_time_counter = state
-                    .metrics
-                    .system_disk_io_time_seconds_total
-                    .with_label_values(&[&device]);
-                io_time_counter.reset();
-                io_time_counter.inc_by(stats.time_io_ms as f64 / 1000.0);
+    // Handles are resolved once per device list, not per render
+    let mut handles = state
+        .system_handles
+        .lock()
+        .expect("system_handles lock poisoned");
+    if let Some(diskstats) = &system.diskstats {
+        let disks = handles.disks.update(
+            diskstats,
+            |device| state.metrics.disk_handles(device),
+            |device| state.metrics.remove_disk(device),
+        );
+        for ((_, stats), disk) in diskstats.devices.iter().zip(disks) {
+            // For counters reporting cumulative disk stats, use reset + inc_by pattern
+            disk.read_bytes.reset();
+            disk.read_bytes.inc_by(stats.sectors_read as f64 * 512.0);
+            disk.write_bytes.reset();
+            disk.write_bytes
+                .inc_by(stats.sectors_written as f64 * 512.0);
+
+            // I/O time in seconds (convert from milliseconds)
+            disk.io_time_seconds.reset();
+            disk.io_time_seconds
+                .inc_by(stats.time_io_ms as f64 / 1000.0);
+
+            // Queue depth (I/Os in progress) - this is a gauge, keep as-is
+            disk.queue_depth.set(stats.ios_in_progress as f64);
+        }
+    }
+    clock.lap(Phase::RenderDisk);
 
-                // Queue depth (I/Os in progress) - this is a gauge, keep as-is
-                state
-                    .metrics
-                    .system_disk_queue_depth
-                    .with_label_values(&[&device])
-                    .set(stats.ios_in_progress as f64);
+    // ========== PHASE 6: System-Level Network Metrics ==========
+    if let Some(netdevs) = &system.netdev {
+        let interfaces = handles.netdevs.update(
+            netdevs,
+            |device| state.metrics.netdev_handles(device),
+            |device| state.metrics.remove_netdev(device),
+        );
+        for ((_, stats), net) in netdevs.devices.iter().zip(interfaces) {
+            // For counters reporting cumulative network stats, use reset + inc_by pattern
+            for (counter, value) in [
+                (&net.rx_bytes, stats.receive_bytes),
+                (&net.tx_bytes, stats.transmit_bytes),
+                (&net.rx_errors, stats.receive_errs),
+                (&net.tx_errors, stats.transmit_errs),
+                (&net.rx_drops, stats.receive_drop),
+                (&net.tx_drops, stats.transmit_drop),
+            ] {
+                counter.reset();
+                counter.inc_by(value as f64);
             }
         }
-        Err(e) => {
-            warn!("Failed to read disk statistics: {}", e);
-        }
     }
+    drop(handles);
+    clock.lap(Phase::RenderNetwork);
 
-    // ========== PHASE 6: System-Level Network Metrics ==========
-    match collectors::netdev::read_netdev_stats() {
-        Ok(netdevs) => {
-            for (device, stats) in netdevs {
-                // For counters reporting cumulative network stats, use reset + inc_by pattern
-                // RX bytes
-                let rx_counter = state
+    // ========== PHASE 6.5: System-Level Filesystem Metrics ==========
+    if state.config.enable_filesystem_collector.unwrap_or(true) {
+        if let Some(filesystems) = &system.filesystems {
+            // Unmounted filesystems drop out with the mount table
+            for vec in [
+                &state.metrics.system_filesystem_avail_bytes,
+                &state.metrics.system_filesystem_size_bytes,
+                &state.metrics.system_filesystem_files,
+                &state.metrics.system_filesystem_files_free,
+                &state.metrics.system_filesystem_stale,
+                &state.metrics.system_filesystem_collect_duration_seconds,
+            ] {
+                vec.reset();
+            }
+            for fs in filesystems {
+                state
                     .metrics
-                    .system_net_rx_bytes_total
-                    .with_label_values(&[&device]);
-                rx_counter.reset();
-                rx_counter.inc_by(stats.receive_bytes as f64);
+                    .system_filesystem_avail_bytes
+                    .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
+                    .set(fs.available_bytes as f64);
 
-                // TX bytes
-                let tx_counter = state
+                state
                     .metrics
-                    .system_net_tx_bytes_total
-                    .with_label_values(&[&device]);
-                tx_counter.reset();
-                tx_counter.inc_by(stats.transmit_bytes as f64);
+                    .system_filesystem_size_bytes
+                    .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
+                    .set(fs.size_bytes as f64);
 
-                // RX errors
-                let rx_err_counter = state
+                state
                     .metrics
-                    .system_net_rx_errors_total
-                    .with_label_values(&[&device]);
-                rx_err_counter.reset();
-                rx_err_counter.inc_by(stats.receive_errs as f64);
+                    .system_filesystem_files
+                    .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
+                    .set(fs.files_total as f64);
 
-                // TX errors
-                let tx_err_counter = state
+                state
                     .metrics
-                    .system_net_tx_errors_total
-                    .with_label_values(&[&device]);
-                tx_err_counter.reset();
-                tx_err_counter.inc_by(stats.transmit_errs as f64);
+                    .system_filesystem_files_free
+                    .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
+                    .set(fs.files_free as f64);
 
-                // RX drops
-                let rx_drop_counter = state
+                state
                     .metrics
-                    .system_net_drops_total
-                    .with_label_values(&[device.as_str(), "rx"]);
-                rx_drop_counter.reset();
-                rx_drop_counter.inc_by(stats.receive_drop as f64);
+                    .system_filesystem_stale
+                    .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
+                    .set(if fs.stale { 1.0 } else { 0.0 });
 
-                // TX drops
-                let tx_drop_counter = state
+                state
                     .metrics
-                    .system_net_drops_total
-                    .with_label_values(&[device.as_str(), "tx"]);
-                tx_drop_counter.reset();
-                tx_drop_counter.inc_by(stats.transmit_drop as f64);
-            }
-        }
-        Err(e) => {
-            warn!("Failed to read network device statistics: {}", e);
-        }
-    }
-
-    // ========== PHASE 6.5: System-Level Filesystem Metrics ==========
-    if state.config.enable_filesystem_collector.unwrap_or(true) {
-        match collectors::filesystem::read_filesystem_stats() {
-            Ok(filesystems) => {
-                for fs in filesystems {
-                    state
-                        .metrics
-                        .system_filesystem_avail_bytes
-                        .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
-                        .set(fs.available_bytes as f64);
-
-                    state
-                        .metrics
-                        .system_filesystem_size_bytes
-                        .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
-                        .set(fs.size_bytes as f64);
-
-                    state
-                        .metrics
-                        .system_filesystem_files
-                        .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
-                        .set(fs.files_total as f64);
-
-                    state
-                        .metrics
-                        .system_filesystem_files_free
-                        .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
-                        .set(fs.files_free as f64);
-                }
-            }
-            Err(e) => {
-                warn!("Failed to read filesystem statistics: {}", e);
+                    .system_filesystem_collect_duration_seconds
+                    .with_label_values(&[&fs.device, &fs.mount_point, &fs.fstype])
+                    .set(fs.collect_seconds);
             }
         }
     }
+    clock.lap(Phase::RenderFilesystem);
 
     // ========== PHASE 7: Hardware/Host Metrics ==========
     // Thermal sensors (if enabled)
     if state.config.enable_thermal_collector.unwrap_or(true) {
-        match collectors::thermal::collect_temperatures() {
-            Ok(temperatures) => {
-                for (sensor, temp) in temperatures {
-                    state
-                        .metrics
-                        .system_cpu_temp_celsius
-                        .with_label_values(&[&sensor])
-                        .set(temp);
-                }
-            }
-            Err(e) => {
-                warn!("Failed to read thermal sensors: {}", e);
+        if let Some(temperatures) = &system.temperatures {
+            for (sensor, temp) in temperatures {
+                state
+                    .metrics
+                    .system_cpu_temp_celsius
+                    .with_label_values(&[&sensor])
+                    .set(*temp);
             }
         }
     }
 
     // Uptime
-    match system::read_uptime() {
-        Ok(uptime) => {
-            state.metrics.system_uptime_seconds.set(uptime);
-        }
-        Err(e) => {
-            warn!("Failed to read system uptime: {}", e);
-        }
+    if let Some(uptime) = system.uptime_seconds {
+        state.metrics.system_uptime_seconds.set(uptime);
     }
 
     // Boot time, context switches, and forks from /proc/stat
-    match system::read_stat_counters() {
-        Ok((boot_time, context_switches, forks)) => {
-            state.metrics.system_boot_time_seconds.set(boot_time as f64);
+    if let Some((boot_time, context_switches, forks)) = system.stat_counters {
+        state.metrics.system_boot_time_seconds.set(boot_time as f64);
             
-            // For counters, use reset + inc_by pattern
-            state.metrics.system_context_switches_total.reset();
-            state.metrics.system_context_switches_total.inc_by(context_switches as f64);
+        // For counters, use reset + inc_by pattern
+        state.metrics.system_context_switches_total.reset();
+        state.metrics.system_context_switches_total.inc_by(context_switches as f64);
             
-            state.metrics.system_forks_total.reset();
-            state.metrics.system_forks_total.inc_by(forks as f64);
-        }
-        Err(e) => warn!("Failed to read stat counters: {}", e),
+        state.metrics.system_forks_total.reset();
+        state.metrics.system_forks_total.inc_by(forks as f64);
     }
 
     // Uname info
-    match system::read_uname_info() {
-        Ok((sysname, release, version, machine)) => {
-            state
-                .metrics
-                .system_uname_info
-                .with_label_values(&[&sysname, &release, &version, &machine])
-                .set(1.0);
-        }
-        Err(e) => warn!("Failed to read uname info: {}", e),
+    if let Some((sysname, release, version, machine)) = &system.uname {
+        state
+            .metrics
+            .system_uname_info
+            .with_label_values(&[&sysname, &release, &version, &machine])
+            .set(1.0);
     }
+    clock.lap(Phase::RenderHost);
 
     // ========== PHASE 8: Kernel/Runtime Metrics ==========
     // File descriptors
-    match system::read_system_fd_stats() {
-        Ok((open_fds, _unused_fds, max_fds)) => {
-            state
-                .metrics
-                .system_open_fds
-                .with_label_values(&["allocated"])
-                .set(open_fds as f64);
-            state
-                .metrics
-                .system_open_fds
-                .with_label_values(&["max"])
-                .set(max_fds as f64);
-        }
-        Err(e) => {
-            warn!("Failed to read system FD stats: {}", e);
-        }
+    if let Some((open_fds, _unused_fds, max_fds)) = system.fd_stats {
+        state
+            .metrics
+            .system_open_fds
+            .with_label_values(&["allocated"])
+            .set(open_fds as f64);
+        state
+            .metrics
+            .system_open_fds
+            .with_label_values(&["max"])
+            .set(max_fds as f64);
     }
 
     // Entropy
-    match system::read_entropy() {
-        Ok(entropy) => {
-            state.metrics.system_entropy_bits.set(entropy as f64);
-        }
-        Err(e) => warn!("Failed to read entropy: {}", e),
+    if let Some(entropy) = system.entropy_bits {
+        state.metrics.system_entropy_bits.set(entropy as f64);
     }
+    clock.lap(Phase::RenderKernel);
 
     // ========== PHASE 9: PSI (Pressure Stall Information) Metrics ==========
     if state.config.enable_psi_collector.unwrap_or(true) {
         // PSI metrics are cumulative totals from the kernel, so we use counters
-        if let Ok(cpu_psi) = system::read_psi_some_total("/proc/pressure/cpu") {
+        if let Some(cpu_psi) = system.psi_cpu_seconds {
             state.metrics.system_cpu_psi_wait_seconds_total.reset();
             state.metrics.system_cpu_psi_wait_seconds_total.inc_by(cpu_psi);
         }
-        if let Ok(mem_psi) = system::read_psi_some_total("/proc/pressure/memory") {
+        if let Some(mem_psi) = system.psi_memory_seconds {
             state.metrics.system_memory_psi_wait_seconds_total.reset();
             state.metrics.system_memory_psi_wait_seconds_total.inc_by(mem_psi);
         }
-        if let Ok(io_psi) = system::read_psi_some_total("/proc/pressure/io") {
+        if let Some(io_psi) = system.psi_io_seconds {
             state.metrics.system_disk_psi_wait_seconds_total.reset();
             state.metrics.system_disk_psi_wait_seconds_total.inc_by(io_psi);
         }
     }
+    clock.lap(Phase::RenderPsi);
 
     // ========== PHASE 10: eBPF Group Network Metrics (if available) ==========
     #[cfg(feature = "ebpf")]
-    if let Some(ebpf) = &state.ebpf {
-        match ebpf.read_process_net_stats() {
-            Ok(net_stats) => {
-                // Aggregated per (group, subgroup)
-                let mut net_groups: HashMap<(String, String), (u64, u64)> = HashMap::new();
-
-                for stat in net_stats {
-                    let (group, subgroup) = crate::process::classify_process_raw(&stat.comm);
-                    let entry = net_groups
-                        .entry((group.to_string(), subgroup.to_string()))
-                        .or_insert((0, 0));
-
-                    entry.0 += stat.rx_bytes;
-                    entry.1 += stat.tx_bytes;
-                }
+    if let Some(net_stats) = &system.ebpf_net {
+        // Aggregated per subgroup ID
+        let mut net_groups: Vec<Option<(u64, u64)>> = vec![None; subgroups.len()];
 
-                for ((group, subgroup), (rx, tx)) in net_groups {
-                    // For counters, use reset + inc_by pattern
-                    let rx_counter = state
-                        .metrics
-                        .group_net_rx_bytes_total
-                        .with_label_values(&[&group, &subgroup]);
-                    rx_counter.reset();
-                    rx_counter.inc_by(rx as f64);
+        for stat in net_stats {
+            let id = stat.subgroup_id(&processes);
+            let entry = net_groups[id as usize].get_or_insert((0, 0));
 
-                    let tx_counter = state
-                        .metrics
-                        .group_net_tx_bytes_total
-                        .with_label_values(&[&group, &subgroup]);
-                    tx_counter.reset();
-                    tx_counter.inc_by(tx as f64);
-                }
-            }
-            Err(e) => {
-                warn!("Failed to read eBPF network statistics: {}", e);
-            }
+            entry.0 += stat.rx_bytes;
+            entry.1 += stat.tx_bytes;
         }
 
-        // NOTE: Group network connections tracking requires eBPF-based
-        // connection state tracking which is not yet implemented.
-        // The metric group_net_connections_total{proto="tcp/udp"} will be
-        // added in a future enhancement.
+        for (info, totals) in subgroups.iter().zip(net_groups) {
+            let (rx, tx) = match totals {
+                Some(totals) => totals,
+                None => continue,
+            };
+            let (group, subgroup) = (info.group.as_ref(), info.subgroup.as_ref());
+
+            // For counters, use reset + inc_by pattern
+            let rx_counter = state
+                .metrics
+                .group_net_rx_bytes_total
+                .with_label_values(&[&group, &subgroup]);
+            rx_counter.reset();
+            rx_counter.inc_by(rx as f64);
+
+            let tx_counter = state
+                .metrics
+                .group_net_tx_bytes_total
+                .with_label_values(&[&group, &subgroup]);
+            tx_counter.reset();
+            tx_counter.inc_by(tx as f64);
+        }
     }
 
+    // NOTE: Group network connections tracking requires eBPF-based
+    // connection state tracking which is not yet implemented.
+    // The metric group_net_connections_total{proto="tcp/udp"} will be
+    // added in a future enhancement.
+    clock.lap(Phase::RenderEbpfNet);
+
     // ========== PHASE 10.5: TCP Connection Statistics (eBPF) ==========
     #[cfg(feature = "ebpf")]
-    if let Some(ebpf) = &state.ebpf {
-        if state.config.enable_tcp_tracking.unwrap_or(true) {
-            match ebpf.read_tcp_stats() {
-                Ok(tcp_stats) => {
-                    state.metrics.system_tcp_connections_established.set(tcp_stats.established as f64);
-                    state.metrics.system_tcp_connections_syn_sent.set(tcp_stats.syn_sent as f64);
-                    state.metrics.system_tcp_connections_syn_recv.set(tcp_stats.syn_recv as f64);
-                    state.metrics.system_tcp_connections_fin_wait1.set(tcp_stats.fin_wait1 as f64);
-                    state.metrics.system_tcp_connections_fin_wait2.set(tcp_stats.fin_wait2 as f64);
-                    state.metrics.system_tcp_connections_time_wait.set(tcp_stats.time_wait as f64);
-                    state.metrics.system_tcp_connections_close.set(tcp_stats.close as f64);
-                    state.metrics.system_tcp_connections_close_wait.set(tcp_stats.close_wait as f64);
-                    state.metrics.system_tcp_connections_last_ack.set(tcp_stats.last_ack as f64);
-                    state.metrics.system_tcp_connections_listen.set(tcp_stats.listen as f64);
-                    state.metrics.system_tcp_connections_closing.set(tcp_stats.closing as f64);
+    if let Some(tcp_stats) = &system.ebpf_tcp {
+        state.metrics.system_tcp_connections_established.set(tcp_stats.established as f64);
+        state.metrics.system_tcp_connections_syn_sent.set(tcp_stats.syn_sent as f64);
+        state.metrics.system_tcp_connections_syn_recv.set(tcp_stats.syn_recv as f64);
+        state.metrics.system_tcp_connections_fin_wait1.set(tcp_stats.fin_wait1 as f64);
+        state.metrics.system_tcp_connections_fin_wait2.set(tcp_stats.fin_wait2 as f64);
+        state.metrics.system_tcp_connections_time_wait.set(tcp_stats.time_wait as f64);
+        state.metrics.system_tcp_connections_close.set(tcp_stats.close as f64);
+        state.metrics.system_tcp_connections_close_wait.set(tcp_stats.close_wait as f64);
+        state.metrics.system_tcp_connections_last_ack.set(tcp_stats.last_ack as f64);
+        state.metrics.system_tcp_connections_listen.set(tcp_stats.listen as f64);
+        state.metrics.system_tcp_connections_closing.set(tcp_stats.closing as f64);
+    }
+    clock.lap(Phase::RenderTcp);
+
+    // ========== PHASE 10.6: I/O Histogram Group Metrics (eBPF) ==========
+    // Bucketed in the kernel per subgroup ID; only subgroups with events
+    // are in the snapshot
+    #[cfg(feature = "ebpf")]
+    if let Some(histograms) = &system.ebpf_io_histograms {
+        for histograms in histograms {
+            let info = match subgroups.get(histograms.subgroup_id as usize) {
+                Some(info) => info,
+                None => continue,
+            };
+            let (group, subgroup) = (info.group.as_ref(), info.subgroup.as_ref());
+
+            for (metric, histogram, scale) in [
+                (
+                    &state.metrics.group_net_syscall_latency_seconds,
+                    &histograms.net_latency_ns,
+                    1e-9,
+                ),
+                (
+                    &state.metrics.group_net_syscall_size_bytes,
+                    &histograms.net_size_bytes,
+                    1.0,
+                ),
+                (
+                    &state.metrics.group_blkio_request_size_bytes,
+                    &histograms.blkio_size_bytes,
+                    1.0,
+                ),
+            ] {
+                if histogram.count() > 0 {
+                    metric.set(
+                        group,
+                        subgroup,
+                        &histogram.buckets,
+                        histogram.sum as f64 * scale,
+                    );
+                }
+            }
+        }
+    }
+    clock.lap(Phase::RenderIoHistograms);
+
+    // ========== PHASE 10.7: cgroup Metrics ==========
+    // Process counts come from the last scan, usage from the cgroups
+    // collector; both are limited to the max_cgroups largest cgroups
+    if cfg.enable_cgroups.unwrap_or(false) {
+        let members = Arc::clone(&state.cgroups.read().expect("cgroups lock poisoned"));
+        for members in members.iter() {
+            state
+                .metrics
+                .cgroup_processes
+                .with_label_values(&[&members.path])
+                .set(members.processes as f64);
+        }
+
+        if let Some(cgroups) = &system.cgroups {
+            for stats in cgroups {
+                let cgroup: &str = &stats.path;
+                for (kind, bytes) in [
+                    ("current", stats.memory_bytes),
+                    ("anon", stats.memory_anon_bytes),
+                    ("file", stats.memory_file_bytes),
+                    ("swap", stats.memory_swap_bytes),
+                ] {
+                    state
+                        .metrics
+                        .cgroup_memory_bytes
+                        .with_label_values(&[cgroup, kind])
+                        .set(bytes as f64);
                 }
-                Err(e) => {
-                    warn!("Failed to read TCP connection statistics: {}", e);
+
+                // For counters, use reset + inc_by pattern
+                for (mode, seconds) in [
+                    ("user", stats.cpu_user_seconds),
+                    ("system", stats.cpu_system_seconds),
+                ] {
+                    let counter = state
+                        .metrics
+                        .cgroup_cpu_seconds_total
+                        .with_label_values(&[cgroup, mode]);
+                    counter.reset();
+                    counter.inc_by(seconds);
+                }
+                let throttled = state
+                    .metrics
+                    .cgroup_cpu_throttled_seconds_total
+                    .with_label_values(&[cgroup]);
+                throttled.reset();
+                throttled.inc_by(stats.cpu_throttled_seconds);
+            }
+
+            #[cfg(feature = "ebpf")]
+            if let Some(cgroup_io) = &system.ebpf_cgroup_io {
+                for (cgroup, io) in join_cgroup_io(cgroups, cgroup_io) {
+                    for (metric, direction, bytes) in [
+                        (&state.metrics.cgroup_net_bytes_total, "rx", io.rx_bytes),
+                        (&state.metrics.cgroup_net_bytes_total, "tx", io.tx_bytes),
+                        (
+                            &state.metrics.cgroup_blkio_bytes_total,
+                            "read",
+                            io.read_bytes,
+                        ),
+                        (
+                            &state.metrics.cgroup_blkio_bytes_total,
+                            "write",
+                            io.write_bytes,
+                        ),
+                    ] {
+                        let counter = metric.with_label_values(&[cgroup, direction]);
+                        counter.reset();
+                        counter.inc_by(bytes as f64);
+                    }
                 }
             }
         }
     }
+    clock.lap(Phase::RenderCgroups);
 
     // ========== PHASE 11: eBPF Performance Metrics ==========
     #[cfg(feature = "ebpf")]
-    if let Some(ebpf) = &state.ebpf {
-        let perf_stats = ebpf.get_performance_stats();
-        
+    if let Some(perf_stats) = system.ebpf_perf {
         if perf_stats.enabled {
             // For counters, use reset + inc_by pattern to set absolute cumulative values
             // Total cumulative events processed
@@ -672,6 +887,14 @@ pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String,
         }
     }
 
+    drop(system);
+    clock.lap(Phase::RenderEbpfPerf);
+
+    // ========== PHASE 11.5: Exporter Phase Profiles ==========
+    // Includes this render's sections up to here; encoding is profiled in
+    // the next render
+    state.phase_metrics.update(&state.health_stats.phases);
+
     // ========== PHASE 12: Encode and Return Metrics ==========
     let serialize_start = Instant::now();
     let families = state.registry.gather();
@@ -697,12 +920,7 @@ pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String,
     state
         .health_stats
         .record_serialization_duration_ms(serialization_ms);
-
-    // Record response size
-    let response_size_kb = buffer.len() as f64 / 1024.0;
-    state
-        .health_stats
-        .record_metrics_response_size_kb(response_size_kb);
+    clock.lap(Phase::RenderEncode);
 
     // Count time series
     let time_series_count = families.iter().map(|f| f.get_metric().len()).sum::<usize>() as u64;
@@ -710,23 +928,127 @@ pub async fn metrics_handler(State(state): State<SharedState>) -> Result<String,
         .health_stats
         .record_total_time_series(time_series_count);
 
-    // Record metrics request statistics
-    let request_duration_ms = start.elapsed().as_secs_f64() * 1000.0;
-    state.health_stats.record_metrics_endpoint_call();
-    state
-        .health_stats
-        .record_request_duration(request_duration_ms);
-    state.health_stats.record_http_request();
-    state.health_stats.record_cache_hit();
-
-    state.scrape_duration.set(start.elapsed().as_secs_f64());
-
     debug!(
-        "Metrics request completed: {} processes, {} bytes, {:.3}ms",
+        "Rendered metrics: {} processes, {} bytes, {:.3}ms",
         exported_count,
         buffer.len(),
-        request_duration_ms
+        start.elapsed().as_secs_f64() * 1000.0
     );
 
-    String::from_utf8(buffer).map_err(|_| MetricsError::EncodingFailed)
+    Ok(RenderedMetrics::new(
+        families,
+        Bytes::from(buffer),
+        generation,
+        cache_updated,
+        system_generation,
+    ))
+}
+
+/// Pairs the kernel's per-cgroup I/O with the exported cgroups.
+///
+/// The kernel keys cgroup I/O by cgroup ID, which is the inode of the cgroup
+/// directory read by the collector. With `cgroup_depth` both sides use the
+/// ancestor at that depth (see `EbpfOptions::cgroup_level`). I/O of cgroups
+/// that are not exported is skipped.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+fn join_cgroup_io<'a>(
+    cgroups: &'a [CgroupStats],
+    cgroup_io: &'a [CgroupIoStats],
+) -> Vec<(&'a str, &'a CgroupIoStats)> {
+    let paths: HashMap<u64, &str> = cgroups
+        .iter()
+        .map(|stats| (stats.id, &*stats.path))
+        .collect();
+    cgroup_io
+        .iter()
+        .filter_map(|io| paths.get(&io.cgroup_id).map(|&path| (path, io)))
+        .collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::cache_updater::update_cache;
+    use crate::collectors::cgroup::read_cgroup_stats;
+    use crate::fixtures::{app_state, write_proc_tree, ProcTreeSpec};
+    use crate::process::CgroupEntry;
+    use crate::scheduler::collect_all_system;
+    use std::os::unix::fs::MetadataExt;
+
+    fn request_headers(if_none_match: &[&str]) -> HeaderMap {
+        let mut headers = HeaderMap::new();
+        for value in if_none_match {
+            headers.append(header::IF_NONE_MATCH, HeaderValue::from_str(value).unwrap());
+        }
+        headers
+    }
+
+    #[test]
+    fn test_etag_matches() {
+        let etag = HeaderValue::from_static("\"abc-7\"");
+        assert!(etag_matches(&request_headers(&["\"abc-7\""]), &etag));
+        assert!(etag_matches(&request_headers(&["W/\"abc-7\""]), &etag));
+        assert!(etag_matches(
+            &request_headers(&["\"abc-6\", \"abc-7\""]),
+            &etag
+        ));
+        assert!(etag_matches(&request_headers(&["*"]), &etag));
+        assert!(!etag_matches(&request_headers(&["\"abc-6\""]), &etag));
+        assert!(!etag_matches(&request_headers(&[]), &etag));
+    }
+
+    #[test]
+    fn test_join_cgroup_io_with_cgroup_depth() {
+        let root = tempfile::tempdir().unwrap();
+        std::fs::write(root.path().join("cgroup.controllers"), "cpu memory\n").unwrap();
+        let pod = root.path().join("kubepods.slice/pod1");
+        let container = pod.join("cri-containerd-1.scope");
+        std::fs::create_dir_all(&container).unwrap();
+        for dir in [&pod, &container] {
+            std::fs::write(dir.join("memory.stat"), "anon 0\nfile 0\n").unwrap();
+            std::fs::write(dir.join("cpu.stat"), "usage_usec 0\n").unwrap();
+        }
+
+        // cgroup_depth: 2 reports the pod instead of its container
+        let entry = CgroupEntry::resolve(None, 1, Some(2), || {
+            Some("0::/kubepods.slice/pod1/cri-containerd-1.scope\n".to_string())
+        });
+        let path = entry.path.unwrap();
+        assert_eq!(&*path, "/kubepods.slice/pod1");
+        let cgroups = read_cgroup_stats(root.path(), [&path]).unwrap();
+
+        // With cgroup_level 2 the kernel reports the pod's ID; a leaf ID
+        // (cgroup_level 0) matches no exported cgroup
+        let io = |dir: &std::path::Path, rx_bytes| CgroupIoStats {
+            cgroup_id: std::fs::metadata(dir).unwrap().ino(),
+            rx_bytes,
+            ..Default::default()
+        };
+        let cgroup_io = [io(&pod, 100), io(&container, 7)];
+        let joined = join_cgroup_io(&cgroups, &cgroup_io);
+        assert_eq!(joined.len(), 1);
+        assert_eq!(joined[0].0, "/kubepods.slice/pod1");
+        assert_eq!(joined[0].1.rx_bytes, 100);
+    }
+
+    #[tokio::test]
+    async fn test_scrapes_share_render_while_collectors_run() {
+        let root = tempfile::tempdir().unwrap();
+        write_proc_tree(root.path(), &ProcTreeSpec::new(50)).unwrap();
+        let state = app_state(root.path()).unwrap();
+        update_cache(&state).await.unwrap();
+
+        let first = latest_metrics(&state).await.unwrap();
+        // The system collectors publish between the two scrapes
+        let before = system_generation(&state);
+        collect_all_system(&state);
+        assert!(system_generation(&state) > before);
+        let second = latest_metrics(&state).await.unwrap();
+        assert!(Arc::ptr_eq(&first, &second));
+
+        // A new process scan is rendered on the next scrape
+        update_cache(&state).await.unwrap();
+        let third = latest_metrics(&state).await.unwrap();
+        assert_eq!(third.generation, first.generation + 1);
+    }
 }
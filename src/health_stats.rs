@@ -2,12 +2,19 @@
 //!
 //! This module provides types and functionality for tracking exporter health,
 //! including scan performance, cache statistics, and HTTP request metrics.
+//!
+//! The phases of a cache update, of a /metrics render and of each eBPF map
+//! read are profiled in lock-free log-bucket histograms ([`PhaseStats`]),
+//! together with the /proc syscalls counted while each phase ran.
 
 use std::collections::VecDeque;
 use std::fmt::Write as FmtWrite;
+use std::ops::Add;
 use std::sync::atomic::{AtomicU64, Ordering};
-use std::sync::{Mutex, RwLock as StdRwLock};
-use std::time::{Instant, SystemTime};
+use std::sync::{Arc, Mutex, RwLock as StdRwLock};
+use std::time::{Duration, Instant, SystemTime};
+
+use crate::procfs;
 
 /// Running statistics for a single metric.
 #[derive(Clone, Copy, Default)]
@@ -106,6 +113,370 @@ impl RequestTimestamps {
     }
 }
 
+/// Run statistics of one scheduled collector.
+pub struct CollectorStats {
+    pub name: String,
+    pub budget_ms: u64,
+    pub duration_ms: Stat,
+    pub overruns: AtomicU64,
+}
+
+impl CollectorStats {
+    /// Records one run; `overrun` is set when it exceeded the budget.
+    pub fn record_run(&self, duration_ms: f64, overrun: bool) {
+        self.duration_ms.add_sample(duration_ms);
+        if overrun {
+            self.overruns.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Profiled phases of the exporter, in report order.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Phase {
+    // Cache update
+    Discovery,
+    ReadParse,
+    PidCaches,
+    Convert,
+    EbpfMerge,
+    Aggregate,
+    Publish,
+    Ringbuffer,
+    // Render of the /metrics body, one per section
+    RenderSnapshot,
+    RenderAggregate,
+    RenderGroups,
+    RenderBlkio,
+    RenderCpu,
+    RenderMemory,
+    RenderDisk,
+    RenderNetwork,
+    RenderFilesystem,
+    RenderHost,
+    RenderKernel,
+    RenderPsi,
+    RenderEbpfNet,
+    RenderTcp,
+    RenderIoHistograms,
+    RenderCgroups,
+    RenderEbpfPerf,
+    RenderEncode,
+    // eBPF map reads
+    EbpfNetStats,
+    EbpfBlkioStats,
+    EbpfTcpStats,
+    EbpfIoHistograms,
+    EbpfCgroupIo,
+    EbpfPidClasses,
+    EbpfLifecycle,
+}
+
+impl Phase {
+    pub const ALL: [Phase; 33] = [
+        Phase::Discovery,
+        Phase::ReadParse,
+        Phase::PidCaches,
+        Phase::Convert,
+        Phase::EbpfMerge,
+        Phase::Aggregate,
+        Phase::Publish,
+        Phase::Ringbuffer,
+        Phase::RenderSnapshot,
+        Phase::RenderAggregate,
+        Phase::RenderGroups,
+        Phase::RenderBlkio,
+        Phase::RenderCpu,
+        Phase::RenderMemory,
+        Phase::RenderDisk,
+        Phase::RenderNetwork,
+        Phase::RenderFilesystem,
+        Phase::RenderHost,
+        Phase::RenderKernel,
+        Phase::RenderPsi,
+        Phase::RenderEbpfNet,
+        Phase::RenderTcp,
+        Phase::RenderIoHistograms,
+        Phase::RenderCgroups,
+        Phase::RenderEbpfPerf,
+        Phase::RenderEncode,
+        Phase::EbpfNetStats,
+        Phase::EbpfBlkioStats,
+        Phase::EbpfTcpStats,
+        Phase::EbpfIoHistograms,
+        Phase::EbpfCgroupIo,
+        Phase::EbpfPidClasses,
+        Phase::EbpfLifecycle,
+    ];
+
+    /// Code path the phase belongs to.
+    pub fn scope(self) -> &'static str {
+        match self {
+            Phase::Discovery
+            | Phase::ReadParse
+            | Phase::PidCaches
+            | Phase::Convert
+            | Phase::EbpfMerge
+            | Phase::Aggregate
+            | Phase::Publish
+            | Phase::Ringbuffer => "update_cache",
+            Phase::EbpfNetStats
+            | Phase::EbpfBlkioStats
+            | Phase::EbpfTcpStats
+            | Phase::EbpfIoHistograms
+            | Phase::EbpfCgroupIo
+            | Phase::EbpfPidClasses
+            | Phase::EbpfLifecycle => "ebpf_read",
+            _ => "metrics_handler",
+        }
+    }
+
+    /// Name of the phase within its scope.
+    pub fn name(self) -> &'static str {
+        match self {
+            Phase::Discovery => "discovery",
+            Phase::ReadParse => "read_parse",
+            Phase::PidCaches => "pid_caches",
+            Phase::Convert => "convert",
+            Phase::EbpfMerge => "ebpf_merge",
+            Phase::Aggregate => "aggregate",
+            Phase::Publish => "publish",
+            Phase::Ringbuffer => "ringbuffer",
+            Phase::RenderSnapshot => "snapshot",
+            Phase::RenderAggregate => "aggregate",
+            Phase::RenderGroups => "groups",
+            Phase::RenderBlkio => "blkio",
+            Phase::RenderCpu => "cpu",
+            Phase::RenderMemory => "memory",
+            Phase::RenderDisk => "disk",
+            Phase::RenderNetwork => "network",
+            Phase::RenderFilesystem => "filesystem",
+            Phase::RenderHost => "host",
+            Phase::RenderKernel => "kernel",
+            Phase::RenderPsi => "psi",
+            Phase::RenderEbpfNet => "ebpf_net",
+            Phase::RenderTcp => "tcp",
+            Phase::RenderIoHistograms => "io_histograms",
+            Phase::RenderCgroups => "cgroups",
+            Phase::RenderEbpfPerf => "ebpf_perf",
+            Phase::RenderEncode => "encode",
+            Phase::EbpfNetStats => "net_stats",
+            Phase::EbpfBlkioStats => "blkio_stats",
+            Phase::EbpfTcpStats => "tcp_stats",
+            Phase::EbpfIoHistograms => "io_histograms",
+            Phase::EbpfCgroupIo => "cgroup_io",
+            Phase::EbpfPidClasses => "pid_classes",
+            Phase::EbpfLifecycle => "lifecycle",
+        }
+    }
+}
+
+/// Sub-buckets per power of two: durations are bucketed with a relative
+/// error below 25%.
+const SUB_BITS: u32 = 2;
+const SUB_BUCKETS: usize = 1 << SUB_BITS;
+/// Durations from 2^MAX_OCTAVE ns (about 18 minutes) share the last bucket.
+const MAX_OCTAVE: u32 = 40;
+const PHASE_BUCKETS: usize = (MAX_OCTAVE as usize - 1) * SUB_BUCKETS + 1;
+
+/// Bucket of a duration in nanoseconds.
+fn bucket_index(ns: u64) -> usize {
+    if ns < SUB_BUCKETS as u64 {
+        return ns as usize;
+    }
+    let octave = 63 - ns.leading_zeros();
+    if octave >= MAX_OCTAVE {
+        return PHASE_BUCKETS - 1;
+    }
+    let sub = (ns >> (octave - SUB_BITS)) as usize & (SUB_BUCKETS - 1);
+    (octave as usize - 1) * SUB_BUCKETS + sub
+}
+
+/// Largest duration in nanoseconds counted in bucket `i`.
+fn bucket_upper_ns(i: usize) -> u64 {
+    if i < SUB_BUCKETS {
+        return i as u64;
+    }
+    if i == PHASE_BUCKETS - 1 {
+        return u64::MAX;
+    }
+    let octave = (i / SUB_BUCKETS + 1) as u32;
+    let sub = (i % SUB_BUCKETS) as u64;
+    ((SUB_BUCKETS as u64 + sub + 1) << (octave - SUB_BITS)) - 1
+}
+
+/// Duration and /proc syscalls of one run of a phase.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct PhaseSplit {
+    pub duration: Duration,
+    pub syscalls: u64,
+}
+
+impl Add for PhaseSplit {
+    type Output = PhaseSplit;
+
+    fn add(self, other: PhaseSplit) -> PhaseSplit {
+        PhaseSplit {
+            duration: self.duration + other.duration,
+            syscalls: self.syscalls + other.syscalls,
+        }
+    }
+}
+
+/// Histogram of one phase. Recording is a few relaxed atomic operations,
+/// no lock is taken.
+struct PhaseHistogram {
+    buckets: [AtomicU64; PHASE_BUCKETS],
+    last_ns: AtomicU64,
+    max_ns: AtomicU64,
+    syscalls: AtomicU64,
+}
+
+impl Default for PhaseHistogram {
+    fn default() -> Self {
+        Self {
+            buckets: std::array::from_fn(|_| AtomicU64::new(0)),
+            last_ns: AtomicU64::new(0),
+            max_ns: AtomicU64::new(0),
+            syscalls: AtomicU64::new(0),
+        }
+    }
+}
+
+impl PhaseHistogram {
+    fn record(&self, split: PhaseSplit) {
+        let ns = u64::try_from(split.duration.as_nanos()).unwrap_or(u64::MAX);
+        self.buckets[bucket_index(ns)].fetch_add(1, Ordering::Relaxed);
+        self.last_ns.store(ns, Ordering::Relaxed);
+        self.max_ns.fetch_max(ns, Ordering::Relaxed);
+        self.syscalls.fetch_add(split.syscalls, Ordering::Relaxed);
+    }
+
+    /// Reads the histogram. Concurrent recordings may be half included.
+    fn snapshot(&self, phase: Phase) -> PhaseSnapshot {
+        let buckets: Vec<u64> = self
+            .buckets
+            .iter()
+            .map(|bucket| bucket.load(Ordering::Relaxed))
+            .collect();
+        let runs: u64 = buckets.iter().sum();
+        let max_ns = self.max_ns.load(Ordering::Relaxed);
+        // Bucket bounds overestimate; the maximum is exact
+        let quantile = |q: f64| {
+            let rank = ((runs as f64 * q).ceil() as u64).max(1);
+            let mut seen = 0;
+            for (i, &count) in buckets.iter().enumerate() {
+                seen += count;
+                if seen >= rank {
+                    return Duration::from_nanos(bucket_upper_ns(i).min(max_ns));
+                }
+            }
+            Duration::from_nanos(max_ns)
+        };
+        PhaseSnapshot {
+            phase,
+            runs,
+            last: Duration::from_nanos(self.last_ns.load(Ordering::Relaxed)),
+            p50: quantile(0.50),
+            p99: quantile(0.99),
+            max: Duration::from_nanos(max_ns),
+            syscalls: self.syscalls.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Profile of one phase since startup.
+#[derive(Debug, Clone, Copy)]
+pub struct PhaseSnapshot {
+    pub phase: Phase,
+    pub runs: u64,
+    pub last: Duration,
+    pub p50: Duration,
+    pub p99: Duration,
+    pub max: Duration,
+    /// /proc syscalls of all runs, including those of other threads issued
+    /// while the phase ran
+    pub syscalls: u64,
+}
+
+impl PhaseSnapshot {
+    pub fn syscalls_per_run(&self) -> f64 {
+        if self.runs == 0 {
+            0.0
+        } else {
+            self.syscalls as f64 / self.runs as f64
+        }
+    }
+}
+
+/// Histograms of all profiled phases.
+pub struct PhaseStats {
+    phases: [PhaseHistogram; Phase::ALL.len()],
+}
+
+impl Default for PhaseStats {
+    fn default() -> Self {
+        Self {
+            phases: std::array::from_fn(|_| PhaseHistogram::default()),
+        }
+    }
+}
+
+impl PhaseStats {
+    /// Starts a clock whose laps are recorded here.
+    pub fn clock(&self) -> PhaseClock<'_> {
+        PhaseClock {
+            stats: self,
+            mark: Instant::now(),
+            syscalls: procfs::syscall_count(),
+        }
+    }
+
+    pub fn record(&self, phase: Phase, split: PhaseSplit) {
+        self.phases[phase as usize].record(split);
+    }
+
+    pub fn snapshot(&self, phase: Phase) -> PhaseSnapshot {
+        self.phases[phase as usize].snapshot(phase)
+    }
+
+    /// Snapshots of all phases, in report order.
+    pub fn snapshots(&self) -> Vec<PhaseSnapshot> {
+        Phase::ALL
+            .iter()
+            .map(|&phase| self.snapshot(phase))
+            .collect()
+    }
+}
+
+/// Measures consecutive phases of one code path.
+pub struct PhaseClock<'a> {
+    stats: &'a PhaseStats,
+    mark: Instant,
+    syscalls: u64,
+}
+
+impl PhaseClock<'_> {
+    /// Returns the time and syscalls since the previous split and restarts.
+    pub fn split(&mut self) -> PhaseSplit {
+        let now = Instant::now();
+        let syscalls = procfs::syscall_count();
+        let split = PhaseSplit {
+            duration: now - self.mark,
+            syscalls: syscalls.saturating_sub(self.syscalls),
+        };
+        self.mark = now;
+        self.syscalls = syscalls;
+        split
+    }
+
+    /// Records the time since the previous split as one run of `phase`.
+    pub fn lap(&mut self, phase: Phase) {
+        let split = self.split();
+        self.stats.record(phase, split);
+    }
+}
+
 /// Comprehensive health statistics for the exporter.
 pub struct HealthStats {
     // Existing fields
@@ -157,6 +528,12 @@ pub struct HealthStats {
     pub metrics_response_size_kb: Stat,
     pub total_time_series: Stat,
 
+    // Collector scheduling, in registration order
+    pub collectors: StdRwLock<Vec<Arc<CollectorStats>>>,
+
+    // Phase profiles
+    pub phases: PhaseStats,
+
     // Timing
     pub start_time: Instant,
     pub last_scan_time: StdRwLock<Option<Instant>>,
@@ -196,6 +573,8 @@ impl Default for HealthStats {
             max_fds: AtomicU64::new(0),
             metrics_response_size_kb: Stat::default(),
             total_time_series: Stat::default(),
+            collectors: StdRwLock::new(Vec::new()),
+            phases: PhaseStats::default(),
             start_time: Instant::now(),
             last_scan_time: StdRwLock::new(None),
         }
@@ -322,6 +701,20 @@ impl HealthStats {
         self.total_time_series.add_sample(count as f64);
     }
 
+    /// Adds a collector to the report and returns its statistics.
+    pub fn register_collector(&self, name: &str, budget_ms: u64) -> Arc<CollectorStats> {
+        let stats = Arc::new(CollectorStats {
+            name: name.to_string(),
+            budget_ms,
+            duration_ms: Stat::default(),
+            overruns: AtomicU64::new(0),
+        });
+        if let Ok(mut guard) = self.collectors.write() {
+            guard.push(Arc::clone(&stats));
+        }
+        stats
+    }
+
     pub fn get_scan_success_rate(&self) -> f64 {
         let success = self.scan_success_count.load(Ordering::Relaxed);
         let failure = self.scan_failure_count.load(Ordering::Relaxed);
@@ -783,6 +1176,88 @@ impl HealthStats {
         )
         .ok();
 
+        // COLLECTORS section
+        let collectors = self
+            .collectors
+            .read()
+            .map(|guard| guard.clone())
+            .unwrap_or_default();
+        if !collectors.is_empty() {
+            writeln!(out).ok();
+            writeln!(out, "COLLECTORS (ms)").ok();
+            writeln!(out, "---------------").ok();
+
+            for collector in &collectors {
+                let (cd_cur, cd_avg, cd_max, cd_min, _) = collector.duration_ms.snapshot();
+                writeln!(
+                    out,
+                    "{:left$} | {:^col$} | {:^col$} | {:^col$} | {:^col$}",
+                    format!("{} (budget {})", collector.name, collector.budget_ms),
+                    format!("{:.1}", cd_cur),
+                    format!("{:.1}", cd_avg),
+                    format!("{:.1}", cd_max),
+                    format!("{:.1}", cd_min),
+                    left = left_col,
+                    col = col_w
+                )
+                .ok();
+            }
+
+            for collector in &collectors {
+                writeln!(
+                    out,
+                    "{:left$} | {:^col$} | {:^col$} | {:^col$} | {:^col$}",
+                    format!("{}_overruns", collector.name),
+                    format!("{}", collector.overruns.load(Ordering::Relaxed)),
+                    "N/A",
+                    "N/A",
+                    "N/A",
+                    left = left_col,
+                    col = col_w
+                )
+                .ok();
+            }
+        }
+
+        // PHASES sections, one per scope
+        let phases = self.phases.snapshots();
+        let mut scope = "";
+        for phase in phases.iter().filter(|p| p.runs > 0) {
+            if phase.phase.scope() != scope {
+                scope = phase.phase.scope();
+                let title = format!("PHASES: {} (ms)", scope);
+                writeln!(out).ok();
+                writeln!(out, "{}", title).ok();
+                writeln!(out, "{}", "-".repeat(title.len())).ok();
+                writeln!(
+                    out,
+                    "{:left$} | {:^col$} | {:^col$} | {:^col$} | {:^col$} | {:^col$}",
+                    "",
+                    "last",
+                    "p50",
+                    "p99",
+                    "max",
+                    "syscalls/run",
+                    left = left_col,
+                    col = col_w
+                )
+                .ok();
+            }
+            writeln!(
+                out,
+                "{:left$} | {:^col$} | {:^col$} | {:^col$} | {:^col$} | {:^col$}",
+                format!("{} ({})", phase.phase.name(), phase.runs),
+                format!("{:.3}", phase.last.as_secs_f64() * 1000.0),
+                format!("{:.3}", phase.p50.as_secs_f64() * 1000.0),
+                format!("{:.3}", phase.p99.as_secs_f64() * 1000.0),
+                format!("{:.3}", phase.max.as_secs_f64() * 1000.0),
+                format!("{:.1}", phase.syscalls_per_run()),
+                left = left_col,
+                col = col_w
+            )
+            .ok();
+        }
+
         // RESOURCE LIMITS section
         writeln!(out).ok();
         writeln!(out, "RESOURCE LIMITS").ok();
@@ -876,3 +1351,64 @@ impl HealthStats {
         out
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_bucket_bounds() {
+        for ns in [0, 1, 3, 4, 5, 7, 8, 9, 1_000, 123_456_789, (1 << 40) - 1] {
+            let i = bucket_index(ns);
+            assert!(ns <= bucket_upper_ns(i), "{} above bucket {}", ns, i);
+            if i > 0 {
+                assert!(ns > bucket_upper_ns(i - 1), "{} below bucket {}", ns, i);
+            }
+            assert!(bucket_upper_ns(i) as f64 <= ns as f64 * 1.25 + 1.0);
+        }
+        assert_eq!(bucket_index(u64::MAX), PHASE_BUCKETS - 1);
+        assert!(Phase::ALL.iter().enumerate().all(|(i, &p)| p as usize == i));
+    }
+
+    #[test]
+    fn test_phase_quantiles() {
+        let stats = PhaseStats::default();
+        for ms in 1..=100 {
+            stats.record(
+                Phase::ReadParse,
+                PhaseSplit {
+                    duration: Duration::from_millis(ms),
+                    syscalls: 5,
+                },
+            );
+        }
+
+        let snapshot = stats.snapshot(Phase::ReadParse);
+        assert_eq!(snapshot.runs, 100);
+        assert_eq!(snapshot.last, Duration::from_millis(100));
+        assert_eq!(snapshot.max, Duration::from_millis(100));
+        let p50 = snapshot.p50.as_secs_f64() * 1000.0;
+        assert!((50.0..=62.5).contains(&p50), "p50 {}", p50);
+        assert!(snapshot.p99 >= Duration::from_millis(99));
+        assert!(snapshot.p99 <= snapshot.max);
+        assert_eq!(snapshot.syscalls_per_run(), 5.0);
+        assert_eq!(stats.snapshot(Phase::Publish).runs, 0);
+    }
+
+    #[test]
+    fn test_phase_clock_laps() {
+        let stats = HealthStats::default();
+        let mut clock = stats.phases.clock();
+        std::thread::sleep(Duration::from_millis(2));
+        clock.lap(Phase::Discovery);
+        let first = clock.split();
+        clock.lap(Phase::Publish);
+        stats.phases.record(Phase::PidCaches, first + clock.split());
+
+        let discovery = stats.phases.snapshot(Phase::Discovery);
+        assert_eq!(discovery.runs, 1);
+        assert!(discovery.max >= Duration::from_millis(2));
+        assert_eq!(stats.phases.snapshot(Phase::PidCaches).runs, 1);
+        assert!(stats.render_table().contains("PHASES: update_cache (ms)"));
+    }
+}
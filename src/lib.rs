@@ -10,6 +10,14 @@
 //! - **Configurable Thresholds**: Set warning and critical thresholds
 //! - **Flexible Status Logic**: Support for both "larger is better" and "smaller is better" buffers
 //! - **Thread-Safe Updates**: Atomic operations for efficient cross-thread updates
+//! - **/proc Parsers**: Allocation-free byte parsers for `/proc/<pid>` files (see [`procfs`])
+//! - **Process Cache**: Published process snapshots and eBPF joins (see [`cache`])
+//! - **Top-K Rankings**: Single-pass bounded selection of top processes (see [`topk`])
+//! - **Batched Reads**: io_uring reads of many small files (see [`uring`])
+//! - **Fixtures**: Reproducible synthetic `/proc` trees and test processes (see [`fixtures`])
+//! - **Exporter**: Process scans, classification, ringbuffers and the HTTP
+//!   handlers the `herakles-node-exporter` binary is built from (see
+//!   [`state::AppState`] and [`cache_updater::update_cache`])
 //!
 //! # Usage
 //!
@@ -40,9 +48,34 @@
 //!
 //! - `health-actix`: Enables actix-web integration example (see examples/health_server.rs)
 
+pub mod cache;
+pub mod cache_updater;
+pub mod cli;
+pub mod collectors;
+pub mod commands;
+pub mod config;
+pub mod ebpf;
+pub mod exposition;
+pub mod fixtures;
+pub mod handlers;
 pub mod health;
 pub mod health_config;
 pub mod health_stats;
+pub mod metrics;
+pub mod process;
+pub mod procfs;
+pub mod remote_write;
+pub mod ringbuffer;
+pub mod ringbuffer_columnar;
+pub mod ringbuffer_manager;
+pub mod ringbuffer_mmap;
+pub mod ringbuffer_stats;
+pub mod scheduler;
+pub mod startup_checks;
+pub mod state;
+pub mod system;
+pub mod topk;
+pub mod uring;
 
 // Re-export main types for convenience
 pub use health::{BufferHealth, HealthResponse, HealthState};
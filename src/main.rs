@@ -3,61 +3,37 @@
 //! Professional memory metrics exporter with tracing logging.
 //! This is the main entry point that initializes the server and handles subcommands.
 
-mod cache;
-mod cache_updater;
-mod cli;
-mod collectors;
-mod commands;
-mod config;
-mod ebpf;
-mod handlers;
-mod health_stats;
-mod metrics;
-mod process;
-mod ringbuffer;
-mod ringbuffer_manager;
-mod startup_checks;
-mod state;
-mod system;
-
-use ahash::AHashMap as HashMap;
 use axum::{routing::get, Router};
 use axum_server::tls_rustls::RustlsConfig;
 use clap::Parser;
-use herakles_node_exporter::{AppConfig as HealthAppConfig, BufferHealthConfig, HealthState};
-use prometheus::{Gauge, Registry};
+use herakles_node_exporter::uring::{BatchReader, DEFAULT_SLOTS, DEFAULT_SLOT_BYTES};
+use herakles_node_exporter::{cache_updater, ebpf, remote_write, scheduler, startup_checks};
+use nix::unistd::{geteuid, setgid, setgroups, setuid, Group, User};
+use prometheus::Registry;
 use std::net::SocketAddr;
 use std::sync::atomic::Ordering;
-use std::sync::{Arc, RwLock as StdRwLock};
-use std::time::Instant;
-use tokio::{
-    net::TcpListener,
-    signal,
-    sync::RwLock,
-};
+use std::sync::{Arc, Mutex as StdMutex};
+use tokio::{net::TcpListener, signal};
 use tracing::{debug, error, info, warn, Level};
-use nix::unistd::{geteuid, setgid, setgroups, setuid, Group, User};
 
-use cache::MetricsCache;
-use cli::{Args, Commands, LogLevel};
-use commands::{
-    command_check, command_config, command_generate_testdata, command_install, command_subgroups,
-    command_test, command_uninstall,
+use herakles_node_exporter::cli::{Args, Commands, LogLevel};
+use herakles_node_exporter::commands::{
+    command_check, command_config, command_generate_proc_tree, command_generate_testdata,
+    command_install, command_subgroups, command_test, command_uninstall,
 };
-use config::{
+use herakles_node_exporter::config::{
     resolve_config, show_config, validate_effective_config, Config, DEFAULT_BIND_ADDR, DEFAULT_PORT,
 };
-use handlers::{
+use herakles_node_exporter::handlers::{
     config_handler, details_handler, doc_handler, health_handler, html_config_handler,
     html_details_handler, html_docs_handler, html_health_handler, html_index_handler,
     html_subgroups_handler, metrics_handler, root_handler, subgroups_handler,
 };
-use health_stats::HealthStats;
-use metrics::MemoryMetrics;
-use process::{BufferConfig, SUBGROUPS};
-use ringbuffer_manager::RingbufferManager;
-use state::{AppState, SharedState};
-use system::CpuStatsCache;
+use herakles_node_exporter::health_stats::HealthStats;
+use herakles_node_exporter::metrics::RemoteWriteMetrics;
+use herakles_node_exporter::process::{BufferConfig, SUBGROUPS};
+use herakles_node_exporter::ringbuffer_manager::RingbufferManager;
+use herakles_node_exporter::state::{AppState, SharedState};
 
 /// Initializes tracing logging subsystem with configured log level.
 fn setup_logging(_config: &Config, args: &Args) {
@@ -113,7 +89,7 @@ fn load_validated_config(args: &Args) -> Result<Config, Box<dyn std::error::Erro
     Ok(config)
 }
 
-/// Wrapper function to call cache updater from background task.
+/// Wrapper function to call cache updater for the initial population.
 async fn update_cache(state: &SharedState) -> Result<(), Box<dyn std::error::Error>> {
     cache_updater::update_cache(state).await
 }
@@ -285,9 +261,18 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
                 output,
                 min_per_subgroup,
                 others_count,
-            } => {
-                command_generate_testdata(output.clone(), *min_per_subgroup, *others_count, &config)
-            }
+                proc_tree,
+                processes,
+                seed,
+            } => match proc_tree {
+                Some(dir) => command_generate_proc_tree(dir, *processes, *seed),
+                None => command_generate_testdata(
+                    output.clone(),
+                    *min_per_subgroup,
+                    *others_count,
+                    &config,
+                ),
+            },
 
             Commands::Install { .. } => unreachable!("Install handled above"),
             Commands::Uninstall { .. } => unreachable!("Uninstall handled above"),
@@ -335,64 +320,28 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
     let registry = Registry::new();
     debug!("Prometheus registry initialized");
 
-    let metrics = MemoryMetrics::new(&registry)?;
-    let scrape_duration = Gauge::new(
-        "herakles_exporter_scrape_duration_seconds",
-        "Time spent serving /metrics request (reading from cache)",
-    )?;
-    let processes_total = Gauge::new(
-        "herakles_exporter_processes_total",
-        "Number of processes currently exported by herakles-node-exporter",
-    )?;
-    let cache_update_duration = Gauge::new(
-        "herakles_exporter_cache_update_duration_seconds",
-        "Time spent updating the process metrics cache in background",
-    )?;
-    let cache_update_success = Gauge::new(
-        "herakles_exporter_cache_update_success",
-        "Whether the last cache update was successful (1) or failed (0)",
-    )?;
-    let cache_updating = Gauge::new(
-        "herakles_exporter_cache_updating",
-        "Whether cache update is currently in progress (1) or idle (0)",
-    )?;
-
-    registry.register(Box::new(scrape_duration.clone()))?;
-    registry.register(Box::new(processes_total.clone()))?;
-    registry.register(Box::new(cache_update_duration.clone()))?;
-    registry.register(Box::new(cache_update_success.clone()))?;
-    registry.register(Box::new(cache_updating.clone()))?;
-
-    debug!("All metrics registered successfully");
+    let remote_write_metrics = if config.remote_write.url.is_some() {
+        Some(RemoteWriteMetrics::new(&registry)?)
+    } else {
+        None
+    };
 
     let health_stats = Arc::new(HealthStats::new());
 
-    let health_config = HealthAppConfig {
-        io_buffer: BufferHealthConfig {
-            capacity_kb: buffer_config.io_kb,
-            larger_is_better: false,
-            warn_percent: Some(80.0),
-            critical_percent: Some(95.0),
-        },
-        smaps_buffer: BufferHealthConfig {
-            capacity_kb: buffer_config.smaps_kb,
-            larger_is_better: false,
-            warn_percent: Some(80.0),
-            critical_percent: Some(95.0),
-        },
-        smaps_rollup_buffer: BufferHealthConfig {
-            capacity_kb: buffer_config.smaps_rollup_kb,
-            larger_is_better: false,
-            warn_percent: Some(80.0),
-            critical_percent: Some(95.0),
-        },
-    };
-    let health_state = Arc::new(HealthState::new(health_config));
-
     // Initialize eBPF manager if enabled
     let ebpf = if config.enable_ebpf.unwrap_or(false) {
         info!("eBPF enabled in configuration, attempting to initialize...");
-        match ebpf::EbpfManager::new() {
+        let ebpf_options = ebpf::EbpfOptions {
+            percpu_maps: config.ebpf_percpu_maps.unwrap_or(false),
+            lru_maps: config.ebpf_lru_maps.unwrap_or(false),
+            map_max_entries: config
+                .ebpf_map_max_entries
+                .unwrap_or(ebpf::DEFAULT_MAP_MAX_ENTRIES),
+            cgroup_io: config.enable_cgroups.unwrap_or(false),
+            cgroup_level: config.cgroup_depth.map_or(0, |depth| depth as u32),
+            net_latency: config.ebpf_net_latency.unwrap_or(false),
+        };
+        match ebpf::EbpfManager::with_options(ebpf_options) {
             Ok(manager) => {
                 if manager.is_enabled() {
                     info!("✅ eBPF initialized successfully - process I/O tracking enabled");
@@ -439,25 +388,35 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         ringbuffer_manager.get_stats().entries_per_subgroup
     );
 
-    let state = Arc::new(AppState {
-        registry,
-        metrics,
-        scrape_duration,
-        processes_total,
-        cache_update_duration,
-        cache_update_success,
-        cache_updating,
-        cache: Arc::new(RwLock::new(MetricsCache::default())),
-        config: Arc::new(config.clone()),
+    let uring = if config.io_uring.unwrap_or(false) {
+        match BatchReader::new(DEFAULT_SLOTS, DEFAULT_SLOT_BYTES) {
+            Ok(reader) => {
+                info!(
+                    "io_uring /proc reads enabled ({} slots, registered buffers: {})",
+                    DEFAULT_SLOTS,
+                    reader.fixed_buffers()
+                );
+                Some(StdMutex::new(reader))
+            }
+            Err(e) => {
+                warn!("io_uring unavailable, using threaded /proc reads: {}", e);
+                None
+            }
+        }
+    } else {
+        None
+    };
+
+    let state = Arc::new(AppState::new(
+        config.clone(),
         buffer_config,
-        cpu_cache: StdRwLock::new(HashMap::new()),
-        health_stats: health_stats.clone(),
-        health_state,
-        system_cpu_cache: CpuStatsCache::new(),
+        registry,
+        health_stats,
         ebpf,
         ringbuffer_manager,
-        start_time: Instant::now(),
-    });
+        uring,
+    )?);
+    debug!("All metrics registered successfully");
 
     // Perform initial cache population
     info!("Performing initial cache update");
@@ -467,9 +426,16 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         info!("Initial cache update completed successfully");
     }
 
-    info!(
-        "Note: No background cache refresh task - updates will be triggered by /metrics requests"
-    );
+    // Publish system readings before the first scrape, then hand all
+    // collection over to the background scheduler
+    scheduler::collect_all_system(&state);
+    scheduler::spawn_collectors(&state);
+
+    // Push the scans to the remote-write endpoint, starting with the
+    // initial one
+    if let Some(remote_write_metrics) = remote_write_metrics {
+        remote_write::spawn(&state, remote_write_metrics)?;
+    }
 
     // Setup graceful shutdown signal handlers
     let shutdown_signal = async {
@@ -3,7 +3,15 @@
 //! This module defines all the Prometheus metrics according to the system specification.
 //! Only system-level and group-level metrics are exposed. No per-process or Top-N metrics.
 
+use prometheus::core::{Collector, Desc};
+use prometheus::proto::{self, MetricFamily, MetricType};
 use prometheus::{Counter, CounterVec, Gauge, GaugeVec, Opts, Registry};
+use std::collections::{BTreeMap, HashSet};
+use std::sync::{Arc, Mutex};
+
+use crate::collectors::DeviceTable;
+use crate::ebpf::{Log2Histogram, HIST_SLOTS};
+use crate::health_stats::PhaseStats;
 
 /// Collection of Prometheus metrics according to system specification.
 #[derive(Clone)]
@@ -46,6 +54,8 @@ pub struct MemoryMetrics {
     pub system_filesystem_size_bytes: GaugeVec,   // labels: device, mountpoint, fstype
     pub system_filesystem_files: GaugeVec,        // labels: device, mountpoint, fstype
     pub system_filesystem_files_free: GaugeVec,   // labels: device, mountpoint, fstype
+    pub system_filesystem_stale: GaugeVec,        // labels: device, mountpoint, fstype
+    pub system_filesystem_collect_duration_seconds: GaugeVec, // labels: device, mountpoint, fstype
 
     // ========== TCP Connection Metrics (eBPF) ==========
     #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
@@ -103,6 +113,24 @@ pub struct MemoryMetrics {
     pub group_net_tx_bytes_total: CounterVec, // labels: group, subgroup
     pub group_net_connections_total: GaugeVec, // labels: group, subgroup, proto
 
+    // ========== I/O Histogram Group Metrics (eBPF) ==========
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub group_net_syscall_latency_seconds: BucketedHistogramVec, // labels: group, subgroup
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub group_net_syscall_size_bytes: BucketedHistogramVec, // labels: group, subgroup
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub group_blkio_request_size_bytes: BucketedHistogramVec, // labels: group, subgroup
+
+    // ========== cgroup Metrics ==========
+    pub cgroup_processes: GaugeVec,           // labels: cgroup
+    pub cgroup_memory_bytes: GaugeVec,        // labels: cgroup, type
+    pub cgroup_cpu_seconds_total: CounterVec, // labels: cgroup, mode
+    pub cgroup_cpu_throttled_seconds_total: CounterVec, // labels: cgroup
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub cgroup_net_bytes_total: CounterVec, // labels: cgroup, direction
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub cgroup_blkio_bytes_total: CounterVec, // labels: cgroup, direction
+
     // ========== eBPF Performance Metrics ==========
     pub ebpf_events_processed_total: Counter,
     pub ebpf_events_dropped_total: Counter,
@@ -277,6 +305,20 @@ impl MemoryMetrics {
             ),
             &["device", "mountpoint", "fstype"],
         )?;
+        let system_filesystem_stale = GaugeVec::new(
+            Opts::new(
+                "herakles_system_filesystem_stale",
+                "1 if statvfs timed out and the filesystem values are from an earlier call",
+            ),
+            &["device", "mountpoint", "fstype"],
+        )?;
+        let system_filesystem_collect_duration_seconds = GaugeVec::new(
+            Opts::new(
+                "herakles_system_filesystem_collect_duration_seconds",
+                "Duration of the last statvfs call, or of the running one while it hangs",
+            ),
+            &["device", "mountpoint", "fstype"],
+        )?;
 
         // ========== TCP Connection Metrics (eBPF) ==========
         let system_tcp_connections_established = Gauge::new(
@@ -415,21 +457,21 @@ impl MemoryMetrics {
         let group_blkio_write_bytes_total = CounterVec::new(
             Opts::new(
                 "herakles_group_blkio_write_bytes_total",
-                "Total bytes written per group and subgroup",
+                "Total bytes written per group and subgroup; buffered writeback is charged to kernel flusher threads",
             ),
             &["group", "subgroup"],
         )?;
         let group_blkio_read_syscalls_total = CounterVec::new(
             Opts::new(
                 "herakles_group_blkio_read_syscalls_total",
-                "Total read syscalls per group and subgroup",
+                "Total block read requests per group and subgroup",
             ),
             &["group", "subgroup"],
         )?;
         let group_blkio_write_syscalls_total = CounterVec::new(
             Opts::new(
                 "herakles_group_blkio_write_syscalls_total",
-                "Total write syscalls per group and subgroup",
+                "Total block write requests per group and subgroup; buffered writeback is charged to kernel flusher threads",
             ),
             &["group", "subgroup"],
         )?;
@@ -457,6 +499,67 @@ impl MemoryMetrics {
             &["group", "subgroup", "proto"],
         )?;
 
+        // ========== I/O Histogram Group Metrics (eBPF) ==========
+        let group_net_syscall_latency_seconds = BucketedHistogramVec::new(
+            "herakles_group_net_syscall_latency_seconds",
+            "Latency of network send/receive syscalls per group and subgroup (eBPF)",
+            log2_bucket_bounds(1e-9),
+        )?;
+        let group_net_syscall_size_bytes = BucketedHistogramVec::new(
+            "herakles_group_net_syscall_size_bytes",
+            "Bytes per network send/receive syscall per group and subgroup (eBPF)",
+            log2_bucket_bounds(1.0),
+        )?;
+        let group_blkio_request_size_bytes = BucketedHistogramVec::new(
+            "herakles_group_blkio_request_size_bytes",
+            "Bytes per block I/O request per group and subgroup (eBPF)",
+            log2_bucket_bounds(1.0),
+        )?;
+
+        // ========== cgroup Metrics ==========
+        let cgroup_processes = GaugeVec::new(
+            Opts::new(
+                "herakles_cgroup_processes",
+                "Number of scanned processes per cgroup",
+            ),
+            &["cgroup"],
+        )?;
+        let cgroup_memory_bytes = GaugeVec::new(
+            Opts::new(
+                "herakles_cgroup_memory_bytes",
+                "Memory usage per cgroup and type (current, anon, file, swap)",
+            ),
+            &["cgroup", "type"],
+        )?;
+        let cgroup_cpu_seconds_total = CounterVec::new(
+            Opts::new(
+                "herakles_cgroup_cpu_seconds_total",
+                "Total CPU time per cgroup and mode (user, system)",
+            ),
+            &["cgroup", "mode"],
+        )?;
+        let cgroup_cpu_throttled_seconds_total = CounterVec::new(
+            Opts::new(
+                "herakles_cgroup_cpu_throttled_seconds_total",
+                "Total time the cgroup was throttled by its CPU limit",
+            ),
+            &["cgroup"],
+        )?;
+        let cgroup_net_bytes_total = CounterVec::new(
+            Opts::new(
+                "herakles_cgroup_net_bytes_total",
+                "Total network bytes per cgroup and direction (eBPF)",
+            ),
+            &["cgroup", "direction"],
+        )?;
+        let cgroup_blkio_bytes_total = CounterVec::new(
+            Opts::new(
+                "herakles_cgroup_blkio_bytes_total",
+                "Total block I/O bytes per cgroup and direction (eBPF); buffered writeback is charged to the flusher's cgroup",
+            ),
+            &["cgroup", "direction"],
+        )?;
+
         // ========== eBPF Performance Metrics ==========
         let ebpf_events_processed_total = Counter::new(
             "herakles_ebpf_events_processed_total",
@@ -514,6 +617,8 @@ impl MemoryMetrics {
         registry.register(Box::new(system_filesystem_size_bytes.clone()))?;
         registry.register(Box::new(system_filesystem_files.clone()))?;
         registry.register(Box::new(system_filesystem_files_free.clone()))?;
+        registry.register(Box::new(system_filesystem_stale.clone()))?;
+        registry.register(Box::new(system_filesystem_collect_duration_seconds.clone()))?;
 
         // TCP Connections
         registry.register(Box::new(system_tcp_connections_established.clone()))?;
@@ -560,6 +665,19 @@ impl MemoryMetrics {
         registry.register(Box::new(group_net_tx_bytes_total.clone()))?;
         registry.register(Box::new(group_net_connections_total.clone()))?;
 
+        // I/O Histogram Group
+        registry.register(Box::new(group_net_syscall_latency_seconds.clone()))?;
+        registry.register(Box::new(group_net_syscall_size_bytes.clone()))?;
+        registry.register(Box::new(group_blkio_request_size_bytes.clone()))?;
+
+        // cgroup
+        registry.register(Box::new(cgroup_processes.clone()))?;
+        registry.register(Box::new(cgroup_memory_bytes.clone()))?;
+        registry.register(Box::new(cgroup_cpu_seconds_total.clone()))?;
+        registry.register(Box::new(cgroup_cpu_throttled_seconds_total.clone()))?;
+        registry.register(Box::new(cgroup_net_bytes_total.clone()))?;
+        registry.register(Box::new(cgroup_blkio_bytes_total.clone()))?;
+
         // eBPF Performance Metrics
         registry.register(Box::new(ebpf_events_processed_total.clone()))?;
         registry.register(Box::new(ebpf_events_dropped_total.clone()))?;
@@ -596,6 +714,8 @@ impl MemoryMetrics {
             system_filesystem_size_bytes,
             system_filesystem_files,
             system_filesystem_files_free,
+            system_filesystem_stale,
+            system_filesystem_collect_duration_seconds,
             system_tcp_connections_established,
             system_tcp_connections_syn_sent,
             system_tcp_connections_syn_recv,
@@ -627,6 +747,15 @@ impl MemoryMetrics {
             group_net_rx_bytes_total,
             group_net_tx_bytes_total,
             group_net_connections_total,
+            group_net_syscall_latency_seconds,
+            group_net_syscall_size_bytes,
+            group_blkio_request_size_bytes,
+            cgroup_processes,
+            cgroup_memory_bytes,
+            cgroup_cpu_seconds_total,
+            cgroup_cpu_throttled_seconds_total,
+            cgroup_net_bytes_total,
+            cgroup_blkio_bytes_total,
             ebpf_events_processed_total,
             ebpf_events_dropped_total,
             ebpf_maps_count,
@@ -656,5 +785,490 @@ impl MemoryMetrics {
 
         // Network Group - only reset connections (gauge)
         self.group_net_connections_total.reset();
+
+        // cgroups - counters included, so the series of cgroups that are
+        // gone or fell out of max_cgroups disappear
+        self.cgroup_processes.reset();
+        self.cgroup_memory_bytes.reset();
+        self.cgroup_cpu_seconds_total.reset();
+        self.cgroup_cpu_throttled_seconds_total.reset();
+        self.cgroup_net_bytes_total.reset();
+        self.cgroup_blkio_bytes_total.reset();
+    }
+
+    /// Resolves the series of one block device.
+    pub fn disk_handles(&self, device: &str) -> DiskHandles {
+        DiskHandles {
+            read_bytes: self
+                .system_disk_read_bytes_total
+                .with_label_values(&[device]),
+            write_bytes: self
+                .system_disk_write_bytes_total
+                .with_label_values(&[device]),
+            io_time_seconds: self
+                .system_disk_io_time_seconds_total
+                .with_label_values(&[device]),
+            queue_depth: self.system_disk_queue_depth.with_label_values(&[device]),
+        }
+    }
+
+    /// Removes the series of a block device that is gone.
+    pub fn remove_disk(&self, device: &str) {
+        let _ = self
+            .system_disk_read_bytes_total
+            .remove_label_values(&[device]);
+        let _ = self
+            .system_disk_write_bytes_total
+            .remove_label_values(&[device]);
+        let _ = self
+            .system_disk_io_time_seconds_total
+            .remove_label_values(&[device]);
+        let _ = self.system_disk_queue_depth.remove_label_values(&[device]);
+    }
+
+    /// Resolves the series of one network interface.
+    pub fn netdev_handles(&self, device: &str) -> NetDevHandles {
+        NetDevHandles {
+            rx_bytes: self.system_net_rx_bytes_total.with_label_values(&[device]),
+            tx_bytes: self.system_net_tx_bytes_total.with_label_values(&[device]),
+            rx_errors: self.system_net_rx_errors_total.with_label_values(&[device]),
+            tx_errors: self.system_net_tx_errors_total.with_label_values(&[device]),
+            rx_drops: self
+                .system_net_drops_total
+                .with_label_values(&[device, "rx"]),
+            tx_drops: self
+                .system_net_drops_total
+                .with_label_values(&[device, "tx"]),
+        }
+    }
+
+    /// Removes the series of a network interface that is gone.
+    pub fn remove_netdev(&self, device: &str) {
+        let _ = self
+            .system_net_rx_bytes_total
+            .remove_label_values(&[device]);
+        let _ = self
+            .system_net_tx_bytes_total
+            .remove_label_values(&[device]);
+        let _ = self
+            .system_net_rx_errors_total
+            .remove_label_values(&[device]);
+        let _ = self
+            .system_net_tx_errors_total
+            .remove_label_values(&[device]);
+        let _ = self
+            .system_net_drops_total
+            .remove_label_values(&[device, "rx"]);
+        let _ = self
+            .system_net_drops_total
+            .remove_label_values(&[device, "tx"]);
+    }
+}
+
+/// Series of one block device.
+pub struct DiskHandles {
+    pub read_bytes: Counter,
+    pub write_bytes: Counter,
+    pub io_time_seconds: Counter,
+    pub queue_depth: Gauge,
+}
+
+/// Series of one network interface.
+pub struct NetDevHandles {
+    pub rx_bytes: Counter,
+    pub tx_bytes: Counter,
+    pub rx_errors: Counter,
+    pub tx_errors: Counter,
+    pub rx_drops: Counter,
+    pub tx_drops: Counter,
+}
+
+/// Metric handles aligned with the devices of a [`DeviceTable`].
+///
+/// `with_label_values` hashes the labels and locks the vec on every call;
+/// the handles are resolved once and reused until the table's version
+/// changes.
+pub struct DeviceHandles<H> {
+    version: u64,
+    names: Vec<Arc<str>>,
+    handles: Vec<H>,
+}
+
+impl<H> Default for DeviceHandles<H> {
+    fn default() -> Self {
+        Self {
+            version: 0,
+            names: Vec::new(),
+            handles: Vec::new(),
+        }
+    }
+}
+
+impl<H> DeviceHandles<H> {
+    /// Returns the handles of `table`'s devices, in table order.
+    ///
+    /// On a new version, handles are resolved with `resolve` and the series
+    /// of devices that disappeared are dropped with `remove`.
+    pub fn update<T>(
+        &mut self,
+        table: &DeviceTable<T>,
+        resolve: impl Fn(&str) -> H,
+        remove: impl Fn(&str),
+    ) -> &[H] {
+        if self.version != table.version || self.handles.len() != table.devices.len() {
+            let current: HashSet<&str> = table.devices.iter().map(|(name, _)| &**name).collect();
+            for name in &self.names {
+                if !current.contains(&**name) {
+                    remove(name);
+                }
+            }
+            self.names = table
+                .devices
+                .iter()
+                .map(|(name, _)| Arc::clone(name))
+                .collect();
+            self.handles = self.names.iter().map(|name| resolve(name)).collect();
+            self.version = table.version;
+        }
+        &self.handles
+    }
+}
+
+/// Resolved per-device series of the system metrics.
+#[derive(Default)]
+pub struct SystemHandles {
+    pub disks: DeviceHandles<DiskHandles>,
+    pub netdevs: DeviceHandles<NetDevHandles>,
+}
+
+/// Self-metrics of the remote-write push task, registered only when pushing
+/// is enabled.
+#[derive(Clone)]
+pub struct RemoteWriteMetrics {
+    pub samples_total: Counter,
+    pub requests_total: CounterVec,
+    pub sent_bytes_total: Counter,
+    pub dropped_batches_total: Counter,
+    pub queued_batches: Gauge,
+}
+
+impl RemoteWriteMetrics {
+    pub fn new(registry: &Registry) -> Result<Self, Box<dyn std::error::Error>> {
+        let samples_total = Counter::new(
+            "herakles_exporter_remote_write_samples_total",
+            "Total samples staged for remote write",
+        )?;
+        let requests_total = CounterVec::new(
+            Opts::new(
+                "herakles_exporter_remote_write_requests_total",
+                "Total remote-write requests by result (success, retry, rejected)",
+            ),
+            &["result"],
+        )?;
+        let sent_bytes_total = Counter::new(
+            "herakles_exporter_remote_write_sent_bytes_total",
+            "Total compressed bytes of accepted remote-write requests",
+        )?;
+        let dropped_batches_total = Counter::new(
+            "herakles_exporter_remote_write_dropped_batches_total",
+            "Total batches dropped unsent because the retry queue was full",
+        )?;
+        let queued_batches = Gauge::new(
+            "herakles_exporter_remote_write_queued_batches",
+            "Batches waiting to be sent",
+        )?;
+
+        registry.register(Box::new(samples_total.clone()))?;
+        registry.register(Box::new(requests_total.clone()))?;
+        registry.register(Box::new(sent_bytes_total.clone()))?;
+        registry.register(Box::new(dropped_batches_total.clone()))?;
+        registry.register(Box::new(queued_batches.clone()))?;
+
+        Ok(Self {
+            samples_total,
+            requests_total,
+            sent_bytes_total,
+            dropped_batches_total,
+            queued_batches,
+        })
+    }
+}
+
+/// Phase profiles of the exporter itself, from [`PhaseStats`].
+#[derive(Clone)]
+pub struct PhaseMetrics {
+    pub duration_seconds: GaugeVec,
+    pub duration_max_seconds: GaugeVec,
+    pub runs_total: CounterVec,
+    pub syscalls_total: CounterVec,
+}
+
+impl PhaseMetrics {
+    pub fn new(registry: &Registry) -> Result<Self, Box<dyn std::error::Error>> {
+        let duration_seconds = GaugeVec::new(
+            Opts::new(
+                "herakles_exporter_phase_duration_seconds",
+                "Duration quantiles of exporter phases since startup",
+            ),
+            &["scope", "phase", "quantile"],
+        )?;
+        let duration_max_seconds = GaugeVec::new(
+            Opts::new(
+                "herakles_exporter_phase_duration_max_seconds",
+                "Longest run of exporter phases since startup",
+            ),
+            &["scope", "phase"],
+        )?;
+        let runs_total = CounterVec::new(
+            Opts::new(
+                "herakles_exporter_phase_runs_total",
+                "Total runs of exporter phases",
+            ),
+            &["scope", "phase"],
+        )?;
+        let syscalls_total = CounterVec::new(
+            Opts::new(
+                "herakles_exporter_phase_syscalls_total",
+                "Total /proc syscalls issued while exporter phases ran",
+            ),
+            &["scope", "phase"],
+        )?;
+
+        registry.register(Box::new(duration_seconds.clone()))?;
+        registry.register(Box::new(duration_max_seconds.clone()))?;
+        registry.register(Box::new(runs_total.clone()))?;
+        registry.register(Box::new(syscalls_total.clone()))?;
+
+        Ok(Self {
+            duration_seconds,
+            duration_max_seconds,
+            runs_total,
+            syscalls_total,
+        })
+    }
+
+    /// Sets the series of every phase that ran at least once.
+    pub fn update(&self, stats: &PhaseStats) {
+        for snapshot in stats.snapshots().iter().filter(|s| s.runs > 0) {
+            let (scope, phase) = (snapshot.phase.scope(), snapshot.phase.name());
+            self.duration_seconds
+                .with_label_values(&[scope, phase, "0.5"])
+                .set(snapshot.p50.as_secs_f64());
+            self.duration_seconds
+                .with_label_values(&[scope, phase, "0.99"])
+                .set(snapshot.p99.as_secs_f64());
+            self.duration_max_seconds
+                .with_label_values(&[scope, phase])
+                .set(snapshot.max.as_secs_f64());
+
+            // For counters, use reset + inc_by to set the cumulative values
+            let runs = self.runs_total.with_label_values(&[scope, phase]);
+            runs.reset();
+            runs.inc_by(snapshot.runs as f64);
+            let syscalls = self.syscalls_total.with_label_values(&[scope, phase]);
+            syscalls.reset();
+            syscalls.inc_by(snapshot.syscalls as f64);
+        }
+    }
+}
+
+/// Finite bucket bounds of the eBPF log2 histograms, converted with `scale`
+/// from the unit the kernel records in.
+fn log2_bucket_bounds(scale: f64) -> Vec<f64> {
+    (0..HIST_SLOTS)
+        .filter_map(Log2Histogram::upper_bound)
+        .map(|bound| bound as f64 * scale)
+        .collect()
+}
+
+/// Histogram family labeled by group and subgroup whose series are set as a
+/// whole.
+///
+/// `HistogramVec` can only observe single values. The eBPF I/O histograms
+/// are bucketed in the kernel, so each render replaces a series' counts
+/// with [`BucketedHistogramVec::set`] instead.
+#[derive(Clone)]
+pub struct BucketedHistogramVec {
+    desc: Desc,
+    upper_bounds: Arc<[f64]>,
+    series: Arc<Mutex<BTreeMap<(String, String), HistogramSeries>>>,
+}
+
+/// Cumulative bucket counts of one series, aligned with the upper bounds.
+struct HistogramSeries {
+    cumulative: Vec<u64>,
+    count: u64,
+    sum: f64,
+}
+
+impl BucketedHistogramVec {
+    /// Creates a family with the given finite bucket upper bounds, ascending.
+    /// The `+Inf` bucket is implied.
+    pub fn new(name: &str, help: &str, upper_bounds: Vec<f64>) -> prometheus::Result<Self> {
+        let desc = Desc::new(
+            name.to_string(),
+            help.to_string(),
+            vec!["group".to_string(), "subgroup".to_string()],
+            std::collections::HashMap::new(),
+        )?;
+        Ok(Self {
+            desc,
+            upper_bounds: upper_bounds.into(),
+            series: Arc::new(Mutex::new(BTreeMap::new())),
+        })
+    }
+
+    /// Sets the series of a group and subgroup.
+    ///
+    /// `counts[i]` is the number of values in bucket `i` (not cumulative);
+    /// counts past the finite bounds only go to the `+Inf` bucket.
+    #[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+    pub fn set(&self, group: &str, subgroup: &str, counts: &[u64], sum: f64) {
+        let mut cumulative = Vec::with_capacity(self.upper_bounds.len());
+        let mut count = 0u64;
+        for (i, &bucket) in counts.iter().enumerate() {
+            count = count.wrapping_add(bucket);
+            if i < self.upper_bounds.len() {
+                cumulative.push(count);
+            }
+        }
+        // Fewer counts than bounds: the remaining buckets hold everything
+        cumulative.resize(self.upper_bounds.len(), count);
+
+        self.series
+            .lock()
+            .expect("histogram series lock poisoned")
+            .insert(
+                (group.to_string(), subgroup.to_string()),
+                HistogramSeries {
+                    cumulative,
+                    count,
+                    sum,
+                },
+            );
+    }
+}
+
+fn label_pair(name: &str, value: &str) -> proto::LabelPair {
+    let mut pair = proto::LabelPair::default();
+    pair.set_name(name.to_string());
+    pair.set_value(value.to_string());
+    pair
+}
+
+impl Collector for BucketedHistogramVec {
+    fn desc(&self) -> Vec<&Desc> {
+        vec![&self.desc]
+    }
+
+    fn collect(&self) -> Vec<MetricFamily> {
+        let series = self.series.lock().expect("histogram series lock poisoned");
+        if series.is_empty() {
+            return Vec::new();
+        }
+
+        let metrics: Vec<proto::Metric> = series
+            .iter()
+            .map(|((group, subgroup), series)| {
+                let buckets: Vec<proto::Bucket> = self
+                    .upper_bounds
+                    .iter()
+                    .zip(&series.cumulative)
+                    .map(|(&upper_bound, &cumulative_count)| {
+                        let mut bucket = proto::Bucket::default();
+                        bucket.set_upper_bound(upper_bound);
+                        bucket.set_cumulative_count(cumulative_count);
+                        bucket
+                    })
+                    .collect();
+
+                let mut histogram = proto::Histogram::default();
+                histogram.set_sample_count(series.count);
+                histogram.set_sample_sum(series.sum);
+                histogram.set_bucket(buckets.into());
+
+                let mut metric = proto::Metric::default();
+                metric.set_label(
+                    vec![label_pair("group", group), label_pair("subgroup", subgroup)].into(),
+                );
+                metric.set_histogram(histogram);
+                metric
+            })
+            .collect();
+
+        let mut family = MetricFamily::default();
+        family.set_name(self.desc.fq_name.clone());
+        family.set_help(self.desc.help.clone());
+        family.set_field_type(MetricType::HISTOGRAM);
+        family.set_metric(metrics.into());
+        vec![family]
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::cell::RefCell;
+
+    fn table(version: u64, names: &[&str]) -> DeviceTable<()> {
+        DeviceTable {
+            version,
+            devices: names.iter().map(|name| (Arc::from(*name), ())).collect(),
+        }
+    }
+
+    #[test]
+    fn test_device_handles_rebuild_on_new_version() {
+        let resolved = RefCell::new(0);
+        let removed = RefCell::new(Vec::new());
+        let resolve = |name: &str| {
+            *resolved.borrow_mut() += 1;
+            name.to_string()
+        };
+        let remove = |name: &str| removed.borrow_mut().push(name.to_string());
+        let mut handles = DeviceHandles::default();
+
+        let first = table(1, &["sda", "sdb"]);
+        assert_eq!(handles.update(&first, resolve, remove), ["sda", "sdb"]);
+        handles.update(&first, resolve, remove);
+        assert_eq!(*resolved.borrow(), 2);
+
+        let second = table(2, &["sda", "nvme0n1"]);
+        assert_eq!(handles.update(&second, resolve, remove), ["sda", "nvme0n1"]);
+        assert_eq!(*resolved.borrow(), 4);
+        assert_eq!(*removed.borrow(), ["sdb"]);
+    }
+
+    #[test]
+    fn test_phase_metrics_export_recorded_phases() {
+        use crate::health_stats::{Phase, PhaseSplit};
+
+        let registry = Registry::new();
+        let metrics = PhaseMetrics::new(&registry).unwrap();
+        let stats = PhaseStats::default();
+        stats.record(
+            Phase::ReadParse,
+            PhaseSplit {
+                duration: std::time::Duration::from_millis(3),
+                syscalls: 12,
+            },
+        );
+        metrics.update(&stats);
+
+        let runs = metrics
+            .runs_total
+            .with_label_values(&["update_cache", "read_parse"]);
+        assert_eq!(runs.get(), 1.0);
+        let syscalls = metrics
+            .syscalls_total
+            .with_label_values(&["update_cache", "read_parse"]);
+        assert_eq!(syscalls.get(), 12.0);
+        // Phases that never ran have no series
+        let families = registry.gather();
+        let max = families
+            .iter()
+            .find(|f| f.get_name() == "herakles_exporter_phase_duration_max_seconds")
+            .unwrap();
+        assert_eq!(max.get_metric().len(), 1);
     }
 }
@@ -0,0 +1,192 @@
+//! cgroup v2 membership of processes.
+//!
+//! The cgroup of a process is read from `/proc/<pid>/cgroup` once per (PID,
+//! start time) and kept between scans like its classification. Paths can be
+//! cut to their first components, so that for example every container of a
+//! Kubernetes pod is counted in the pod's cgroup; cgroup v2 statistics are
+//! hierarchical, so the ancestor's `memory.stat` and `cpu.stat` already
+//! cover its descendants.
+
+use ahash::AHashMap as HashMap;
+use std::sync::{Arc, Mutex};
+
+/// Returns the cgroup v2 path from the contents of `/proc/<pid>/cgroup`.
+///
+/// Only the unified hierarchy entry (`0::<path>`) is used, so hosts with
+/// only cgroup v1 hierarchies have none.
+pub fn parse_proc_cgroup(content: &str) -> Option<&str> {
+    content
+        .lines()
+        .find_map(|line| line.strip_prefix("0::"))
+        .map(str::trim_end)
+        .filter(|path| path.starts_with('/'))
+}
+
+/// Cuts `path` to its first `depth` components; `None` keeps it whole.
+pub fn truncate_path(path: &str, depth: Option<usize>) -> &str {
+    let depth = match depth {
+        Some(depth) => depth,
+        None => return path,
+    };
+    match path.match_indices('/').nth(depth) {
+        Some((end, _)) => &path[..end],
+        None => path,
+    }
+}
+
+/// cgroup of one process, valid while its PID and start time are unchanged.
+#[derive(Debug, Clone)]
+pub struct CgroupEntry {
+    start_ticks: u64,
+    pub path: Option<Arc<str>>,
+}
+
+impl CgroupEntry {
+    /// Reuses `previous` if it still describes the process, otherwise reads
+    /// its cgroup. `read` returns the contents of `/proc/<pid>/cgroup` and is
+    /// only called on a miss.
+    pub fn resolve(
+        previous: Option<&CgroupEntry>,
+        start_ticks: u64,
+        depth: Option<usize>,
+        read: impl FnOnce() -> Option<String>,
+    ) -> CgroupEntry {
+        if let Some(previous) = previous {
+            if previous.start_ticks == start_ticks {
+                return previous.clone();
+            }
+        }
+        let path = read().and_then(|content| {
+            parse_proc_cgroup(&content).map(|path| Arc::from(truncate_path(path, depth)))
+        });
+        CgroupEntry { start_ticks, path }
+    }
+}
+
+/// cgroups of the previous scan, keyed by PID.
+///
+/// Swapped per scan like [`crate::process::ClassCache`], so PIDs that were
+/// not seen in the scan are dropped with the old map.
+#[derive(Default)]
+pub struct CgroupCache {
+    entries: Mutex<HashMap<u32, CgroupEntry>>,
+}
+
+impl CgroupCache {
+    /// Takes the cgroups of the previous scan, leaving the cache empty.
+    pub fn take(&self) -> HashMap<u32, CgroupEntry> {
+        std::mem::take(&mut *self.entries.lock().expect("cgroup_cache lock poisoned"))
+    }
+
+    /// Stores the cgroups of the current scan.
+    pub fn replace(&self, entries: HashMap<u32, CgroupEntry>) {
+        *self.entries.lock().expect("cgroup_cache lock poisoned") = entries;
+    }
+}
+
+/// Processes of one cgroup in the last scan.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct CgroupMembers {
+    pub path: Arc<str>,
+    pub processes: usize,
+    /// Sum of the RSS of the processes, used to rank cgroups
+    pub rss_sum: u64,
+}
+
+/// Groups processes by cgroup, keeping the `max` cgroups with the largest
+/// RSS. `processes` yields `(cgroup path, rss)`.
+///
+/// Returns the kept cgroups, largest first, and the number of dropped ones.
+pub fn group_by_cgroup<'a>(
+    processes: impl IntoIterator<Item = (&'a Arc<str>, u64)>,
+    max: usize,
+) -> (Vec<CgroupMembers>, usize) {
+    let mut by_path: HashMap<&'a Arc<str>, CgroupMembers> = HashMap::new();
+    for (path, rss) in processes {
+        let members = by_path.entry(path).or_insert_with(|| CgroupMembers {
+            path: Arc::clone(path),
+            processes: 0,
+            rss_sum: 0,
+        });
+        members.processes += 1;
+        members.rss_sum += rss;
+    }
+
+    let mut cgroups: Vec<CgroupMembers> = by_path.into_values().collect();
+    // Ties broken by path so the kept set is stable between scans
+    cgroups.sort_unstable_by(|a, b| b.rss_sum.cmp(&a.rss_sum).then(a.path.cmp(&b.path)));
+    let dropped = cgroups.len().saturating_sub(max);
+    cgroups.truncate(max);
+    (cgroups, dropped)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_proc_cgroup() {
+        let hybrid = "12:memory:/docker/abc\n0::/system.slice/nginx.service\n";
+        assert_eq!(
+            parse_proc_cgroup(hybrid),
+            Some("/system.slice/nginx.service")
+        );
+        assert_eq!(parse_proc_cgroup("0::/\n"), Some("/"));
+        // cgroup v1 only
+        assert_eq!(parse_proc_cgroup("4:cpu,cpuacct:/user.slice\n"), None);
+    }
+
+    #[test]
+    fn test_truncate_path() {
+        let path = "/kubepods.slice/kubepods-burstable.slice/pod1.slice/cri-containerd-a.scope";
+        assert_eq!(
+            truncate_path(path, Some(3)),
+            "/kubepods.slice/kubepods-burstable.slice/pod1.slice"
+        );
+        assert_eq!(truncate_path(path, Some(1)), "/kubepods.slice");
+        assert_eq!(truncate_path(path, Some(9)), path);
+        assert_eq!(truncate_path(path, None), path);
+        assert_eq!(truncate_path("/", Some(2)), "/");
+    }
+
+    #[test]
+    fn test_resolve_reads_once_per_process() {
+        let read = || Some("0::/a/b/c\n".to_string());
+        let entry = CgroupEntry::resolve(None, 100, Some(2), read);
+        assert_eq!(entry.path.as_deref(), Some("/a/b"));
+
+        // Same start time: the previous entry is reused without reading
+        let again = CgroupEntry::resolve(Some(&entry), 100, Some(2), || unreachable!());
+        assert_eq!(again.path.as_deref(), Some("/a/b"));
+
+        // A reused PID is read again
+        let reused = CgroupEntry::resolve(Some(&entry), 200, None, || None);
+        assert_eq!(reused.path, None);
+    }
+
+    #[test]
+    fn test_group_by_cgroup_keeps_largest() {
+        let a: Arc<str> = Arc::from("/a");
+        let b: Arc<str> = Arc::from("/b");
+        let c: Arc<str> = Arc::from("/c");
+        let processes = [(&a, 10), (&b, 50), (&a, 30), (&c, 5)];
+
+        let (cgroups, dropped) = group_by_cgroup(processes, 2);
+        assert_eq!(dropped, 1);
+        assert_eq!(
+            cgroups,
+            vec![
+                CgroupMembers {
+                    path: Arc::clone(&b),
+                    processes: 1,
+                    rss_sum: 50
+                },
+                CgroupMembers {
+                    path: Arc::clone(&a),
+                    processes: 2,
+                    rss_sum: 40
+                },
+            ]
+        );
+    }
+}
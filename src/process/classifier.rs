@@ -1,15 +1,26 @@
 //! Process classification for grouping processes into categories.
 //!
 //! This module provides functions to classify processes into groups and subgroups
-//! based on their names, using a configurable mapping loaded from TOML files.
+//! based on their names and command lines, using a configurable mapping loaded
+//! from TOML files.
+//!
+//! The mapping is compiled once into a [`Classifier`]: an exact map over
+//! `matches`, an anchored pattern set for `matches` entries ending in `-` or
+//! `*` (prefixes such as `yb-`), and a pattern set over the command line for
+//! `cmdline_matches`. Scans classify each process once per lifetime and keep
+//! the result in a [`ClassCache`]. Every classification is a subgroup of the
+//! [`SUBGROUP_REGISTRY`] and carries its ID.
 
+use crate::cache::ProcMem;
 use crate::config::Config;
+use crate::process::registry::{SubgroupId, SubgroupInfo, OTHER_ID, SUBGROUP_REGISTRY};
 use ahash::AHashMap as HashMap;
 use once_cell::sync::Lazy;
+use regex::RegexSet;
 use serde::Deserialize;
 use std::fs;
 use std::path::Path;
-use std::sync::Arc;
+use std::sync::{Arc, Mutex};
 
 /// Type alias for the subgroups map.
 pub type SubgroupsMap = HashMap<Arc<str>, (Arc<str>, Arc<str>)>;
@@ -29,44 +40,23 @@ struct SubgroupsConfig {
     subgroups: Vec<Subgroup>,
 }
 
-/// Helper: load subgroups from TOML string into map.
-fn load_subgroups_from_str(content: &str, map: &mut SubgroupsMap) {
-    let parsed: SubgroupsConfig = match toml::from_str(content) {
-        Ok(c) => c,
-        Err(e) => {
-            eprintln!("Failed to parse subgroups TOML: {}", e);
-            return;
-        }
-    };
-
-    for sg in parsed.subgroups {
-        let group_arc: Arc<str> = Arc::from(sg.group.as_str());
-        let subgroup_arc: Arc<str> = Arc::from(sg.subgroup.as_str());
-
-        if let Some(matches) = sg.matches {
-            for m in matches {
-                let key_arc: Arc<str> = Arc::from(m.as_str());
-                map.insert(key_arc, (Arc::clone(&group_arc), Arc::clone(&subgroup_arc)));
-            }
-        }
-        if let Some(cmdlines) = sg.cmdline_matches {
-            for cmd in cmdlines {
-                let key_arc: Arc<str> = Arc::from(cmd.as_str());
-                map.insert(key_arc, (Arc::clone(&group_arc), Arc::clone(&subgroup_arc)));
-            }
-        }
+/// Helper: parse subgroups from a TOML string.
+fn load_subgroups_from_str(content: &str, defs: &mut Vec<Subgroup>) {
+    match toml::from_str::<SubgroupsConfig>(content) {
+        Ok(parsed) => defs.extend(parsed.subgroups),
+        Err(e) => eprintln!("Failed to parse subgroups TOML: {}", e),
     }
 }
 
 /// Helper: load subgroups from TOML file path (if exists).
-fn load_subgroups_from_file(path: &str, map: &mut SubgroupsMap) {
+fn load_subgroups_from_file(path: &str, defs: &mut Vec<Subgroup>) {
     let p = Path::new(path);
     if !p.exists() {
         return;
     }
     match fs::read_to_string(p) {
         Ok(content) => {
-            load_subgroups_from_str(&content, map);
+            load_subgroups_from_str(&content, defs);
             eprintln!("Loaded additional subgroups from {}", path);
         }
         Err(e) => {
@@ -75,33 +65,272 @@ fn load_subgroups_from_file(path: &str, map: &mut SubgroupsMap) {
     }
 }
 
-/// Static configuration for process subgroups loaded from TOML file(s).
-pub static SUBGROUPS: Lazy<SubgroupsMap> = Lazy::new(|| {
-    let mut map = HashMap::new();
+/// Subgroup definitions in load order; later definitions take precedence.
+static DEFINITIONS: Lazy<Vec<Subgroup>> = Lazy::new(|| {
+    let mut defs = Vec::new();
 
     // 1) built-in subgroups from embedded file
     let content = include_str!("../../data/subgroups.toml");
-    load_subgroups_from_str(content, &mut map);
+    load_subgroups_from_str(content, &mut defs);
 
     // 2) optional system-wide subgroups
-    load_subgroups_from_file("/etc/herakles/subgroups.toml", &mut map);
+    load_subgroups_from_file("/etc/herakles/subgroups.toml", &mut defs);
 
     // 3) optional subgroups in current working directory
-    load_subgroups_from_file("./subgroups.toml", &mut map);
+    load_subgroups_from_file("./subgroups.toml", &mut defs);
 
+    defs
+});
+
+/// Static configuration for process subgroups loaded from TOML file(s).
+///
+/// Lists every `matches` and `cmdline_matches` entry; classification itself
+/// goes through [`CLASSIFIER`].
+pub static SUBGROUPS: Lazy<SubgroupsMap> = Lazy::new(|| {
+    let mut map = HashMap::new();
+    for sg in DEFINITIONS.iter() {
+        let group_arc: Arc<str> = Arc::from(sg.group.as_str());
+        let subgroup_arc: Arc<str> = Arc::from(sg.subgroup.as_str());
+
+        let matches = sg.matches.iter().flatten();
+        let cmdlines = sg.cmdline_matches.iter().flatten();
+        for m in matches.chain(cmdlines) {
+            let key_arc: Arc<str> = Arc::from(m.as_str());
+            map.insert(key_arc, (Arc::clone(&group_arc), Arc::clone(&subgroup_arc)));
+        }
+    }
     map
 });
 
+/// Compiled classifier over the loaded subgroup definitions.
+pub static CLASSIFIER: Lazy<Classifier> = Lazy::new(|| Classifier::new(&DEFINITIONS));
+
 // Static Arc<str> for default classification values to avoid repeated allocations
 static OTHER_STR: Lazy<Arc<str>> = Lazy::new(|| Arc::from("other"));
-static UNKNOWN_STR: Lazy<Arc<str>> = Lazy::new(|| Arc::from("unknown"));
+
+/// The `other`/`unknown` fallback classification.
+static OTHER: Lazy<SubgroupInfo> = Lazy::new(|| {
+    SUBGROUP_REGISTRY
+        .get(OTHER_ID)
+        .expect("fallback subgroup is registered")
+});
+
+/// Builds a pattern set, logging and matching nothing if it fails to compile.
+fn build_set(patterns: &[String], what: &str) -> RegexSet {
+    RegexSet::new(patterns).unwrap_or_else(|e| {
+        eprintln!("Failed to compile subgroup {} patterns: {}", what, e);
+        RegexSet::empty()
+    })
+}
+
+/// Prefix of `cmdline_matches` entries that are regular expressions.
+const REGEX_PREFIX: &str = "re:";
+
+/// Returns the pattern of a `cmdline_matches` entry: the entry escaped, so
+/// it matches as a literal substring, or the expression after `re:`.
+/// Invalid expressions are logged and match nothing.
+fn cmdline_pattern(entry: &str) -> Option<String> {
+    let Some(expr) = entry.strip_prefix(REGEX_PREFIX) else {
+        return Some(regex::escape(entry));
+    };
+    match regex::Regex::new(expr) {
+        Ok(_) => Some(expr.to_string()),
+        Err(e) => {
+            eprintln!("Ignoring invalid cmdline_matches pattern {:?}: {}", entry, e);
+            None
+        }
+    }
+}
+
+/// Compiled process classifier.
+///
+/// Matching order: `cmdline_matches` (when a command line is given), then
+/// the exact process name, then the longest name prefix. Command line
+/// patterns come first because they identify the application behind a
+/// generic interpreter such as `java` or `node`.
+pub struct Classifier {
+    /// Exact process name matches
+    names: HashMap<Box<str>, SubgroupInfo>,
+    /// `^prefix` patterns for `matches` entries ending in `-` or `*`
+    prefixes: RegexSet,
+    /// Per prefix pattern: prefix length and class
+    prefix_classes: Vec<(usize, SubgroupInfo)>,
+    /// `cmdline_matches` substrings and `re:` patterns, searched anywhere in
+    /// the command line
+    cmdlines: RegexSet,
+    cmdline_classes: Vec<SubgroupInfo>,
+}
+
+impl Classifier {
+    fn new(defs: &[Subgroup]) -> Self {
+        let mut names = HashMap::new();
+        let mut prefix_patterns = Vec::new();
+        let mut prefix_classes = Vec::new();
+        let mut cmdline_patterns = Vec::new();
+        let mut cmdline_classes = Vec::new();
+
+        for sg in defs {
+            let class = SUBGROUP_REGISTRY.intern(&sg.group, &sg.subgroup);
+
+            for m in sg.matches.iter().flatten() {
+                names.insert(Box::from(m.as_str()), class.clone());
+                let prefix = m.strip_suffix('*').unwrap_or(m);
+                if (m.ends_with('-') || m.ends_with('*')) && !prefix.is_empty() {
+                    prefix_patterns.push(format!("^{}", regex::escape(prefix)));
+                    prefix_classes.push((prefix.len(), class.clone()));
+                }
+            }
+
+            for cmd in sg.cmdline_matches.iter().flatten() {
+                if let Some(pattern) = cmdline_pattern(cmd) {
+                    cmdline_patterns.push(pattern);
+                    cmdline_classes.push(class.clone());
+                }
+            }
+        }
+
+        Self {
+            names,
+            prefixes: build_set(&prefix_patterns, "prefix"),
+            prefix_classes,
+            cmdlines: build_set(&cmdline_patterns, "cmdline"),
+            cmdline_classes,
+        }
+    }
+
+    /// Whether any `cmdline_matches` are defined, i.e. whether reading the
+    /// command line can change a classification.
+    pub fn has_cmdline_patterns(&self) -> bool {
+        !self.cmdline_classes.is_empty()
+    }
+
+    /// Classifies by process name: exact match, then the longest prefix.
+    pub fn classify_name(&self, name: &str) -> Option<SubgroupInfo> {
+        if let Some(class) = self.names.get(name) {
+            return Some(class.clone());
+        }
+        self.prefixes
+            .matches(name)
+            .iter()
+            // Longest prefix wins, later definitions break ties
+            .max_by_key(|&i| (self.prefix_classes[i].0, i))
+            .map(|i| self.prefix_classes[i].1.clone())
+    }
+
+    /// Classifies by raw `/proc/<pid>/cmdline` contents (NUL-separated).
+    pub fn classify_cmdline(&self, cmdline: &[u8]) -> Option<SubgroupInfo> {
+        if !self.has_cmdline_patterns() {
+            return None;
+        }
+        let text: String = String::from_utf8_lossy(cmdline)
+            .chars()
+            .map(|c| if c == '\0' { ' ' } else { c })
+            .collect();
+        // Later definitions take precedence, as for names
+        self.cmdlines
+            .matches(text.trim_end())
+            .iter()
+            .last()
+            .map(|i| self.cmdline_classes[i].clone())
+    }
+
+    /// Classifies a process, falling back to `other`/`unknown`.
+    pub fn classify(&self, name: &str, cmdline: Option<&[u8]>) -> SubgroupInfo {
+        cmdline
+            .and_then(|c| self.classify_cmdline(c))
+            .or_else(|| self.classify_name(name))
+            .unwrap_or_else(|| OTHER.clone())
+    }
+}
+
+/// Classification of one process, valid while its PID, start time and name
+/// are unchanged.
+#[derive(Debug, Clone)]
+pub struct ClassEntry {
+    start_ticks: u64,
+    name: Arc<str>,
+    pub class: SubgroupInfo,
+}
+
+impl ClassEntry {
+    /// Reuses `previous` if it still describes the process, otherwise
+    /// classifies it. `cmdline` is only called on a miss.
+    pub fn classify(
+        previous: Option<&ClassEntry>,
+        start_ticks: u64,
+        name: &str,
+        cmdline: impl FnOnce() -> Option<Vec<u8>>,
+    ) -> ClassEntry {
+        if let Some(previous) = previous {
+            // A changed name means the process called exec
+            if previous.start_ticks == start_ticks && previous.name.as_ref() == name {
+                return previous.clone();
+            }
+        }
+        let cmdline = if CLASSIFIER.has_cmdline_patterns() {
+            cmdline()
+        } else {
+            None
+        };
+        ClassEntry {
+            start_ticks,
+            name: Arc::from(name),
+            class: CLASSIFIER.classify(name, cmdline.as_deref()),
+        }
+    }
+}
+
+/// Classifications of the previous scan, keyed by PID.
+///
+/// Swapped per scan like [`crate::process::CpuCache`], so PIDs that were not
+/// seen in the scan are dropped with the old map.
+#[derive(Default)]
+pub struct ClassCache {
+    entries: Mutex<HashMap<u32, ClassEntry>>,
+}
+
+impl ClassCache {
+    /// Takes the classifications of the previous scan, leaving the cache empty.
+    pub fn take(&self) -> HashMap<u32, ClassEntry> {
+        std::mem::take(&mut *self.entries.lock().expect("class_cache lock poisoned"))
+    }
+
+    /// Stores the classifications of the current scan.
+    pub fn replace(&self, entries: HashMap<u32, ClassEntry>) {
+        *self.entries.lock().expect("class_cache lock poisoned") = entries;
+    }
+}
 
 /// Classifies a process into group and subgroup based on process name (raw).
 pub fn classify_process_raw(process_name: &str) -> (Arc<str>, Arc<str>) {
-    SUBGROUPS
-        .get(process_name)
-        .map(|(g, sg)| (Arc::clone(g), Arc::clone(sg)))
-        .unwrap_or_else(|| (Arc::clone(&OTHER_STR), Arc::clone(&UNKNOWN_STR)))
+    let class = CLASSIFIER.classify(process_name, None);
+    (class.group, class.subgroup)
+}
+
+/// Classifies an entry keyed by PID, such as eBPF statistics: reuses the
+/// scan's classification when the PID is in `processes`, otherwise falls
+/// back to the kernel's `comm`.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+pub fn classify_pid(processes: &HashMap<u32, ProcMem>, pid: u32, comm: &str) -> SubgroupId {
+    match processes.get(&pid) {
+        Some(p) => p.subgroup_id,
+        None => classify_comm(comm),
+    }
+}
+
+/// Classifies a process no scan has seen by the kernel's `comm` alone.
+#[cfg_attr(not(feature = "ebpf"), allow(dead_code))] // Used when eBPF feature is enabled
+pub fn classify_comm(comm: &str) -> SubgroupId {
+    CLASSIFIER.classify(comm, None).id
+}
+
+/// Returns every registered subgroup, indexed by ID.
+///
+/// Forces the classifier first, so any ID it can return (including for a
+/// `comm` fallback in [`classify_pid`]) is in range.
+pub fn registered_subgroups() -> Vec<SubgroupInfo> {
+    Lazy::force(&CLASSIFIER);
+    SUBGROUP_REGISTRY.entries()
 }
 
 /// Classification including config rules (include/exclude, disable_others).
@@ -110,7 +339,16 @@ pub fn classify_process_with_config(
     cfg: &Config,
 ) -> Option<(Arc<str>, Arc<str>)> {
     let (group, subgroup) = classify_process_raw(process_name);
+    apply_config_rules(group, subgroup, cfg)
+}
 
+/// Applies the config rules (include/exclude, disable_others) to an
+/// existing classification.
+pub fn apply_config_rules(
+    group: Arc<str>,
+    subgroup: Arc<str>,
+    cfg: &Config,
+) -> Option<(Arc<str>, Arc<str>)> {
     // If user explicitly disabled "other" bucket, drop these processes
     let disable_others = cfg.disable_others.unwrap_or(false);
     if disable_others && group.as_ref() == "other" {
@@ -197,4 +435,102 @@ mod tests {
         assert_eq!(group.as_ref(), "system");
         assert_eq!(subgroup.as_ref(), "ssh");
     }
+
+    // -------------------------------------------------------------------------
+    // Tests for the compiled Classifier / ClassEntry
+    // -------------------------------------------------------------------------
+
+    fn classifier(toml: &str) -> Classifier {
+        let mut defs = Vec::new();
+        load_subgroups_from_str(toml, &mut defs);
+        Classifier::new(&defs)
+    }
+
+    #[test]
+    fn test_classify_name_prefix() {
+        let (group, subgroup) = classify_process_raw("yb-tserver");
+        assert_eq!(group.as_ref(), "db");
+        assert_eq!(subgroup.as_ref(), "yugabyte");
+
+        let (group, subgroup) = classify_process_raw("ossec-syscheckd");
+        assert_eq!(group.as_ref(), "security");
+        assert_eq!(subgroup.as_ref(), "wazuh");
+
+        // Prefixes are anchored at the start of the name
+        let (group, _) = classify_process_raw("my-yb-tserver");
+        assert_eq!(group.as_ref(), "other");
+    }
+
+    #[test]
+    fn test_classify_cmdline_overrides_interpreter_name() {
+        let cmdline = b"java\0-cp\0/opt/tomcat/bin/bootstrap.jar\0org.apache.catalina.startup.Bootstrap\0start\0";
+        let class = CLASSIFIER.classify("java", Some(cmdline));
+        assert_eq!(class.key.as_ref(), "web:tomcat");
+
+        // Without a matching cmdline the name decides
+        let class = CLASSIFIER.classify("java", Some(b"java\0-jar\0app.jar\0"));
+        assert_eq!(class.key.as_ref(), "runtime:java");
+    }
+
+    #[test]
+    fn test_classifier_patterns_and_precedence() {
+        let c = classifier(
+            r#"
+            subgroups = [
+              { group = "app", subgroup = "frontend", cmdline_matches = ["re:node.*myapp-frontend"] },
+              { group = "app", subgroup = "literal", cmdline_matches = ["--opt=(unbalanced"] },
+              { group = "app", subgroup = "class", cmdline_matches = ["weblogic.Server"] },
+              { group = "app", subgroup = "invalid", cmdline_matches = ["re:(unbalanced"] },
+              { group = "app", subgroup = "short", matches = ["svc-"] },
+              { group = "app", subgroup = "long", matches = ["svc-worker*"] },
+            ]
+            "#,
+        );
+        assert!(c.has_cmdline_patterns());
+
+        let class = c.classify("node", Some(b"node\0/srv/myapp-frontend/index.js\0"));
+        assert_eq!(class.subgroup.as_ref(), "frontend");
+
+        // Plain entries match literally, `.` included
+        let class = c.classify("tool", Some(b"tool\0--opt=(unbalanced\0"));
+        assert_eq!(class.subgroup.as_ref(), "literal");
+        let class = c.classify("java", Some(b"java\0weblogic.Server\0"));
+        assert_eq!(class.subgroup.as_ref(), "class");
+        let class = c.classify("java", Some(b"java\0weblogicXServer\0"));
+        assert_eq!(class.id, OTHER_ID);
+        // Invalid `re:` patterns match nothing, not even themselves
+        for cmdline in [&b"x\0re:(unbalanced\0"[..], b"x\0(unbalanced\0"] {
+            assert_eq!(c.classify("x", Some(cmdline)).id, OTHER_ID);
+        }
+
+        // Longest prefix wins
+        assert_eq!(c.classify("svc-api", None).subgroup.as_ref(), "short");
+        assert_eq!(c.classify("svc-worker-1", None).subgroup.as_ref(), "long");
+        assert_eq!(c.classify("other", None).id, OTHER_ID);
+
+        // Classifications carry their registry ID
+        let short = c.classify("svc-api", None);
+        assert_eq!(
+            SUBGROUP_REGISTRY.get_by_key("app:short").unwrap().id,
+            short.id
+        );
+    }
+
+    #[test]
+    fn test_class_entry_reuse_and_invalidation() {
+        let first = ClassEntry::classify(None, 100, "sshd", || None);
+        assert_eq!(first.class.subgroup.as_ref(), "ssh");
+
+        // Same process: the cmdline is not read again
+        let reused = ClassEntry::classify(Some(&first), 100, "sshd", || {
+            panic!("cmdline read for a cached process")
+        });
+        assert_eq!(reused.class.id, first.class.id);
+
+        // PID reuse (new start time) and exec (new name) reclassify
+        let reused_pid = ClassEntry::classify(Some(&first), 200, "nginx", || None);
+        assert_eq!(reused_pid.class.subgroup.as_ref(), "nginx");
+        let exec = ClassEntry::classify(Some(&first), 100, "nginx", || None);
+        assert_eq!(exec.class.subgroup.as_ref(), "nginx");
+    }
 }
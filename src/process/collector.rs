@@ -0,0 +1,755 @@
+//! Single-pass collector for `/proc/<pid>` directories.
+//!
+//! Opens `/proc` once per scan and each `/proc/<pid>` directory once per
+//! process, then reads every needed file exactly once with `openat` relative
+//! to the directory fd. Files backing disabled metric families are skipped:
+//! without PSS/USS (and no `min_uss_kb` filter), RSS comes from `stat` and
+//! `smaps_rollup` is never opened. With a [`SmapsPlan`], `smaps_rollup` is
+//! only opened for the processes the plan selects.
+//!
+//! [`ProcRoot::collect_batched`] reads the same files for all processes at
+//! once through an io_uring [`BatchReader`].
+
+use once_cell::sync::Lazy;
+use std::ffi::CStr;
+use std::fs::{File, OpenOptions};
+use std::io::{self, Read, Write};
+use std::os::fd::{AsRawFd, FromRawFd, RawFd};
+use std::os::unix::fs::OpenOptionsExt;
+use std::path::{Path, PathBuf};
+use std::time::Instant;
+
+use crate::config::Config;
+use crate::process::cpu::CLK_TCK;
+use crate::process::memory::{
+    update_max_buffer_usage, BufferConfig, SmapsEntry, SmapsPlan, MAX_IO_BUFFER_BYTES,
+    MAX_SMAPS_BUFFER_BYTES, MAX_SMAPS_ROLLUP_BUFFER_BYTES,
+};
+use crate::process::scanner::{collect_proc_pids, should_include_process};
+use crate::procfs::{self, StatFields};
+use crate::uring::BatchReader;
+
+/// System page size in bytes (for RSS from `stat`).
+pub static PAGE_SIZE: Lazy<u64> = Lazy::new(|| {
+    // SAFETY: sysconf is safe to call with _SC_PAGESIZE
+    let size = unsafe { libc::sysconf(libc::_SC_PAGESIZE) };
+    if size > 0 {
+        size as u64
+    } else {
+        4096
+    }
+});
+
+/// Which parts of a process to collect, derived from the enabled metrics.
+#[derive(Debug, Clone, Copy)]
+pub struct CollectOptions {
+    /// Parse smaps_rollup for PSS/USS (otherwise RSS comes from `stat`)
+    pub memory: bool,
+    /// Compute CPU usage deltas
+    pub cpu: bool,
+}
+
+impl CollectOptions {
+    pub fn from_config(cfg: &Config) -> Self {
+        let uss_filter = cfg.min_uss_kb.unwrap_or(0) > 0;
+        Self {
+            memory: cfg.enable_pss.unwrap_or(true) || cfg.enable_uss.unwrap_or(true) || uss_filter,
+            cpu: cfg.enable_cpu.unwrap_or(true),
+        }
+    }
+}
+
+/// Result of sampling one process.
+#[derive(Debug, Clone)]
+pub struct ProcSample {
+    pub name: String,
+    pub rss: u64,
+    pub pss: u64,
+    pub uss: u64,
+    pub vmswap: u64,
+    pub cpu_time_seconds: f64,
+    pub start_time_seconds: f64,
+    /// Start time in clock ticks since boot; with the PID it identifies the process
+    pub start_ticks: u64,
+    pub read_bytes: u64,
+    pub write_bytes: u64,
+    /// Time spent parsing memory, `None` if nothing was parsed
+    pub parse_duration_ms: Option<f64>,
+    /// Unix timestamp of the smaps read PSS/USS were reused from, `None` if
+    /// they are from this scan
+    pub memory_sampled_at: Option<f64>,
+}
+
+/// Reasons a process produced no sample.
+#[derive(Debug)]
+pub enum ScanError {
+    /// The process exited before `stat` could be read
+    Vanished,
+    /// Neither `comm` nor `cmdline` yielded a name
+    NoName,
+    /// Excluded by the include/exclude name filters
+    Filtered(String),
+    /// Reading memory information failed
+    Memory(String, io::Error),
+}
+
+/// Opens `name` relative to the directory `dir`.
+fn open_at(dir: RawFd, name: &CStr, flags: libc::c_int) -> io::Result<File> {
+    procfs::count_syscalls(2);
+    // SAFETY: name is NUL-terminated and the returned fd is owned by the File
+    let fd = unsafe { libc::openat(dir, name.as_ptr(), libc::O_RDONLY | libc::O_CLOEXEC | flags) };
+    if fd < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(unsafe { File::from_raw_fd(fd) })
+}
+
+/// Formats a PID as a NUL-terminated name without allocating.
+fn pid_name(pid: u32, out: &mut [u8; 11]) -> &CStr {
+    let mut digits = [0u8; 10];
+    let mut n = pid;
+    let mut len = 0;
+    loop {
+        digits[len] = b'0' + (n % 10) as u8;
+        len += 1;
+        n /= 10;
+        if n == 0 {
+            break;
+        }
+    }
+    for (i, d) in digits[..len].iter().rev().enumerate() {
+        out[i] = *d;
+    }
+    out[len] = 0;
+    CStr::from_bytes_with_nul(&out[..=len]).expect("pid name is NUL-terminated")
+}
+
+/// An open `/proc/<pid>` directory.
+struct ProcDir {
+    dir: File,
+}
+
+impl ProcDir {
+    /// Reads `name` into `buf`, replacing its contents.
+    fn read(&self, name: &CStr, buf: &mut Vec<u8>) -> io::Result<()> {
+        buf.clear();
+        procfs::CountingReader(open_at(self.dir.as_raw_fd(), name, 0)?).read_to_end(buf)?;
+        Ok(())
+    }
+
+    /// Reads the process name from `comm`, falling back to `cmdline`.
+    fn read_name(&self, buf: &mut Vec<u8>) -> Option<String> {
+        if self.read(c"comm", buf).is_ok() {
+            update_max_buffer_usage(&MAX_IO_BUFFER_BYTES, buf.len() as u64);
+            if let Some(comm) = parse_comm(buf) {
+                return Some(comm);
+            }
+        }
+
+        self.read(c"cmdline", buf).ok()?;
+        update_max_buffer_usage(&MAX_IO_BUFFER_BYTES, buf.len() as u64);
+        let argv0 = buf.split(|&b| b == 0).next().filter(|a| !a.is_empty())?;
+        let argv0 = std::str::from_utf8(argv0).ok()?;
+        Path::new(argv0)
+            .file_name()
+            .and_then(|n| n.to_str())
+            .map(|n| n.to_string())
+    }
+}
+
+/// Returns the trimmed contents of `comm`, `None` if empty or not UTF-8.
+fn parse_comm(content: &[u8]) -> Option<String> {
+    let comm = std::str::from_utf8(content).ok()?.trim();
+    if comm.is_empty() {
+        None
+    } else {
+        Some(comm.to_string())
+    }
+}
+
+/// Builds NUL-terminated `<pid>/<file>` paths for a [`BatchReader`].
+fn batch_paths<'a>(files: impl Iterator<Item = (u32, &'a str)>) -> Vec<u8> {
+    let mut buf = Vec::new();
+    for (pid, file) in files {
+        write!(buf, "{}/{}\0", pid, file).expect("writing to a Vec cannot fail");
+    }
+    buf
+}
+
+/// Splits the output of [`batch_paths`] into paths.
+fn split_paths(buf: &[u8]) -> Vec<&CStr> {
+    buf.split_inclusive(|&b| b == 0)
+        .map(|path| CStr::from_bytes_with_nul(path).expect("batch path is NUL-terminated"))
+        .collect()
+}
+
+/// Files of the second batch of [`ProcRoot::collect_batched`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum BatchFile {
+    SmapsRollup,
+    Status,
+    Io,
+}
+
+/// A process that passed the name filter in [`ProcRoot::collect_batched`].
+struct Pending<'a> {
+    pid: u32,
+    name: String,
+    stat: StatFields,
+    reused: Option<&'a SmapsEntry>,
+    memory: Option<(u64, u64, u64)>,
+    parse_duration_ms: Option<f64>,
+    vmswap: u64,
+    io: (u64, u64),
+    /// A file needs the regular path (missing smaps_rollup, file too large)
+    retry: bool,
+}
+
+/// The `/proc` root, opened once per scan.
+pub struct ProcRoot {
+    path: PathBuf,
+    dir: File,
+}
+
+impl ProcRoot {
+    pub fn open(path: &Path) -> io::Result<Self> {
+        let dir = OpenOptions::new()
+            .read(true)
+            .custom_flags(libc::O_DIRECTORY | libc::O_CLOEXEC)
+            .open(path)?;
+        Ok(Self {
+            path: path.to_path_buf(),
+            dir,
+        })
+    }
+
+    /// Lists the PIDs currently present.
+    pub fn pids(&self, max: Option<usize>) -> Vec<u32> {
+        collect_proc_pids(&self.path, max)
+    }
+
+    /// Collects one process in a single pass over its files.
+    ///
+    /// `uptime` is the system uptime in seconds used for the start time.
+    /// `smaps` enables tiered sampling: PSS/USS of processes the plan does
+    /// not select are reused and RSS comes from `stat`.
+    pub fn collect(
+        &self,
+        pid: u32,
+        cfg: &Config,
+        options: CollectOptions,
+        buffers: &BufferConfig,
+        uptime: f64,
+        smaps: Option<&SmapsPlan<'_>>,
+    ) -> Result<ProcSample, ScanError> {
+        let mut name_buf = [0u8; 11];
+        let dir = open_at(
+            self.dir.as_raw_fd(),
+            pid_name(pid, &mut name_buf),
+            libc::O_DIRECTORY,
+        )
+        .map_err(|_| ScanError::Vanished)?;
+        let dir = ProcDir { dir };
+
+        procfs::with_buffer(|buf| {
+            let name = dir.read_name(buf).ok_or(ScanError::NoName)?;
+            if !should_include_process(&name, cfg) {
+                return Err(ScanError::Filtered(name));
+            }
+
+            // One read of stat serves CPU time, start time and RSS
+            let stat: StatFields = match dir.read(c"stat", buf) {
+                Ok(()) => procfs::parse_stat(buf).ok_or(ScanError::Vanished)?,
+                Err(_) => return Err(ScanError::Vanished),
+            };
+
+            let stat_rss = stat.rss_pages * *PAGE_SIZE;
+            let reused = smaps
+                .filter(|_| options.memory)
+                .and_then(|plan| plan.reusable(pid, stat.start_ticks, stat_rss));
+
+            let mut parse_duration_ms = None;
+            let (rss, pss, uss) = if let Some(entry) = reused {
+                (stat_rss, entry.pss, entry.uss)
+            } else if options.memory {
+                let parse_start = Instant::now();
+                let memory = match read_memory(&dir, buffers, buf) {
+                    Ok(memory) => memory,
+                    Err(e) => return Err(ScanError::Memory(name, e)),
+                };
+                parse_duration_ms = Some(parse_start.elapsed().as_secs_f64() * 1000.0);
+                memory
+            } else {
+                (stat_rss, 0, 0)
+            };
+
+            let vmswap = match dir.read(c"status", buf) {
+                Ok(()) => procfs::parse_status_vmswap(buf),
+                Err(_) => 0,
+            };
+
+            let (read_bytes, write_bytes) = match dir.read(c"io", buf) {
+                Ok(()) => {
+                    update_max_buffer_usage(&MAX_IO_BUFFER_BYTES, buf.len() as u64);
+                    procfs::parse_io(buf)
+                }
+                Err(_) => (0, 0),
+            };
+
+            Ok(ProcSample {
+                name,
+                rss,
+                pss,
+                uss,
+                vmswap,
+                cpu_time_seconds: stat.cpu_ticks as f64 / *CLK_TCK,
+                start_time_seconds: uptime - (stat.start_ticks as f64 / *CLK_TCK),
+                start_ticks: stat.start_ticks,
+                read_bytes,
+                write_bytes,
+                parse_duration_ms,
+                memory_sampled_at: reused.map(|entry| entry.sampled_at),
+            })
+        })
+    }
+
+    /// Collects `pids` with batched reads through `reader`.
+    ///
+    /// `comm` and `stat` of every process are read in a first batch, then
+    /// `smaps_rollup`, `status` and `io` of the processes that pass the name
+    /// filter in a second. Processes that need more than a single read of
+    /// one of these (an empty `comm`, no `smaps_rollup`, a file larger than a
+    /// pool slot) are collected through [`ProcRoot::collect`] instead.
+    ///
+    /// Fails only if the ring itself fails; callers then fall back to
+    /// [`ProcRoot::collect`] for the whole scan.
+    #[allow(clippy::too_many_arguments)]
+    pub fn collect_batched(
+        &self,
+        reader: &mut BatchReader,
+        pids: &[u32],
+        cfg: &Config,
+        options: CollectOptions,
+        buffers: &BufferConfig,
+        uptime: f64,
+        smaps: Option<&SmapsPlan<'_>>,
+    ) -> io::Result<Vec<(u32, Result<ProcSample, ScanError>)>> {
+        let dir = self.dir.as_raw_fd();
+        let mut samples = Vec::with_capacity(pids.len());
+        let mut retry = Vec::new();
+
+        let paths = batch_paths(pids.iter().flat_map(|&pid| [(pid, "comm"), (pid, "stat")]));
+        let mut pending = Vec::with_capacity(pids.len());
+        let mut name = None;
+        // Files are passed in order, so each comm is followed by its stat
+        reader.read_all(dir, &split_paths(&paths), |index, result| {
+            let pid = pids[index / 2];
+            if index.is_multiple_of(2) {
+                name = result.ok().and_then(|comm| {
+                    update_max_buffer_usage(&MAX_IO_BUFFER_BYTES, comm.len() as u64);
+                    parse_comm(comm)
+                });
+                return;
+            }
+            let name = match name.take() {
+                Some(name) => name,
+                None => {
+                    retry.push(pid);
+                    return;
+                }
+            };
+            if !should_include_process(&name, cfg) {
+                samples.push((pid, Err(ScanError::Filtered(name))));
+                return;
+            }
+            match result.map(procfs::parse_stat) {
+                Ok(Some(stat)) => {
+                    let stat_rss = stat.rss_pages * *PAGE_SIZE;
+                    pending.push(Pending {
+                        pid,
+                        name,
+                        stat,
+                        reused: smaps
+                            .filter(|_| options.memory)
+                            .and_then(|plan| plan.reusable(pid, stat.start_ticks, stat_rss)),
+                        memory: None,
+                        parse_duration_ms: None,
+                        vmswap: 0,
+                        io: (0, 0),
+                        retry: false,
+                    });
+                }
+                Err(e) if e.kind() == io::ErrorKind::FileTooLarge => retry.push(pid),
+                Ok(None) | Err(_) => samples.push((pid, Err(ScanError::Vanished))),
+            }
+        })?;
+
+        let mut files = Vec::with_capacity(pending.len() * 3);
+        for (at, p) in pending.iter().enumerate() {
+            if options.memory && p.reused.is_none() {
+                files.push((at, BatchFile::SmapsRollup));
+            }
+            files.push((at, BatchFile::Status));
+            files.push((at, BatchFile::Io));
+        }
+        let paths = batch_paths(files.iter().map(|&(at, file)| {
+            let name = match file {
+                BatchFile::SmapsRollup => "smaps_rollup",
+                BatchFile::Status => "status",
+                BatchFile::Io => "io",
+            };
+            (pending[at].pid, name)
+        }));
+        reader.read_all(dir, &split_paths(&paths), |index, result| {
+            let (at, file) = files[index];
+            let p = &mut pending[at];
+            let content = match result {
+                Ok(content) => content,
+                // status and io are optional like in collect
+                Err(e) => {
+                    p.retry |=
+                        file == BatchFile::SmapsRollup || e.kind() == io::ErrorKind::FileTooLarge;
+                    return;
+                }
+            };
+            match file {
+                BatchFile::SmapsRollup => {
+                    update_max_buffer_usage(&MAX_SMAPS_ROLLUP_BUFFER_BYTES, content.len() as u64);
+                    let parse_start = Instant::now();
+                    p.memory = Some(procfs::parse_smaps_rollup(content));
+                    p.parse_duration_ms = Some(parse_start.elapsed().as_secs_f64() * 1000.0);
+                }
+                BatchFile::Status => p.vmswap = procfs::parse_status_vmswap(content),
+                BatchFile::Io => {
+                    update_max_buffer_usage(&MAX_IO_BUFFER_BYTES, content.len() as u64);
+                    p.io = procfs::parse_io(content);
+                }
+            }
+        })?;
+
+        for p in pending {
+            if p.retry {
+                retry.push(p.pid);
+                continue;
+            }
+            let stat_rss = p.stat.rss_pages * *PAGE_SIZE;
+            let (rss, pss, uss) = match (p.reused, p.memory) {
+                (Some(entry), _) => (stat_rss, entry.pss, entry.uss),
+                (None, Some(memory)) => memory,
+                (None, None) => (stat_rss, 0, 0),
+            };
+            let sample = ProcSample {
+                name: p.name,
+                rss,
+                pss,
+                uss,
+                vmswap: p.vmswap,
+                cpu_time_seconds: p.stat.cpu_ticks as f64 / *CLK_TCK,
+                start_time_seconds: uptime - (p.stat.start_ticks as f64 / *CLK_TCK),
+                start_ticks: p.stat.start_ticks,
+                read_bytes: p.io.0,
+                write_bytes: p.io.1,
+                parse_duration_ms: p.parse_duration_ms,
+                memory_sampled_at: p.reused.map(|entry| entry.sampled_at),
+            };
+            samples.push((p.pid, Ok(sample)));
+        }
+
+        for pid in retry {
+            let sample = self.collect(pid, cfg, options, buffers, uptime, smaps);
+            samples.push((pid, sample));
+        }
+        Ok(samples)
+    }
+}
+
+/// Reads (rss, pss, uss) from smaps_rollup, or the full smaps on kernels
+/// older than 4.14.
+fn read_memory(
+    dir: &ProcDir,
+    buffers: &BufferConfig,
+    buf: &mut Vec<u8>,
+) -> io::Result<(u64, u64, u64)> {
+    buf.reserve(buffers.smaps_rollup_kb * 1024);
+    match dir.read(c"smaps_rollup", buf) {
+        Ok(()) => {
+            update_max_buffer_usage(&MAX_SMAPS_ROLLUP_BUFFER_BYTES, buf.len() as u64);
+            Ok(procfs::parse_smaps_rollup(buf))
+        }
+        Err(e) if e.kind() == io::ErrorKind::NotFound => {
+            buf.reserve(buffers.smaps_kb * 1024);
+            dir.read(c"smaps", buf)?;
+            update_max_buffer_usage(&MAX_SMAPS_BUFFER_BYTES, buf.len() as u64);
+            Ok(procfs::parse_smaps(buf))
+        }
+        Err(e) => Err(e),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::fs;
+    use tempfile::tempdir;
+
+    const BUFFERS: BufferConfig = BufferConfig {
+        io_kb: 4,
+        smaps_kb: 4,
+        smaps_rollup_kb: 4,
+    };
+
+    fn write_process(root: &Path, pid: u32, files: &[(&str, &str)]) {
+        let dir = root.join(pid.to_string());
+        fs::create_dir_all(&dir).unwrap();
+        for (name, content) in files {
+            fs::write(dir.join(name), content).unwrap();
+        }
+    }
+
+    const STAT: &str =
+        "42 (worker) S 1 42 42 0 -1 4194304 0 0 0 0 300 100 0 0 20 0 1 0 500 1000 3 0";
+
+    #[test]
+    fn test_pid_name() {
+        let mut buf = [0u8; 11];
+        assert_eq!(pid_name(0, &mut buf).to_bytes(), b"0");
+        assert_eq!(pid_name(1234, &mut buf).to_bytes(), b"1234");
+        assert_eq!(pid_name(u32::MAX, &mut buf).to_bytes(), b"4294967295");
+    }
+
+    #[test]
+    fn test_collect_reads_all_files() {
+        let root = tempdir().unwrap();
+        write_process(
+            root.path(),
+            42,
+            &[
+                ("comm", "worker\n"),
+                ("stat", STAT),
+                (
+                    "smaps_rollup",
+                    "Rss: 64 kB\nPss: 32 kB\nPrivate_Dirty: 16 kB\n",
+                ),
+                ("status", "VmSwap:\t 8 kB\n"),
+                ("io", "read_bytes: 10\nwrite_bytes: 20\n"),
+            ],
+        );
+
+        let proc_root = ProcRoot::open(root.path()).unwrap();
+        assert_eq!(proc_root.pids(None), vec![42]);
+
+        let options = CollectOptions::from_config(&Config::default());
+        let sample = proc_root
+            .collect(42, &Config::default(), options, &BUFFERS, 100.0, None)
+            .unwrap();
+        assert_eq!(sample.name, "worker");
+        assert_eq!(
+            (sample.rss, sample.pss, sample.uss),
+            (64 * 1024, 32 * 1024, 16 * 1024)
+        );
+        assert_eq!(sample.vmswap, 8 * 1024);
+        assert_eq!((sample.read_bytes, sample.write_bytes), (10, 20));
+        assert!((sample.cpu_time_seconds - 400.0 / *CLK_TCK).abs() < 1e-9);
+        assert!(sample.parse_duration_ms.is_some());
+    }
+
+    #[test]
+    fn test_collect_skips_smaps_when_only_rss_enabled() {
+        let root = tempdir().unwrap();
+        // No smaps_rollup or smaps: reading them would fail the sample
+        write_process(root.path(), 42, &[("comm", "worker\n"), ("stat", STAT)]);
+
+        let mut cfg = Config::default();
+        cfg.enable_pss = Some(false);
+        cfg.enable_uss = Some(false);
+        let options = CollectOptions::from_config(&cfg);
+        assert!(!options.memory);
+
+        let proc_root = ProcRoot::open(root.path()).unwrap();
+        let sample = proc_root
+            .collect(42, &cfg, options, &BUFFERS, 100.0, None)
+            .unwrap();
+        assert_eq!(sample.rss, 3 * *PAGE_SIZE);
+        assert_eq!((sample.pss, sample.uss), (0, 0));
+        assert!(sample.parse_duration_ms.is_none());
+    }
+
+    #[test]
+    fn test_collect_reuses_smaps_when_tiered() {
+        use crate::process::memory::{SmapsEntry, SmapsTiering};
+        use ahash::AHashMap as HashMap;
+
+        let root = tempdir().unwrap();
+        write_process(
+            root.path(),
+            42,
+            &[
+                ("comm", "worker\n"),
+                ("stat", STAT),
+                (
+                    "smaps_rollup",
+                    "Rss: 64 kB\nPss: 32 kB\nPrivate_Dirty: 16 kB\n",
+                ),
+            ],
+        );
+        let cfg = Config::default();
+        let options = CollectOptions::from_config(&cfg);
+        let proc_root = ProcRoot::open(root.path()).unwrap();
+        let tiering = SmapsTiering {
+            top_n: 0,
+            rss_change_ratio: 10.0,
+            refresh_cycles: 100,
+        };
+
+        // Never read before: smaps_rollup is read
+        let empty = HashMap::new();
+        let plan = SmapsPlan::new(tiering, 0, &empty);
+        let first = proc_root
+            .collect(42, &cfg, options, &BUFFERS, 100.0, Some(&plan))
+            .unwrap();
+        assert!(first.parse_duration_ms.is_some());
+        assert_eq!(first.memory_sampled_at, None);
+
+        // Reused: smaps_rollup is not opened, RSS comes from stat
+        fs::remove_file(root.path().join("42/smaps_rollup")).unwrap();
+        let previous: HashMap<u32, SmapsEntry> = [(42, SmapsEntry::sample(None, &first, 10.0))]
+            .into_iter()
+            .collect();
+        let plan = SmapsPlan::new(tiering, 1, &previous);
+        let second = proc_root
+            .collect(42, &cfg, options, &BUFFERS, 100.0, Some(&plan))
+            .unwrap();
+        assert_eq!(
+            (second.rss, second.pss, second.uss),
+            (3 * *PAGE_SIZE, 32 * 1024, 16 * 1024)
+        );
+        assert_eq!(second.memory_sampled_at, Some(10.0));
+        assert!(second.parse_duration_ms.is_none());
+    }
+
+    #[test]
+    fn test_collect_falls_back_to_cmdline_and_smaps() {
+        let root = tempdir().unwrap();
+        write_process(
+            root.path(),
+            7,
+            &[
+                ("comm", "\n"),
+                ("cmdline", "/usr/bin/daemon\0--flag\0"),
+                ("stat", STAT),
+                (
+                    "smaps",
+                    "00400000-00452000 r-xp 0 0:0 0\nRss: 4 kB\nPss: 2 kB\n",
+                ),
+            ],
+        );
+
+        let cfg = Config::default();
+        let proc_root = ProcRoot::open(root.path()).unwrap();
+        let sample = proc_root
+            .collect(
+                7,
+                &cfg,
+                CollectOptions::from_config(&cfg),
+                &BUFFERS,
+                100.0,
+                None,
+            )
+            .unwrap();
+        assert_eq!(sample.name, "daemon");
+        assert_eq!(sample.rss, 4 * 1024);
+    }
+
+    #[test]
+    fn test_collect_reports_missing_and_filtered() {
+        let root = tempdir().unwrap();
+        write_process(root.path(), 7, &[("comm", "test_app\n"), ("stat", STAT)]);
+
+        let mut cfg = Config::default();
+        cfg.exclude_names = Some(vec!["test".to_string()]);
+        let options = CollectOptions::from_config(&cfg);
+        let proc_root = ProcRoot::open(root.path()).unwrap();
+
+        assert!(matches!(
+            proc_root.collect(7, &cfg, options, &BUFFERS, 100.0, None),
+            Err(ScanError::Filtered(_))
+        ));
+        assert!(matches!(
+            proc_root.collect(8, &cfg, options, &BUFFERS, 100.0, None),
+            Err(ScanError::Vanished)
+        ));
+    }
+
+    #[test]
+    fn test_collect_batched_matches_collect() {
+        let mut reader = match BatchReader::new(2, 4096) {
+            Ok(reader) => reader,
+            // io_uring may be disabled where the tests run
+            Err(_) => return,
+        };
+        let root = tempdir().unwrap();
+        let full = [
+            ("comm", "worker\n"),
+            ("stat", STAT),
+            (
+                "smaps_rollup",
+                "Rss: 64 kB\nPss: 32 kB\nPrivate_Dirty: 16 kB\n",
+            ),
+            ("status", "VmSwap:\t 8 kB\n"),
+            ("io", "read_bytes: 10\nwrite_bytes: 20\n"),
+        ];
+        write_process(root.path(), 1, &full);
+        write_process(root.path(), 2, &full);
+        // Needs the regular path: cmdline name and smaps fallback
+        write_process(
+            root.path(),
+            3,
+            &[
+                ("comm", "\n"),
+                ("cmdline", "/usr/bin/daemon\0"),
+                ("stat", STAT),
+                ("smaps", "Rss: 4 kB\nPss: 2 kB\n"),
+            ],
+        );
+        write_process(root.path(), 4, &[("comm", "test_app\n"), ("stat", STAT)]);
+
+        let mut cfg = Config::default();
+        cfg.exclude_names = Some(vec!["test".to_string()]);
+        let options = CollectOptions::from_config(&cfg);
+        let proc_root = ProcRoot::open(root.path()).unwrap();
+        // PID 5 does not exist
+        let mut samples = proc_root
+            .collect_batched(
+                &mut reader,
+                &[1, 2, 3, 4, 5],
+                &cfg,
+                options,
+                &BUFFERS,
+                100.0,
+                None,
+            )
+            .unwrap();
+        samples.sort_by_key(|(pid, _)| *pid);
+
+        let pids: Vec<u32> = samples.iter().map(|(pid, _)| *pid).collect();
+        assert_eq!(pids, vec![1, 2, 3, 4, 5]);
+        for (pid, sample) in &samples[..3] {
+            let batched = sample.as_ref().unwrap();
+            let single = proc_root
+                .collect(*pid, &cfg, options, &BUFFERS, 100.0, None)
+                .unwrap();
+            assert_eq!(batched.name, single.name);
+            assert_eq!(
+                (batched.rss, batched.pss, batched.uss, batched.vmswap),
+                (single.rss, single.pss, single.uss, single.vmswap)
+            );
+            assert_eq!(
+                (batched.read_bytes, batched.write_bytes),
+                (single.read_bytes, single.write_bytes)
+            );
+            assert_eq!(batched.start_ticks, single.start_ticks);
+        }
+        assert!(matches!(samples[3].1, Err(ScanError::Filtered(_))));
+        assert!(matches!(samples[4].1, Err(ScanError::Vanished)));
+    }
+}
@@ -1,18 +1,19 @@
 //! CPU statistics parsing for process metrics.
 //!
 //! This module provides functions to parse CPU time information from
-//! `/proc/<pid>/stat` and manage CPU usage caching for delta calculations.
+//! `/proc/<pid>/stat` and keeps the previous scan's samples for delta
+//! calculations.
 
 use ahash::AHashMap as HashMap;
 use once_cell::sync::Lazy;
-use std::fs;
 use std::path::Path;
-use std::sync::RwLock as StdRwLock;
+use std::sync::Mutex;
 use std::time::Instant;
-use tracing::debug;
+
+use crate::procfs::{self, StatFields};
 
 /// Get system clock ticks per second (usually 100, but can vary).
-fn get_clk_tck() -> f64 {
+fn get_clk_tck() -> u64 {
     #[cfg(unix)]
     {
         // SAFETY: sysconf is safe to call with _SC_CLK_TCK
@@ -20,16 +21,19 @@ fn get_clk_tck() -> f64 {
         unsafe {
             let tck = libc::sysconf(libc::_SC_CLK_TCK);
             if tck > 0 {
-                return tck as f64;
+                return tck as u64;
             }
         }
     }
     // Fallback to common default for error cases or non-Unix platforms
-    100.0
+    100
 }
 
+/// System clock ticks per second, for exact conversions to ticks.
+pub static CLK_TCK_HZ: Lazy<u64> = Lazy::new(get_clk_tck);
+
 /// System clock ticks per second (for CPU time calculation).
-pub static CLK_TCK: Lazy<f64> = Lazy::new(get_clk_tck);
+pub static CLK_TCK: Lazy<f64> = Lazy::new(|| *CLK_TCK_HZ as f64);
 
 /// Cached CPU statistics for a single process (monotonic CPU time + last computed percent).
 #[derive(Clone, Copy)]
@@ -44,69 +48,14 @@ pub struct CpuEntry {
     pub last_updated: Instant,
 }
 
-/// Parse total CPU time (user+system) in seconds from /proc/<pid>/stat.
-pub fn parse_cpu_time_seconds(proc_path: &Path) -> Result<f64, std::io::Error> {
-    let stat_path = proc_path.join("stat");
-    let content = fs::read_to_string(stat_path)?;
-
-    let parts: Vec<&str> = content.split_whitespace().collect();
-    if parts.len() <= 14 {
-        return Err(std::io::Error::other("Invalid stat format"));
-    }
-
-    let utime: f64 = parts[13].parse().unwrap_or(0.0);
-    let stime: f64 = parts[14].parse().unwrap_or(0.0);
-
-    // Use system-detected clock ticks per second
-    Ok((utime + stime) / *CLK_TCK)
-}
-
-/// Parse process start time from /proc/<pid>/stat (field 22 - starttime in jiffies).
-/// Returns start time in seconds since system boot.
-pub fn parse_start_time_seconds(proc_path: &Path) -> Result<f64, std::io::Error> {
-    let stat_path = proc_path.join("stat");
-    let content = fs::read_to_string(stat_path)?;
-
-    let parts: Vec<&str> = content.split_whitespace().collect();
-    if parts.len() <= 21 {
-        return Err(std::io::Error::other("Invalid stat format"));
-    }
-
-    // Field 22 is at index 21 (0-based)
-    let starttime_jiffies: u64 = parts[21]
-        .parse()
-        .map_err(|_| std::io::Error::other("Failed to parse starttime field"))?;
-
-    // Get system uptime
-    let system_uptime = crate::system::read_uptime().unwrap_or(0.0);
-
-    // Calculate process start time: system_uptime - (starttime_jiffies / HZ)
-    let start_time_seconds = system_uptime - (starttime_jiffies as f64 / *CLK_TCK);
-
-    Ok(start_time_seconds)
-}
-
-/// Returns CPU stats for a PID using delta between samples.
-pub fn get_cpu_stat_for_pid(
-    pid: u32,
-    proc_path: &Path,
-    cache: &StdRwLock<HashMap<u32, CpuEntry>>,
-) -> CpuStat {
-    let now = Instant::now();
-    let cpu_time_seconds = match parse_cpu_time_seconds(proc_path) {
-        Ok(v) => v,
-        Err(e) => {
-            debug!("Failed to read CPU time for pid {}: {}", pid, e);
-            0.0
-        }
-    };
+impl CpuEntry {
+    /// Computes CPU percent from `cpu_time_seconds` sampled at `now`,
+    /// relative to the `previous` sample of the same process.
+    pub fn sample(previous: Option<&CpuEntry>, cpu_time_seconds: f64, now: Instant) -> Self {
+        let mut cpu_percent = 0.0;
 
-    let mut cpu_percent = 0.0;
-
-    // Use delta between last and current CPU time to compute percent
-    {
-        let cache_read = cache.read().expect("cpu_cache read lock poisoned");
-        if let Some(entry) = cache_read.get(&pid) {
+        // Use delta between last and current CPU time to compute percent
+        if let Some(entry) = previous {
             let dt = now.duration_since(entry.last_updated).as_secs_f64();
             if dt > 0.0 {
                 let delta_cpu = cpu_time_seconds - entry.stat.cpu_time_seconds;
@@ -115,26 +64,57 @@ pub fn get_cpu_stat_for_pid(
                 }
             }
         }
+
+        Self {
+            stat: CpuStat {
+                cpu_percent,
+                cpu_time_seconds,
+            },
+            last_updated: now,
+        }
     }
+}
 
-    let stat = CpuStat {
-        cpu_percent,
-        cpu_time_seconds,
-    };
+/// CPU samples of the previous scan, keyed by PID.
+///
+/// A scan takes the whole map, reads it without locking while sampling in
+/// parallel and stores the map built from its own samples afterwards. PIDs
+/// that were not seen in the scan are dropped with the old map.
+#[derive(Default)]
+pub struct CpuCache {
+    entries: Mutex<HashMap<u32, CpuEntry>>,
+}
 
-    // Store updated value in cache
-    {
-        let mut cache_write = cache.write().expect("cpu_cache write lock poisoned");
-        cache_write.insert(
-            pid,
-            CpuEntry {
-                stat,
-                last_updated: now,
-            },
-        );
+impl CpuCache {
+    /// Takes the samples of the previous scan, leaving the cache empty.
+    pub fn take(&self) -> HashMap<u32, CpuEntry> {
+        std::mem::take(&mut *self.entries.lock().expect("cpu_cache lock poisoned"))
     }
 
-    stat
+    /// Stores the samples of the current scan.
+    pub fn replace(&self, entries: HashMap<u32, CpuEntry>) {
+        *self.entries.lock().expect("cpu_cache lock poisoned") = entries;
+    }
+
+    /// Number of processes with a stored sample.
+    #[allow(dead_code)] // Used by tests
+    pub fn len(&self) -> usize {
+        self.entries.lock().expect("cpu_cache lock poisoned").len()
+    }
+}
+
+/// Parse total CPU time (user+system) in seconds from /proc/<pid>/stat.
+pub fn parse_cpu_time_seconds(proc_path: &Path) -> Result<f64, std::io::Error> {
+    let stat = read_stat_fields(proc_path)?;
+
+    // Use system-detected clock ticks per second
+    Ok(stat.cpu_ticks as f64 / *CLK_TCK)
+}
+
+/// Reads and parses /proc/<pid>/stat.
+fn read_stat_fields(proc_path: &Path) -> Result<StatFields, std::io::Error> {
+    procfs::with_file(&proc_path.join("stat"), 0, procfs::parse_stat)?
+        .ok_or_else(|| std::io::Error::other("Invalid stat format"))
 }
 
 #[cfg(test)]
@@ -197,6 +177,49 @@ mod tests {
         assert!(result.is_err());
     }
 
+    // -------------------------------------------------------------------------
+    // Tests for CpuEntry / CpuCache
+    // -------------------------------------------------------------------------
+
+    #[test]
+    fn test_cpu_entry_sample_delta() {
+        let start = Instant::now();
+        let first = CpuEntry::sample(None, 10.0, start);
+        assert_eq!(first.stat.cpu_percent, 0.0);
+
+        let later = start + std::time::Duration::from_secs(2);
+        let second = CpuEntry::sample(Some(&first), 11.0, later);
+        assert!((second.stat.cpu_percent - 50.0).abs() < 1e-9);
+        assert_eq!(second.stat.cpu_time_seconds, 11.0);
+
+        // A lower CPU time (PID reuse) never yields a negative percent
+        let reused = CpuEntry::sample(
+            Some(&second),
+            1.0,
+            later + std::time::Duration::from_secs(1),
+        );
+        assert_eq!(reused.stat.cpu_percent, 0.0);
+    }
+
+    #[test]
+    fn test_cpu_cache_replace_drops_unseen_pids() {
+        let cache = CpuCache::default();
+        let now = Instant::now();
+        let mut entries = HashMap::new();
+        entries.insert(1, CpuEntry::sample(None, 1.0, now));
+        entries.insert(2, CpuEntry::sample(None, 2.0, now));
+        cache.replace(entries);
+
+        let previous = cache.take();
+        assert_eq!(previous.len(), 2);
+        assert_eq!(cache.len(), 0);
+
+        let mut next = HashMap::new();
+        next.insert(2, CpuEntry::sample(previous.get(&2), 3.0, now));
+        cache.replace(next);
+        assert_eq!(cache.len(), 1);
+    }
+
     #[test]
     fn test_parse_cpu_time_seconds_zero_values() {
         let dir = tempdir().expect("Failed to create temp dir");
@@ -1,12 +1,19 @@
 //! Memory parsing utilities for reading process memory metrics from /proc.
 //!
 //! This module provides functions to parse memory information from
-//! `/proc/<pid>/smaps` and `/proc/<pid>/smaps_rollup` files.
+//! `/proc/<pid>/smaps` and `/proc/<pid>/smaps_rollup` files, and the tiered
+//! sampling policy that decides which processes get them read in a scan.
 
-use std::fs;
-use std::io::{BufRead, BufReader};
+use ahash::AHashMap as HashMap;
 use std::path::Path;
 use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Mutex;
+
+use crate::config::{
+    Config, DEFAULT_SMAPS_REFRESH_CYCLES, DEFAULT_SMAPS_RSS_CHANGE_PERCENT, DEFAULT_SMAPS_TOP_N,
+};
+use crate::process::collector::ProcSample;
+use crate::procfs;
 
 /// Static atomics for tracking maximum buffer usage across parse operations.
 /// These track the actual bytes read through each buffer type.
@@ -41,73 +48,26 @@ pub fn update_max_buffer_usage(current_max: &AtomicU64, new_value: u64) {
 /// Fast parser for /proc/<pid>/smaps_rollup (Linux >= 4.14).
 /// Much faster than reading the full smaps file.
 pub fn parse_smaps_rollup(path: &Path, buf_kb: usize) -> Result<(u64, u64, u64), std::io::Error> {
-    let file = fs::File::open(path)?;
-    let reader = BufReader::with_capacity(buf_kb * 1024, file);
-
-    let mut rss_kb = 0;
-    let mut pss_kb = 0;
-    let mut private_clean_kb = 0;
-    let mut private_dirty_kb = 0;
-    let mut bytes_read: u64 = 0;
-
-    for line in reader.lines() {
-        let l = line?;
-        bytes_read += l.len() as u64 + 1; // +1 for newline
-        if let Some(v) = l.strip_prefix("Rss:") {
-            rss_kb += parse_kb_value(v).unwrap_or(0);
-        } else if let Some(v) = l.strip_prefix("Pss:") {
-            pss_kb += parse_kb_value(v).unwrap_or(0);
-        } else if let Some(v) = l.strip_prefix("Private_Clean:") {
-            private_clean_kb += parse_kb_value(v).unwrap_or(0);
-        } else if let Some(v) = l.strip_prefix("Private_Dirty:") {
-            private_dirty_kb += parse_kb_value(v).unwrap_or(0);
-        }
-    }
+    let (memory, bytes_read) = procfs::with_file(path, buf_kb * 1024, |content| {
+        (procfs::parse_smaps_rollup(content), content.len() as u64)
+    })?;
 
     // Update maximum buffer usage for smaps_rollup
     update_max_buffer_usage(&MAX_SMAPS_ROLLUP_BUFFER_BYTES, bytes_read);
 
-    Ok((
-        rss_kb * 1024,
-        pss_kb * 1024,
-        (private_clean_kb + private_dirty_kb) * 1024,
-    ))
+    Ok(memory)
 }
 
 /// Parses memory metrics from /proc/pid/smaps file.
 pub fn parse_smaps(path: &Path, buf_kb: usize) -> Result<(u64, u64, u64), std::io::Error> {
-    let file = fs::File::open(path)?;
-    let reader = BufReader::with_capacity(buf_kb * 1024, file);
-
-    let mut rss = 0;
-    let mut pss = 0;
-    let mut pc = 0;
-    let mut pd = 0;
-    let mut bytes_read: u64 = 0;
-
-    for line in reader.lines() {
-        let l = line?;
-        bytes_read += l.len() as u64 + 1; // +1 for newline
-        if let Some(kb) = l.strip_prefix("Rss:") {
-            rss += parse_kb_value(kb).unwrap_or(0);
-        } else if let Some(kb) = l.strip_prefix("Pss:") {
-            pss += parse_kb_value(kb).unwrap_or(0);
-        } else if let Some(kb) = l.strip_prefix("Private_Clean:") {
-            pc += parse_kb_value(kb).unwrap_or(0);
-        } else if let Some(kb) = l.strip_prefix("Private_Dirty:") {
-            pd += parse_kb_value(kb).unwrap_or(0);
-        }
-    }
+    let (memory, bytes_read) = procfs::with_file(path, buf_kb * 1024, |content| {
+        (procfs::parse_smaps(content), content.len() as u64)
+    })?;
 
     // Update maximum buffer usage for smaps
     update_max_buffer_usage(&MAX_SMAPS_BUFFER_BYTES, bytes_read);
 
-    Ok((rss * 1024, pss * 1024, (pc + pd) * 1024))
-}
-
-/// Parses kilobyte values from smaps file lines.
-pub fn parse_kb_value(v: &str) -> Option<u64> {
-    v.split_whitespace().next()?.parse().ok()
+    Ok(memory)
 }
 
 /// Wrapper that selects the fastest available memory parser.
@@ -125,52 +85,148 @@ pub fn parse_memory_for_process(
     parse_smaps(&smaps, buffers.smaps_kb)
 }
 
-/// Reads VmSwap from /proc/[pid]/status.
-/// Returns swap usage in bytes.
-pub fn read_vmswap(proc_path: &Path) -> Result<u64, std::io::Error> {
-    let status_path = proc_path.join("status");
-    let content = fs::read_to_string(status_path)?;
+/// Tiered smaps sampling policy.
+///
+/// Reading smaps_rollup makes the kernel walk the page tables of the process
+/// under its mmap lock. In tiered mode RSS comes from `stat` for every
+/// process and PSS/USS are only re-read for a process that
+/// - is among the `top_n` largest by RSS,
+/// - has an RSS that moved by more than `rss_change_ratio` since the read, or
+/// - is in this scan's round-robin slot, so that every process is read at
+///   least once per `refresh_cycles` scans.
+///
+/// Other processes keep the PSS/USS of their last read.
+#[derive(Debug, Clone, Copy)]
+pub struct SmapsTiering {
+    pub top_n: usize,
+    pub rss_change_ratio: f64,
+    pub refresh_cycles: u32,
+}
+
+impl SmapsTiering {
+    /// Returns the policy if `smaps_tiering` is enabled.
+    pub fn from_config(cfg: &Config) -> Option<Self> {
+        cfg.smaps_tiering.unwrap_or(false).then(|| Self {
+            top_n: cfg.smaps_top_n.unwrap_or(DEFAULT_SMAPS_TOP_N),
+            rss_change_ratio: cfg
+                .smaps_rss_change_percent
+                .unwrap_or(DEFAULT_SMAPS_RSS_CHANGE_PERCENT)
+                / 100.0,
+            refresh_cycles: cfg
+                .smaps_refresh_cycles
+                .unwrap_or(DEFAULT_SMAPS_REFRESH_CYCLES)
+                .max(1),
+        })
+    }
+}
 
-    for line in content.lines() {
-        if let Some(v) = line.strip_prefix("VmSwap:") {
-            if let Some(kb) = parse_kb_value(v) {
-                return Ok(kb * 1024);
+/// PSS/USS of a process from its last smaps read.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SmapsEntry {
+    start_ticks: u64,
+    /// RSS at the time of the read
+    rss: u64,
+    pub pss: u64,
+    pub uss: u64,
+    /// Unix timestamp of the read (seconds)
+    pub sampled_at: f64,
+}
+
+impl SmapsEntry {
+    /// Entry after `sample`: `previous` if the sample reused it, otherwise a
+    /// new one for the read done at `now`.
+    pub fn sample(previous: Option<&SmapsEntry>, sample: &ProcSample, now: f64) -> Self {
+        if let Some(previous) = previous {
+            if sample.memory_sampled_at.is_some() && previous.start_ticks == sample.start_ticks {
+                return *previous;
             }
         }
+        Self {
+            start_ticks: sample.start_ticks,
+            rss: sample.rss,
+            pss: sample.pss,
+            uss: sample.uss,
+            sampled_at: now,
+        }
     }
+}
 
-    // If VmSwap is not present in status (kernel < 2.6.34 or no swap), return 0
-    Ok(0)
+/// smaps reads of previous scans, keyed by PID, and the scan counter that
+/// drives the round-robin refresh.
+///
+/// Swapped per scan like [`crate::process::CpuCache`], so PIDs that were not
+/// seen in the scan are dropped with the old map.
+#[derive(Default)]
+pub struct SmapsCache {
+    entries: Mutex<HashMap<u32, SmapsEntry>>,
+    cycles: AtomicU64,
 }
 
-/// Reads Block I/O statistics from /proc/[pid]/io.
-/// Returns (read_bytes, write_bytes) from storage devices.
-/// Note: Requires appropriate permissions (usually root or CAP_SYS_PTRACE).
-pub fn read_block_io(proc_path: &Path) -> Result<(u64, u64), std::io::Error> {
-    let io_path = proc_path.join("io");
-    let content = fs::read_to_string(io_path)?;
-
-    let mut read_bytes = 0u64;
-    let mut write_bytes = 0u64;
-    let mut found_read = false;
-    let mut found_write = false;
-
-    for line in content.lines() {
-        if let Some(v) = line.strip_prefix("read_bytes:") {
-            read_bytes = v.trim().parse().unwrap_or(0);
-            found_read = true;
-        } else if let Some(v) = line.strip_prefix("write_bytes:") {
-            write_bytes = v.trim().parse().unwrap_or(0);
-            found_write = true;
-        }
+impl SmapsCache {
+    /// Takes the entries of the previous scan, leaving the cache empty.
+    pub fn take(&self) -> HashMap<u32, SmapsEntry> {
+        std::mem::take(&mut *self.entries.lock().expect("smaps_cache lock poisoned"))
+    }
 
-        // Early exit if we've found both values
-        if found_read && found_write {
-            break;
+    /// Stores the entries of the current scan.
+    pub fn replace(&self, entries: HashMap<u32, SmapsEntry>) {
+        *self.entries.lock().expect("smaps_cache lock poisoned") = entries;
+    }
+
+    /// Returns the number of the scan that is starting.
+    pub fn next_cycle(&self) -> u64 {
+        self.cycles.fetch_add(1, Ordering::Relaxed)
+    }
+}
+
+/// The tiering decisions of one scan.
+#[derive(Debug, Clone, Copy)]
+pub struct SmapsPlan<'a> {
+    tiering: SmapsTiering,
+    cycle: u64,
+    /// RSS from which a process counts as one of the `top_n` largest
+    top_rss: u64,
+    previous: &'a HashMap<u32, SmapsEntry>,
+}
+
+impl<'a> SmapsPlan<'a> {
+    /// Plans scan number `cycle` from the entries of the previous scans. The
+    /// largest processes are ranked by the RSS of their last read, which is
+    /// current for the ones that were in the top.
+    pub fn new(tiering: SmapsTiering, cycle: u64, previous: &'a HashMap<u32, SmapsEntry>) -> Self {
+        let top_rss = match tiering.top_n {
+            0 => u64::MAX,
+            n if n >= previous.len() => 0,
+            n => {
+                let mut rss: Vec<u64> = previous.values().map(|entry| entry.rss).collect();
+                let (_, nth, _) = rss.select_nth_unstable_by(n - 1, |a, b| b.cmp(a));
+                *nth
+            }
+        };
+        Self {
+            tiering,
+            cycle,
+            top_rss,
+            previous,
         }
     }
 
-    Ok((read_bytes, write_bytes))
+    /// Returns the last smaps read of a process if it can be reused in this
+    /// scan, or `None` if smaps has to be read. `rss` is the current RSS.
+    pub fn reusable(&self, pid: u32, start_ticks: u64, rss: u64) -> Option<&'a SmapsEntry> {
+        let entry = self
+            .previous
+            .get(&pid)
+            .filter(|entry| entry.start_ticks == start_ticks)?;
+        let round_robin =
+            (pid as u64 + self.cycle).is_multiple_of(self.tiering.refresh_cycles as u64);
+        let moved =
+            rss.abs_diff(entry.rss) as f64 > entry.rss as f64 * self.tiering.rss_change_ratio;
+        if rss >= self.top_rss || round_robin || moved {
+            return None;
+        }
+        Some(entry)
+    }
 }
 
 #[cfg(test)]
@@ -178,44 +234,62 @@ mod tests {
     use super::*;
 
     // -------------------------------------------------------------------------
-    // Tests for parse_kb_value
+    // Tests for tiered smaps sampling
     // -------------------------------------------------------------------------
 
-    #[test]
-    fn test_parse_kb_value() {
-        // Standard smaps format with trailing "kB"
-        assert_eq!(parse_kb_value("       1234 kB"), Some(1234));
-        assert_eq!(parse_kb_value("1234 kB"), Some(1234));
-        assert_eq!(parse_kb_value("0 kB"), Some(0));
-        assert_eq!(parse_kb_value("999999999 kB"), Some(999999999));
-
-        // Just numeric values (whitespace trimmed)
-        assert_eq!(parse_kb_value("  42  "), Some(42));
-        assert_eq!(parse_kb_value("100"), Some(100));
-
-        // Large values
-        assert_eq!(parse_kb_value("18446744073709551615"), Some(u64::MAX));
+    fn entry(rss: u64) -> SmapsEntry {
+        SmapsEntry {
+            start_ticks: 500,
+            rss,
+            pss: rss / 2,
+            uss: rss / 4,
+            sampled_at: 10.0,
+        }
     }
 
     #[test]
-    fn test_parse_kb_value_invalid() {
-        // Empty input
-        assert_eq!(parse_kb_value(""), None);
-
-        // Only whitespace
-        assert_eq!(parse_kb_value("   "), None);
-
-        // Non-numeric input
-        assert_eq!(parse_kb_value("abc"), None);
-        assert_eq!(parse_kb_value("kB"), None);
-
-        // Negative values (can't parse as u64)
-        assert_eq!(parse_kb_value("-1 kB"), None);
-
-        // Floating point values
-        assert_eq!(parse_kb_value("1.5 kB"), None);
+    fn test_smaps_plan_selects_processes_to_read() {
+        let tiering = SmapsTiering {
+            top_n: 1,
+            rss_change_ratio: 0.1,
+            refresh_cycles: 4,
+        };
+        let previous: HashMap<u32, SmapsEntry> =
+            [(1, entry(1000)), (2, entry(5000)), (3, entry(1000))]
+                .into_iter()
+                .collect();
+        // Cycle 2: PID 2 and PID 6 are in the round-robin slot
+        let plan = SmapsPlan::new(tiering, 2, &previous);
+
+        // Small, stable process outside the slot: reused
+        assert_eq!(plan.reusable(1, 500, 1050), Some(&previous[&1]));
+        // Largest process
+        assert_eq!(plan.reusable(2, 500, 5000), None);
+        // RSS moved by more than 10%
+        assert_eq!(plan.reusable(1, 500, 1200), None);
+        // PID reused or never read
+        assert_eq!(plan.reusable(1, 900, 1000), None);
+        assert_eq!(plan.reusable(4, 500, 1000), None);
+        // Round-robin: PID 3 is read in cycle 1 (3 + 1 = 4)
+        assert!(plan.reusable(3, 500, 1000).is_some());
+        assert_eq!(
+            SmapsPlan::new(tiering, 1, &previous).reusable(3, 500, 1000),
+            None
+        );
+    }
 
-        // Mixed invalid formats
-        assert_eq!(parse_kb_value("12abc34 kB"), None);
+    #[test]
+    fn test_smaps_plan_top_n_covers_small_hosts() {
+        let tiering = SmapsTiering {
+            top_n: 5,
+            rss_change_ratio: 1.0,
+            refresh_cycles: 100,
+        };
+        let previous: HashMap<u32, SmapsEntry> = [(1, entry(1000))].into_iter().collect();
+        // Fewer processes than top_n: all of them are read
+        assert_eq!(
+            SmapsPlan::new(tiering, 0, &previous).reusable(1, 500, 1000),
+            None
+        );
     }
 }
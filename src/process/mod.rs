@@ -1,21 +1,36 @@
 //! Process-related modules for memory, CPU, and classification functionality.
 //!
 //! This module provides:
-//! - `memory`: Memory parsing from /proc/<pid>/smaps
+//! - `memory`: Memory parsing from /proc/<pid>/smaps and tiered smaps sampling
 //! - `cpu`: CPU time parsing and statistics
 //! - `scanner`: Process discovery and filtering
 //! - `classifier`: Process grouping and classification
+//! - `collector`: Single-pass reads of /proc/<pid> via openat
+//! - `tracker`: Incremental scanning with per-process state across cycles
+//! - `registry`: Stable integer IDs for (group, subgroup) pairs
+//! - `cgroup`: cgroup v2 membership of processes
 
+pub mod cgroup;
 pub mod classifier;
+pub mod collector;
 pub mod cpu;
 pub mod memory;
+pub mod registry;
 pub mod scanner;
+pub mod tracker;
 
 // Re-export commonly used types
-pub use classifier::{classify_process_raw, classify_process_with_config, SUBGROUPS};
-pub use cpu::{get_cpu_stat_for_pid, parse_start_time_seconds, CpuEntry, CpuStat, CLK_TCK};
+pub use cgroup::{group_by_cgroup, CgroupCache, CgroupEntry, CgroupMembers};
+pub use classifier::{
+    apply_config_rules, classify_comm, classify_pid, classify_process_raw,
+    classify_process_with_config, registered_subgroups, ClassCache, ClassEntry, SUBGROUPS,
+};
+pub use collector::{CollectOptions, ProcRoot, ProcSample, ScanError};
+pub use cpu::{CpuCache, CpuEntry, CpuStat, CLK_TCK, CLK_TCK_HZ};
 pub use memory::{
-    parse_memory_for_process, read_block_io, read_vmswap, BufferConfig, MAX_IO_BUFFER_BYTES,
-    MAX_SMAPS_BUFFER_BYTES, MAX_SMAPS_ROLLUP_BUFFER_BYTES,
+    parse_memory_for_process, BufferConfig, SmapsCache, SmapsEntry, SmapsPlan, SmapsTiering,
+    MAX_IO_BUFFER_BYTES, MAX_SMAPS_BUFFER_BYTES, MAX_SMAPS_ROLLUP_BUFFER_BYTES,
 };
+pub use registry::{SubgroupId, SubgroupInfo, SUBGROUP_REGISTRY};
 pub use scanner::{collect_proc_entries, read_process_name, should_include_process};
+pub use tracker::{Discovery, ProcessTracker};
@@ -0,0 +1,163 @@
+//! Registry of subgroups with stable small integer IDs.
+//!
+//! Every `(group, subgroup)` pair the classifier can produce is registered
+//! once and keeps its ID for the lifetime of the exporter. Per-cycle
+//! aggregation indexes contiguous vectors by ID instead of hashing
+//! `"group:subgroup"` strings for every process.
+
+use ahash::AHashMap as HashMap;
+use once_cell::sync::Lazy;
+use std::sync::{Arc, RwLock};
+
+/// Dense index of a subgroup in [`SUBGROUP_REGISTRY`].
+pub type SubgroupId = u32;
+
+/// ID of the `other`/`unknown` fallback classification.
+pub const OTHER_ID: SubgroupId = 0;
+
+/// A registered subgroup with its interned names.
+#[derive(Debug, Clone)]
+pub struct SubgroupInfo {
+    pub id: SubgroupId,
+    pub group: Arc<str>,
+    pub subgroup: Arc<str>,
+    /// `"group:subgroup"`, as used for ringbuffer and handler lookups
+    pub key: Arc<str>,
+}
+
+#[derive(Default)]
+struct Inner {
+    ids: HashMap<Arc<str>, SubgroupId>,
+    entries: Vec<SubgroupInfo>,
+}
+
+/// Append-only registry assigning IDs in registration order.
+pub struct SubgroupRegistry {
+    inner: RwLock<Inner>,
+}
+
+impl SubgroupRegistry {
+    /// Creates a registry holding only the `other`/`unknown` fallback.
+    pub fn new() -> Self {
+        let registry = Self {
+            inner: RwLock::new(Inner::default()),
+        };
+        let other = registry.intern("other", "unknown");
+        debug_assert_eq!(other.id, OTHER_ID);
+        registry
+    }
+
+    /// Returns the subgroup for `(group, subgroup)`, registering it on first use.
+    pub fn intern(&self, group: &str, subgroup: &str) -> SubgroupInfo {
+        let key = format!("{}:{}", group, subgroup);
+        if let Some(info) = self.get_by_key(&key) {
+            return info;
+        }
+
+        let mut inner = self.inner.write().expect("subgroup registry lock poisoned");
+        // Another thread may have registered it between the two locks
+        if let Some(&id) = inner.ids.get(key.as_str()) {
+            return inner.entries[id as usize].clone();
+        }
+        let info = SubgroupInfo {
+            id: inner.entries.len() as SubgroupId,
+            group: Arc::from(group),
+            subgroup: Arc::from(subgroup),
+            key: Arc::from(key),
+        };
+        inner.ids.insert(Arc::clone(&info.key), info.id);
+        inner.entries.push(info.clone());
+        info
+    }
+
+    /// Looks up a subgroup by its `"group:subgroup"` key.
+    pub fn get_by_key(&self, key: &str) -> Option<SubgroupInfo> {
+        let inner = self.inner.read().expect("subgroup registry lock poisoned");
+        inner
+            .ids
+            .get(key)
+            .map(|&id| inner.entries[id as usize].clone())
+    }
+
+    /// Returns the subgroup with the given ID.
+    pub fn get(&self, id: SubgroupId) -> Option<SubgroupInfo> {
+        self.inner
+            .read()
+            .expect("subgroup registry lock poisoned")
+            .entries
+            .get(id as usize)
+            .cloned()
+    }
+
+    /// Returns all registered subgroups, indexed by ID.
+    ///
+    /// IDs of processes in a snapshot taken before this call are always in
+    /// range, since the registry only grows.
+    pub fn entries(&self) -> Vec<SubgroupInfo> {
+        self.inner
+            .read()
+            .expect("subgroup registry lock poisoned")
+            .entries
+            .clone()
+    }
+
+    /// Number of registered subgroups.
+    #[allow(dead_code)] // Used by tests
+    pub fn len(&self) -> usize {
+        self.inner
+            .read()
+            .expect("subgroup registry lock poisoned")
+            .entries
+            .len()
+    }
+}
+
+impl Default for SubgroupRegistry {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Global registry shared by the classifier, the cache updater and the
+/// ringbuffers.
+pub static SUBGROUP_REGISTRY: Lazy<SubgroupRegistry> = Lazy::new(SubgroupRegistry::new);
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_intern_assigns_stable_ids() {
+        let registry = SubgroupRegistry::new();
+        assert_eq!(registry.len(), 1);
+        assert_eq!(
+            registry.get(OTHER_ID).unwrap().key.as_ref(),
+            "other:unknown"
+        );
+
+        let ssh = registry.intern("system", "ssh");
+        let nginx = registry.intern("web", "nginx");
+        assert_eq!(ssh.id, 1);
+        assert_eq!(nginx.id, 2);
+
+        // Interning again returns the same ID and shared names
+        let again = registry.intern("system", "ssh");
+        assert_eq!(again.id, ssh.id);
+        assert!(Arc::ptr_eq(&again.subgroup, &ssh.subgroup));
+        assert_eq!(registry.len(), 3);
+    }
+
+    #[test]
+    fn test_lookup_by_key_and_entries() {
+        let registry = SubgroupRegistry::new();
+        let db = registry.intern("db", "postgres");
+
+        assert_eq!(registry.get_by_key("db:postgres").unwrap().id, db.id);
+        assert!(registry.get_by_key("db:mysql").is_none());
+        assert!(registry.get(99).is_none());
+
+        let entries = registry.entries();
+        assert_eq!(entries.len(), 2);
+        assert_eq!(entries[db.id as usize].group.as_ref(), "db");
+    }
+}
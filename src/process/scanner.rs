@@ -46,6 +46,33 @@ pub fn collect_proc_entries(root: &str, max: Option<usize>) -> Vec<ProcEntry> {
     out
 }
 
+/// Lists numeric PIDs under /proc without touching the per-process directories.
+///
+/// Used by the incremental scanner, which learns about unreadable processes
+/// when it opens their files instead of probing them with extra stat calls.
+pub fn collect_proc_pids(root: &Path, max: Option<usize>) -> Vec<u32> {
+    let mut out = Vec::new();
+    if let Ok(entries) = fs::read_dir(root) {
+        for entry in entries.flatten() {
+            let pid = match entry
+                .file_name()
+                .to_str()
+                .and_then(|s| s.parse::<u32>().ok())
+            {
+                Some(v) => v,
+                None => continue,
+            };
+            out.push(pid);
+            if let Some(maxp) = max {
+                if out.len() >= maxp {
+                    break;
+                }
+            }
+        }
+    }
+    out
+}
+
 /// Reads process name from comm file or extracts from cmdline.
 pub fn read_process_name(proc_path: &Path) -> Option<String> {
     let comm = proc_path.join("comm");
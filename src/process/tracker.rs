@@ -0,0 +1,773 @@
+//! Incremental process scanner that keeps per-process state across cycles.
+//!
+//! Each tracked process keeps its `/proc/<pid>` files open and re-reads them
+//! with `pread` at offset 0 instead of opening and parsing everything again on
+//! every cycle. Records are keyed by PID and validated against the start time
+//! in `stat`, so a reused PID starts a fresh record.
+//!
+//! The process name, start time and name filter decision are resolved once per
+//! record. A different command name in `stat` means the process called exec,
+//! which starts a fresh record as a reused PID does. `smaps_rollup` and
+//! `status` are only re-read when CPU time or RSS in `stat` changed, or every
+//! [`FULL_REFRESH_CYCLES`] cycles since PSS also moves when processes sharing
+//! the same pages change. With a [`SmapsPlan`] `smaps_rollup` is read when the
+//! plan selects the process instead.
+//!
+//! With [`Discovery::Events`] the set of tracked processes is updated from
+//! eBPF lifecycle events instead of listing /proc, which is still done every
+//! [`FULL_LISTING_CYCLES`] cycles to pick up anything the events missed. An
+//! exec event also starts a fresh record, even if the command name is kept.
+
+use ahash::AHashMap as HashMap;
+use rayon::prelude::*;
+use std::cell::RefCell;
+use std::fs::File;
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU32, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::Instant;
+
+use crate::config::Config;
+use crate::ebpf::LifecycleKind;
+use crate::process::collector::{CollectOptions, ProcSample, ScanError, PAGE_SIZE};
+use crate::process::cpu::CLK_TCK;
+use crate::process::memory::{
+    parse_memory_for_process, update_max_buffer_usage, BufferConfig, SmapsPlan,
+    MAX_IO_BUFFER_BYTES, MAX_SMAPS_ROLLUP_BUFFER_BYTES,
+};
+use crate::process::scanner::{collect_proc_pids, read_process_name, should_include_process};
+use crate::procfs::{self, StatFields};
+
+/// Number of cycles after which memory is re-read even if `stat` is unchanged.
+pub const FULL_REFRESH_CYCLES: u32 = 10;
+
+/// Number of event-driven cycles after which /proc is listed again.
+pub const FULL_LISTING_CYCLES: u32 = 20;
+
+/// Initial capacity of the per-thread read buffer.
+const READ_BUFFER_CAPACITY: usize = 4096;
+
+/// Upper bound for kept-open files when RLIMIT_NOFILE is unlimited.
+const MAX_KEPT_FILES: usize = 1 << 20;
+
+// Separate from the procfs buffer, which the smaps fallback borrows while a
+// sample holds this one
+thread_local! {
+    static READ_BUFFER: RefCell<Vec<u8>> = RefCell::new(Vec::with_capacity(READ_BUFFER_CAPACITY));
+}
+
+/// Limits how many /proc files are kept open across cycles.
+struct FdBudget {
+    open: AtomicUsize,
+    max: usize,
+}
+
+impl FdBudget {
+    fn try_acquire(&self) -> bool {
+        self.open
+            .fetch_update(Ordering::Relaxed, Ordering::Relaxed, |open| {
+                (open < self.max).then_some(open + 1)
+            })
+            .is_ok()
+    }
+
+    fn release(&self) {
+        self.open.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+/// A kept-open file that returns its slot to the budget when closed.
+struct KeptFile {
+    file: File,
+    budget: Arc<FdBudget>,
+}
+
+impl Drop for KeptFile {
+    fn drop(&mut self) {
+        self.budget.release();
+    }
+}
+
+/// A /proc file that stays open across cycles while the budget allows.
+struct ProcFile {
+    path: PathBuf,
+    kept: Option<KeptFile>,
+}
+
+impl ProcFile {
+    fn new(path: PathBuf) -> Self {
+        Self { path, kept: None }
+    }
+
+    /// Reads the whole file into `buf`, keeping the descriptor for the next
+    /// cycle if the budget allows.
+    fn read(&mut self, buf: &mut Vec<u8>, budget: &Arc<FdBudget>) -> io::Result<()> {
+        if let Some(kept) = &self.kept {
+            return procfs::read_at_start(&kept.file, buf);
+        }
+
+        let file = procfs::open(&self.path)?;
+        procfs::read_at_start(&file, buf)?;
+        if budget.try_acquire() {
+            self.kept = Some(KeptFile {
+                file,
+                budget: Arc::clone(budget),
+            });
+        }
+        Ok(())
+    }
+}
+
+/// Per-process state kept between cycles.
+struct ProcRecord {
+    name: String,
+    /// Command name in `stat` when the record was created
+    comm: Vec<u8>,
+    included: bool,
+    start_ticks: u64,
+    stat: ProcFile,
+    io: ProcFile,
+    status: ProcFile,
+    /// smaps_rollup, if the kernel provides it (>= 4.14)
+    rollup: Option<ProcFile>,
+    last_stat: StatFields,
+    /// Last parsed (rss, pss, uss), `None` until the first successful parse
+    memory: Option<(u64, u64, u64)>,
+    vmswap: u64,
+    cycles_since_refresh: u32,
+}
+
+/// How a scan finds the processes to sample.
+#[derive(Debug, Clone, Copy)]
+pub enum Discovery<'a> {
+    /// List /proc
+    Full,
+    /// Apply process lifecycle changes since the previous scan to the
+    /// tracked processes, each PID mapped to its last event: exited PIDs are
+    /// dropped, forked and exec'd ones sampled, exec'd ones with a fresh
+    /// record
+    Events(&'a HashMap<u32, LifecycleKind>),
+}
+
+impl Discovery<'_> {
+    /// Whether the last lifecycle event of `pid` was an exec, so anything
+    /// derived from its name or command line is stale.
+    pub fn exec(&self, pid: u32) -> bool {
+        match self {
+            Discovery::Events(changes) => changes.get(&pid) == Some(&LifecycleKind::Exec),
+            Discovery::Full => false,
+        }
+    }
+}
+
+/// Incremental /proc scanner holding per-process records between cycles.
+pub struct ProcessTracker {
+    records: Mutex<HashMap<u32, ProcRecord>>,
+    budget: Arc<FdBudget>,
+    /// Event-driven cycles since /proc was last listed
+    cycles_since_listing: AtomicU32,
+}
+
+impl Default for ProcessTracker {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl ProcessTracker {
+    /// Creates an empty tracker.
+    ///
+    /// Kept-open files are capped at half the soft RLIMIT_NOFILE so sockets
+    /// and other readers keep headroom; beyond that files are opened per read.
+    pub fn new() -> Self {
+        Self::with_max_open_files(default_max_open_files())
+    }
+
+    /// Creates an empty tracker with an explicit kept-open file budget.
+    pub fn with_max_open_files(max: usize) -> Self {
+        Self {
+            records: Mutex::new(HashMap::new()),
+            budget: Arc::new(FdBudget {
+                open: AtomicUsize::new(0),
+                max,
+            }),
+            // The first scan always lists /proc
+            cycles_since_listing: AtomicU32::new(FULL_LISTING_CYCLES),
+        }
+    }
+
+    /// Number of /proc files currently kept open.
+    #[allow(dead_code)]
+    pub fn open_files(&self) -> usize {
+        self.budget.open.load(Ordering::Relaxed)
+    }
+
+    /// Scans `root` and samples every process in parallel.
+    ///
+    /// `uptime` is the system uptime in seconds used for start times. Records
+    /// of processes that disappeared are dropped, closing their files.
+    /// `discovery` selects how processes are found; event-driven discovery
+    /// falls back to listing /proc on the first scan and every
+    /// [`FULL_LISTING_CYCLES`] cycles. `smaps` enables tiered smaps sampling.
+    #[allow(clippy::too_many_arguments)]
+    pub fn scan(
+        &self,
+        root: &Path,
+        max: Option<usize>,
+        cfg: &Config,
+        options: CollectOptions,
+        buffers: &BufferConfig,
+        uptime: f64,
+        discovery: Discovery<'_>,
+        smaps: Option<&SmapsPlan<'_>>,
+    ) -> Vec<(u32, Result<ProcSample, ScanError>)> {
+        let mut previous =
+            std::mem::take(&mut *self.records.lock().expect("process tracker lock poisoned"));
+
+        let pids = match discovery {
+            Discovery::Events(changes)
+                if self.cycles_since_listing.load(Ordering::Relaxed) < FULL_LISTING_CYCLES =>
+            {
+                self.cycles_since_listing.fetch_add(1, Ordering::Relaxed);
+                apply_changes(previous.keys().copied(), changes, max)
+            }
+            _ => {
+                self.cycles_since_listing.store(0, Ordering::Relaxed);
+                collect_proc_pids(root, max)
+            }
+        };
+
+        let work: Vec<(u32, Option<ProcRecord>)> = pids
+            .into_iter()
+            .map(|pid| {
+                let record = previous.remove(&pid).filter(|_| !discovery.exec(pid));
+                (pid, record)
+            })
+            .collect();
+        // Whatever is left belongs to exited processes
+        drop(previous);
+
+        let sampled: Vec<(u32, Option<ProcRecord>, Result<ProcSample, ScanError>)> = work
+            .into_par_iter()
+            .map(|(pid, record)| {
+                let (record, sample) = READ_BUFFER.with(|buf| {
+                    self.sample(
+                        root,
+                        pid,
+                        record,
+                        cfg,
+                        options,
+                        buffers,
+                        uptime,
+                        smaps,
+                        &mut buf.borrow_mut(),
+                    )
+                });
+                (pid, record, sample)
+            })
+            .collect();
+
+        let mut records = HashMap::with_capacity(sampled.len());
+        let mut out = Vec::with_capacity(sampled.len());
+        for (pid, record, sample) in sampled {
+            if let Some(record) = record {
+                records.insert(pid, record);
+            }
+            out.push((pid, sample));
+        }
+
+        *self.records.lock().expect("process tracker lock poisoned") = records;
+        out
+    }
+
+    #[allow(clippy::too_many_arguments)]
+    fn sample(
+        &self,
+        root: &Path,
+        pid: u32,
+        record: Option<ProcRecord>,
+        cfg: &Config,
+        options: CollectOptions,
+        buffers: &BufferConfig,
+        uptime: f64,
+        smaps: Option<&SmapsPlan<'_>>,
+        buf: &mut Vec<u8>,
+    ) -> (Option<ProcRecord>, Result<ProcSample, ScanError>) {
+        // Re-read stat through the kept descriptor; a read error (ESRCH after
+        // exit) or a different start time means the PID now belongs to a new
+        // process, a different command name that it called exec. Either way
+        // the name, filter decision and files of the record are stale.
+        let existing = record.and_then(|mut record| {
+            let stat = read_stat(&mut record.stat, buf, &self.budget)?;
+            (stat.start_ticks == record.start_ticks
+                && procfs::stat_comm(buf) == Some(record.comm.as_slice()))
+            .then_some((record, stat))
+        });
+
+        let (mut record, stat) = match existing {
+            Some(found) => found,
+            None => match self.new_record(root, pid, cfg, buf) {
+                Ok(created) => created,
+                Err(e) => return (None, Err(e)),
+            },
+        };
+
+        if !record.included {
+            let name = record.name.clone();
+            return (Some(record), Err(ScanError::Filtered(name)));
+        }
+
+        let unchanged = record.memory.is_some()
+            && stat.cpu_ticks == record.last_stat.cpu_ticks
+            && stat.rss_pages == record.last_stat.rss_pages
+            && record.cycles_since_refresh < FULL_REFRESH_CYCLES;
+        record.last_stat = stat;
+
+        let stat_rss = stat.rss_pages * *PAGE_SIZE;
+        let reused = smaps
+            .filter(|_| options.memory)
+            .and_then(|plan| plan.reusable(pid, record.start_ticks, stat_rss));
+
+        let mut parse_duration_ms = None;
+        if !options.memory {
+            // Only RSS is exported: take it from stat and skip smaps_rollup
+            record.memory = Some((stat_rss, 0, 0));
+        } else if let Some(entry) = reused {
+            // Tiered: RSS from stat, PSS/USS from the last smaps read
+            record.memory = Some((stat_rss, entry.pss, entry.uss));
+        }
+
+        // A plan decides on its own when smaps is read, stat changes or not
+        let read_smaps = options.memory && reused.is_none() && (smaps.is_some() || !unchanged);
+        if read_smaps {
+            let parse_start = Instant::now();
+            let memory = match record.rollup.as_mut() {
+                Some(rollup) => rollup.read(buf, &self.budget).map(|()| {
+                    update_max_buffer_usage(&MAX_SMAPS_ROLLUP_BUFFER_BYTES, buf.len() as u64);
+                    procfs::parse_smaps_rollup(buf)
+                }),
+                None => parse_memory_for_process(&root.join(pid.to_string()), buffers),
+            };
+
+            match memory {
+                Ok(memory) => record.memory = Some(memory),
+                Err(e) => {
+                    record.memory = None;
+                    let name = record.name.clone();
+                    return (Some(record), Err(ScanError::Memory(name, e)));
+                }
+            }
+            parse_duration_ms = Some(parse_start.elapsed().as_secs_f64() * 1000.0);
+        }
+
+        if unchanged {
+            record.cycles_since_refresh += 1;
+        } else {
+            record.vmswap = match record.status.read(buf, &self.budget) {
+                Ok(()) => procfs::parse_status_vmswap(buf),
+                Err(_) => 0,
+            };
+            record.cycles_since_refresh = 0;
+        }
+
+        // I/O counters can move without CPU time (writeback), read them every cycle
+        let (read_bytes, write_bytes) = match record.io.read(buf, &self.budget) {
+            Ok(()) => {
+                update_max_buffer_usage(&MAX_IO_BUFFER_BYTES, buf.len() as u64);
+                procfs::parse_io(buf)
+            }
+            Err(_) => (0, 0),
+        };
+
+        let (rss, pss, uss) = record.memory.unwrap_or_default();
+        let sample = ProcSample {
+            name: record.name.clone(),
+            rss,
+            pss,
+            uss,
+            vmswap: record.vmswap,
+            cpu_time_seconds: stat.cpu_ticks as f64 / *CLK_TCK,
+            start_time_seconds: uptime - (record.start_ticks as f64 / *CLK_TCK),
+            start_ticks: record.start_ticks,
+            read_bytes,
+            write_bytes,
+            parse_duration_ms,
+            memory_sampled_at: reused.map(|entry| entry.sampled_at),
+        };
+
+        (Some(record), Ok(sample))
+    }
+
+    /// Opens a fresh record for a process seen for the first time.
+    fn new_record(
+        &self,
+        root: &Path,
+        pid: u32,
+        cfg: &Config,
+        buf: &mut Vec<u8>,
+    ) -> Result<(ProcRecord, StatFields), ScanError> {
+        let proc_path = root.join(pid.to_string());
+
+        let mut stat_file = ProcFile::new(proc_path.join("stat"));
+        let stat = read_stat(&mut stat_file, buf, &self.budget).ok_or(ScanError::Vanished)?;
+        let comm = procfs::stat_comm(buf).unwrap_or_default().to_vec();
+
+        let name = read_process_name(&proc_path).ok_or(ScanError::NoName)?;
+        let included = should_include_process(&name, cfg);
+
+        let rollup_path = proc_path.join("smaps_rollup");
+        let rollup = rollup_path.exists().then(|| ProcFile::new(rollup_path));
+
+        let record = ProcRecord {
+            name,
+            comm,
+            included,
+            start_ticks: stat.start_ticks,
+            stat: stat_file,
+            io: ProcFile::new(proc_path.join("io")),
+            status: ProcFile::new(proc_path.join("status")),
+            rollup,
+            last_stat: stat,
+            memory: None,
+            vmswap: 0,
+            cycles_since_refresh: 0,
+        };
+
+        Ok((record, stat))
+    }
+}
+
+/// Reads and parses `stat`, returning `None` if the process is gone.
+fn read_stat(file: &mut ProcFile, buf: &mut Vec<u8>, budget: &Arc<FdBudget>) -> Option<StatFields> {
+    file.read(buf, budget).ok()?;
+    procfs::parse_stat(buf)
+}
+
+/// Applies lifecycle changes to the tracked PIDs: exited PIDs are removed,
+/// forked and exec'd ones added. At most `max` PIDs are returned.
+fn apply_changes(
+    tracked: impl Iterator<Item = u32>,
+    changes: &HashMap<u32, LifecycleKind>,
+    max: Option<usize>,
+) -> Vec<u32> {
+    let started = changes
+        .iter()
+        .filter(|(_, &kind)| kind != LifecycleKind::Exit)
+        .map(|(&pid, _)| pid);
+    let mut pids: Vec<u32> = tracked
+        .filter(|pid| !changes.contains_key(pid))
+        .chain(started)
+        .collect();
+    if let Some(max) = max {
+        pids.truncate(max);
+    }
+    pids
+}
+
+/// Half of the soft RLIMIT_NOFILE, leaving room for sockets and other readers.
+fn default_max_open_files() -> usize {
+    let mut limit = libc::rlimit {
+        rlim_cur: 0,
+        rlim_max: 0,
+    };
+    // SAFETY: getrlimit only writes to the provided struct
+    let ret = unsafe { libc::getrlimit(libc::RLIMIT_NOFILE, &mut limit) };
+    if ret != 0 {
+        return 512;
+    }
+
+    if limit.rlim_cur == libc::RLIM_INFINITY {
+        MAX_KEPT_FILES
+    } else {
+        ((limit.rlim_cur / 2) as usize).min(MAX_KEPT_FILES)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::fs;
+    use tempfile::tempdir;
+
+    fn stat_line(pid: u32, cpu_ticks: u64, start_ticks: u64, rss_pages: u64) -> String {
+        format!(
+            "{} (worker) S 1 {} {} 0 -1 4194304 0 0 0 0 {} 0 0 0 20 0 1 0 {} 1000 {} 0",
+            pid, pid, pid, cpu_ticks, start_ticks, rss_pages
+        )
+    }
+
+    fn rollup(rss_kb: u64) -> String {
+        format!(
+            "Rss: {} kB\nPss: {} kB\nPrivate_Clean: 0 kB\nPrivate_Dirty: {} kB\n",
+            rss_kb, rss_kb, rss_kb
+        )
+    }
+
+    fn write_process(root: &Path, pid: u32, name: &str, stat: &str, rss_kb: u64) {
+        let dir = root.join(pid.to_string());
+        fs::create_dir_all(&dir).unwrap();
+        fs::write(dir.join("comm"), format!("{}\n", name)).unwrap();
+        fs::write(dir.join("stat"), stat).unwrap();
+        fs::write(dir.join("smaps_rollup"), rollup(rss_kb)).unwrap();
+        fs::write(dir.join("status"), "VmSwap:\t 8 kB\n").unwrap();
+        fs::write(dir.join("io"), "read_bytes: 10\nwrite_bytes: 20\n").unwrap();
+    }
+
+    fn scan_one(tracker: &ProcessTracker, root: &Path) -> ProcSample {
+        let buffers = BufferConfig {
+            io_kb: 4,
+            smaps_kb: 4,
+            smaps_rollup_kb: 4,
+        };
+        let cfg = Config::default();
+        let options = CollectOptions::from_config(&cfg);
+        let mut results = tracker.scan(
+            root,
+            None,
+            &cfg,
+            options,
+            &buffers,
+            100.0,
+            Discovery::Full,
+            None,
+        );
+        assert_eq!(results.len(), 1);
+        results.pop().unwrap().1.expect("sample")
+    }
+
+    #[test]
+    fn test_scan_reuses_memory_when_stat_unchanged() {
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 42, "worker", &stat_line(42, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(16);
+
+        let first = scan_one(&tracker, dir.path());
+        assert_eq!(first.name, "worker");
+        assert_eq!(first.rss, 64 * 1024);
+        assert_eq!(first.vmswap, 8 * 1024);
+        assert_eq!((first.read_bytes, first.write_bytes), (10, 20));
+        assert!(first.parse_duration_ms.is_some());
+        assert!(tracker.open_files() > 0);
+
+        // Memory changed but stat did not: cached values are reused
+        fs::write(dir.path().join("42/smaps_rollup"), rollup(128)).unwrap();
+        let second = scan_one(&tracker, dir.path());
+        assert_eq!(second.rss, 64 * 1024);
+        assert!(second.parse_duration_ms.is_none());
+
+        // CPU time moved: smaps_rollup is re-read
+        fs::write(dir.path().join("42/stat"), stat_line(42, 11, 500, 3)).unwrap();
+        let third = scan_one(&tracker, dir.path());
+        assert_eq!(third.rss, 128 * 1024);
+        assert!(third.parse_duration_ms.is_some());
+    }
+
+    #[test]
+    fn test_scan_follows_smaps_plan() {
+        use crate::process::memory::{SmapsEntry, SmapsTiering};
+
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 42, "worker", &stat_line(42, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(16);
+        let buffers = BufferConfig {
+            io_kb: 4,
+            smaps_kb: 4,
+            smaps_rollup_kb: 4,
+        };
+        let cfg = Config::default();
+        let options = CollectOptions::from_config(&cfg);
+        let tiering = SmapsTiering {
+            top_n: 0,
+            rss_change_ratio: 100.0,
+            refresh_cycles: 1000,
+        };
+        let scan = |plan: &SmapsPlan<'_>| {
+            let mut results = tracker.scan(
+                dir.path(),
+                None,
+                &cfg,
+                options,
+                &buffers,
+                100.0,
+                Discovery::Full,
+                Some(plan),
+            );
+            results.pop().unwrap().1.expect("sample")
+        };
+
+        let empty = HashMap::new();
+        let first = scan(&SmapsPlan::new(tiering, 0, &empty));
+        assert_eq!(first.pss, 64 * 1024);
+
+        // CPU time moved, but the plan reuses the last read
+        fs::write(dir.path().join("42/smaps_rollup"), rollup(128)).unwrap();
+        fs::write(dir.path().join("42/stat"), stat_line(42, 11, 500, 3)).unwrap();
+        let previous: HashMap<u32, SmapsEntry> = [(42, SmapsEntry::sample(None, &first, 10.0))]
+            .into_iter()
+            .collect();
+        let second = scan(&SmapsPlan::new(tiering, 1, &previous));
+        assert_eq!((second.rss, second.pss), (3 * *PAGE_SIZE, 64 * 1024));
+        assert_eq!(second.memory_sampled_at, Some(10.0));
+        assert!(second.parse_duration_ms.is_none());
+
+        // Round-robin slot of PID 42: read although stat is unchanged
+        let third = scan(&SmapsPlan::new(tiering, 1000 - 42, &previous));
+        assert_eq!(third.pss, 128 * 1024);
+        assert_eq!(third.memory_sampled_at, None);
+    }
+
+    #[test]
+    fn test_scan_detects_pid_reuse() {
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 7, "old", &stat_line(7, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(16);
+        assert_eq!(scan_one(&tracker, dir.path()).name, "old");
+
+        // Same PID, different start time: a new process with its own name
+        fs::write(dir.path().join("7/comm"), "new\n").unwrap();
+        fs::write(dir.path().join("7/stat"), stat_line(7, 10, 900, 3)).unwrap();
+        assert_eq!(scan_one(&tracker, dir.path()).name, "new");
+    }
+
+    #[test]
+    fn test_scan_detects_exec() {
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 7, "worker", &stat_line(7, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(16);
+        assert_eq!(scan_one(&tracker, dir.path()).name, "worker");
+
+        // Same PID and start time, new command name: the process called exec
+        fs::write(dir.path().join("7/comm"), "server\n").unwrap();
+        let exec_stat = stat_line(7, 10, 500, 3).replace("(worker)", "(server)");
+        fs::write(dir.path().join("7/stat"), exec_stat).unwrap();
+        assert_eq!(scan_one(&tracker, dir.path()).name, "server");
+    }
+
+    #[test]
+    fn test_scan_drops_exited_processes() {
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 7, "worker", &stat_line(7, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(16);
+        scan_one(&tracker, dir.path());
+
+        fs::remove_dir_all(dir.path().join("7")).unwrap();
+        let buffers = BufferConfig {
+            io_kb: 4,
+            smaps_kb: 4,
+            smaps_rollup_kb: 4,
+        };
+        let cfg = Config::default();
+        let options = CollectOptions::from_config(&cfg);
+        let results = tracker.scan(
+            dir.path(),
+            None,
+            &cfg,
+            options,
+            &buffers,
+            100.0,
+            Discovery::Full,
+            None,
+        );
+        assert!(results.is_empty());
+        assert_eq!(tracker.open_files(), 0);
+    }
+
+    #[test]
+    fn test_scan_applies_lifecycle_changes() {
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 7, "worker", &stat_line(7, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(16);
+        let buffers = BufferConfig {
+            io_kb: 4,
+            smaps_kb: 4,
+            smaps_rollup_kb: 4,
+        };
+        let cfg = Config::default();
+        let options = CollectOptions::from_config(&cfg);
+        let scan_pids = |changes: &HashMap<u32, LifecycleKind>| {
+            let mut pids: Vec<u32> = tracker
+                .scan(
+                    dir.path(),
+                    None,
+                    &cfg,
+                    options,
+                    &buffers,
+                    100.0,
+                    Discovery::Events(changes),
+                    None,
+                )
+                .into_iter()
+                .map(|(pid, _)| pid)
+                .collect();
+            pids.sort_unstable();
+            pids
+        };
+
+        // The first scan lists /proc even when events are available
+        assert_eq!(scan_pids(&HashMap::new()), vec![7]);
+
+        // Without events a new process is not discovered until the next listing
+        write_process(dir.path(), 8, "worker", &stat_line(8, 10, 600, 3), 64);
+        assert_eq!(scan_pids(&HashMap::new()), vec![7]);
+
+        // Exited processes are dropped even if /proc still has them
+        let changes: HashMap<u32, LifecycleKind> =
+            [(7, LifecycleKind::Exit), (8, LifecycleKind::Fork)]
+                .into_iter()
+                .collect();
+        assert_eq!(scan_pids(&changes), vec![8]);
+        assert_eq!(
+            apply_changes([1, 2, 3].into_iter(), &changes, Some(2)).len(),
+            2
+        );
+    }
+
+    #[test]
+    fn test_scan_refreshes_exec_records() {
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 7, "worker", &stat_line(7, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(16);
+        let buffers = BufferConfig {
+            io_kb: 4,
+            smaps_kb: 4,
+            smaps_rollup_kb: 4,
+        };
+        let cfg = Config::default();
+        let options = CollectOptions::from_config(&cfg);
+        let scan_name = |changes: &HashMap<u32, LifecycleKind>| {
+            let mut results = tracker.scan(
+                dir.path(),
+                None,
+                &cfg,
+                options,
+                &buffers,
+                100.0,
+                Discovery::Events(changes),
+                None,
+            );
+            results.pop().unwrap().1.expect("sample").name
+        };
+        assert_eq!(scan_name(&HashMap::new()), "worker");
+
+        // The stat name is unchanged, so only the exec event reveals the new name
+        fs::write(dir.path().join("7/comm"), "server\n").unwrap();
+        assert_eq!(scan_name(&HashMap::new()), "worker");
+        let changes: HashMap<u32, LifecycleKind> = [(7, LifecycleKind::Exec)].into_iter().collect();
+        assert!(Discovery::Events(&changes).exec(7));
+        assert!(!Discovery::Full.exec(7));
+        assert_eq!(scan_name(&changes), "server");
+    }
+
+    #[test]
+    fn test_fd_budget_limits_kept_files() {
+        let dir = tempdir().unwrap();
+        write_process(dir.path(), 7, "worker", &stat_line(7, 10, 500, 3), 64);
+        let tracker = ProcessTracker::with_max_open_files(1);
+
+        // Files beyond the budget are still read, just not kept open
+        let sample = scan_one(&tracker, dir.path());
+        assert_eq!(sample.rss, 64 * 1024);
+        assert_eq!(tracker.open_files(), 1);
+    }
+}
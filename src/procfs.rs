@@ -0,0 +1,552 @@
+//! Allocation-free parsers for `/proc` text files.
+//!
+//! Files are read into one reusable per-thread buffer and scanned as bytes:
+//! lines are split with `memchr`, keys are located with `memmem`, and integers
+//! are parsed straight from the digits without building a `String` per line.
+//! Parsers stop as soon as all fields they need were found.
+//!
+//! The readers count the `open`/`read`/`pread`/`close` syscalls they issue
+//! (see [`syscall_count`]), which the phase profiles of `health_stats`
+//! attribute to the scan phase that issued them.
+//!
+//! # Usage
+//!
+//! ```rust,no_run
+//! use herakles_node_exporter::procfs;
+//! use std::path::Path;
+//!
+//! let (rss, pss, uss) =
+//!     procfs::with_file(Path::new("/proc/self/smaps_rollup"), 4096, procfs::parse_smaps_rollup)
+//!         .unwrap();
+//! println!("rss={} pss={} uss={}", rss, pss, uss);
+//! ```
+
+use memchr::{memchr, memmem, memrchr};
+use std::cell::RefCell;
+use std::fs::File;
+use std::io::{self, Read};
+use std::os::unix::fs::FileExt;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+
+/// Initial capacity of the per-thread read buffer.
+const DEFAULT_BUFFER_CAPACITY: usize = 4096;
+
+/// Buffers larger than this (e.g. after a full `smaps` read) are shrunk back
+/// after use so idle worker threads don't pin megabytes each.
+const MAX_RETAINED_CAPACITY: usize = 1024 * 1024;
+
+/// Shards of the syscall counter. Threads are spread over them round-robin.
+const SYSCALL_SHARDS: usize = 16;
+
+/// One shard of the syscall counter, on its own cache line.
+#[repr(align(64))]
+struct SyscallShard(AtomicU64);
+
+static SYSCALLS: [SyscallShard; SYSCALL_SHARDS] =
+    [const { SyscallShard(AtomicU64::new(0)) }; SYSCALL_SHARDS];
+static NEXT_SHARD: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    static BUFFER: RefCell<Vec<u8>> = RefCell::new(Vec::with_capacity(DEFAULT_BUFFER_CAPACITY));
+    static SHARD: usize = NEXT_SHARD.fetch_add(1, Ordering::Relaxed) % SYSCALL_SHARDS;
+}
+
+/// Counts `n` syscalls issued to read `/proc`.
+///
+/// Each thread adds to its own shard, so the scan workers count without
+/// contending on one cache line.
+pub fn count_syscalls(n: u64) {
+    let shard = SHARD.with(|shard| *shard);
+    SYSCALLS[shard].0.fetch_add(n, Ordering::Relaxed);
+}
+
+/// Syscalls counted by [`count_syscalls`] since startup, over all threads.
+pub fn syscall_count() -> u64 {
+    SYSCALLS
+        .iter()
+        .map(|shard| shard.0.load(Ordering::Relaxed))
+        .sum()
+}
+
+/// Reader that counts every `read` call as one syscall.
+pub struct CountingReader<R>(pub R);
+
+impl<R: Read> Read for CountingReader<R> {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        count_syscalls(1);
+        self.0.read(buf)
+    }
+}
+
+/// Opens `path` for reading, counting the `open` and the later `close`.
+pub fn open(path: &Path) -> io::Result<File> {
+    count_syscalls(2);
+    File::open(path)
+}
+
+/// Runs `f` with this thread's reusable read buffer.
+///
+/// Must not be nested: the buffer is borrowed for the duration of `f`.
+pub fn with_buffer<R>(f: impl FnOnce(&mut Vec<u8>) -> R) -> R {
+    BUFFER.with(|buf| {
+        let mut buf = buf.borrow_mut();
+        let result = f(&mut buf);
+        if buf.capacity() > MAX_RETAINED_CAPACITY {
+            buf.clear();
+            buf.shrink_to(DEFAULT_BUFFER_CAPACITY);
+        }
+        result
+    })
+}
+
+/// Reads `path` into the per-thread buffer and passes its contents to `parse`.
+///
+/// `capacity_hint` pre-sizes the buffer for files known to be large.
+pub fn with_file<R>(
+    path: &Path,
+    capacity_hint: usize,
+    parse: impl FnOnce(&[u8]) -> R,
+) -> io::Result<R> {
+    with_buffer(|buf| {
+        buf.clear();
+        buf.reserve(capacity_hint);
+        CountingReader(open(path)?).read_to_end(buf)?;
+        Ok(parse(buf))
+    })
+}
+
+/// Reads a whole file from offset 0 with pread, reusing `buf`'s allocation.
+///
+/// Lets callers keep /proc files open across reads: procfs regenerates the
+/// content on every read from offset 0.
+pub fn read_at_start(file: &File, buf: &mut Vec<u8>) -> io::Result<()> {
+    buf.clear();
+    loop {
+        let len = buf.len();
+        if len == buf.capacity() {
+            buf.reserve(len.max(DEFAULT_BUFFER_CAPACITY));
+        }
+        buf.resize(buf.capacity(), 0);
+        count_syscalls(1);
+        match file.read_at(&mut buf[len..], len as u64) {
+            Ok(0) => {
+                buf.truncate(len);
+                return Ok(());
+            }
+            Ok(n) => buf.truncate(len + n),
+            Err(e) => {
+                buf.truncate(len);
+                return Err(e);
+            }
+        }
+    }
+}
+
+/// A `/proc` file kept open across reads.
+///
+/// Each [`read`](Self::read) re-reads the whole file with pread into a
+/// buffer owned by the `ProcFile`, so periodic collectors of system-wide
+/// files pay neither an `open`/`close` nor an allocation per run. A failed
+/// read closes the file; the next read reopens it.
+#[derive(Debug)]
+pub struct ProcFile {
+    path: PathBuf,
+    file: Option<File>,
+    buf: Vec<u8>,
+}
+
+impl ProcFile {
+    /// Creates a reader for `path`. The file is opened on the first read.
+    pub fn new(path: impl Into<PathBuf>) -> Self {
+        Self {
+            path: path.into(),
+            file: None,
+            buf: Vec::with_capacity(DEFAULT_BUFFER_CAPACITY),
+        }
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// Returns the current contents of the file.
+    pub fn read(&mut self) -> io::Result<&[u8]> {
+        let file = match &self.file {
+            Some(file) => file,
+            None => self.file.insert(open(&self.path)?),
+        };
+        if let Err(e) = read_at_start(file, &mut self.buf) {
+            self.file = None;
+            return Err(e);
+        }
+        Ok(&self.buf)
+    }
+}
+
+/// Iterates over the whitespace-separated fields of `line`.
+pub fn fields(line: &[u8]) -> impl Iterator<Item = &[u8]> {
+    line.split(|&b| b == b' ' || b == b'\t')
+        .filter(|field| !field.is_empty())
+}
+
+/// Iterates over the lines of `content` without the trailing newline.
+pub fn lines(content: &[u8]) -> impl Iterator<Item = &[u8]> {
+    let mut rest = content;
+    std::iter::from_fn(move || {
+        if rest.is_empty() {
+            return None;
+        }
+        match memchr(b'\n', rest) {
+            Some(end) => {
+                let line = &rest[..end];
+                rest = &rest[end + 1..];
+                Some(line)
+            }
+            None => Some(std::mem::take(&mut rest)),
+        }
+    })
+}
+
+/// Parses an unsigned integer, skipping leading spaces and tabs.
+///
+/// The digits must be followed by whitespace or the end of input, so
+/// `"12abc"` and `"1.5"` are rejected like `str::parse` would.
+pub fn parse_u64(bytes: &[u8]) -> Option<u64> {
+    let start = bytes.iter().position(|&b| b != b' ' && b != b'\t')?;
+    let mut value: u64 = 0;
+    let mut digits = 0;
+
+    for &b in &bytes[start..] {
+        match b {
+            b'0'..=b'9' => {
+                value = value.checked_mul(10)?.checked_add(u64::from(b - b'0'))?;
+                digits += 1;
+            }
+            b' ' | b'\t' | b'\n' => break,
+            _ => return None,
+        }
+    }
+
+    (digits > 0).then_some(value)
+}
+
+/// Returns the value after `key` on the line starting with it (key includes
+/// the trailing ':'), searching the whole buffer with `memmem`.
+pub fn find_field<'a>(content: &'a [u8], key: &[u8]) -> Option<&'a [u8]> {
+    let mut offset = 0;
+    while let Some(pos) = memmem::find(&content[offset..], key) {
+        let at = offset + pos;
+        if at == 0 || content[at - 1] == b'\n' {
+            let value = &content[at + key.len()..];
+            let end = memchr(b'\n', value).unwrap_or(value.len());
+            return Some(&value[..end]);
+        }
+        offset = at + key.len();
+    }
+    None
+}
+
+/// Parses (rss, pss, uss) in bytes from `/proc/<pid>/smaps_rollup`.
+///
+/// Stops after Private_Dirty, the last field needed, which comes before the
+/// second half of the file.
+pub fn parse_smaps_rollup(content: &[u8]) -> (u64, u64, u64) {
+    const ALL: u8 = 0b1111;
+    let mut rss_kb = 0;
+    let mut pss_kb = 0;
+    let mut private_kb = 0;
+    let mut seen = 0u8;
+
+    for line in lines(content) {
+        if let Some(v) = line.strip_prefix(b"Rss:") {
+            rss_kb += parse_u64(v).unwrap_or(0);
+            seen |= 0b0001;
+        } else if let Some(v) = line.strip_prefix(b"Pss:") {
+            pss_kb += parse_u64(v).unwrap_or(0);
+            seen |= 0b0010;
+        } else if let Some(v) = line.strip_prefix(b"Private_Clean:") {
+            private_kb += parse_u64(v).unwrap_or(0);
+            seen |= 0b0100;
+        } else if let Some(v) = line.strip_prefix(b"Private_Dirty:") {
+            private_kb += parse_u64(v).unwrap_or(0);
+            seen |= 0b1000;
+        } else {
+            continue;
+        }
+
+        if seen == ALL {
+            break;
+        }
+    }
+
+    (rss_kb * 1024, pss_kb * 1024, private_kb * 1024)
+}
+
+/// Parses (rss, pss, uss) in bytes from a full `/proc/<pid>/smaps`, summing
+/// over all mappings.
+pub fn parse_smaps(content: &[u8]) -> (u64, u64, u64) {
+    let mut rss_kb = 0;
+    let mut pss_kb = 0;
+    let mut private_kb = 0;
+
+    for line in lines(content) {
+        // Mapping headers start with a hex address; only R and P keys matter
+        match line.first() {
+            Some(b'R') => {
+                if let Some(v) = line.strip_prefix(b"Rss:") {
+                    rss_kb += parse_u64(v).unwrap_or(0);
+                }
+            }
+            Some(b'P') => {
+                if let Some(v) = line.strip_prefix(b"Pss:") {
+                    pss_kb += parse_u64(v).unwrap_or(0);
+                } else if let Some(v) = line
+                    .strip_prefix(b"Private_Clean:")
+                    .or_else(|| line.strip_prefix(b"Private_Dirty:"))
+                {
+                    private_kb += parse_u64(v).unwrap_or(0);
+                }
+            }
+            _ => {}
+        }
+    }
+
+    (rss_kb * 1024, pss_kb * 1024, private_kb * 1024)
+}
+
+/// Extracts VmSwap in bytes from `/proc/<pid>/status`, 0 if absent.
+pub fn parse_status_vmswap(content: &[u8]) -> u64 {
+    find_field(content, b"VmSwap:")
+        .and_then(parse_u64)
+        .map_or(0, |kb| kb * 1024)
+}
+
+/// Extracts (read_bytes, write_bytes) from `/proc/<pid>/io`.
+pub fn parse_io(content: &[u8]) -> (u64, u64) {
+    let read_bytes = find_field(content, b"read_bytes:").and_then(parse_u64);
+    let write_bytes = find_field(content, b"write_bytes:").and_then(parse_u64);
+    (read_bytes.unwrap_or(0), write_bytes.unwrap_or(0))
+}
+
+/// Raw fields of `/proc/<pid>/stat`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct StatFields {
+    /// utime + stime in clock ticks (fields 14 and 15)
+    pub cpu_ticks: u64,
+    /// Start time after boot in clock ticks (field 22)
+    pub start_ticks: u64,
+    /// Resident set size in pages (field 24)
+    pub rss_pages: u64,
+}
+
+/// Parses `/proc/<pid>/stat`.
+///
+/// Splits after the last ')' so command names containing spaces or
+/// parentheses don't shift the field indices.
+pub fn parse_stat(content: &[u8]) -> Option<StatFields> {
+    let rest = &content[memrchr(b')', content)? + 1..];
+    // Index 0 is the state (field 3), so field N is at index N - 3
+    let mut fields = rest
+        .split(|&b| b == b' ' || b == b'\n')
+        .filter(|f| !f.is_empty());
+    let utime = parse_u64(fields.nth(11)?)?;
+    let stime = parse_u64(fields.next()?)?;
+    let start_ticks = parse_u64(fields.nth(6)?)?;
+    let rss_pages = parse_u64(fields.nth(1)?)?;
+
+    Some(StatFields {
+        cpu_ticks: utime + stime,
+        start_ticks,
+        rss_pages,
+    })
+}
+
+/// Extracts the command name from `/proc/<pid>/stat`, between the first '('
+/// and the last ')'.
+pub fn stat_comm(content: &[u8]) -> Option<&[u8]> {
+    let start = memchr(b'(', content)? + 1;
+    let end = memrchr(b')', content)?;
+    content.get(start..end)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const ROLLUP: &[u8] = b"55cde9540000-7fff204c4000 ---p 00000000 00:00 0    [rollup]
+Rss:                1316 kB
+Pss:                 350 kB
+Pss_Dirty:           104 kB
+Shared_Clean:       1168 kB
+Private_Clean:        44 kB
+Private_Dirty:       104 kB
+Referenced:         1316 kB
+";
+
+    #[test]
+    fn test_parse_u64() {
+        assert_eq!(parse_u64(b"       1234 kB"), Some(1234));
+        assert_eq!(parse_u64(b"\t42\n"), Some(42));
+        assert_eq!(parse_u64(b"18446744073709551615"), Some(u64::MAX));
+        assert_eq!(parse_u64(b"18446744073709551616"), None);
+        assert_eq!(parse_u64(b""), None);
+        assert_eq!(parse_u64(b"   "), None);
+        assert_eq!(parse_u64(b"-1 kB"), None);
+        assert_eq!(parse_u64(b"1.5 kB"), None);
+        assert_eq!(parse_u64(b"12abc34 kB"), None);
+    }
+
+    #[test]
+    fn test_lines() {
+        let collected: Vec<&[u8]> = lines(b"a\nbc\n\nd").collect();
+        assert_eq!(collected, vec![&b"a"[..], b"bc", b"", b"d"]);
+        assert_eq!(lines(b"").count(), 0);
+    }
+
+    #[test]
+    fn test_find_field_requires_line_start() {
+        let content = b"rchar: 1\nread_bytes: 2\ncancelled_write_bytes: 3\nwrite_bytes: 4\n";
+        assert_eq!(find_field(content, b"read_bytes:"), Some(&b" 2"[..]));
+        assert_eq!(find_field(content, b"write_bytes:"), Some(&b" 4"[..]));
+        assert_eq!(find_field(content, b"syscr:"), None);
+    }
+
+    #[test]
+    fn test_parse_smaps_rollup() {
+        assert_eq!(
+            parse_smaps_rollup(ROLLUP),
+            (1316 * 1024, 350 * 1024, 148 * 1024)
+        );
+        assert_eq!(parse_smaps_rollup(b""), (0, 0, 0));
+    }
+
+    #[test]
+    fn test_parse_smaps_sums_mappings() {
+        let content = b"00400000-00452000 r-xp 00000000 08:02 173521 /usr/bin/dbus-daemon
+Size:                328 kB
+Rss:                 100 kB
+Pss:                  50 kB
+Private_Clean:        10 kB
+Private_Dirty:         5 kB
+00651000-00652000 r--p 00051000 08:02 173521 /usr/bin/dbus-daemon
+Rss:                  20 kB
+Pss:                  20 kB
+Private_Dirty:        20 kB
+";
+        assert_eq!(parse_smaps(content), (120 * 1024, 70 * 1024, 35 * 1024));
+    }
+
+    #[test]
+    fn test_parse_status_vmswap() {
+        assert_eq!(
+            parse_status_vmswap(b"Name:\ttest\nVmSwap:\t     12 kB\n"),
+            12 * 1024
+        );
+        assert_eq!(parse_status_vmswap(b"Name:\ttest\n"), 0);
+    }
+
+    #[test]
+    fn test_parse_io() {
+        let io = b"rchar: 100\nwchar: 200\nread_bytes: 4096\nwrite_bytes: 8192\ncancelled_write_bytes: 1\n";
+        assert_eq!(parse_io(io), (4096, 8192));
+        assert_eq!(parse_io(b""), (0, 0));
+    }
+
+    #[test]
+    fn test_parse_stat() {
+        let stat = b"1234 (test_process) S 1 1234 1234 0 -1 4194304 100 0 0 0 1000 500 0 0 20 0 1 0 12345 12345678 1234 18446744073709551615 4194304\n";
+        let fields = parse_stat(stat).unwrap();
+        assert_eq!(fields.cpu_ticks, 1500);
+        assert_eq!(fields.start_ticks, 12345);
+        assert_eq!(fields.rss_pages, 1234);
+
+        let spaced =
+            b"42 (tmux: server) (x) S 1 42 42 0 -1 4194304 0 0 0 0 7 3 0 0 20 0 1 0 999 1000 55 0";
+        let fields = parse_stat(spaced).unwrap();
+        assert_eq!(fields.cpu_ticks, 10);
+        assert_eq!(fields.start_ticks, 999);
+        assert_eq!(fields.rss_pages, 55);
+
+        assert!(parse_stat(b"1234 (test) S 1 2 3").is_none());
+        assert!(parse_stat(b"").is_none());
+    }
+
+    #[test]
+    fn test_stat_comm() {
+        assert_eq!(stat_comm(b"1 (init) S 0"), Some(&b"init"[..]));
+        assert_eq!(
+            stat_comm(b"42 (tmux: server) (x) S 1"),
+            Some(&b"tmux: server) (x"[..])
+        );
+        assert_eq!(stat_comm(b"7 () S 1"), Some(&b""[..]));
+        assert_eq!(stat_comm(b""), None);
+        assert_eq!(stat_comm(b"1 )( S"), None);
+    }
+
+    #[test]
+    fn test_with_file_reads_contents() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("smaps_rollup");
+        std::fs::write(&path, ROLLUP).unwrap();
+
+        let parsed = with_file(&path, 0, parse_smaps_rollup).unwrap();
+        assert_eq!(parsed.0, 1316 * 1024);
+        assert!(with_file(&dir.path().join("missing"), 0, parse_io).is_err());
+    }
+
+    #[test]
+    fn test_read_at_start_rereads_file() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("io");
+        std::fs::write(&path, "read_bytes: 1\n").unwrap();
+        let file = File::open(&path).unwrap();
+
+        let mut buf = Vec::new();
+        read_at_start(&file, &mut buf).unwrap();
+        assert_eq!(parse_io(&buf), (1, 0));
+
+        std::fs::write(&path, "read_bytes: 2\nwrite_bytes: 3\n").unwrap();
+        read_at_start(&file, &mut buf).unwrap();
+        assert_eq!(parse_io(&buf), (2, 3));
+    }
+
+    #[test]
+    fn test_readers_count_syscalls() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("io");
+        std::fs::write(&path, "read_bytes: 1\n").unwrap();
+
+        // open, read, read of EOF, close; other tests may count concurrently
+        let before = syscall_count();
+        with_file(&path, 0, parse_io).unwrap();
+        assert!(syscall_count() - before >= 4);
+
+        let file = File::open(&path).unwrap();
+        let mut buf = Vec::new();
+        let before = syscall_count();
+        read_at_start(&file, &mut buf).unwrap();
+        assert!(syscall_count() - before >= 2);
+    }
+
+    #[test]
+    fn test_fields() {
+        let collected: Vec<&[u8]> = fields(b"  8  0 sda\t12 ").collect();
+        assert_eq!(collected, vec![&b"8"[..], b"0", b"sda", b"12"]);
+        assert_eq!(fields(b"   ").count(), 0);
+    }
+
+    #[test]
+    fn test_proc_file_rereads_and_reopens() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("stat");
+        let mut file = ProcFile::new(&path);
+        assert!(file.read().is_err());
+
+        std::fs::write(&path, "ctxt 1\n").unwrap();
+        assert_eq!(file.read().unwrap(), b"ctxt 1\n");
+        std::fs::write(&path, "ctxt 22\n").unwrap();
+        assert_eq!(file.read().unwrap(), b"ctxt 22\n");
+        assert_eq!(file.path(), path);
+    }
+}
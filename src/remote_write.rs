@@ -0,0 +1,956 @@
+//! Prometheus remote-write push mode.
+//!
+//! For hosts that cannot be scraped, the exporter pushes its registry to a
+//! remote-write endpoint instead. The push task is driven by the cache
+//! updater: after every published process scan it takes the current render
+//! (the same one `/metrics` serves, see `handlers::metrics::latest_metrics`)
+//! and stages only the series whose value changed since they were last
+//! staged. Unchanged series are staged again every `resend_interval_seconds`
+//! so the receiver does not mark them stale, and series that disappear are
+//! staged once more with the staleness marker.
+//!
+//! Every `batch_cycles` scans the staged samples are encoded as one
+//! `WriteRequest` (remote-write 1.0: protobuf, snappy block format) and
+//! queued. Queued batches are sent oldest first until the endpoint fails;
+//! 5xx, 429 and transport errors keep the batch for the next scan, other
+//! rejections drop it. When a batch is dropped, unsent or rejected, every
+//! series is staged again with the next scan so the receiver catches up,
+//! and the series whose staleness marker it carried are marked stale again.
+//!
+//! The protobuf messages and the snappy compressor are encoded by hand: the
+//! three message types are small and fixed, and neither format needs more
+//! than a few lines to produce.
+
+use ahash::AHashMap as HashMap;
+use axum::body::Bytes;
+use prometheus::proto::{Metric, MetricFamily, MetricType};
+use reqwest::header::{HeaderMap, HeaderName, HeaderValue, CONTENT_ENCODING, CONTENT_TYPE};
+use reqwest::StatusCode;
+use std::collections::VecDeque;
+use std::time::{Duration, SystemTime, UNIX_EPOCH};
+use tracing::{debug, info, warn};
+
+use crate::config::RemoteWriteConfig;
+use crate::handlers::metrics::latest_metrics;
+use crate::metrics::RemoteWriteMetrics;
+use crate::state::SharedState;
+
+/// Sample value marking a series as stale (Prometheus `StaleNaN`).
+const STALE_NAN: u64 = 0x7ff0_0000_0000_0002;
+
+/// Default `job` external label.
+const DEFAULT_JOB: &str = "herakles-node-exporter";
+
+/// Uncompressed bytes per snappy block; copies never reach across blocks.
+const SNAPPY_BLOCK: usize = 1 << 16;
+
+/// Bits of the snappy match finder hash table.
+const SNAPPY_HASH_BITS: u32 = 14;
+
+/// Push state of one series.
+struct Series {
+    /// Bits of the value last staged, `None` to stage the next value
+    /// regardless of change.
+    staged: Option<u64>,
+    /// Timestamp of the value last staged in milliseconds.
+    staged_at: i64,
+    /// Last cycle the series was present in.
+    seen: u64,
+    /// Samples staged for the next batch.
+    pending: Vec<(f64, i64)>,
+}
+
+/// One encoded and compressed `WriteRequest`.
+pub struct Batch {
+    pub body: Bytes,
+    pub samples: usize,
+    /// Keys of the series whose staleness marker the batch carries, forgotten
+    /// once it was sealed.
+    vanished: Vec<Vec<u8>>,
+}
+
+/// Delta staging, batching and the retry queue of the push task.
+///
+/// Series are keyed by their encoded protobuf labels, which are copied into
+/// the request as they are.
+pub struct Pusher {
+    batch_cycles: usize,
+    resend_interval_ms: i64,
+    max_queued_batches: usize,
+    /// External labels sorted by name.
+    external_labels: Vec<(String, String)>,
+    series: HashMap<Vec<u8>, Series>,
+    cycle: u64,
+    staged_cycles: usize,
+    queue: VecDeque<Batch>,
+    /// Scratch buffer for the label key of the current series.
+    key: Vec<u8>,
+}
+
+impl Pusher {
+    pub fn new(config: &RemoteWriteConfig, hostname: &str) -> Self {
+        let mut external_labels = config.external_labels.clone();
+        external_labels
+            .entry("job".to_string())
+            .or_insert_with(|| DEFAULT_JOB.to_string());
+        external_labels
+            .entry("instance".to_string())
+            .or_insert_with(|| hostname.to_string());
+        Self {
+            batch_cycles: config.batch_cycles.max(1),
+            resend_interval_ms: (config.resend_interval_seconds as i64).saturating_mul(1000),
+            max_queued_batches: config.max_queued_batches.max(1),
+            external_labels: external_labels.into_iter().collect(),
+            series: HashMap::new(),
+            cycle: 0,
+            staged_cycles: 0,
+            queue: VecDeque::new(),
+            key: Vec::new(),
+        }
+    }
+
+    /// Stages the changed series of one scan and seals a batch every
+    /// `batch_cycles` scans. Returns the number of staged samples and
+    /// whether a queued batch was dropped to make room.
+    pub fn stage(&mut self, families: &[MetricFamily], timestamp_ms: i64) -> (usize, bool) {
+        self.cycle += 1;
+        let mut staged = 0;
+        for family in families {
+            let name = family.get_name();
+            for metric in family.get_metric() {
+                match family.get_field_type() {
+                    MetricType::COUNTER => {
+                        let value = metric.get_counter().get_value();
+                        staged += self.observe(name, metric, None, value, timestamp_ms);
+                    }
+                    MetricType::GAUGE => {
+                        let value = metric.get_gauge().get_value();
+                        staged += self.observe(name, metric, None, value, timestamp_ms);
+                    }
+                    MetricType::UNTYPED => {
+                        let value = metric.get_untyped().get_value();
+                        staged += self.observe(name, metric, None, value, timestamp_ms);
+                    }
+                    MetricType::HISTOGRAM => {
+                        staged += self.observe_histogram(name, metric, timestamp_ms);
+                    }
+                    // The registry holds no summaries
+                    _ => {}
+                }
+            }
+        }
+        staged += self.stage_vanished(timestamp_ms);
+
+        self.staged_cycles += 1;
+        let dropped = self.staged_cycles >= self.batch_cycles && self.seal();
+        (staged, dropped)
+    }
+
+    /// Stages the `_bucket`, `_sum` and `_count` series of a histogram.
+    fn observe_histogram(&mut self, name: &str, metric: &Metric, timestamp_ms: i64) -> usize {
+        let histogram = metric.get_histogram();
+        let bucket_name = format!("{}_bucket", name);
+        let mut staged = 0;
+        for bucket in histogram.get_bucket() {
+            let le = bucket.get_upper_bound().to_string();
+            let count = bucket.get_cumulative_count() as f64;
+            staged += self.observe(&bucket_name, metric, Some(&le), count, timestamp_ms);
+        }
+        let count = histogram.get_sample_count() as f64;
+        staged += self.observe(&bucket_name, metric, Some("+Inf"), count, timestamp_ms);
+        let sum = histogram.get_sample_sum();
+        staged += self.observe(&format!("{}_sum", name), metric, None, sum, timestamp_ms);
+        staged += self.observe(
+            &format!("{}_count", name),
+            metric,
+            None,
+            count,
+            timestamp_ms,
+        );
+        staged
+    }
+
+    /// Stages one series if its value changed or is due to be resent.
+    /// Returns the number of staged samples.
+    fn observe(
+        &mut self,
+        name: &str,
+        metric: &Metric,
+        le: Option<&str>,
+        value: f64,
+        timestamp_ms: i64,
+    ) -> usize {
+        let mut labels: Vec<(&str, &str)> = metric
+            .get_label()
+            .iter()
+            .map(|pair| (pair.get_name(), pair.get_value()))
+            .collect();
+        labels.push(("__name__", name));
+        if let Some(le) = le {
+            labels.push(("le", le));
+        }
+        // Labels of the series take precedence over external labels
+        for (label, label_value) in &self.external_labels {
+            if !labels.iter().any(|(existing, _)| *existing == label) {
+                labels.push((label.as_str(), label_value.as_str()));
+            }
+        }
+        labels.sort_unstable_by(|a, b| a.0.cmp(b.0));
+
+        let mut key = std::mem::take(&mut self.key);
+        key.clear();
+        for (label, label_value) in &labels {
+            put_label(&mut key, label, label_value);
+        }
+        let staged = self.observe_key(&key, value, timestamp_ms);
+        self.key = key;
+        staged
+    }
+
+    /// Stages `value` of the series with the encoded labels `key`.
+    fn observe_key(&mut self, key: &[u8], value: f64, timestamp_ms: i64) -> usize {
+        let cycle = self.cycle;
+        if !self.series.contains_key(key) {
+            self.series.insert(
+                key.to_vec(),
+                Series {
+                    staged: None,
+                    staged_at: 0,
+                    seen: cycle,
+                    pending: Vec::new(),
+                },
+            );
+        }
+        let series = self.series.get_mut(key).expect("series inserted above");
+        series.seen = cycle;
+
+        let bits = value.to_bits();
+        let due = timestamp_ms - series.staged_at >= self.resend_interval_ms;
+        if series.staged == Some(bits) && !due {
+            return 0;
+        }
+        series.staged = Some(bits);
+        series.staged_at = timestamp_ms;
+        series.pending.push((value, timestamp_ms));
+        1
+    }
+
+    /// Stages the staleness marker for series missing from this cycle that
+    /// were present in the previous one.
+    fn stage_vanished(&mut self, timestamp_ms: i64) -> usize {
+        let previous = self.cycle - 1;
+        let mut staged = 0;
+        for series in self.series.values_mut() {
+            if series.seen == previous {
+                // Stage the value again should the series come back
+                series.staged = None;
+                series
+                    .pending
+                    .push((f64::from_bits(STALE_NAN), timestamp_ms));
+                staged += 1;
+            }
+        }
+        staged
+    }
+
+    /// Encodes the pending samples into a queued batch, forgets vanished
+    /// series until the batch is acked and drops the oldest batch if the
+    /// queue is full. Returns whether a batch was dropped.
+    fn seal(&mut self) -> bool {
+        self.staged_cycles = 0;
+        let cycle = self.cycle;
+        let mut request = Vec::new();
+        let mut samples = 0;
+        for (key, series) in self.series.iter_mut() {
+            if series.pending.is_empty() {
+                continue;
+            }
+            put_time_series(&mut request, key, &series.pending);
+            samples += series.pending.len();
+            series.pending.clear();
+        }
+        let mut vanished = Vec::new();
+        self.series.retain(|key, series| {
+            let present = series.seen == cycle;
+            if !present {
+                vanished.push(key.clone());
+            }
+            present
+        });
+        if samples == 0 {
+            return false;
+        }
+
+        self.queue.push_back(Batch {
+            body: Bytes::from(snappy_compress(&request)),
+            samples,
+            vanished,
+        });
+        if self.queue.len() <= self.max_queued_batches {
+            return false;
+        }
+        let dropped = self.queue.pop_front().expect("queue is not empty");
+        self.resync(dropped);
+        true
+    }
+
+    /// The oldest queued batch, next to be sent.
+    pub fn front(&self) -> Option<&Batch> {
+        self.queue.front()
+    }
+
+    /// Removes the oldest batch after the endpoint accepted it.
+    pub fn ack(&mut self) {
+        self.queue.pop_front();
+    }
+
+    /// Removes the oldest batch after the endpoint rejected it for good.
+    pub fn reject(&mut self) {
+        if let Some(rejected) = self.queue.pop_front() {
+            self.resync(rejected);
+        }
+    }
+
+    /// Number of batches waiting to be sent.
+    pub fn queued(&self) -> usize {
+        self.queue.len()
+    }
+
+    /// Stages every present series with the next scan, replacing the
+    /// samples lost with the dropped batch `lost`. The series it marked stale
+    /// are restored as present in the last cycle, so the next scan that does
+    /// not contain them marks them stale again.
+    fn resync(&mut self, lost: Batch) {
+        for series in self.series.values_mut() {
+            series.staged = None;
+        }
+        let cycle = self.cycle;
+        for key in lost.vanished {
+            self.series.entry(key).or_insert_with(|| Series {
+                staged: None,
+                staged_at: 0,
+                seen: cycle,
+                pending: Vec::new(),
+            });
+        }
+    }
+}
+
+/// Starts the push task if `remote_write.url` is set.
+pub fn spawn(
+    state: &SharedState,
+    metrics: RemoteWriteMetrics,
+) -> Result<(), Box<dyn std::error::Error>> {
+    let config = &state.config.remote_write;
+    let url = match config.url.clone() {
+        Some(url) => url,
+        None => return Ok(()),
+    };
+
+    let mut headers = HeaderMap::new();
+    for (name, value) in &config.headers {
+        headers.insert(
+            HeaderName::from_bytes(name.as_bytes())?,
+            HeaderValue::from_str(value)?,
+        );
+    }
+    headers.insert(CONTENT_ENCODING, HeaderValue::from_static("snappy"));
+    headers.insert(
+        CONTENT_TYPE,
+        HeaderValue::from_static("application/x-protobuf"),
+    );
+    headers.insert(
+        "x-prometheus-remote-write-version",
+        HeaderValue::from_static("0.1.0"),
+    );
+    let client = reqwest::Client::builder()
+        .user_agent(concat!(
+            "herakles-node-exporter/",
+            env!("CARGO_PKG_VERSION")
+        ))
+        .default_headers(headers)
+        .timeout(Duration::from_secs(config.timeout_seconds))
+        .build()?;
+
+    let hostname = std::fs::read_to_string("/proc/sys/kernel/hostname")
+        .map(|name| name.trim().to_string())
+        .unwrap_or_else(|_| "unknown".to_string());
+    let pusher = Pusher::new(config, &hostname);
+    info!(
+        "Pushing metrics to {} every {} process scans",
+        url, config.batch_cycles
+    );
+
+    let state = state.clone();
+    tokio::spawn(async move { run(state, client, url, pusher, metrics).await });
+    Ok(())
+}
+
+/// Stages every published scan and sends the queued batches.
+///
+/// A scan published while a request is in flight is staged when the request
+/// completes; scans published meanwhile are skipped, and their changes are
+/// picked up by the next one.
+async fn run(
+    state: SharedState,
+    client: reqwest::Client,
+    url: String,
+    mut pusher: Pusher,
+    metrics: RemoteWriteMetrics,
+) {
+    loop {
+        state.cache_published.notified().await;
+
+        let rendered = match latest_metrics(&state).await {
+            Ok(rendered) => rendered,
+            Err(e) => {
+                warn!("Skipping remote write of this scan: {:?}", e);
+                continue;
+            }
+        };
+        let (staged, dropped) = pusher.stage(rendered.families(), unix_millis());
+        metrics.samples_total.inc_by(staged as f64);
+        if dropped {
+            metrics.dropped_batches_total.inc();
+            warn!("Remote write queue full, dropped the oldest batch");
+        }
+
+        send_queued(&client, &url, &mut pusher, &metrics).await;
+        metrics.queued_batches.set(pusher.queued() as f64);
+    }
+}
+
+/// Sends queued batches oldest first until the queue is empty or a request
+/// has to be retried.
+async fn send_queued(
+    client: &reqwest::Client,
+    url: &str,
+    pusher: &mut Pusher,
+    metrics: &RemoteWriteMetrics,
+) {
+    while let Some(batch) = pusher.front() {
+        let samples = batch.samples;
+        let bytes = batch.body.len();
+        let status = match client.post(url).body(batch.body.clone()).send().await {
+            Ok(response) => response.status(),
+            Err(e) => {
+                metrics.requests_total.with_label_values(&["retry"]).inc();
+                warn!("Remote write to {} failed, retrying: {}", url, e);
+                return;
+            }
+        };
+
+        if status.is_success() {
+            pusher.ack();
+            metrics.requests_total.with_label_values(&["success"]).inc();
+            metrics.sent_bytes_total.inc_by(bytes as f64);
+            debug!("Remote write sent {} samples in {} bytes", samples, bytes);
+        } else if status.is_server_error() || status == StatusCode::TOO_MANY_REQUESTS {
+            metrics.requests_total.with_label_values(&["retry"]).inc();
+            warn!("Remote write to {} returned {}, retrying", url, status);
+            return;
+        } else {
+            pusher.reject();
+            metrics
+                .requests_total
+                .with_label_values(&["rejected"])
+                .inc();
+            warn!(
+                "Remote write to {} returned {}, dropped {} samples",
+                url, status, samples
+            );
+        }
+    }
+}
+
+/// Milliseconds since the Unix epoch.
+fn unix_millis() -> i64 {
+    SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map_or(0, |elapsed| elapsed.as_millis() as i64)
+}
+
+// ========== Protobuf encoding ==========
+
+/// Appends `value` as a protobuf varint.
+fn put_varint(out: &mut Vec<u8>, mut value: u64) {
+    while value >= 0x80 {
+        out.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    out.push(value as u8);
+}
+
+/// Encoded length of `value` as a protobuf varint.
+fn varint_len(value: u64) -> usize {
+    (64 - (value | 1).leading_zeros() as usize).div_ceil(7)
+}
+
+/// Appends a length-delimited field with tag byte `tag`.
+fn put_bytes(out: &mut Vec<u8>, tag: u8, bytes: &[u8]) {
+    out.push(tag);
+    put_varint(out, bytes.len() as u64);
+    out.extend_from_slice(bytes);
+}
+
+/// Appends `Label { name = 1, value = 2 }` as field 1 of a `TimeSeries`.
+fn put_label(out: &mut Vec<u8>, name: &str, value: &str) {
+    let len = 2
+        + varint_len(name.len() as u64)
+        + name.len()
+        + varint_len(value.len() as u64)
+        + value.len();
+    out.push(0x0a);
+    put_varint(out, len as u64);
+    put_bytes(out, 0x0a, name.as_bytes());
+    put_bytes(out, 0x12, value.as_bytes());
+}
+
+/// Appends `TimeSeries { labels = 1, samples = 2 }` as field 1 of a
+/// `WriteRequest`, with `Sample { double value = 1, int64 timestamp = 2 }`.
+fn put_time_series(out: &mut Vec<u8>, labels: &[u8], samples: &[(f64, i64)]) {
+    let sample_len = |timestamp: i64| 10 + varint_len(timestamp as u64);
+    let len = labels.len()
+        + samples
+            .iter()
+            .map(|&(_, timestamp)| 1 + 1 + sample_len(timestamp))
+            .sum::<usize>();
+    out.push(0x0a);
+    put_varint(out, len as u64);
+    out.extend_from_slice(labels);
+    for &(value, timestamp) in samples {
+        out.push(0x12);
+        put_varint(out, sample_len(timestamp) as u64);
+        out.push(0x09);
+        out.extend_from_slice(&value.to_le_bytes());
+        out.push(0x10);
+        put_varint(out, timestamp as u64);
+    }
+}
+
+// ========== Snappy block format ==========
+
+/// Compresses `input` in the snappy block format.
+fn snappy_compress(input: &[u8]) -> Vec<u8> {
+    let mut out = Vec::with_capacity(input.len() / 2 + 16);
+    put_varint(&mut out, input.len() as u64);
+    let mut table = vec![0u16; 1 << SNAPPY_HASH_BITS];
+    for block in input.chunks(SNAPPY_BLOCK) {
+        table.fill(0);
+        snappy_compress_block(block, &mut table, &mut out);
+    }
+    out
+}
+
+/// Greedy 4-byte match finder over one block; `table` maps word hashes to
+/// their last position in the block.
+fn snappy_compress_block(block: &[u8], table: &mut [u16], out: &mut Vec<u8>) {
+    let load = |pos: usize| u32::from_le_bytes(block[pos..pos + 4].try_into().unwrap());
+    let mut literal_start = 0;
+    let mut pos = 0;
+    while pos + 4 <= block.len() {
+        let word = load(pos);
+        let slot = (word.wrapping_mul(0x1e35_a7bd) >> (32 - SNAPPY_HASH_BITS)) as usize;
+        let candidate = table[slot] as usize;
+        table[slot] = pos as u16;
+        if candidate >= pos || load(candidate) != word {
+            pos += 1;
+            continue;
+        }
+
+        let mut len = 4;
+        while pos + len < block.len() && block[candidate + len] == block[pos + len] {
+            len += 1;
+        }
+        snappy_literal(out, &block[literal_start..pos]);
+        snappy_copy(out, pos - candidate, len);
+        pos += len;
+        literal_start = pos;
+    }
+    snappy_literal(out, &block[literal_start..]);
+}
+
+/// Appends a literal element.
+fn snappy_literal(out: &mut Vec<u8>, literal: &[u8]) {
+    if literal.is_empty() {
+        return;
+    }
+    let n = literal.len() - 1;
+    if n < 60 {
+        out.push((n as u8) << 2);
+    } else if n < 1 << 8 {
+        out.push(60 << 2);
+        out.push(n as u8);
+    } else {
+        // Literals never exceed one block
+        out.push(61 << 2);
+        out.extend_from_slice(&(n as u16).to_le_bytes());
+    }
+    out.extend_from_slice(literal);
+}
+
+/// Appends copy elements for a match of `len` bytes `offset` bytes back.
+fn snappy_copy(out: &mut Vec<u8>, offset: usize, mut len: usize) {
+    let copy2 = |out: &mut Vec<u8>, len: usize| {
+        out.push(((len - 1) as u8) << 2 | 2);
+        out.extend_from_slice(&(offset as u16).to_le_bytes());
+    };
+    while len >= 68 {
+        copy2(out, 64);
+        len -= 64;
+    }
+    if len > 64 {
+        copy2(out, 60);
+        len -= 60;
+    }
+    if (4..12).contains(&len) && offset < 2048 {
+        out.push(((offset >> 8) as u8) << 5 | ((len - 4) as u8) << 2 | 1);
+        out.push(offset as u8);
+    } else {
+        copy2(out, len);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use prometheus::{CounterVec, Gauge, Histogram, HistogramOpts, Opts, Registry};
+
+    /// Labels, value and timestamp of one decoded sample.
+    type DecodedSample = (Vec<(String, String)>, f64, i64);
+
+    /// Reads a protobuf varint at `pos`.
+    fn varint(buf: &[u8], pos: &mut usize) -> u64 {
+        let (mut value, mut shift) = (0u64, 0);
+        loop {
+            let byte = buf[*pos];
+            *pos += 1;
+            value |= u64::from(byte & 0x7f) << shift;
+            shift += 7;
+            if byte < 0x80 {
+                return value;
+            }
+        }
+    }
+
+    /// Reference snappy block decoder.
+    fn snappy_decompress(input: &[u8]) -> Vec<u8> {
+        let mut pos = 0;
+        let expected = varint(input, &mut pos);
+        let mut out = Vec::new();
+        while pos < input.len() {
+            let tag = input[pos];
+            pos += 1;
+            let (len, offset) = match tag & 3 {
+                0 => {
+                    let mut len = (tag >> 2) as usize + 1;
+                    if len > 60 {
+                        let extra = len - 60;
+                        len = input[pos..pos + extra]
+                            .iter()
+                            .rev()
+                            .fold(0, |acc, &b| acc << 8 | b as usize)
+                            + 1;
+                        pos += extra;
+                    }
+                    out.extend_from_slice(&input[pos..pos + len]);
+                    pos += len;
+                    continue;
+                }
+                1 => {
+                    let offset = ((tag >> 5) as usize) << 8 | input[pos] as usize;
+                    pos += 1;
+                    (((tag >> 2) & 7) as usize + 4, offset)
+                }
+                2 => {
+                    let offset = u16::from_le_bytes([input[pos], input[pos + 1]]) as usize;
+                    pos += 2;
+                    ((tag >> 2) as usize + 1, offset)
+                }
+                _ => panic!("4-byte offsets are never emitted"),
+            };
+            assert!(offset > 0 && offset <= out.len(), "invalid copy offset");
+            for _ in 0..len {
+                out.push(out[out.len() - offset]);
+            }
+        }
+        assert_eq!(out.len() as u64, expected);
+        out
+    }
+
+    /// Decodes the samples of a `WriteRequest` as (labels, value, timestamp).
+    fn decode_request(body: &[u8]) -> Vec<DecodedSample> {
+        fn field<'a>(buf: &'a [u8], pos: &mut usize) -> (u8, &'a [u8]) {
+            let tag = buf[*pos];
+            *pos += 1;
+            let len = match tag & 7 {
+                1 => 8,
+                2 => varint(buf, pos) as usize,
+                _ => {
+                    let start = *pos;
+                    varint(buf, pos);
+                    let bytes = &buf[start..*pos];
+                    return (tag, bytes);
+                }
+            };
+            let bytes = &buf[*pos..*pos + len];
+            *pos += len;
+            (tag, bytes)
+        }
+
+        let request = snappy_decompress(body);
+        let mut samples = Vec::new();
+        let mut pos = 0;
+        while pos < request.len() {
+            let (tag, series) = field(&request, &mut pos);
+            assert_eq!(tag, 0x0a);
+            let mut labels = Vec::new();
+            let mut series_pos = 0;
+            while series_pos < series.len() {
+                let (tag, message) = field(series, &mut series_pos);
+                let mut message_pos = 0;
+                let (_, first) = field(message, &mut message_pos);
+                let (_, second) = field(message, &mut message_pos);
+                if tag == 0x0a {
+                    labels.push((
+                        String::from_utf8(first.to_vec()).unwrap(),
+                        String::from_utf8(second.to_vec()).unwrap(),
+                    ));
+                } else {
+                    let value = f64::from_le_bytes(first.try_into().unwrap());
+                    let timestamp = varint(second, &mut 0) as i64;
+                    samples.push((labels.clone(), value, timestamp));
+                }
+            }
+        }
+        samples
+    }
+
+    fn config(batch_cycles: usize, max_queued_batches: usize) -> RemoteWriteConfig {
+        RemoteWriteConfig {
+            url: Some("http://localhost:9090/api/v1/write".to_string()),
+            batch_cycles,
+            resend_interval_seconds: 60,
+            max_queued_batches,
+            ..RemoteWriteConfig::default()
+        }
+    }
+
+    fn value_of(samples: &[DecodedSample], name: &str) -> Vec<f64> {
+        samples
+            .iter()
+            .filter(|(labels, _, _)| labels.iter().any(|(k, v)| k == "__name__" && v == name))
+            .map(|&(_, value, _)| value)
+            .collect()
+    }
+
+    #[test]
+    fn test_snappy_round_trip() {
+        let mut inputs: Vec<Vec<u8>> = vec![
+            Vec::new(),
+            b"abc".to_vec(),
+            vec![b'a'; 1000],
+            b"herakles_mem_group_rss_bytes{group=\"db\",subgroup=\"postgres\"} 1\n".repeat(3000),
+        ];
+        let mut seed = 0x2545_f491_4f6c_dd1du64;
+        inputs.push(
+            (0..200_000)
+                .map(|_| {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 7;
+                    seed ^= seed << 17;
+                    (seed % 16) as u8
+                })
+                .collect(),
+        );
+        for input in &inputs {
+            let compressed = snappy_compress(input);
+            assert_eq!(&snappy_decompress(&compressed), input);
+        }
+        assert_eq!(snappy_compress(b"abc"), [3, 0x08, b'a', b'b', b'c']);
+        assert!(snappy_compress(&inputs[3]).len() < inputs[3].len() / 10);
+    }
+
+    #[test]
+    fn test_varint_len_matches_encoding() {
+        for value in [0, 1, 127, 128, 16_383, 16_384, u32::MAX as u64, u64::MAX] {
+            let mut out = Vec::new();
+            put_varint(&mut out, value);
+            assert_eq!(out.len(), varint_len(value), "value {}", value);
+        }
+    }
+
+    #[test]
+    fn test_stage_sends_only_changed_series() {
+        let registry = Registry::new();
+        let rss = Gauge::new("herakles_mem_rss_bytes", "RSS").unwrap();
+        let cpu =
+            CounterVec::new(Opts::new("herakles_cpu_seconds_total", "CPU"), &["group"]).unwrap();
+        registry.register(Box::new(rss.clone())).unwrap();
+        registry.register(Box::new(cpu.clone())).unwrap();
+
+        let mut pusher = Pusher::new(&config(2, 4), "node1");
+        rss.set(100.0);
+        cpu.with_label_values(&["db"]).inc_by(2.0);
+        assert_eq!(pusher.stage(&registry.gather(), 1_000), (2, false));
+        assert!(pusher.front().is_none());
+
+        // Only the changed gauge is staged; the second cycle seals the batch
+        rss.set(200.0);
+        assert_eq!(pusher.stage(&registry.gather(), 2_000), (1, false));
+        let samples = decode_request(&pusher.front().unwrap().body);
+        assert_eq!(samples.len(), 3);
+        assert_eq!(value_of(&samples, "herakles_mem_rss_bytes"), [100.0, 200.0]);
+        assert_eq!(value_of(&samples, "herakles_cpu_seconds_total"), [2.0]);
+
+        // Labels are sorted by name and include the external labels
+        let (labels, _, timestamp) = &samples[0];
+        let names: Vec<&str> = labels.iter().map(|(k, _)| k.as_str()).collect();
+        let mut sorted = names.clone();
+        sorted.sort_unstable();
+        assert_eq!(names, sorted);
+        assert!(labels.contains(&("instance".to_string(), "node1".to_string())));
+        assert!(labels.contains(&("job".to_string(), DEFAULT_JOB.to_string())));
+        assert_eq!(*timestamp, 1_000);
+
+        // Unchanged series are resent once the resend interval passed
+        pusher.ack();
+        assert_eq!(pusher.stage(&registry.gather(), 3_000), (0, false));
+        assert_eq!(pusher.stage(&registry.gather(), 62_000), (2, false));
+    }
+
+    #[test]
+    fn test_stage_marks_vanished_series_stale() {
+        let registry = Registry::new();
+        let cpu =
+            CounterVec::new(Opts::new("herakles_cpu_seconds_total", "CPU"), &["group"]).unwrap();
+        registry.register(Box::new(cpu.clone())).unwrap();
+
+        let mut pusher = Pusher::new(&config(1, 4), "node1");
+        cpu.with_label_values(&["db"]).inc();
+        pusher.stage(&registry.gather(), 1_000);
+        pusher.ack();
+
+        cpu.remove_label_values(&["db"]).unwrap();
+        assert_eq!(pusher.stage(&registry.gather(), 2_000), (1, false));
+        let samples = decode_request(&pusher.front().unwrap().body);
+        assert_eq!(samples.len(), 1);
+        assert_eq!(samples[0].1.to_bits(), STALE_NAN);
+        pusher.ack();
+
+        // The marker is sent once and the series forgotten
+        assert_eq!(pusher.stage(&registry.gather(), 3_000), (0, false));
+        assert!(pusher.series.is_empty());
+    }
+
+    #[test]
+    fn test_stage_expands_histograms() {
+        let registry = Registry::new();
+        let histogram = Histogram::with_opts(
+            HistogramOpts::new("herakles_io_latency_seconds", "latency").buckets(vec![0.5, 1.0]),
+        )
+        .unwrap();
+        registry.register(Box::new(histogram.clone())).unwrap();
+        histogram.observe(0.25);
+        histogram.observe(0.75);
+
+        let mut pusher = Pusher::new(&config(1, 4), "node1");
+        assert_eq!(pusher.stage(&registry.gather(), 1_000), (5, false));
+        let samples = decode_request(&pusher.front().unwrap().body);
+        let bucket = |le: &str| {
+            samples
+                .iter()
+                .find(|(labels, _, _)| labels.contains(&("le".to_string(), le.to_string())))
+                .map(|&(_, value, _)| value)
+        };
+        assert_eq!(bucket("0.5"), Some(1.0));
+        assert_eq!(bucket("1"), Some(2.0));
+        assert_eq!(bucket("+Inf"), Some(2.0));
+        assert_eq!(value_of(&samples, "herakles_io_latency_seconds_sum"), [1.0]);
+        assert_eq!(
+            value_of(&samples, "herakles_io_latency_seconds_count"),
+            [2.0]
+        );
+    }
+
+    #[test]
+    fn test_full_queue_drops_oldest_and_resyncs() {
+        let registry = Registry::new();
+        let rss = Gauge::new("herakles_mem_rss_bytes", "RSS").unwrap();
+        let swap = Gauge::new("herakles_mem_swap_bytes", "swap").unwrap();
+        registry.register(Box::new(rss.clone())).unwrap();
+        registry.register(Box::new(swap.clone())).unwrap();
+
+        let mut pusher = Pusher::new(&config(1, 2), "node1");
+        for (cycle, value) in [1.0, 2.0].into_iter().enumerate() {
+            rss.set(value);
+            pusher.stage(&registry.gather(), cycle as i64 * 1_000);
+        }
+        assert_eq!(pusher.queued(), 2);
+
+        // The third batch pushes out the first
+        rss.set(3.0);
+        assert_eq!(pusher.stage(&registry.gather(), 2_000), (1, true));
+        assert_eq!(pusher.queued(), 2);
+        let samples = decode_request(&pusher.front().unwrap().body);
+        assert_eq!(value_of(&samples, "herakles_mem_rss_bytes"), [2.0]);
+
+        // The unchanged swap series of the dropped batch is sent again
+        while pusher.front().is_some() {
+            pusher.ack();
+        }
+        assert_eq!(pusher.stage(&registry.gather(), 3_000), (2, false));
+        pusher.ack();
+        assert_eq!(pusher.stage(&registry.gather(), 4_000), (0, false));
+
+        // A rejected batch also resends everything
+        rss.set(4.0);
+        assert_eq!(pusher.stage(&registry.gather(), 5_000), (1, false));
+        pusher.reject();
+        assert_eq!(pusher.stage(&registry.gather(), 6_000), (2, false));
+    }
+
+    #[test]
+    fn test_lost_stale_markers_are_resent() {
+        let registry = Registry::new();
+        let cpu =
+            CounterVec::new(Opts::new("herakles_cpu_seconds_total", "CPU"), &["group"]).unwrap();
+        registry.register(Box::new(cpu.clone())).unwrap();
+
+        let mut pusher = Pusher::new(&config(1, 4), "node1");
+        cpu.with_label_values(&["db"]).inc();
+        pusher.stage(&registry.gather(), 1_000);
+        pusher.ack();
+
+        // The batch with the marker is rejected; the next scan sends it again
+        cpu.remove_label_values(&["db"]).unwrap();
+        assert_eq!(pusher.stage(&registry.gather(), 2_000), (1, false));
+        pusher.reject();
+        assert_eq!(pusher.stage(&registry.gather(), 3_000), (1, false));
+        let samples = decode_request(&pusher.front().unwrap().body);
+        assert_eq!(samples.len(), 1);
+        assert_eq!(samples[0].1.to_bits(), STALE_NAN);
+        assert_eq!(samples[0].2, 3_000);
+
+        // Once acked, the marker is not sent again
+        pusher.ack();
+        assert_eq!(pusher.stage(&registry.gather(), 4_000), (0, false));
+        assert!(pusher.series.is_empty());
+
+        // A marker pushed out of a full queue is sent again as well
+        let mut pusher = Pusher::new(&config(1, 1), "node1");
+        cpu.with_label_values(&["db"]).inc();
+        pusher.stage(&registry.gather(), 1_000);
+        cpu.remove_label_values(&["db"]).unwrap();
+        assert_eq!(pusher.stage(&registry.gather(), 2_000), (1, true));
+        cpu.with_label_values(&["web"]).inc();
+        assert_eq!(pusher.stage(&registry.gather(), 3_000), (1, true));
+        assert_eq!(pusher.stage(&registry.gather(), 4_000), (2, true));
+        let samples = decode_request(&pusher.front().unwrap().body);
+        let stale = samples
+            .iter()
+            .filter(|(_, value, _)| value.to_bits() == STALE_NAN)
+            .count();
+        assert_eq!(stale, 1);
+    }
+}
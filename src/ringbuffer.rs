@@ -1,11 +1,18 @@
 //! Ringbuffer module for tracking historical metrics.
 //!
 //! This module provides a fixed-size ringbuffer for storing historical
-//! metrics entries with predictable memory usage.
+//! metrics entries with predictable memory usage, and the [`HistoryView`]
+//! read interface shared with the columnar storage in
+//! [`crate::ringbuffer_columnar`].
+
+use std::ops::Range;
 
 /// Size of a single ringbuffer entry in bytes (256 bytes with extended top-N data).
 pub const ENTRY_SIZE_BYTES: usize = 256;
 
+/// Number of top processes stored per metric in each entry.
+pub const TOP_SLOTS: usize = 3;
+
 /// Top process information stored in ringbuffer (24 bytes per entry).
 #[repr(C)]
 #[derive(Clone, Copy, Debug)]
@@ -66,14 +73,126 @@ pub struct RingbufferEntry {
 
     // Top-3 processes by each metric
     // 3 entries per metric × 3 metrics = 9 entries × 24 bytes = 216 bytes
-    pub top_cpu: [TopProcessInfo; 3], // 72 bytes - Top 3 by CPU
-    pub top_rss: [TopProcessInfo; 3], // 72 bytes - Top 3 by RSS
-    pub top_pss: [TopProcessInfo; 3], // 72 bytes - Top 3 by PSS
+    pub top_cpu: [TopProcessInfo; TOP_SLOTS], // 72 bytes - Top 3 by CPU
+    pub top_rss: [TopProcessInfo; TOP_SLOTS], // 72 bytes - Top 3 by RSS
+    pub top_pss: [TopProcessInfo; TOP_SLOTS], // 72 bytes - Top 3 by PSS
 
     // Total: 40 + 216 = 256 bytes exactly
     pub _padding: [u8; 0], // No padding needed - exactly 256 bytes
 }
 
+/// Memory metric of a history entry, read in bytes.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Metric {
+    Rss,
+    Pss,
+    Uss,
+}
+
+impl Metric {
+    /// Value of this metric in `entry`, in bytes.
+    pub fn bytes(self, entry: &RingbufferEntry) -> u64 {
+        match self {
+            Metric::Rss => entry.rss_kb * 1024,
+            Metric::Pss => entry.pss_kb * 1024,
+            Metric::Uss => entry.uss_kb * 1024,
+        }
+    }
+}
+
+/// Read access to one subgroup's history, indexed from the oldest entry.
+///
+/// Lets analysis code scan a single metric without decoding or copying whole
+/// entries, whichever storage the history lives in.
+pub trait HistoryView {
+    /// Number of entries.
+    fn len(&self) -> usize;
+
+    fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Calls `f(timestamp, bytes)` for the entries in `range`, oldest first.
+    /// Indices past the end are ignored.
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64));
+
+    /// Value of `metric` at entry `index`.
+    fn value_at(&self, metric: Metric, index: usize) -> Option<u64> {
+        let mut value = None;
+        self.for_each(metric, index..index + 1, &mut |_, v| value = Some(v));
+        value
+    }
+}
+
+impl HistoryView for [RingbufferEntry] {
+    fn len(&self) -> usize {
+        <[RingbufferEntry]>::len(self)
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        let end = range.end.min(<[RingbufferEntry]>::len(self));
+        if range.start < end {
+            for entry in &self[range.start..end] {
+                f(entry.timestamp, metric.bytes(entry));
+            }
+        }
+    }
+}
+
+impl HistoryView for Vec<RingbufferEntry> {
+    fn len(&self) -> usize {
+        Vec::len(self)
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        HistoryView::for_each(self.as_slice(), metric, range, f)
+    }
+}
+
+/// Copies the `count` valid entries of a circular buffer, oldest first.
+///
+/// `write_index` is the slot the next entry goes to, which holds the oldest
+/// entry once the buffer is full.
+pub fn chronological(
+    entries: &[RingbufferEntry],
+    write_index: usize,
+    count: usize,
+) -> Vec<RingbufferEntry> {
+    let mut result = Vec::with_capacity(count);
+
+    if count < entries.len() {
+        // Buffer not yet full, entries are in order from 0 to count-1
+        result.extend_from_slice(&entries[0..count]);
+    } else {
+        // Buffer is full, need to arrange from write_index (oldest) to end, then from 0
+        result.extend_from_slice(&entries[write_index..]);
+        result.extend_from_slice(&entries[0..write_index]);
+    }
+
+    result
+}
+
+/// Scans `range` of the `count` valid entries of a circular buffer in
+/// chronological order, without copying them (see [`chronological`]).
+pub fn for_each_chronological(
+    entries: &[RingbufferEntry],
+    write_index: usize,
+    count: usize,
+    metric: Metric,
+    range: Range<usize>,
+    f: &mut dyn FnMut(i64, u64),
+) {
+    let oldest = if count < entries.len() {
+        0
+    } else {
+        write_index
+    };
+    for i in range.start..range.end.min(count) {
+        let entry = &entries[(oldest + i) % entries.len()];
+        f(entry.timestamp, metric.bytes(entry));
+    }
+}
+
 /// A circular buffer for storing metric entries with fixed capacity.
 pub struct Ringbuffer {
     entries: Vec<RingbufferEntry>,
@@ -110,22 +229,7 @@ impl Ringbuffer {
 
     /// Returns all entries in chronological order (oldest to newest).
     pub fn get_history(&self) -> Vec<RingbufferEntry> {
-        if self.count == 0 {
-            return Vec::new();
-        }
-
-        let mut result = Vec::with_capacity(self.count);
-
-        if self.count < self.capacity {
-            // Buffer not yet full, entries are in order from 0 to count-1
-            result.extend_from_slice(&self.entries[0..self.count]);
-        } else {
-            // Buffer is full, need to arrange from write_index (oldest) to end, then from 0
-            result.extend_from_slice(&self.entries[self.write_index..]);
-            result.extend_from_slice(&self.entries[0..self.write_index]);
-        }
-
-        result
+        chronological(&self.entries, self.write_index, self.count)
     }
 
     /// Returns the current number of entries in the buffer.
@@ -145,6 +249,23 @@ impl Ringbuffer {
     }
 }
 
+impl HistoryView for Ringbuffer {
+    fn len(&self) -> usize {
+        self.count
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        for_each_chronological(
+            &self.entries,
+            self.write_index,
+            self.count,
+            metric,
+            range,
+            f,
+        );
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -0,0 +1,745 @@
+//! Columnar, delta-compressed ringbuffer storage.
+//!
+//! A subgroup's history is kept in blocks of [`BLOCK_LEN`] samples. Inside a
+//! block every field of [`RingbufferEntry`] is its own column of varints:
+//!
+//! - timestamps as delta-of-delta, so a steady interval costs one byte
+//! - memory counters as zigzag deltas from the previous sample
+//! - CPU floats XORed with the previous sample's bits (Gorilla-style)
+//! - top-N slots as an index into the block's name dictionary plus a PID
+//!   delta, written only when the slot's process changes, and a value delta
+//!
+//! Each block decodes on its own, so the oldest block can be dropped as a
+//! whole once enough newer samples exist or the encoded blocks outgrow the
+//! buffer's byte budget. Sealed blocks are immutable and
+//! shared with readers through `Arc`, which makes a [`ColumnarHistory`]
+//! snapshot cheap to take and lets metric scans run without holding the
+//! manager lock or building a `Vec<RingbufferEntry>`.
+
+use std::collections::VecDeque;
+use std::ops::Range;
+use std::sync::Arc;
+
+use crate::ringbuffer::{HistoryView, Metric, RingbufferEntry, TopProcessInfo, TOP_SLOTS};
+
+/// Samples per block.
+pub const BLOCK_LEN: usize = 64;
+
+const COL_TIMESTAMP: usize = 0;
+const COL_RSS: usize = 1;
+const COL_CPU: usize = 4;
+const COL_SLOTS: usize = 6;
+/// Top-N slots per sample: `top_cpu`, `top_rss` and `top_pss`, in that order
+const SLOTS: usize = 3 * TOP_SLOTS;
+/// Each slot has an identity column and a value column
+const COLUMNS: usize = COL_SLOTS + 2 * SLOTS;
+
+type Name = [u8; 16];
+
+fn put_varint(out: &mut Vec<u8>, mut value: u64) {
+    while value >= 0x80 {
+        out.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    out.push(value as u8);
+}
+
+fn zigzag(value: i64) -> u64 {
+    ((value << 1) ^ (value >> 63)) as u64
+}
+
+fn unzigzag(value: u64) -> i64 {
+    (value >> 1) as i64 ^ -((value & 1) as i64)
+}
+
+/// Sequential varint reader over one column.
+struct Cursor<'a> {
+    bytes: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Cursor<'a> {
+    fn new(bytes: &'a [u8]) -> Self {
+        Self { bytes, pos: 0 }
+    }
+
+    fn next(&mut self) -> u64 {
+        let mut value = 0u64;
+        let mut shift = 0;
+        loop {
+            let byte = self.bytes[self.pos];
+            self.pos += 1;
+            value |= ((byte & 0x7f) as u64) << shift;
+            if byte & 0x80 == 0 {
+                return value;
+            }
+            shift += 7;
+        }
+    }
+
+    fn next_signed(&mut self) -> i64 {
+        unzigzag(self.next())
+    }
+}
+
+#[derive(Clone, Copy)]
+struct SlotState {
+    pid: u32,
+    /// Index into the block's name dictionary
+    name: u32,
+    value: u32,
+}
+
+/// Previous sample's values, the base for the next delta. Encoder and
+/// decoder both start every block from `State::new()`.
+#[derive(Clone, Copy)]
+struct State {
+    timestamp: i64,
+    timestamp_delta: i64,
+    memory_kb: [u64; 3],
+    cpu_bits: [u32; 2],
+    slots: [SlotState; SLOTS],
+}
+
+impl State {
+    fn new() -> Self {
+        Self {
+            timestamp: 0,
+            timestamp_delta: 0,
+            memory_kb: [0; 3],
+            cpu_bits: [0; 2],
+            slots: [SlotState {
+                pid: 0,
+                name: u32::MAX, // No name yet: the first sample writes every slot
+                value: 0,
+            }; SLOTS],
+        }
+    }
+}
+
+fn metric_column(metric: Metric) -> usize {
+    COL_RSS
+        + match metric {
+            Metric::Rss => 0,
+            Metric::Pss => 1,
+            Metric::Uss => 2,
+        }
+}
+
+/// Calls `f(timestamp, bytes)` for samples `skip..skip + take` of a block's
+/// timestamp and memory columns.
+fn scan_columns(
+    timestamps: &[u8],
+    values: &[u8],
+    skip: usize,
+    take: usize,
+    f: &mut dyn FnMut(i64, u64),
+) {
+    let mut timestamps = Cursor::new(timestamps);
+    let mut values = Cursor::new(values);
+    let (mut timestamp, mut delta, mut value_kb) = (0i64, 0i64, 0u64);
+    for i in 0..skip + take {
+        delta = delta.wrapping_add(timestamps.next_signed());
+        timestamp = timestamp.wrapping_add(delta);
+        value_kb = value_kb.wrapping_add(values.next_signed() as u64);
+        if i >= skip {
+            f(timestamp, value_kb * 1024);
+        }
+    }
+}
+
+/// A run of samples that can be scanned by metric: a sealed block or the
+/// open one.
+trait Samples {
+    fn len(&self) -> usize;
+
+    /// Calls `f(timestamp, bytes)` for samples `skip..skip + take`.
+    fn scan(&self, metric: Metric, skip: usize, take: usize, f: &mut dyn FnMut(i64, u64));
+}
+
+/// Scans `range` of the samples in `blocks`, where the first `skip` samples
+/// are hidden from readers.
+fn scan_range<'a>(
+    blocks: impl Iterator<Item = &'a dyn Samples>,
+    skip: usize,
+    len: usize,
+    metric: Metric,
+    range: Range<usize>,
+    f: &mut dyn FnMut(i64, u64),
+) {
+    // Work in stored indices, which include the hidden entries
+    let start = range.start.min(len) + skip;
+    let end = range.end.min(len) + skip;
+    let mut offset = 0;
+    for block in blocks {
+        if offset >= end {
+            break;
+        }
+        let block_end = offset + block.len();
+        if block_end > start {
+            let from = start.max(offset);
+            block.scan(metric, from - offset, end.min(block_end) - from, f);
+        }
+        offset = block_end;
+    }
+}
+
+/// An immutable, encoded block.
+struct Block {
+    len: usize,
+    data: Box<[u8]>,
+    /// Start of each column in `data`, plus the end of the last one
+    offsets: [u32; COLUMNS + 1],
+    names: Box<[Name]>,
+}
+
+impl Block {
+    fn column(&self, column: usize) -> &[u8] {
+        &self.data[self.offsets[column] as usize..self.offsets[column + 1] as usize]
+    }
+
+    fn memory_bytes(&self) -> usize {
+        std::mem::size_of::<Self>() + self.data.len() + self.names.len() * 16
+    }
+
+    /// Decodes every sample of the block into `out`.
+    fn decode_into(&self, out: &mut Vec<RingbufferEntry>) {
+        let mut columns: [Cursor; COLUMNS] = std::array::from_fn(|c| Cursor::new(self.column(c)));
+        let mut state = State::new();
+        for _ in 0..self.len {
+            let mut entry = RingbufferEntry::default();
+
+            state.timestamp_delta = state
+                .timestamp_delta
+                .wrapping_add(columns[COL_TIMESTAMP].next_signed());
+            state.timestamp = state.timestamp.wrapping_add(state.timestamp_delta);
+            entry.timestamp = state.timestamp;
+
+            for (i, kb) in state.memory_kb.iter_mut().enumerate() {
+                *kb = kb.wrapping_add(columns[COL_RSS + i].next_signed() as u64);
+            }
+            [entry.rss_kb, entry.pss_kb, entry.uss_kb] = state.memory_kb;
+
+            for (i, bits) in state.cpu_bits.iter_mut().enumerate() {
+                *bits ^= columns[COL_CPU + i].next() as u32;
+            }
+            entry.cpu_percent = f32::from_bits(state.cpu_bits[0]);
+            entry.cpu_time_seconds = f32::from_bits(state.cpu_bits[1]);
+
+            let tops = entry
+                .top_cpu
+                .iter_mut()
+                .chain(entry.top_rss.iter_mut())
+                .chain(entry.top_pss.iter_mut());
+            for (slot, (top, prev)) in tops.zip(state.slots.iter_mut()).enumerate() {
+                let ident = &mut columns[COL_SLOTS + 2 * slot];
+                let name = ident.next();
+                if name != 0 {
+                    prev.name = (name - 1) as u32;
+                    prev.pid = prev.pid.wrapping_add(ident.next_signed() as i32 as u32);
+                }
+                prev.value = prev
+                    .value
+                    .wrapping_add(columns[COL_SLOTS + 2 * slot + 1].next_signed() as i32 as u32);
+                *top = TopProcessInfo {
+                    pid: prev.pid,
+                    value: prev.value,
+                    name: self.names[prev.name as usize],
+                };
+            }
+
+            out.push(entry);
+        }
+    }
+}
+
+impl Samples for Block {
+    fn len(&self) -> usize {
+        self.len
+    }
+
+    fn scan(&self, metric: Metric, skip: usize, take: usize, f: &mut dyn FnMut(i64, u64)) {
+        scan_columns(
+            self.column(COL_TIMESTAMP),
+            self.column(metric_column(metric)),
+            skip,
+            take,
+            f,
+        );
+    }
+}
+
+/// The block currently being appended to, one growable buffer per column.
+struct OpenBlock {
+    len: usize,
+    columns: [Vec<u8>; COLUMNS],
+    names: Vec<Name>,
+    state: State,
+}
+
+impl OpenBlock {
+    fn new() -> Self {
+        Self {
+            len: 0,
+            columns: std::array::from_fn(|_| Vec::new()),
+            names: Vec::new(),
+            state: State::new(),
+        }
+    }
+
+    fn intern(&mut self, name: &Name) -> u32 {
+        match self.names.iter().position(|n| n == name) {
+            Some(index) => index as u32,
+            None => {
+                self.names.push(*name);
+                (self.names.len() - 1) as u32
+            }
+        }
+    }
+
+    fn push(&mut self, entry: &RingbufferEntry) {
+        let delta = entry.timestamp.wrapping_sub(self.state.timestamp);
+        put_varint(
+            &mut self.columns[COL_TIMESTAMP],
+            zigzag(delta.wrapping_sub(self.state.timestamp_delta)),
+        );
+        self.state.timestamp = entry.timestamp;
+        self.state.timestamp_delta = delta;
+
+        let memory_kb = [entry.rss_kb, entry.pss_kb, entry.uss_kb];
+        for (i, (&kb, prev)) in memory_kb
+            .iter()
+            .zip(self.state.memory_kb.iter_mut())
+            .enumerate()
+        {
+            put_varint(
+                &mut self.columns[COL_RSS + i],
+                zigzag(kb.wrapping_sub(*prev) as i64),
+            );
+            *prev = kb;
+        }
+
+        let cpu_bits = [
+            entry.cpu_percent.to_bits(),
+            entry.cpu_time_seconds.to_bits(),
+        ];
+        for (i, (&bits, prev)) in cpu_bits
+            .iter()
+            .zip(self.state.cpu_bits.iter_mut())
+            .enumerate()
+        {
+            put_varint(&mut self.columns[COL_CPU + i], (bits ^ *prev) as u64);
+            *prev = bits;
+        }
+
+        let tops = entry
+            .top_cpu
+            .iter()
+            .chain(entry.top_rss.iter())
+            .chain(entry.top_pss.iter());
+        for (slot, top) in tops.enumerate() {
+            let name = self.intern(&top.name);
+            let prev = &mut self.state.slots[slot];
+            let ident = &mut self.columns[COL_SLOTS + 2 * slot];
+            if top.pid == prev.pid && name == prev.name {
+                put_varint(ident, 0);
+            } else {
+                put_varint(ident, name as u64 + 1);
+                put_varint(ident, zigzag(top.pid.wrapping_sub(prev.pid) as i32 as i64));
+            }
+            put_varint(
+                &mut self.columns[COL_SLOTS + 2 * slot + 1],
+                zigzag(top.value.wrapping_sub(prev.value) as i32 as i64),
+            );
+            *prev = SlotState {
+                pid: top.pid,
+                name,
+                value: top.value,
+            };
+        }
+
+        self.len += 1;
+    }
+
+    /// Packs the columns into an immutable block.
+    fn seal(&self) -> Block {
+        let total: usize = self.columns.iter().map(Vec::len).sum();
+        let mut data = Vec::with_capacity(total);
+        let mut offsets = [0u32; COLUMNS + 1];
+        for (i, column) in self.columns.iter().enumerate() {
+            data.extend_from_slice(column);
+            offsets[i + 1] = data.len() as u32;
+        }
+        Block {
+            len: self.len,
+            data: data.into_boxed_slice(),
+            offsets,
+            names: self.names.clone().into_boxed_slice(),
+        }
+    }
+
+    fn memory_bytes(&self) -> usize {
+        std::mem::size_of::<Self>()
+            + self.columns.iter().map(Vec::capacity).sum::<usize>()
+            + self.names.capacity() * 16
+    }
+}
+
+impl Samples for OpenBlock {
+    fn len(&self) -> usize {
+        self.len
+    }
+
+    fn scan(&self, metric: Metric, skip: usize, take: usize, f: &mut dyn FnMut(i64, u64)) {
+        scan_columns(
+            &self.columns[COL_TIMESTAMP],
+            &self.columns[metric_column(metric)],
+            skip,
+            take,
+            f,
+        );
+    }
+}
+
+/// Ringbuffer keeping the last `capacity` entries in compressed columns,
+/// within a budget of `max_bytes`.
+pub struct ColumnarRingbuffer {
+    sealed: VecDeque<Arc<Block>>,
+    open: OpenBlock,
+    capacity: usize,
+    max_bytes: usize,
+    /// Entries held in `sealed` and `open`; up to `BLOCK_LEN - 1` more than
+    /// `capacity`, the excess is hidden from readers
+    stored: usize,
+    /// Sum of `memory_bytes` over `sealed`
+    sealed_bytes: usize,
+}
+
+impl ColumnarRingbuffer {
+    /// Creates a new columnar ringbuffer holding at most `capacity` entries
+    /// in at most `max_bytes` of encoded blocks.
+    pub fn new(capacity: usize, max_bytes: usize) -> Self {
+        Self {
+            sealed: VecDeque::new(),
+            open: OpenBlock::new(),
+            capacity: capacity.max(1),
+            max_bytes,
+            stored: 0,
+            sealed_bytes: 0,
+        }
+    }
+
+    /// Appends an entry, dropping the oldest block once it is no longer
+    /// needed to hold `capacity` entries or the blocks exceed `max_bytes`.
+    ///
+    /// The open block is never dropped, so a budget below one block's
+    /// encoded size still keeps the newest samples.
+    pub fn push(&mut self, entry: RingbufferEntry) {
+        self.open.push(&entry);
+        self.stored += 1;
+        if self.open.len == BLOCK_LEN {
+            let block = self.open.seal();
+            self.sealed_bytes += block.memory_bytes();
+            self.sealed.push_back(Arc::new(block));
+            self.open = OpenBlock::new();
+        }
+        self.evict();
+    }
+
+    /// Changes the byte budget, dropping the oldest blocks that no longer
+    /// fit it.
+    pub fn set_max_bytes(&mut self, max_bytes: usize) {
+        self.max_bytes = max_bytes;
+        self.evict();
+    }
+
+    /// Drops the oldest sealed blocks not needed for `capacity` entries or
+    /// over `max_bytes`.
+    fn evict(&mut self) {
+        while let Some(oldest) = self.sealed.front() {
+            if self.stored - oldest.len < self.capacity && self.memory_bytes() <= self.max_bytes {
+                break;
+            }
+            self.stored -= oldest.len;
+            self.sealed_bytes -= oldest.memory_bytes();
+            self.sealed.pop_front();
+        }
+    }
+
+    /// Returns the current number of entries in the buffer.
+    pub fn len(&self) -> usize {
+        self.stored.min(self.capacity)
+    }
+
+    /// Returns the maximum capacity of the buffer.
+    pub fn capacity(&self) -> usize {
+        self.capacity
+    }
+
+    /// Returns true if the buffer is empty.
+    #[allow(dead_code)]
+    pub fn is_empty(&self) -> bool {
+        self.stored == 0
+    }
+
+    /// Bytes held by the encoded history.
+    pub fn memory_bytes(&self) -> usize {
+        self.sealed_bytes + self.open.memory_bytes()
+    }
+
+    /// Returns a read-only view of the current entries.
+    ///
+    /// Shares the sealed blocks and copies only the open block's bytes.
+    pub fn snapshot(&self) -> ColumnarHistory {
+        let mut blocks: Vec<Arc<Block>> = self.sealed.iter().cloned().collect();
+        if self.open.len > 0 {
+            blocks.push(Arc::new(self.open.seal()));
+        }
+        ColumnarHistory {
+            blocks,
+            skip: self.stored - self.len(),
+            len: self.len(),
+        }
+    }
+
+    /// Returns all entries in chronological order (oldest to newest).
+    pub fn get_history(&self) -> Vec<RingbufferEntry> {
+        self.snapshot().entries()
+    }
+}
+
+/// Scans the live buffer in place, including the open block, without taking
+/// a snapshot.
+impl HistoryView for ColumnarRingbuffer {
+    fn len(&self) -> usize {
+        ColumnarRingbuffer::len(self)
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        let blocks = self
+            .sealed
+            .iter()
+            .map(|b| &**b as &dyn Samples)
+            .chain(std::iter::once(&self.open as &dyn Samples));
+        let len = self.len();
+        scan_range(blocks, self.stored - len, len, metric, range, f);
+    }
+}
+
+/// Point-in-time view of a [`ColumnarRingbuffer`].
+pub struct ColumnarHistory {
+    blocks: Vec<Arc<Block>>,
+    /// Decoded but hidden entries at the start of the first block
+    skip: usize,
+    len: usize,
+}
+
+impl ColumnarHistory {
+    /// Decodes all entries in chronological order.
+    pub fn entries(&self) -> Vec<RingbufferEntry> {
+        let mut out = Vec::with_capacity(self.skip + self.len);
+        for block in &self.blocks {
+            block.decode_into(&mut out);
+        }
+        out.drain(..self.skip);
+        out
+    }
+
+    /// Decodes the newest entry, which only needs the last block.
+    pub fn latest(&self) -> Option<RingbufferEntry> {
+        if self.len == 0 {
+            return None;
+        }
+        let mut out = Vec::with_capacity(BLOCK_LEN);
+        self.blocks.last()?.decode_into(&mut out);
+        out.pop()
+    }
+
+    /// Sums `cpu_percent` over all entries, reading only the CPU column.
+    pub fn cpu_percent_sum(&self) -> f64 {
+        let mut sum = 0.0;
+        let mut index = 0;
+        for block in &self.blocks {
+            let mut column = Cursor::new(block.column(COL_CPU));
+            let mut bits = 0u32;
+            for _ in 0..block.len {
+                bits ^= column.next() as u32;
+                if index >= self.skip {
+                    sum += f32::from_bits(bits) as f64;
+                }
+                index += 1;
+            }
+        }
+        sum
+    }
+}
+
+impl HistoryView for ColumnarHistory {
+    fn len(&self) -> usize {
+        self.len
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        let blocks = self.blocks.iter().map(|b| &**b as &dyn Samples);
+        scan_range(blocks, self.skip, self.len, metric, range, f);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn entry(i: i64) -> RingbufferEntry {
+        let names = ["postgres", "postgres: wal", "pgbouncer"];
+        let mut entry = RingbufferEntry {
+            timestamp: 1_700_000_000 + i * 30,
+            rss_kb: 500_000 + (i as u64 * 37) % 900,
+            pss_kb: 400_000 + (i as u64 * 11) % 500,
+            uss_kb: 300_000 - (i as u64 % 7) * 3,
+            cpu_percent: 12.5 + (i % 4) as f32,
+            cpu_time_seconds: 1000.0 + i as f32 * 0.25,
+            ..Default::default()
+        };
+        for (slot, top) in entry.top_rss.iter_mut().enumerate() {
+            *top = TopProcessInfo::new(1000 + slot as u32, (160_000 + i * 3) as u32, names[slot]);
+        }
+        // A process taking over the top CPU slot now and then
+        let (pid, name) = if i % 50 == 0 {
+            (4242, "vacuum")
+        } else {
+            (1000, names[0])
+        };
+        entry.top_cpu[0] = TopProcessInfo::new(pid, ((i * 13) % 4000) as u32, name);
+        entry
+    }
+
+    fn assert_same(a: &RingbufferEntry, b: &RingbufferEntry) {
+        assert_eq!(a.timestamp, b.timestamp);
+        assert_eq!(
+            (a.rss_kb, a.pss_kb, a.uss_kb),
+            (b.rss_kb, b.pss_kb, b.uss_kb)
+        );
+        assert_eq!(a.cpu_percent.to_bits(), b.cpu_percent.to_bits());
+        assert_eq!(a.cpu_time_seconds.to_bits(), b.cpu_time_seconds.to_bits());
+        let tops = |e: &RingbufferEntry| {
+            e.top_cpu
+                .iter()
+                .chain(&e.top_rss)
+                .chain(&e.top_pss)
+                .map(|t| (t.pid, t.value, t.name))
+                .collect::<Vec<_>>()
+        };
+        assert_eq!(tops(a), tops(b));
+    }
+
+    #[test]
+    fn test_varint_roundtrip() {
+        let values = [0u64, 1, 127, 128, 300, u32::MAX as u64, u64::MAX];
+        let mut bytes = Vec::new();
+        for &v in &values {
+            put_varint(&mut bytes, v);
+        }
+        let mut cursor = Cursor::new(&bytes);
+        for &v in &values {
+            assert_eq!(cursor.next(), v);
+        }
+        for v in [0i64, -1, 1, i64::MIN, i64::MAX] {
+            assert_eq!(unzigzag(zigzag(v)), v);
+        }
+    }
+
+    #[test]
+    fn test_roundtrip_and_wraparound() {
+        let capacity = 150;
+        let mut rb = ColumnarRingbuffer::new(capacity, usize::MAX);
+        assert!(rb.is_empty());
+
+        let pushed: Vec<RingbufferEntry> = (0..500).map(entry).collect();
+        for (i, e) in pushed.iter().enumerate() {
+            rb.push(*e);
+            assert_eq!(rb.len(), (i + 1).min(capacity));
+        }
+
+        let history = rb.get_history();
+        assert_eq!(history.len(), capacity);
+        for (decoded, original) in history.iter().zip(&pushed[pushed.len() - capacity..]) {
+            assert_same(decoded, original);
+        }
+    }
+
+    #[test]
+    fn test_column_scan_matches_entries() {
+        let mut rb = ColumnarRingbuffer::new(100, usize::MAX);
+        let pushed: Vec<RingbufferEntry> = (0..230).map(entry).collect();
+        for e in &pushed {
+            rb.push(*e);
+        }
+        let view = rb.snapshot();
+        let expected = &pushed[130..];
+
+        for metric in [Metric::Rss, Metric::Pss, Metric::Uss] {
+            for range in [0..100, 10..11, 60..90, 95..500, 100..120] {
+                let end = range.end.min(expected.len());
+                let start = range.start.min(end);
+                let wanted: Vec<(i64, u64)> = expected[start..end]
+                    .iter()
+                    .map(|e| (e.timestamp, metric.bytes(e)))
+                    .collect();
+                // The snapshot and the live buffer, whose open block is unsealed
+                for history in [&view as &dyn HistoryView, &rb] {
+                    let mut scanned = Vec::new();
+                    history.for_each(metric, range.clone(), &mut |ts, v| scanned.push((ts, v)));
+                    assert_eq!(scanned, wanted, "{:?} {:?}", metric, range);
+                }
+            }
+        }
+        assert_eq!(
+            view.value_at(Metric::Rss, 0),
+            Some(expected[0].rss_kb * 1024)
+        );
+        assert_eq!(view.value_at(Metric::Rss, 100), None);
+
+        assert_same(&view.latest().unwrap(), &pushed[229]);
+        let cpu: f64 = expected.iter().map(|e| e.cpu_percent as f64).sum();
+        assert!((view.cpu_percent_sum() - cpu).abs() < 1e-6);
+    }
+
+    #[test]
+    fn test_compression_ratio() {
+        let capacity = 10 * BLOCK_LEN;
+        let mut rb = ColumnarRingbuffer::new(capacity, usize::MAX);
+        for i in 0..capacity as i64 {
+            rb.push(entry(i));
+        }
+        // Typical samples (steady interval, stable top-N names, small
+        // counter changes) encode to 30-40 bytes instead of 256
+        let per_entry = rb.memory_bytes() / capacity;
+        assert!(per_entry <= 40, "{} bytes per entry", per_entry);
+    }
+
+    #[test]
+    fn test_evicts_by_bytes() {
+        let mut rb = ColumnarRingbuffer::new(10_000, 0);
+        for i in 0..1_000 {
+            rb.push(entry(i));
+        }
+        // Only the open block survives a zero budget
+        assert_eq!(rb.len(), 1_000 % BLOCK_LEN);
+
+        let budget = 16 * 1024;
+        let mut rb = ColumnarRingbuffer::new(10_000, budget);
+        let pushed: Vec<RingbufferEntry> = (0..2_000).map(entry).collect();
+        for e in &pushed {
+            rb.push(*e);
+            assert!(rb.sealed.is_empty() || rb.memory_bytes() <= budget);
+        }
+        assert!(
+            rb.len() > BLOCK_LEN && rb.len() < 2_000,
+            "{} entries",
+            rb.len()
+        );
+        let history = rb.get_history();
+        assert_same(history.last().unwrap(), &pushed[1_999]);
+        assert_same(&history[0], &pushed[2_000 - history.len()]);
+    }
+}
@@ -2,33 +2,245 @@
 //!
 //! This module provides the `RingbufferManager` which maintains a collection
 //! of ringbuffers, one per subgroup, with deterministic memory allocation.
-
-use crate::config::RingbufferConfig;
-use crate::ringbuffer::{Ringbuffer, RingbufferEntry, ENTRY_SIZE_BYTES};
+//! Buffers are stored in a vector indexed by the subgroup's registry ID.
+//! Depending on `RingbufferConfig::storage` each buffer holds fixed-size
+//! entries or delta-compressed columns. With `RingbufferConfig::persist_path`
+//! set, entry buffers live in a memory-mapped file and are restored on the
+//! next start. Every subgroup also keeps [`RollingStats`], updated on each
+//! record, so readers get aggregates without scanning the history.
+
+use crate::config::{RingbufferConfig, RingbufferStorage};
+use crate::process::{SubgroupId, SUBGROUP_REGISTRY};
 #[cfg(test)]
 use crate::ringbuffer::TopProcessInfo;
-use dashmap::DashMap;
+use crate::ringbuffer::{HistoryView, Metric, Ringbuffer, RingbufferEntry, ENTRY_SIZE_BYTES};
+use crate::ringbuffer_columnar::{ColumnarHistory, ColumnarRingbuffer};
+use crate::ringbuffer_mmap::{MappedRingbuffer, RingbufferFile};
+use crate::ringbuffer_stats::{RollingStats, SubgroupStats};
 use serde::Serialize;
+use std::ops::Range;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, RwLock};
+use tracing::{info, warn};
 
 /// Statistics about the ringbuffer system.
 #[derive(Debug, Clone, Serialize)]
 pub struct RingbufferStats {
     pub max_memory_mb: usize,
+    pub storage: RingbufferStorage,
+    /// Bytes per entry; for columnar storage the average of the recorded
+    /// entries, 0 before the first record
     pub entry_size_bytes: usize,
     pub interval_seconds: u64,
+    /// Entries each subgroup holds; for columnar storage as many of
+    /// `entry_size_bytes` as fit `bytes_per_subgroup`, up to
+    /// `max_entries_per_subgroup`
     pub entries_per_subgroup: usize,
+    /// RAM budget of each subgroup's history; for columnar storage
+    /// `max_memory_mb` divided among the recorded subgroups, or the
+    /// subgroups expected at startup while there are fewer
+    pub bytes_per_subgroup: usize,
     pub total_subgroups: usize,
+    /// For columnar storage `max_memory_mb`, which the buffers share
     pub estimated_ram_bytes: usize,
+    /// Bytes currently held by all buffers
+    pub used_ram_bytes: usize,
     pub history_seconds: u64,
+    /// Whether history is kept in `persist_path` across restarts
+    pub persistent: bool,
+}
+
+/// Storage of one subgroup's ringbuffer.
+enum HistoryBuffer {
+    Entries(Ringbuffer),
+    Columnar(ColumnarRingbuffer),
+    Mapped(MappedRingbuffer),
+}
+
+impl HistoryBuffer {
+    fn new(storage: RingbufferStorage, capacity: usize, max_bytes: usize) -> Self {
+        match storage {
+            RingbufferStorage::Entries => HistoryBuffer::Entries(Ringbuffer::new(capacity)),
+            RingbufferStorage::Columnar => {
+                HistoryBuffer::Columnar(ColumnarRingbuffer::new(capacity, max_bytes))
+            }
+        }
+    }
+
+    fn push(&mut self, entry: RingbufferEntry) {
+        match self {
+            HistoryBuffer::Entries(rb) => rb.push(entry),
+            HistoryBuffer::Columnar(rb) => rb.push(entry),
+            HistoryBuffer::Mapped(rb) => rb.push(entry),
+        }
+    }
+
+    fn len(&self) -> usize {
+        match self {
+            HistoryBuffer::Entries(rb) => rb.len(),
+            HistoryBuffer::Columnar(rb) => rb.len(),
+            HistoryBuffer::Mapped(rb) => rb.len(),
+        }
+    }
+
+    fn capacity(&self) -> usize {
+        match self {
+            HistoryBuffer::Entries(rb) => rb.capacity(),
+            HistoryBuffer::Columnar(rb) => rb.capacity(),
+            HistoryBuffer::Mapped(rb) => rb.capacity(),
+        }
+    }
+
+    fn memory_bytes(&self) -> usize {
+        match self {
+            HistoryBuffer::Entries(rb) => rb.capacity() * ENTRY_SIZE_BYTES,
+            HistoryBuffer::Columnar(rb) => rb.memory_bytes(),
+            // File-backed pages, reclaimable by the kernel
+            HistoryBuffer::Mapped(rb) => rb.capacity() * ENTRY_SIZE_BYTES,
+        }
+    }
+
+    /// Changes the byte budget of columnar storage; fixed-size entries keep
+    /// their capacity.
+    fn set_max_bytes(&mut self, max_bytes: usize) {
+        if let HistoryBuffer::Columnar(rb) = self {
+            rb.set_max_bytes(max_bytes);
+        }
+    }
+
+    fn get_history(&self) -> Vec<RingbufferEntry> {
+        match self {
+            HistoryBuffer::Entries(rb) => rb.get_history(),
+            HistoryBuffer::Columnar(rb) => rb.get_history(),
+            HistoryBuffer::Mapped(rb) => rb.get_history(),
+        }
+    }
+
+    fn view(&self) -> SubgroupHistory {
+        match self {
+            HistoryBuffer::Entries(rb) => SubgroupHistory::Entries(rb.get_history()),
+            HistoryBuffer::Columnar(rb) => SubgroupHistory::Columnar(rb.snapshot()),
+            HistoryBuffer::Mapped(rb) => SubgroupHistory::Entries(rb.get_history()),
+        }
+    }
+}
+
+impl HistoryView for HistoryBuffer {
+    fn len(&self) -> usize {
+        HistoryBuffer::len(self)
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        match self {
+            HistoryBuffer::Entries(rb) => rb.for_each(metric, range, f),
+            HistoryBuffer::Columnar(rb) => rb.for_each(metric, range, f),
+            HistoryBuffer::Mapped(rb) => rb.for_each(metric, range, f),
+        }
+    }
+}
+
+/// A subgroup's ringbuffer with the statistics of its contents.
+struct SubgroupBuffer {
+    history: HistoryBuffer,
+    stats: RollingStats,
+    interval_seconds: u64,
+}
+
+impl SubgroupBuffer {
+    fn new(history: HistoryBuffer, interval_seconds: u64) -> Self {
+        let stats = RollingStats::from_history(&history, history.capacity(), interval_seconds);
+        Self {
+            history,
+            stats,
+            interval_seconds,
+        }
+    }
+
+    fn push(&mut self, entry: RingbufferEntry) {
+        self.stats.push(&entry, &self.history);
+        self.history.push(entry);
+        self.sync_stats();
+    }
+
+    fn set_max_bytes(&mut self, max_bytes: usize) {
+        self.history.set_max_bytes(max_bytes);
+        self.sync_stats();
+    }
+
+    /// A columnar buffer over its byte budget drops a whole block before
+    /// reaching its capacity; rebuilds the statistics of what is left.
+    fn sync_stats(&mut self) {
+        if self.history.len() < self.stats.len() {
+            self.stats = RollingStats::from_history(
+                &self.history,
+                self.history.capacity(),
+                self.interval_seconds,
+            );
+        }
+    }
+}
+
+/// Point-in-time history of one subgroup, read through [`HistoryView`].
+///
+/// Entry storage is copied; columnar storage shares its sealed blocks, so
+/// scans never decode a full `Vec<RingbufferEntry>`.
+pub enum SubgroupHistory {
+    Entries(Vec<RingbufferEntry>),
+    Columnar(ColumnarHistory),
+}
+
+impl SubgroupHistory {
+    /// Returns the newest entry; columnar storage decodes only its last block.
+    pub fn latest(&self) -> Option<RingbufferEntry> {
+        match self {
+            SubgroupHistory::Entries(entries) => entries.last().copied(),
+            SubgroupHistory::Columnar(history) => history.latest(),
+        }
+    }
+
+    /// Returns the mean `cpu_percent` of the history, 0 if it is empty.
+    pub fn mean_cpu_percent(&self) -> f64 {
+        let sum = match self {
+            SubgroupHistory::Entries(entries) => entries.iter().map(|e| e.cpu_percent as f64).sum(),
+            SubgroupHistory::Columnar(history) => history.cpu_percent_sum(),
+        };
+        sum / self.len().max(1) as f64
+    }
+}
+
+impl HistoryView for SubgroupHistory {
+    fn len(&self) -> usize {
+        match self {
+            SubgroupHistory::Entries(entries) => entries.len(),
+            SubgroupHistory::Columnar(history) => history.len(),
+        }
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        match self {
+            SubgroupHistory::Entries(entries) => entries.for_each(metric, range, f),
+            SubgroupHistory::Columnar(history) => history.for_each(metric, range, f),
+        }
+    }
 }
 
 /// Manager for multiple ringbuffers, one per subgroup.
 pub struct RingbufferManager {
-    buffers: DashMap<String, Ringbuffer>,
+    /// Indexed by `SubgroupId`; `None` until the subgroup is first recorded
+    buffers: RwLock<Vec<Option<SubgroupBuffer>>>,
     entries_per_subgroup: usize,
+    /// Rebalanced under the `buffers` write lock as columnar subgroups are
+    /// added
+    bytes_per_subgroup: AtomicUsize,
+    /// `max_memory_mb` in bytes
+    max_bytes: usize,
+    /// Subgroups the budget is divided among until more are recorded
+    initial_subgroups: usize,
     interval_seconds: u64,
     config: RingbufferConfig,
     estimated_ram_bytes: usize,
+    /// Backing file for new entry buffers, if persistence is enabled
+    file: Option<Arc<RingbufferFile>>,
 }
 
 impl RingbufferManager {
@@ -41,6 +253,17 @@ impl RingbufferManager {
     /// The manager calculates entries_per_subgroup at initialization based on:
     /// - max_memory_mb / ENTRY_SIZE_BYTES / initial_subgroup_count
     /// - Clamped between min_entries_per_subgroup and max_entries_per_subgroup
+    ///
+    /// Columnar buffers instead share max_memory_mb: each gets it divided
+    /// by the larger of initial_subgroup_count and the number of recorded
+    /// subgroups, so the budget of every buffer shrinks as subgroups beyond
+    /// the initial count are added. They drop their oldest blocks by encoded
+    /// size, holding at most max_entries_per_subgroup entries; only the
+    /// open block of each buffer may exceed the budget.
+    ///
+    /// With `persist_path` set the backing file is opened with room for twice
+    /// the initial subgroup count, and the subgroups it holds are restored.
+    /// If the file cannot be opened history is kept in memory only.
     pub fn new(config: RingbufferConfig, initial_subgroup_count: usize) -> Self {
         // Calculate maximum total entries based on memory budget
         let max_bytes = config.max_memory_mb * 1024 * 1024;
@@ -50,70 +273,236 @@ impl RingbufferManager {
         let subgroup_count = initial_subgroup_count.max(1); // Prevent division by zero
         let calculated_entries = max_total_entries / subgroup_count;
 
-        // Clamp to configured min/max
-        let entries_per_subgroup = calculated_entries
-            .max(config.min_entries_per_subgroup)
-            .min(config.max_entries_per_subgroup);
+        let (entries_per_subgroup, bytes_per_subgroup) = match config.storage {
+            RingbufferStorage::Entries => {
+                // Clamp to configured min/max
+                let entries = calculated_entries
+                    .max(config.min_entries_per_subgroup)
+                    .min(config.max_entries_per_subgroup);
+                (entries, entries * ENTRY_SIZE_BYTES)
+            }
+            // The byte budget decides how many entries fit
+            RingbufferStorage::Columnar => {
+                (config.max_entries_per_subgroup, max_bytes / subgroup_count)
+            }
+        };
 
         // Estimate actual RAM usage
-        let estimated_ram_bytes = entries_per_subgroup * ENTRY_SIZE_BYTES * subgroup_count;
+        let estimated_ram_bytes = match config.storage {
+            RingbufferStorage::Entries => bytes_per_subgroup * subgroup_count,
+            RingbufferStorage::Columnar => max_bytes,
+        };
+
+        let file = Self::open_file(&config, entries_per_subgroup, subgroup_count * 2);
+        let mut buffers = Vec::new();
+        if let (Some(file), Some(path)) = (&file, &config.persist_path) {
+            let mut restored = 0;
+            for (slot, key) in file.used_slots() {
+                let (group, subgroup) = key.split_once(':').unwrap_or((key.as_str(), ""));
+                let index = SUBGROUP_REGISTRY.intern(group, subgroup).id as usize;
+                if index >= buffers.len() {
+                    buffers.resize_with(index + 1, || None);
+                }
+                let history = HistoryBuffer::Mapped(file.ringbuffer(slot));
+                buffers[index] = Some(SubgroupBuffer::new(history, config.interval_seconds));
+                restored += 1;
+            }
+            info!(
+                "Restored ringbuffer history for {} subgroups from {}",
+                restored,
+                path.display()
+            );
+        }
 
         Self {
-            buffers: DashMap::new(),
+            buffers: RwLock::new(buffers),
             entries_per_subgroup,
+            bytes_per_subgroup: AtomicUsize::new(bytes_per_subgroup),
+            max_bytes,
+            initial_subgroups: subgroup_count,
             interval_seconds: config.interval_seconds,
             config,
             estimated_ram_bytes,
+            file,
+        }
+    }
+
+    fn open_file(
+        config: &RingbufferConfig,
+        capacity: usize,
+        slot_count: usize,
+    ) -> Option<Arc<RingbufferFile>> {
+        let path = config.persist_path.as_deref()?;
+        if config.storage != RingbufferStorage::Entries {
+            warn!(
+                "Ringbuffer persist_path {} is only supported with entries storage, keeping history in memory",
+                path.display()
+            );
+            return None;
+        }
+        let now = chrono::Utc::now().timestamp();
+        match RingbufferFile::open(path, capacity, config.interval_seconds, slot_count, now) {
+            Ok(file) => Some(Arc::new(file)),
+            Err(e) => {
+                warn!(
+                    "Failed to open ringbuffer file {}, keeping history in memory: {}",
+                    path.display(),
+                    e
+                );
+                None
+            }
+        }
+    }
+
+    fn new_buffer(&self, subgroup: SubgroupId) -> SubgroupBuffer {
+        SubgroupBuffer::new(self.new_history(subgroup), self.interval_seconds)
+    }
+
+    fn new_history(&self, subgroup: SubgroupId) -> HistoryBuffer {
+        if let Some(file) = &self.file {
+            let key = SUBGROUP_REGISTRY
+                .get(subgroup)
+                .map(|info| info.key.to_string())
+                .unwrap_or_default();
+            if let Some(slot) = file.claim(&key) {
+                return HistoryBuffer::Mapped(file.ringbuffer(slot));
+            }
+            warn!(
+                "No free slot in ringbuffer file for subgroup {}, keeping its history in memory",
+                key
+            );
+        }
+        HistoryBuffer::new(
+            self.config.storage,
+            self.entries_per_subgroup,
+            self.bytes_per_subgroup.load(Ordering::Relaxed),
+        )
+    }
+
+    /// Divides the columnar byte budget among the recorded subgroups once
+    /// there are more than at startup, shrinking every buffer to its share.
+    fn rebalance(&self, buffers: &mut [Option<SubgroupBuffer>]) {
+        let recorded = buffers.iter().flatten().count();
+        let budget = self.max_bytes / recorded.max(self.initial_subgroups);
+        if self.bytes_per_subgroup.swap(budget, Ordering::Relaxed) == budget {
+            return;
+        }
+        for buffer in buffers.iter_mut().flatten() {
+            buffer.set_max_bytes(budget);
         }
     }
 
     /// Records a metric entry for a specific subgroup.
     ///
     /// If the subgroup doesn't have a ringbuffer yet, one is created
-    /// with the pre-calculated capacity.
-    pub fn record(&self, subgroup: &str, entry: RingbufferEntry) {
-        self.buffers
-            .entry(subgroup.to_string())
-            .or_insert_with(|| Ringbuffer::new(self.entries_per_subgroup))
-            .push(entry);
+    /// with the pre-calculated capacity, in the backing file if there is one.
+    /// A new columnar buffer rebalances the byte budget of all of them.
+    pub fn record(&self, subgroup: SubgroupId, entry: RingbufferEntry) {
+        let mut buffers = self.buffers.write().expect("ringbuffers lock poisoned");
+        let index = subgroup as usize;
+        if index >= buffers.len() {
+            buffers.resize_with(index + 1, || None);
+        }
+        if buffers[index].is_none() {
+            buffers[index] = Some(self.new_buffer(subgroup));
+            if self.config.storage == RingbufferStorage::Columnar {
+                self.rebalance(&mut buffers);
+            }
+        }
+        if let Some(buffer) = buffers[index].as_mut() {
+            buffer.push(entry);
+        }
     }
 
     /// Returns statistics about the ringbuffer system.
     pub fn get_stats(&self) -> RingbufferStats {
-        let total_subgroups = self.buffers.len();
-        let history_seconds = self.entries_per_subgroup as u64 * self.interval_seconds;
+        let buffers = self.buffers.read().expect("ringbuffers lock poisoned");
+        let total_subgroups = buffers.iter().filter(|b| b.is_some()).count();
+        let used_ram_bytes = buffers
+            .iter()
+            .flatten()
+            .map(|b| b.history.memory_bytes())
+            .sum();
+        let stored_entries: usize = buffers.iter().flatten().map(|b| b.history.len()).sum();
+        drop(buffers);
+
+        let bytes_per_subgroup = self.bytes_per_subgroup.load(Ordering::Relaxed);
+        let (entry_size_bytes, entries_per_subgroup) = match self.config.storage {
+            RingbufferStorage::Entries => (ENTRY_SIZE_BYTES, self.entries_per_subgroup),
+            RingbufferStorage::Columnar if stored_entries == 0 => (0, self.entries_per_subgroup),
+            RingbufferStorage::Columnar => {
+                let entry_size = (used_ram_bytes / stored_entries).max(1);
+                let entries = (bytes_per_subgroup / entry_size).min(self.entries_per_subgroup);
+                (entry_size, entries)
+            }
+        };
+        let history_seconds = entries_per_subgroup as u64 * self.interval_seconds;
 
         RingbufferStats {
             max_memory_mb: self.config.max_memory_mb,
-            entry_size_bytes: ENTRY_SIZE_BYTES,
+            storage: self.config.storage,
+            entry_size_bytes,
             interval_seconds: self.interval_seconds,
-            entries_per_subgroup: self.entries_per_subgroup,
+            entries_per_subgroup,
+            bytes_per_subgroup,
             total_subgroups,
             estimated_ram_bytes: self.estimated_ram_bytes,
+            used_ram_bytes,
             history_seconds,
+            persistent: self.file.is_some(),
         }
     }
 
+    /// Runs `f` on the ringbuffer of a subgroup given as `"group:subgroup"`.
+    fn with_buffer<T>(&self, subgroup: &str, f: impl FnOnce(&HistoryBuffer) -> T) -> Option<T> {
+        let id = SUBGROUP_REGISTRY.get_by_key(subgroup)?.id;
+        let buffers = self.buffers.read().expect("ringbuffers lock poisoned");
+        buffers.get(id as usize)?.as_ref().map(|b| f(&b.history))
+    }
+
     /// Returns the historical entries for a specific subgroup.
     ///
     /// Returns None if the subgroup doesn't exist.
     pub fn get_subgroup_history(&self, subgroup: &str) -> Option<Vec<RingbufferEntry>> {
-        self.buffers.get(subgroup).map(|rb| rb.get_history())
+        self.with_buffer(subgroup, |rb| rb.get_history())
     }
 
-    /// Returns a reference to the ringbuffer for a specific subgroup.
+    /// Returns a view of the history for a specific subgroup, for scanning
+    /// individual metrics.
     ///
     /// Returns None if the subgroup doesn't exist.
-    /// This allows access to ringbuffer methods like len() and capacity().
-    pub fn get_subgroup_buffer(&self, subgroup: &str) -> Option<dashmap::mapref::one::Ref<'_, String, Ringbuffer>> {
-        self.buffers.get(subgroup)
+    pub fn get_subgroup_view(&self, subgroup: &str) -> Option<SubgroupHistory> {
+        self.with_buffer(subgroup, HistoryBuffer::view)
+    }
+
+    /// Returns the rolling statistics for a specific subgroup.
+    ///
+    /// Constant time regardless of history length. Returns None if the
+    /// subgroup doesn't exist.
+    pub fn get_subgroup_stats(&self, subgroup: &str) -> Option<SubgroupStats> {
+        let id = SUBGROUP_REGISTRY.get_by_key(subgroup)?.id;
+        let buffers = self.buffers.read().expect("ringbuffers lock poisoned");
+        buffers
+            .get(id as usize)?
+            .as_ref()
+            .map(|b| b.stats.snapshot())
+    }
+
+    /// Returns `(len, capacity)` of the ringbuffer for a specific subgroup.
+    ///
+    /// Returns None if the subgroup doesn't exist.
+    pub fn get_subgroup_fill(&self, subgroup: &str) -> Option<(usize, usize)> {
+        self.with_buffer(subgroup, |rb| (rb.len(), rb.capacity()))
     }
 
     /// Returns a list of all known subgroup names.
     pub fn get_all_subgroups(&self) -> Vec<String> {
-        self.buffers
-            .iter()
-            .map(|entry| entry.key().clone())
+        let buffers = self.buffers.read().expect("ringbuffers lock poisoned");
+        SUBGROUP_REGISTRY
+            .entries()
+            .into_iter()
+            .filter(|info| matches!(buffers.get(info.id as usize), Some(Some(_))))
+            .map(|info| info.key.to_string())
             .collect()
     }
 }
@@ -128,6 +517,8 @@ mod tests {
             interval_seconds: 30,
             min_entries_per_subgroup: 10,
             max_entries_per_subgroup: 120,
+            storage: RingbufferStorage::Entries,
+            persist_path: None,
         }
     }
 
@@ -184,10 +575,11 @@ mod tests {
             _padding: [],
         };
 
-        manager.record("test_subgroup", entry);
+        let id = SUBGROUP_REGISTRY.intern("test", "test_subgroup").id;
+        manager.record(id, entry);
 
         // Retrieve it
-        let history = manager.get_subgroup_history("test_subgroup");
+        let history = manager.get_subgroup_history("test:test_subgroup");
         assert!(history.is_some());
 
         let history = history.unwrap();
@@ -213,7 +605,10 @@ mod tests {
                 top_pss: [TopProcessInfo::default(); 3],
                 _padding: [],
             };
-            manager.record(&format!("subgroup_{}", i), entry);
+            let id = SUBGROUP_REGISTRY
+                .intern("test", &format!("subgroup_{}", i))
+                .id;
+            manager.record(id, entry);
         }
 
         let stats = manager.get_stats();
@@ -221,6 +616,8 @@ mod tests {
 
         let subgroups = manager.get_all_subgroups();
         assert_eq!(subgroups.len(), 3);
+        assert!(subgroups.contains(&"test:subgroup_1".to_string()));
+        assert_eq!(manager.get_subgroup_fill("test:subgroup_1"), Some((1, 120)));
     }
 
     #[test]
@@ -228,6 +625,13 @@ mod tests {
         let manager = RingbufferManager::new(default_config(), 10);
         let history = manager.get_subgroup_history("nonexistent");
         assert!(history.is_none());
+
+        // Registered but never recorded
+        SUBGROUP_REGISTRY.intern("test", "never_recorded");
+        assert!(manager
+            .get_subgroup_history("test:never_recorded")
+            .is_none());
+        assert!(manager.get_subgroup_fill("test:never_recorded").is_none());
     }
 
     #[test]
@@ -241,4 +645,182 @@ mod tests {
             stats.entries_per_subgroup as u64 * 30
         );
     }
+
+    #[test]
+    fn test_columnar_storage() {
+        let config = RingbufferConfig {
+            storage: RingbufferStorage::Columnar,
+            max_entries_per_subgroup: 1000,
+            ..default_config()
+        };
+        let manager = RingbufferManager::new(config, 10);
+        let stats = manager.get_stats();
+        assert_eq!(stats.storage, RingbufferStorage::Columnar);
+        assert_eq!(stats.entry_size_bytes, 0);
+        assert_eq!(stats.entries_per_subgroup, 1000);
+        assert_eq!(stats.bytes_per_subgroup, 15 * 1024 * 1024 / 10);
+
+        let id = SUBGROUP_REGISTRY.intern("test", "columnar").id;
+        for i in 0..1200u64 {
+            let entry = RingbufferEntry {
+                timestamp: 1000 + i as i64 * 30,
+                rss_kb: 100 + i,
+                ..Default::default()
+            };
+            manager.record(id, entry);
+        }
+
+        let view = manager.get_subgroup_view("test:columnar").unwrap();
+        assert_eq!(view.len(), 1000);
+        // Oldest remaining entry is number 200
+        assert_eq!(view.value_at(Metric::Rss, 0), Some(300 * 1024));
+        let mut sum = 0;
+        view.for_each(Metric::Rss, 990..1000, &mut |_, v| sum += v / 1024);
+        assert_eq!(sum, (1290..1300).sum::<u64>());
+
+        let history = manager.get_subgroup_history("test:columnar").unwrap();
+        assert_eq!(history.len(), 1000);
+        assert_eq!(history[999].timestamp, 1000 + 1199 * 30);
+
+        let stats = manager.get_subgroup_stats("test:columnar").unwrap();
+        assert_eq!(stats.len, 1000);
+        assert_eq!(stats.get(Metric::Rss).min.bytes, 300 * 1024);
+        assert_eq!(stats.get(Metric::Rss).avg_5min, (1290 + 1299) * 1024 / 2);
+
+        let stats = manager.get_stats();
+        assert!(stats.used_ram_bytes > 0 && stats.used_ram_bytes < 1000 * ENTRY_SIZE_BYTES / 4);
+        assert!(stats.entry_size_bytes > 0 && stats.entry_size_bytes < ENTRY_SIZE_BYTES / 4);
+    }
+
+    #[test]
+    fn test_columnar_byte_budget() {
+        // 1 MB over 128 subgroups leaves 8 KB each, a few blocks of entries
+        let config = RingbufferConfig {
+            storage: RingbufferStorage::Columnar,
+            max_memory_mb: 1,
+            max_entries_per_subgroup: 100_000,
+            ..default_config()
+        };
+        let manager = RingbufferManager::new(config, 128);
+        let id = SUBGROUP_REGISTRY.intern("test", "columnar_budget").id;
+        for i in 0..5000u64 {
+            let entry = RingbufferEntry {
+                timestamp: 1000 + i as i64 * 30,
+                rss_kb: 100 + i * 7,
+                ..Default::default()
+            };
+            manager.record(id, entry);
+        }
+
+        let stats = manager.get_stats();
+        assert!(stats.used_ram_bytes <= stats.bytes_per_subgroup);
+        let (len, _) = manager.get_subgroup_fill("test:columnar_budget").unwrap();
+        assert!(len > 0 && len < 5000, "{} entries", len);
+
+        // Statistics cover exactly what the buffer still holds
+        let subgroup = manager.get_subgroup_stats("test:columnar_budget").unwrap();
+        assert_eq!(subgroup.len, len);
+        let oldest = 100 + (5000 - len as u64) * 7;
+        assert_eq!(subgroup.get(Metric::Rss).min.bytes, oldest * 1024);
+    }
+
+    #[test]
+    fn test_columnar_budget_shared_by_added_subgroups() {
+        // 1 MB over 8 expected subgroups, 128 KB each until more are recorded
+        let config = RingbufferConfig {
+            storage: RingbufferStorage::Columnar,
+            max_memory_mb: 1,
+            max_entries_per_subgroup: 1_000_000,
+            ..default_config()
+        };
+        let max_bytes = 1024 * 1024;
+        let manager = RingbufferManager::new(config, 8);
+        let first = SUBGROUP_REGISTRY.intern("test", "shared_budget_0").id;
+        for i in 0..50_000u64 {
+            let entry = RingbufferEntry {
+                timestamp: 1000 + i as i64 * 30,
+                rss_kb: 100 + i * 7,
+                ..Default::default()
+            };
+            manager.record(first, entry);
+        }
+        let stats = manager.get_stats();
+        assert_eq!(stats.bytes_per_subgroup, max_bytes / 8);
+        assert_eq!(stats.estimated_ram_bytes, max_bytes);
+        let used = stats.used_ram_bytes;
+        assert!(used > max_bytes / 16, "{} bytes", used);
+
+        // Twice the expected subgroups halve every buffer's share
+        for n in 1..16 {
+            let id = SUBGROUP_REGISTRY
+                .intern("test", &format!("shared_budget_{}", n))
+                .id;
+            manager.record(id, RingbufferEntry::default());
+        }
+        let stats = manager.get_stats();
+        assert_eq!(stats.total_subgroups, 16);
+        assert_eq!(stats.bytes_per_subgroup, max_bytes / 16);
+        assert_eq!(stats.estimated_ram_bytes, max_bytes);
+        assert!(stats.used_ram_bytes <= max_bytes);
+
+        // The filled buffer was shrunk to its share, statistics included
+        let buffers = manager.buffers.read().unwrap();
+        let first_used = buffers[first as usize]
+            .as_ref()
+            .unwrap()
+            .history
+            .memory_bytes();
+        drop(buffers);
+        assert!(first_used <= max_bytes / 16, "{} bytes", first_used);
+        let (len, _) = manager.get_subgroup_fill("test:shared_budget_0").unwrap();
+        let subgroup = manager.get_subgroup_stats("test:shared_budget_0").unwrap();
+        assert_eq!(subgroup.len, len);
+    }
+
+    #[test]
+    fn test_persistent_history_survives_restart() {
+        let dir = tempfile::tempdir().unwrap();
+        let config = RingbufferConfig {
+            persist_path: Some(dir.path().join("history.rb")),
+            ..default_config()
+        };
+        let now = chrono::Utc::now().timestamp();
+        let id = SUBGROUP_REGISTRY.intern("test", "persistent").id;
+
+        {
+            let manager = RingbufferManager::new(config.clone(), 10);
+            assert!(manager.get_stats().persistent);
+            for i in 0..5 {
+                let entry = RingbufferEntry {
+                    timestamp: now - 120 + i * 30,
+                    rss_kb: 100 + i as u64,
+                    ..Default::default()
+                };
+                manager.record(id, entry);
+            }
+        }
+
+        let manager = RingbufferManager::new(config.clone(), 10);
+        let history = manager.get_subgroup_history("test:persistent").unwrap();
+        assert_eq!(history.len(), 5);
+        assert_eq!(history[4].rss_kb, 104);
+        // Statistics are rebuilt from the restored entries
+        let stats = manager.get_subgroup_stats("test:persistent").unwrap();
+        assert_eq!(stats.len, 5);
+        assert_eq!(stats.get(Metric::Rss).max.bytes, 104 * 1024);
+        assert_eq!(manager.get_subgroup_fill("test:persistent"), Some((5, 120)));
+        assert!(manager
+            .get_all_subgroups()
+            .contains(&"test:persistent".to_string()));
+
+        // Columnar storage does not support persistence
+        let columnar = RingbufferManager::new(
+            RingbufferConfig {
+                storage: RingbufferStorage::Columnar,
+                ..config
+            },
+            10,
+        );
+        assert!(!columnar.get_stats().persistent);
+    }
 }
@@ -0,0 +1,482 @@
+//! Memory-mapped backing file for persistent ringbuffers.
+//!
+//! With `ringbuffer.persist_path` set, entry ringbuffers live in a shared
+//! file mapping instead of heap vectors, so history survives a restart.
+//! Writes are plain stores into the mapping; the kernel writes dirty pages
+//! back, so recording costs no extra syscalls. A warm start maps the file
+//! and adopts its slots without replaying any entries.
+//!
+//! Layout (native endianness, all offsets 8-byte aligned):
+//!
+//! ```text
+//! FileHeader                        64 bytes
+//! slot 0: SlotHeader                128 bytes
+//!         RingbufferEntry × N       N × 256 bytes
+//! slot 1: ...
+//! ```
+//!
+//! A file is only reused when its version, entry size, entries per subgroup
+//! and interval match the running configuration, its size matches its slot
+//! count, and it was written to within one history window. Anything else is
+//! logged and replaced by an empty file.
+
+use std::fs::{File, OpenOptions};
+use std::io;
+use std::ops::Range;
+use std::os::unix::fs::{FileExt, OpenOptionsExt};
+use std::os::unix::io::AsRawFd;
+use std::path::Path;
+use std::sync::Arc;
+
+use tracing::warn;
+
+use crate::ringbuffer::{
+    chronological, for_each_chronological, HistoryView, Metric, RingbufferEntry, ENTRY_SIZE_BYTES,
+};
+
+const MAGIC: [u8; 8] = *b"HRKLSRB\0";
+const VERSION: u32 = 1;
+
+/// Longest `"group:subgroup"` key a slot can hold, including the NUL.
+const KEY_BYTES: usize = 112;
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct FileHeader {
+    magic: [u8; 8],
+    version: u32,
+    entry_size: u32,
+    entries_per_subgroup: u64,
+    interval_seconds: u64,
+    slot_count: u64,
+    /// Timestamp of the newest entry written to any slot
+    updated_at: i64,
+    _reserved: [u8; 16],
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct SlotHeader {
+    /// NUL-terminated subgroup key; empty for a free slot
+    key: [u8; KEY_BYTES],
+    write_index: u64,
+    count: u64,
+}
+
+const HEADER_BYTES: usize = std::mem::size_of::<FileHeader>();
+const SLOT_HEADER_BYTES: usize = std::mem::size_of::<SlotHeader>();
+
+fn slot_bytes(capacity: usize) -> usize {
+    SLOT_HEADER_BYTES + capacity * ENTRY_SIZE_BYTES
+}
+
+fn file_bytes(slot_count: usize, capacity: usize) -> usize {
+    HEADER_BYTES + slot_count * slot_bytes(capacity)
+}
+
+/// A mapped ringbuffer file, locked against use by a second exporter.
+///
+/// Slot headers and entries are accessed through raw pointers; the
+/// `RingbufferManager` lock serializes writers against readers.
+pub struct RingbufferFile {
+    map: *mut u8,
+    len: usize,
+    slot_count: usize,
+    capacity: usize,
+    // Keeps the flock for the lifetime of the mapping
+    _file: File,
+}
+
+// SAFETY: the mapping is only written through `&mut MappedRingbuffer` or
+// `claim`, both called with the manager's write lock held.
+unsafe impl Send for RingbufferFile {}
+unsafe impl Sync for RingbufferFile {}
+
+impl RingbufferFile {
+    /// Opens or creates the file at `path`.
+    ///
+    /// An existing compatible file keeps its history; an incompatible or
+    /// stale one is reset. `slot_count` applies to new files only. Fails if
+    /// the file cannot be created, mapped or locked.
+    pub fn open(
+        path: &Path,
+        capacity: usize,
+        interval_seconds: u64,
+        slot_count: usize,
+        now: i64,
+    ) -> io::Result<Self> {
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .mode(0o600)
+            .open(path)?;
+
+        if unsafe { libc::flock(file.as_raw_fd(), libc::LOCK_EX | libc::LOCK_NB) } != 0 {
+            let err = io::Error::last_os_error();
+            return Err(io::Error::new(
+                err.kind(),
+                format!("file is locked by another process: {}", err),
+            ));
+        }
+
+        let existing = file.metadata()?.len() as usize;
+        let mut reuse = None;
+        if existing >= HEADER_BYTES {
+            let mut bytes = [0u8; HEADER_BYTES];
+            file.read_exact_at(&mut bytes, 0)?;
+            // SAFETY: FileHeader is plain old data, any bit pattern is valid
+            let header: FileHeader = unsafe { std::ptr::read_unaligned(bytes.as_ptr().cast()) };
+            match validate(&header, existing, capacity, interval_seconds, now) {
+                Ok(slots) => reuse = Some(slots),
+                Err(reason) => warn!("Discarding ringbuffer file {}: {}", path.display(), reason),
+            }
+        } else if existing > 0 {
+            warn!(
+                "Discarding ringbuffer file {}: truncated header",
+                path.display()
+            );
+        }
+
+        let slot_count = reuse.unwrap_or(slot_count.max(1));
+        let len = file_bytes(slot_count, capacity);
+        if reuse.is_none() {
+            // Drop the old contents so every slot starts zeroed (free)
+            file.set_len(0)?;
+            file.set_len(len as u64)?;
+        }
+
+        let map = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if map == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+
+        let mapped = Self {
+            map: map.cast(),
+            len,
+            slot_count,
+            capacity,
+            _file: file,
+        };
+
+        if reuse.is_none() {
+            // SAFETY: the mapping is at least HEADER_BYTES long and page aligned
+            unsafe {
+                mapped.header().write(FileHeader {
+                    magic: MAGIC,
+                    version: VERSION,
+                    entry_size: ENTRY_SIZE_BYTES as u32,
+                    entries_per_subgroup: capacity as u64,
+                    interval_seconds,
+                    slot_count: slot_count as u64,
+                    updated_at: now,
+                    _reserved: [0; 16],
+                });
+            }
+        } else {
+            // Free slots whose indices are out of range rather than trust them
+            for slot in 0..slot_count {
+                let header = mapped.slot_header(slot);
+                unsafe {
+                    if (*header).write_index as usize >= capacity
+                        || (*header).count as usize > capacity
+                    {
+                        header.write(SlotHeader {
+                            key: [0; KEY_BYTES],
+                            write_index: 0,
+                            count: 0,
+                        });
+                    }
+                }
+            }
+        }
+
+        Ok(mapped)
+    }
+
+    fn header(&self) -> *mut FileHeader {
+        self.map.cast()
+    }
+
+    fn slot_header(&self, slot: usize) -> *mut SlotHeader {
+        debug_assert!(slot < self.slot_count);
+        unsafe {
+            self.map
+                .add(HEADER_BYTES + slot * slot_bytes(self.capacity))
+                .cast()
+        }
+    }
+
+    fn slot_key(&self, slot: usize) -> Option<String> {
+        let key = unsafe { (*self.slot_header(slot)).key };
+        let len = key.iter().position(|&b| b == 0).unwrap_or(KEY_BYTES);
+        if len == 0 {
+            return None;
+        }
+        std::str::from_utf8(&key[..len]).ok().map(str::to_string)
+    }
+
+    /// Returns the key of every slot in use, with its slot index.
+    pub fn used_slots(&self) -> Vec<(usize, String)> {
+        (0..self.slot_count)
+            .filter_map(|slot| self.slot_key(slot).map(|key| (slot, key)))
+            .collect()
+    }
+
+    /// Claims a free slot for `key`, or None if the file is full or the key
+    /// is too long to store.
+    ///
+    /// Must be called with the manager's write lock held.
+    pub fn claim(&self, key: &str) -> Option<usize> {
+        if key.is_empty() || key.len() >= KEY_BYTES {
+            return None;
+        }
+        let slot = (0..self.slot_count).find(|&slot| self.slot_key(slot).is_none())?;
+        let mut bytes = [0u8; KEY_BYTES];
+        bytes[..key.len()].copy_from_slice(key.as_bytes());
+        unsafe {
+            self.slot_header(slot).write(SlotHeader {
+                key: bytes,
+                write_index: 0,
+                count: 0,
+            });
+        }
+        Some(slot)
+    }
+
+    /// Returns the ringbuffer stored in `slot`.
+    pub fn ringbuffer(self: &Arc<Self>, slot: usize) -> MappedRingbuffer {
+        let header = self.slot_header(slot);
+        MappedRingbuffer {
+            file: Arc::clone(self),
+            header,
+            // SAFETY: entries follow the slot header inside the mapping
+            entries: unsafe { header.cast::<u8>().add(SLOT_HEADER_BYTES).cast() },
+        }
+    }
+}
+
+impl Drop for RingbufferFile {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.map.cast(), self.len);
+        }
+    }
+}
+
+fn validate(
+    header: &FileHeader,
+    file_len: usize,
+    capacity: usize,
+    interval_seconds: u64,
+    now: i64,
+) -> Result<usize, String> {
+    if header.magic != MAGIC {
+        return Err("not a ringbuffer file".to_string());
+    }
+    if header.version != VERSION || header.entry_size as usize != ENTRY_SIZE_BYTES {
+        return Err(format!(
+            "format version {} with {}-byte entries, expected version {} with {}-byte entries",
+            header.version, header.entry_size, VERSION, ENTRY_SIZE_BYTES
+        ));
+    }
+    if header.entries_per_subgroup as usize != capacity
+        || header.interval_seconds != interval_seconds
+    {
+        return Err(format!(
+            "written with {} entries every {}s, configured for {} entries every {}s",
+            header.entries_per_subgroup, header.interval_seconds, capacity, interval_seconds
+        ));
+    }
+    let slot_count = header.slot_count as usize;
+    if slot_count == 0 || file_bytes(slot_count, capacity) != file_len {
+        return Err(format!(
+            "size {} does not match {} slots",
+            file_len, slot_count
+        ));
+    }
+    let window = capacity as i64 * interval_seconds as i64;
+    let age = now.saturating_sub(header.updated_at);
+    if age > window {
+        return Err(format!(
+            "stale, last written {}s ago (history window {}s)",
+            age, window
+        ));
+    }
+    Ok(slot_count)
+}
+
+/// One subgroup's ringbuffer inside a [`RingbufferFile`].
+pub struct MappedRingbuffer {
+    file: Arc<RingbufferFile>,
+    header: *mut SlotHeader,
+    entries: *mut RingbufferEntry,
+}
+
+// SAFETY: see RingbufferFile; the pointers stay valid while `file` is alive.
+unsafe impl Send for MappedRingbuffer {}
+unsafe impl Sync for MappedRingbuffer {}
+
+impl MappedRingbuffer {
+    fn entries(&self) -> &[RingbufferEntry] {
+        unsafe { std::slice::from_raw_parts(self.entries, self.file.capacity) }
+    }
+
+    /// Pushes a new entry, overwriting the oldest one when full.
+    pub fn push(&mut self, entry: RingbufferEntry) {
+        let capacity = self.file.capacity;
+        unsafe {
+            let header = &mut *self.header;
+            self.entries.add(header.write_index as usize).write(entry);
+            header.write_index = (header.write_index + 1) % capacity as u64;
+            if (header.count as usize) < capacity {
+                header.count += 1;
+            }
+            (*self.file.header()).updated_at = entry.timestamp;
+        }
+    }
+
+    /// Returns all entries in chronological order (oldest to newest).
+    pub fn get_history(&self) -> Vec<RingbufferEntry> {
+        let (write_index, count) = unsafe { ((*self.header).write_index, (*self.header).count) };
+        chronological(self.entries(), write_index as usize, count as usize)
+    }
+
+    /// Returns the current number of entries in the buffer.
+    pub fn len(&self) -> usize {
+        unsafe { (*self.header).count as usize }
+    }
+
+    /// Returns the maximum capacity of the buffer.
+    pub fn capacity(&self) -> usize {
+        self.file.capacity
+    }
+
+    /// Returns true if the buffer is empty.
+    #[allow(dead_code)]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+}
+
+impl HistoryView for MappedRingbuffer {
+    fn len(&self) -> usize {
+        MappedRingbuffer::len(self)
+    }
+
+    fn for_each(&self, metric: Metric, range: Range<usize>, f: &mut dyn FnMut(i64, u64)) {
+        let write_index = unsafe { (*self.header).write_index };
+        for_each_chronological(
+            self.entries(),
+            write_index as usize,
+            self.len(),
+            metric,
+            range,
+            f,
+        );
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const NOW: i64 = 1_700_000_000;
+
+    fn entry(timestamp: i64, rss_kb: u64) -> RingbufferEntry {
+        RingbufferEntry {
+            timestamp,
+            rss_kb,
+            ..Default::default()
+        }
+    }
+
+    #[test]
+    fn test_layout_sizes() {
+        assert_eq!(HEADER_BYTES, 64);
+        assert_eq!(SLOT_HEADER_BYTES, 128);
+    }
+
+    #[test]
+    fn test_warm_restart_restores_slots() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("history.rb");
+
+        {
+            let file = Arc::new(RingbufferFile::open(&path, 4, 30, 8, NOW).unwrap());
+            assert!(file.used_slots().is_empty());
+            let slot = file.claim("db:postgres").unwrap();
+            let mut rb = file.ringbuffer(slot);
+            for i in 0..6 {
+                rb.push(entry(NOW + i * 30, 100 + i as u64));
+            }
+            assert_eq!(rb.len(), 4);
+        }
+
+        let file = Arc::new(RingbufferFile::open(&path, 4, 30, 8, NOW + 200).unwrap());
+        assert_eq!(file.used_slots(), vec![(0, "db:postgres".to_string())]);
+        let rb = file.ringbuffer(0);
+        let history = rb.get_history();
+        let rss: Vec<u64> = history.iter().map(|e| e.rss_kb).collect();
+        assert_eq!(rss, vec![102, 103, 104, 105]);
+        assert_eq!(rb.capacity(), 4);
+    }
+
+    #[test]
+    fn test_incompatible_and_stale_files_are_reset() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("history.rb");
+
+        let seed = |now: i64| {
+            let file = Arc::new(RingbufferFile::open(&path, 4, 30, 2, now).unwrap());
+            let slot = file.claim("web:nginx").unwrap();
+            file.ringbuffer(slot).push(entry(now, 1));
+        };
+
+        // Different interval
+        seed(NOW);
+        let file = RingbufferFile::open(&path, 4, 60, 2, NOW).unwrap();
+        assert!(file.used_slots().is_empty());
+        drop(file);
+
+        // Older than one history window (4 × 30s)
+        std::fs::remove_file(&path).unwrap();
+        seed(NOW);
+        let file = RingbufferFile::open(&path, 4, 30, 2, NOW + 121).unwrap();
+        assert!(file.used_slots().is_empty());
+        drop(file);
+
+        // Not a ringbuffer file at all
+        std::fs::write(&path, vec![0xAB; 1000]).unwrap();
+        let file = RingbufferFile::open(&path, 4, 30, 2, NOW).unwrap();
+        assert!(file.used_slots().is_empty());
+        assert_eq!(
+            std::fs::metadata(&path).unwrap().len() as usize,
+            file_bytes(2, 4)
+        );
+    }
+
+    #[test]
+    fn test_second_open_is_rejected_and_slots_run_out() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("history.rb");
+
+        let file = RingbufferFile::open(&path, 4, 30, 2, NOW).unwrap();
+        assert!(RingbufferFile::open(&path, 4, 30, 2, NOW).is_err());
+
+        assert_eq!(file.claim("a:one"), Some(0));
+        assert_eq!(file.claim("a:two"), Some(1));
+        assert_eq!(file.claim("a:three"), None);
+        assert_eq!(file.claim(&"x".repeat(KEY_BYTES)), None);
+    }
+}
@@ -0,0 +1,391 @@
+//! Rolling per-subgroup statistics, updated as entries are recorded.
+//!
+//! `RingbufferManager::record` feeds every entry into the subgroup's
+//! [`RollingStats`] before pushing it into the ringbuffer. Each update is
+//! O(1) amortized: windowed sums subtract the sample leaving the window,
+//! which is read back from the buffer itself, and min/max are kept in
+//! monotonic deques. `/details` reads a [`SubgroupStats`] snapshot instead of
+//! rescanning the history on every request.
+//!
+//! Windows are counted in samples of `interval_seconds`, as the history
+//! scans they replace did, and never extend past the buffer's capacity.
+
+use std::collections::VecDeque;
+
+use crate::ringbuffer::{HistoryView, Metric, RingbufferEntry};
+
+/// Short window, used as the baseline for young processes.
+const SHORT_WINDOW_SECONDS: u64 = 300;
+/// Long window, used for the average and the growth slope.
+const LONG_WINDOW_SECONDS: u64 = 3600;
+
+const METRICS: [Metric; 3] = [Metric::Rss, Metric::Pss, Metric::Uss];
+
+/// A metric value and the timestamp of the entry it was recorded in.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct TimedValue {
+    pub timestamp: i64,
+    pub bytes: u64,
+}
+
+/// Statistics of one metric over a subgroup's history, in bytes.
+#[derive(Debug, Clone, Copy, PartialEq, Default)]
+pub struct MetricStats {
+    /// Mean of the last 5 minutes of entries
+    pub avg_5min: u64,
+    /// Mean of the last hour of entries
+    pub avg_1h: u64,
+    /// Mean of the whole history
+    pub avg: u64,
+    /// Smallest value in the history; the oldest one wins ties
+    pub min: TimedValue,
+    /// Largest value in the history; the oldest one wins ties
+    pub max: TimedValue,
+    /// Exponentially weighted moving average with a 5-minute span
+    pub ewma: f64,
+    /// Least-squares slope over the last hour in bytes/sec, once a full hour
+    /// of entries has been recorded
+    pub slope_1h: Option<f64>,
+}
+
+/// Point-in-time statistics of one subgroup.
+#[derive(Debug, Clone, Copy, PartialEq, Default)]
+pub struct SubgroupStats {
+    /// Number of entries in the history
+    pub len: usize,
+    metrics: [MetricStats; 3],
+}
+
+impl SubgroupStats {
+    pub fn get(&self, metric: Metric) -> &MetricStats {
+        &self.metrics[metric as usize]
+    }
+}
+
+#[derive(Clone, Copy)]
+struct Sample {
+    seq: u64,
+    timestamp: i64,
+    kb: u64,
+}
+
+#[derive(Default)]
+struct MetricState {
+    /// Sums of the values in KB over the whole history and each window
+    total: u64,
+    short: u64,
+    long: u64,
+    /// Σ seq × value over the long window, for the regression
+    long_weighted: i128,
+    /// Increasing values from the oldest minimum; decreasing for `max`
+    min: VecDeque<Sample>,
+    max: VecDeque<Sample>,
+    ewma: f64,
+}
+
+/// Incrementally maintained statistics for one subgroup's ringbuffer.
+pub struct RollingStats {
+    capacity: usize,
+    interval_seconds: u64,
+    short_len: usize,
+    long_len: usize,
+    /// Entries covering an hour, before clamping to the capacity
+    hour_len: usize,
+    alpha: f64,
+    /// Sequence number of the next entry
+    seq: u64,
+    len: usize,
+    metrics: [MetricState; 3],
+}
+
+impl RollingStats {
+    /// Creates empty statistics for a buffer of `capacity` entries recorded
+    /// every `interval_seconds`.
+    pub fn new(capacity: usize, interval_seconds: u64) -> Self {
+        let interval = interval_seconds.max(1);
+        let capacity = capacity.max(1);
+        let short_len = (SHORT_WINDOW_SECONDS / interval).max(1) as usize;
+        let hour_len = (LONG_WINDOW_SECONDS / interval).max(1) as usize;
+        Self {
+            capacity,
+            interval_seconds: interval,
+            short_len: short_len.min(capacity),
+            long_len: hour_len.min(capacity),
+            hour_len,
+            alpha: 2.0 / (short_len as f64 + 1.0),
+            seq: 0,
+            len: 0,
+            metrics: Default::default(),
+        }
+    }
+
+    /// Rebuilds the statistics of an existing history, oldest entry first.
+    ///
+    /// The EWMA starts over from the oldest entry; everything else matches
+    /// statistics maintained since the first record.
+    pub fn from_history(history: &dyn HistoryView, capacity: usize, interval_seconds: u64) -> Self {
+        let mut stats = Self::new(capacity, interval_seconds);
+        let mut columns: [Vec<(i64, u64)>; 3] = Default::default();
+        for (metric, column) in METRICS.iter().zip(columns.iter_mut()) {
+            history.for_each(*metric, 0..history.len(), &mut |timestamp, bytes| {
+                column.push((timestamp, bytes / 1024));
+            });
+        }
+        for i in 0..history.len() {
+            let timestamp = columns[0][i].0;
+            let kb = [columns[0][i].1, columns[1][i].1, columns[2][i].1];
+            // Entries before `i` that are still within the capacity
+            let start = i - stats.len;
+            stats.push_values(timestamp, kb, |m, index| columns[m][start + index].1);
+        }
+        stats
+    }
+
+    /// Adds `entry`, given the buffer's history before it is pushed.
+    ///
+    /// Reads back at most one entry per window from `history`: the one the
+    /// new entry pushes out of it.
+    pub fn push(&mut self, entry: &RingbufferEntry, history: &dyn HistoryView) {
+        let kb = [entry.rss_kb, entry.pss_kb, entry.uss_kb];
+        self.push_values(entry.timestamp, kb, |m, index| {
+            history.value_at(METRICS[m], index).unwrap_or(0) / 1024
+        });
+    }
+
+    /// `leaving(metric, index)` returns the value in KB of history entry
+    /// `index`, counted from the oldest one.
+    fn push_values(&mut self, timestamp: i64, kb: [u64; 3], leaving: impl Fn(usize, usize) -> u64) {
+        let seq = self.seq;
+        let before = self.len;
+        // Sequence number of history entry `index`
+        let seq_of = |index: usize| seq - (before - index) as u64;
+
+        for (m, state) in self.metrics.iter_mut().enumerate() {
+            let value = kb[m];
+
+            if before >= self.capacity {
+                state.total -= leaving(m, before - self.capacity);
+            }
+            if before >= self.short_len {
+                state.short -= leaving(m, before - self.short_len);
+            }
+            if before >= self.long_len {
+                let index = before - self.long_len;
+                let old = leaving(m, index);
+                state.long -= old;
+                state.long_weighted -= seq_of(index) as i128 * old as i128;
+            }
+            state.total += value;
+            state.short += value;
+            state.long += value;
+            state.long_weighted += seq as i128 * value as i128;
+
+            let sample = Sample {
+                seq,
+                timestamp,
+                kb: value,
+            };
+            // Keep equal older values so the oldest extreme is reported
+            while state.min.back().is_some_and(|s| s.kb > value) {
+                state.min.pop_back();
+            }
+            state.min.push_back(sample);
+            while state.max.back().is_some_and(|s| s.kb < value) {
+                state.max.pop_back();
+            }
+            state.max.push_back(sample);
+            let oldest = (seq + 1).saturating_sub(self.capacity as u64);
+            for deque in [&mut state.min, &mut state.max] {
+                while deque.front().is_some_and(|s| s.seq < oldest) {
+                    deque.pop_front();
+                }
+            }
+
+            state.ewma = if before == 0 {
+                value as f64
+            } else {
+                state.ewma + self.alpha * (value as f64 - state.ewma)
+            };
+        }
+
+        self.seq += 1;
+        self.len = (before + 1).min(self.capacity);
+    }
+
+    /// Returns the number of entries the statistics cover.
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Returns the current statistics; all zero while the history is empty.
+    pub fn snapshot(&self) -> SubgroupStats {
+        if self.len == 0 {
+            return SubgroupStats::default();
+        }
+        let short = self.len.min(self.short_len) as u64;
+        let long = self.len.min(self.long_len);
+        let timed = |s: &Sample| TimedValue {
+            timestamp: s.timestamp,
+            bytes: s.kb * 1024,
+        };
+
+        let metrics = std::array::from_fn(|m| {
+            let state = &self.metrics[m];
+            MetricStats {
+                avg_5min: state.short * 1024 / short,
+                avg_1h: state.long * 1024 / long as u64,
+                avg: state.total * 1024 / self.len as u64,
+                min: state.min.front().map(timed).unwrap_or_default(),
+                max: state.max.front().map(timed).unwrap_or_default(),
+                ewma: state.ewma * 1024.0,
+                slope_1h: self.slope(state, long),
+            }
+        });
+
+        SubgroupStats {
+            len: self.len,
+            metrics,
+        }
+    }
+
+    /// Least-squares slope of the long window in bytes/sec, with the entry
+    /// sequence number as x.
+    fn slope(&self, state: &MetricState, n: usize) -> Option<f64> {
+        if self.len < self.hour_len || n < 2 {
+            return None;
+        }
+        let n = n as i128;
+        let first = self.seq as i128 - n;
+        let sum_x = n * first + n * (n - 1) / 2;
+        // n·Σ(x - x̄)² for n consecutive integers
+        let denominator = n * n * (n * n - 1) / 12;
+        let numerator = n * state.long_weighted - sum_x * state.long as i128;
+        let kb_per_entry = numerator as f64 / denominator as f64;
+        Some(kb_per_entry * 1024.0 / self.interval_seconds as f64)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ringbuffer::Ringbuffer;
+
+    fn entry(i: i64, rss_kb: u64) -> RingbufferEntry {
+        RingbufferEntry {
+            timestamp: 1000 + i * 30,
+            rss_kb,
+            pss_kb: rss_kb / 2,
+            uss_kb: 7,
+            ..Default::default()
+        }
+    }
+
+    /// The same statistics computed by scanning the history.
+    fn scanned(history: &[RingbufferEntry], interval: u64, metric: Metric) -> MetricStats {
+        let values: Vec<(i64, u64)> = history
+            .iter()
+            .map(|e| (e.timestamp, metric.bytes(e)))
+            .collect();
+        let mean =
+            |window: &[(i64, u64)]| window.iter().map(|v| v.1).sum::<u64>() / window.len() as u64;
+        let tail = |n: usize| &values[values.len() - n.min(values.len())..];
+        let short = (300 / interval) as usize;
+        let hour = (3600 / interval) as usize;
+
+        let mut min = values[0];
+        let mut max = values[0];
+        for &v in &values {
+            if v.1 < min.1 {
+                min = v;
+            }
+            if v.1 > max.1 {
+                max = v;
+            }
+        }
+
+        MetricStats {
+            avg_5min: mean(tail(short)),
+            avg_1h: mean(tail(hour)),
+            avg: mean(&values),
+            min: TimedValue {
+                timestamp: min.0,
+                bytes: min.1,
+            },
+            max: TimedValue {
+                timestamp: max.0,
+                bytes: max.1,
+            },
+            ewma: 0.0,
+            slope_1h: None,
+        }
+    }
+
+    #[test]
+    fn test_matches_history_scan_through_wraparound() {
+        let capacity = 150;
+        let mut rb = Ringbuffer::new(capacity);
+        let mut stats = RollingStats::new(capacity, 30);
+
+        for i in 0..400i64 {
+            // Noisy values with repeated extremes
+            let e = entry(i, 1000 + ((i * 7919) % 500) as u64);
+            stats.push(&e, &rb);
+            rb.push(e);
+
+            let history = rb.get_history();
+            let snapshot = stats.snapshot();
+            assert_eq!(snapshot.len, history.len());
+            for metric in METRICS {
+                let want = scanned(&history, 30, metric);
+                let got = snapshot.get(metric);
+                assert_eq!(got.avg_5min, want.avg_5min, "{} {:?}", i, metric);
+                assert_eq!(got.avg_1h, want.avg_1h, "{} {:?}", i, metric);
+                assert_eq!(got.avg, want.avg, "{} {:?}", i, metric);
+                assert_eq!(got.min, want.min, "{} {:?}", i, metric);
+                assert_eq!(got.max, want.max, "{} {:?}", i, metric);
+            }
+        }
+
+        // Everything but the EWMA, which restarts at the oldest kept entry
+        let rebuilt = RollingStats::from_history(&rb, capacity, 30).snapshot();
+        for metric in METRICS {
+            let (got, want) = (rebuilt.get(metric), *stats.snapshot().get(metric));
+            assert_eq!(
+                (got.avg_5min, got.avg, got.min, got.max),
+                (want.avg_5min, want.avg, want.min, want.max)
+            );
+            assert_eq!(got.slope_1h, want.slope_1h);
+        }
+    }
+
+    #[test]
+    fn test_slope_and_ewma() {
+        let mut rb = Ringbuffer::new(200);
+        let mut stats = RollingStats::new(200, 30);
+        for i in 0..150i64 {
+            // Steady, then 3 KB per 30s entry for the last hour and more
+            let rss_kb = if i < 25 {
+                5000
+            } else {
+                5000 + (i as u64 - 25) * 3
+            };
+            let e = entry(i, rss_kb);
+            stats.push(&e, &rb);
+            rb.push(e);
+            if i == 118 {
+                assert_eq!(stats.snapshot().get(Metric::Rss).slope_1h, None);
+            }
+        }
+
+        let rss = *stats.snapshot().get(Metric::Rss);
+        let slope = rss.slope_1h.unwrap();
+        assert!((slope - 3.0 * 1024.0 / 30.0).abs() < 1e-6, "{}", slope);
+        assert_eq!(stats.snapshot().get(Metric::Uss).slope_1h, Some(0.0));
+
+        // The EWMA trails a rising series, but by less than the 1h mean
+        let last = (5000 + 124 * 3) * 1024;
+        assert!(rss.ewma < last as f64);
+        assert!(rss.ewma > rss.avg_1h as f64);
+        assert_eq!(RollingStats::new(10, 30).snapshot().len, 0);
+    }
+}
@@ -0,0 +1,655 @@
+//! Background scheduler for the process scan and the system collectors.
+//!
+//! Every collector runs in its own task on its own interval. System
+//! collectors read their sources on the blocking pool and publish the result
+//! into the shared [`SystemSnapshot`]; the process collector refreshes the
+//! metrics cache. The /metrics handler only copies published values into the
+//! registry, so a scrape never waits on `/proc` or `/sys`.
+//!
+//! A run that takes longer than its budget is counted as an overrun in
+//! `HealthStats`. It is not cancelled: the next run is scheduled from its
+//! completion, so runs of one collector never overlap. Intervals are spread
+//! by a random jitter so that collectors started together drift apart.
+
+use rand::Rng;
+use std::collections::HashMap;
+use std::sync::{Arc, Mutex as StdMutex};
+use std::time::{Duration, Instant};
+use tracing::{debug, error, info, warn};
+
+use crate::collectors::{
+    self,
+    cgroup::CgroupStats,
+    diskstats::{DiskStats, DiskstatsReader},
+    filesystem::FilesystemStats,
+    netdev::{NetDevStats, NetdevReader},
+    DeviceTable,
+};
+use crate::config::{
+    Config, DEFAULT_CACHE_TTL, DEFAULT_CGROUP_ROOT, DEFAULT_FILESYSTEM_TIMEOUT_MS,
+};
+use crate::health_stats::CollectorStats;
+use crate::procfs::ProcFile;
+use crate::state::{AppState, SharedState};
+use crate::system::{self, CpuRatios, ExtendedMemoryInfo, LoadAverage};
+
+/// Jitter applied when a collector sets none.
+pub const DEFAULT_JITTER_PERCENT: u8 = 10;
+
+/// Largest accepted jitter; larger spreads could schedule back-to-back runs.
+pub const MAX_JITTER_PERCENT: u8 = 50;
+
+/// A background collector, addressed by [`Collector::name`] in the
+/// `collectors` configuration section.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Collector {
+    /// Process scan into the metrics cache
+    Processes,
+    /// `/proc/stat` (CPU usage ratios, boot time, context switches and
+    /// forks) and load averages
+    Cpu,
+    /// `/proc/meminfo`
+    Memory,
+    /// Uptime, uname, file descriptors and entropy
+    Stat,
+    /// Pressure stall information
+    Psi,
+    /// `/proc/net/dev`
+    Netdev,
+    /// `/proc/diskstats`
+    Diskstats,
+    /// Mounted filesystem usage
+    Filesystem,
+    /// Thermal zones and hwmon sensors
+    Thermal,
+    /// cgroup v2 usage of the cgroups found by the process scan
+    Cgroups,
+    /// eBPF maps
+    Ebpf,
+}
+
+impl Collector {
+    pub const ALL: [Collector; 11] = [
+        Collector::Processes,
+        Collector::Cpu,
+        Collector::Memory,
+        Collector::Stat,
+        Collector::Psi,
+        Collector::Netdev,
+        Collector::Diskstats,
+        Collector::Filesystem,
+        Collector::Thermal,
+        Collector::Cgroups,
+        Collector::Ebpf,
+    ];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Collector::Processes => "processes",
+            Collector::Cpu => "cpu",
+            Collector::Memory => "memory",
+            Collector::Stat => "stat",
+            Collector::Psi => "psi",
+            Collector::Netdev => "netdev",
+            Collector::Diskstats => "diskstats",
+            Collector::Filesystem => "filesystem",
+            Collector::Thermal => "thermal",
+            Collector::Cgroups => "cgroups",
+            Collector::Ebpf => "ebpf",
+        }
+    }
+
+    pub fn from_name(name: &str) -> Option<Self> {
+        Self::ALL.into_iter().find(|c| c.name() == name)
+    }
+
+    /// Default interval; the process scan follows `cache_ttl`.
+    fn default_interval_seconds(self, cfg: &Config) -> u64 {
+        match self {
+            Collector::Processes => cfg.cache_ttl.unwrap_or(DEFAULT_CACHE_TTL),
+            Collector::Filesystem => 30,
+            Collector::Thermal => 15,
+            _ => 5,
+        }
+    }
+
+    fn default_budget_ms(self) -> u64 {
+        match self {
+            Collector::Processes => 10_000,
+            Collector::Filesystem => 1_000,
+            Collector::Cgroups | Collector::Ebpf => 500,
+            _ => 100,
+        }
+    }
+
+    /// Whether the collector is enabled by its feature flag.
+    fn enabled(self, state: &AppState) -> bool {
+        let cfg = &state.config;
+        match self {
+            Collector::Psi => cfg.enable_psi_collector.unwrap_or(true),
+            Collector::Filesystem => cfg.enable_filesystem_collector.unwrap_or(true),
+            Collector::Thermal => cfg.enable_thermal_collector.unwrap_or(true),
+            Collector::Cgroups => cfg.enable_cgroups.unwrap_or(false),
+            Collector::Ebpf => cfg!(feature = "ebpf") && state.ebpf.is_some(),
+            _ => true,
+        }
+    }
+}
+
+/// Effective timing of one collector.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Schedule {
+    pub interval: Duration,
+    pub budget: Duration,
+    pub jitter_percent: u8,
+}
+
+impl Schedule {
+    /// Applies the overrides of `cfg.collectors` to the collector's defaults.
+    pub fn resolve(collector: Collector, cfg: &Config) -> Self {
+        let overrides = cfg.collectors.get(collector.name());
+        let interval_seconds = overrides
+            .and_then(|o| o.interval_seconds)
+            .unwrap_or_else(|| collector.default_interval_seconds(cfg));
+        let budget_ms = overrides
+            .and_then(|o| o.budget_ms)
+            .unwrap_or_else(|| collector.default_budget_ms());
+        let jitter_percent = overrides
+            .and_then(|o| o.jitter_percent)
+            .unwrap_or(DEFAULT_JITTER_PERCENT)
+            .min(MAX_JITTER_PERCENT);
+        Self {
+            interval: Duration::from_secs(interval_seconds.max(1)),
+            budget: Duration::from_millis(budget_ms.max(1)),
+            jitter_percent,
+        }
+    }
+
+    /// Delay before the next run: the interval, moved by up to
+    /// `jitter_percent` in either direction.
+    fn next_delay(&self, rng: &mut impl Rng) -> Duration {
+        let interval = self.interval.as_secs_f64();
+        let spread = interval * f64::from(self.jitter_percent) / 100.0;
+        if spread <= 0.0 {
+            return self.interval;
+        }
+        Duration::from_secs_f64(interval + rng.gen_range(-spread..=spread))
+    }
+}
+
+/// Shortest interval of the enabled system collectors, the most often the
+/// snapshot can change. Renders taken within it are not redone for new
+/// publications (see `RenderedMetrics::is_fresh`).
+pub fn shortest_system_interval(state: &AppState) -> Duration {
+    Collector::ALL
+        .into_iter()
+        .filter(|&c| c != Collector::Processes && c.enabled(state))
+        .map(|c| Schedule::resolve(c, &state.config).interval)
+        .min()
+        .unwrap_or_default()
+}
+
+/// Latest values published by the system collectors.
+///
+/// A field stays `None` until its collector first succeeds; a failed read
+/// keeps the previously published value.
+#[derive(Default)]
+pub struct SystemSnapshot {
+    /// Number of collector runs that published new values, so renders can
+    /// tell whether anything changed since they were taken. Runs whose
+    /// reads all failed leave it unchanged.
+    pub generation: u64,
+    pub cpu_ratios: Option<CpuRatios>,
+    pub load_average: Option<LoadAverage>,
+    pub memory: Option<ExtendedMemoryInfo>,
+    pub uptime_seconds: Option<f64>,
+    /// Boot time, context switches and forks
+    pub stat_counters: Option<(u64, u64, u64)>,
+    /// sysname, release, version and machine
+    pub uname: Option<(String, String, String, String)>,
+    /// Allocated, unused and maximum file descriptors
+    pub fd_stats: Option<(u64, u64, u64)>,
+    pub entropy_bits: Option<u64>,
+    pub psi_cpu_seconds: Option<f64>,
+    pub psi_memory_seconds: Option<f64>,
+    pub psi_io_seconds: Option<f64>,
+    pub diskstats: Option<DeviceTable<DiskStats>>,
+    pub netdev: Option<DeviceTable<NetDevStats>>,
+    pub filesystems: Option<Vec<FilesystemStats>>,
+    pub temperatures: Option<HashMap<String, f64>>,
+    pub cgroups: Option<Vec<CgroupStats>>,
+    #[cfg(feature = "ebpf")]
+    pub ebpf_net: Option<Vec<crate::ebpf::ProcessNetStats>>,
+    #[cfg(feature = "ebpf")]
+    pub ebpf_blkio: Option<Vec<crate::ebpf::ProcessBlkioStats>>,
+    #[cfg(feature = "ebpf")]
+    pub ebpf_tcp: Option<crate::ebpf::TcpStats>,
+    #[cfg(feature = "ebpf")]
+    pub ebpf_perf: Option<crate::ebpf::EbpfPerfStats>,
+    #[cfg(feature = "ebpf")]
+    pub ebpf_io_histograms: Option<Vec<crate::ebpf::SubgroupIoHistograms>>,
+    #[cfg(feature = "ebpf")]
+    pub ebpf_cgroup_io: Option<Vec<crate::ebpf::CgroupIoStats>>,
+}
+
+impl SystemSnapshot {
+    /// Ends a collector run, advancing the generation if it `published`.
+    fn advance(&mut self, published: bool) {
+        if published {
+            self.generation += 1;
+        }
+    }
+}
+
+/// Files kept open by the system collectors between runs.
+///
+/// One lock per collector, so collectors never wait on each other.
+pub struct SystemReaders {
+    pub meminfo: StdMutex<ProcFile>,
+    pub diskstats: StdMutex<DiskstatsReader>,
+    pub netdev: StdMutex<NetdevReader>,
+}
+
+impl Default for SystemReaders {
+    fn default() -> Self {
+        Self {
+            meminfo: StdMutex::new(ProcFile::new("/proc/meminfo")),
+            diskstats: StdMutex::new(DiskstatsReader::default()),
+            netdev: StdMutex::new(NetdevReader::default()),
+        }
+    }
+}
+
+/// Stores a successful read in `slot`, or logs the failure and keeps the
+/// previous value. Returns whether `slot` was updated.
+fn publish<T>(slot: &mut Option<T>, result: Result<T, String>, what: &str) -> bool {
+    match result {
+        Ok(value) => {
+            *slot = Some(value);
+            true
+        }
+        Err(e) => {
+            warn!("Failed to read {}: {}", what, e);
+            false
+        }
+    }
+}
+
+/// Publishes the single read of a collector into the field `slot` selects.
+fn publish_one<T>(
+    state: &AppState,
+    result: Result<T, String>,
+    what: &str,
+    slot: impl FnOnce(&mut SystemSnapshot) -> &mut Option<T>,
+) {
+    let mut snapshot = lock_snapshot(state);
+    let published = publish(slot(&mut *snapshot), result, what);
+    snapshot.advance(published);
+}
+
+/// Runs one system collection and publishes it. Blocks on I/O.
+fn collect_system(collector: Collector, state: &AppState) {
+    // Sources are read before the snapshot lock is taken, so renders only
+    // ever wait for the publication itself
+    match collector {
+        Collector::Processes => unreachable!("the process scan is async"),
+        Collector::Cpu => {
+            // One /proc/stat read feeds the ratios and the counters
+            let sample = state.system_cpu_cache.sample();
+            let load = system::read_load_average();
+            let mut snapshot = lock_snapshot(state);
+            let mut published = match sample {
+                Ok((stat, ratios)) => {
+                    if ratios.is_some() {
+                        snapshot.cpu_ratios = ratios;
+                    }
+                    snapshot.stat_counters =
+                        Some((stat.boot_time, stat.context_switches, stat.forks));
+                    true
+                }
+                Err(e) => {
+                    warn!("Failed to read /proc/stat: {}", e);
+                    false
+                }
+            };
+            published |= publish(&mut snapshot.load_average, load, "load average");
+            snapshot.advance(published);
+        }
+        Collector::Memory => {
+            let memory = system::read_extended_memory_info(
+                &mut state
+                    .system_readers
+                    .meminfo
+                    .lock()
+                    .expect("meminfo lock poisoned"),
+            );
+            publish_one(state, memory, "memory info", |s| &mut s.memory);
+        }
+        Collector::Stat => {
+            let uptime = system::read_uptime();
+            let uname = system::read_uname_info();
+            let fds = system::read_system_fd_stats();
+            let entropy = system::read_entropy();
+            let mut snapshot = lock_snapshot(state);
+            let published = [
+                publish(&mut snapshot.uptime_seconds, uptime, "system uptime"),
+                publish(&mut snapshot.uname, uname, "uname info"),
+                publish(&mut snapshot.fd_stats, fds, "system FD stats"),
+                publish(&mut snapshot.entropy_bits, entropy, "entropy"),
+            ];
+            snapshot.advance(published.contains(&true));
+        }
+        Collector::Psi => {
+            // PSI is missing on kernels without CONFIG_PSI; not worth a warning
+            let cpu = system::read_psi_some_total("/proc/pressure/cpu");
+            let memory = system::read_psi_some_total("/proc/pressure/memory");
+            let io = system::read_psi_some_total("/proc/pressure/io");
+            let mut guard = lock_snapshot(state);
+            let snapshot = &mut *guard;
+            let mut published = false;
+            for (slot, result) in [
+                (&mut snapshot.psi_cpu_seconds, cpu),
+                (&mut snapshot.psi_memory_seconds, memory),
+                (&mut snapshot.psi_io_seconds, io),
+            ] {
+                match result {
+                    Ok(value) => {
+                        *slot = Some(value);
+                        published = true;
+                    }
+                    Err(e) => debug!("Failed to read PSI: {}", e),
+                }
+            }
+            snapshot.advance(published);
+        }
+        Collector::Netdev => {
+            let netdev = state
+                .system_readers
+                .netdev
+                .lock()
+                .expect("netdev reader lock poisoned")
+                .read();
+            publish_one(state, netdev, "network device statistics", |s| {
+                &mut s.netdev
+            });
+        }
+        Collector::Diskstats => {
+            let diskstats = state
+                .system_readers
+                .diskstats
+                .lock()
+                .expect("diskstats reader lock poisoned")
+                .read();
+            publish_one(state, diskstats, "disk statistics", |s| &mut s.diskstats);
+        }
+        Collector::Filesystem => {
+            let timeout = Duration::from_millis(
+                state
+                    .config
+                    .filesystem_timeout_ms
+                    .unwrap_or(DEFAULT_FILESYSTEM_TIMEOUT_MS),
+            );
+            let filesystems = state.filesystem_collector.collect(timeout);
+            publish_one(state, filesystems, "filesystem statistics", |s| {
+                &mut s.filesystems
+            });
+        }
+        Collector::Thermal => {
+            let temperatures = collectors::thermal::collect_temperatures();
+            publish_one(state, temperatures, "thermal sensors", |s| {
+                &mut s.temperatures
+            });
+        }
+        Collector::Cgroups => {
+            // The cgroup set of the last scan; the lock is released before
+            // any cgroup file is read
+            let members = Arc::clone(&state.cgroups.read().expect("cgroups lock poisoned"));
+            let root = state
+                .config
+                .cgroup_root
+                .as_deref()
+                .unwrap_or(std::path::Path::new(DEFAULT_CGROUP_ROOT));
+            let cgroups =
+                collectors::cgroup::read_cgroup_stats(root, members.iter().map(|m| &m.path));
+            publish_one(state, cgroups, "cgroup statistics", |s| &mut s.cgroups);
+        }
+        Collector::Ebpf => collect_ebpf(state),
+    }
+}
+
+/// Reads the eBPF maps and publishes them.
+#[cfg(feature = "ebpf")]
+fn collect_ebpf(state: &AppState) {
+    use crate::health_stats::Phase;
+
+    let ebpf = match &state.ebpf {
+        Some(ebpf) => ebpf,
+        None => return,
+    };
+    let mut clock = state.health_stats.phases.clock();
+    let net = ebpf.read_process_net_stats().map_err(|e| e.to_string());
+    clock.lap(Phase::EbpfNetStats);
+    let blkio = ebpf.read_process_blkio_stats().map_err(|e| e.to_string());
+    clock.lap(Phase::EbpfBlkioStats);
+    let tcp = if state.config.enable_tcp_tracking.unwrap_or(true) {
+        let tcp = ebpf.read_tcp_stats().map_err(|e| e.to_string());
+        clock.lap(Phase::EbpfTcpStats);
+        Some(tcp)
+    } else {
+        None
+    };
+    let histograms = ebpf.read_io_histograms().map_err(|e| e.to_string());
+    clock.lap(Phase::EbpfIoHistograms);
+    let cgroup_io = if state.config.enable_cgroups.unwrap_or(false) {
+        let cgroup_io = ebpf.read_cgroup_io().map_err(|e| e.to_string());
+        clock.lap(Phase::EbpfCgroupIo);
+        Some(cgroup_io)
+    } else {
+        None
+    };
+    // Drained here as well so bursts between two process scans fit the ring
+    ebpf.poll_lifecycle_events();
+    clock.lap(Phase::EbpfLifecycle);
+    let perf = ebpf.get_performance_stats();
+
+    let mut snapshot = lock_snapshot(state);
+    let mut published = publish(&mut snapshot.ebpf_net, net, "eBPF network statistics");
+    published |= publish(&mut snapshot.ebpf_blkio, blkio, "eBPF block I/O statistics");
+    if let Some(tcp) = tcp {
+        published |= publish(&mut snapshot.ebpf_tcp, tcp, "TCP connection statistics");
+    }
+    published |= publish(
+        &mut snapshot.ebpf_io_histograms,
+        histograms,
+        "eBPF I/O histograms",
+    );
+    if let Some(cgroup_io) = cgroup_io {
+        published |= publish(&mut snapshot.ebpf_cgroup_io, cgroup_io, "eBPF cgroup I/O");
+    }
+    snapshot.ebpf_perf = Some(perf);
+    snapshot.advance(published);
+}
+
+/// Without eBPF support the collector is never scheduled.
+#[cfg(not(feature = "ebpf"))]
+fn collect_ebpf(_state: &AppState) {}
+
+/// Locks the snapshot to publish a collector run.
+fn lock_snapshot(state: &AppState) -> std::sync::RwLockWriteGuard<'_, SystemSnapshot> {
+    state
+        .system_snapshot
+        .write()
+        .expect("system snapshot lock poisoned")
+}
+
+/// Runs `collector` once, returning how long it took.
+async fn run_once(collector: Collector, state: &SharedState) -> Duration {
+    let start = Instant::now();
+    if collector == Collector::Processes {
+        if let Err(e) = crate::cache_updater::update_cache(state).await {
+            error!("Scheduled cache update failed: {}", e);
+        }
+    } else {
+        let state = Arc::clone(state);
+        if let Err(e) = tokio::task::spawn_blocking(move || collect_system(collector, &state)).await
+        {
+            error!("Collector {} panicked: {}", collector.name(), e);
+        }
+    }
+    start.elapsed()
+}
+
+/// Runs `collector` forever on its schedule.
+async fn run_collector(
+    collector: Collector,
+    schedule: Schedule,
+    state: SharedState,
+    stats: Arc<CollectorStats>,
+    initial_delay: Duration,
+) {
+    tokio::time::sleep(initial_delay).await;
+    loop {
+        let duration = run_once(collector, &state).await;
+        let overrun = duration > schedule.budget;
+        stats.record_run(duration.as_secs_f64() * 1000.0, overrun);
+        if overrun {
+            warn!(
+                "Collector {} took {:.1}ms, over its {}ms budget",
+                collector.name(),
+                duration.as_secs_f64() * 1000.0,
+                schedule.budget.as_millis()
+            );
+        }
+
+        let delay = schedule.next_delay(&mut rand::thread_rng());
+        tokio::time::sleep(delay).await;
+    }
+}
+
+/// Spawns one task per enabled collector.
+///
+/// The process cache is expected to be populated already, so the process
+/// collector first runs one interval after startup. System collectors start
+/// at a random point of their first interval.
+pub fn spawn_collectors(state: &SharedState) {
+    let mut rng = rand::thread_rng();
+    for collector in Collector::ALL {
+        if !collector.enabled(state) {
+            debug!("Collector {} disabled", collector.name());
+            continue;
+        }
+        let schedule = Schedule::resolve(collector, &state.config);
+        let stats = state
+            .health_stats
+            .register_collector(collector.name(), schedule.budget.as_millis() as u64);
+        let initial_delay = if collector == Collector::Processes {
+            schedule.next_delay(&mut rng)
+        } else {
+            schedule.interval.mul_f64(rng.gen_range(0.0..1.0))
+        };
+        info!(
+            "Collector {} scheduled every {}s (budget {}ms, jitter {}%)",
+            collector.name(),
+            schedule.interval.as_secs(),
+            schedule.budget.as_millis(),
+            schedule.jitter_percent
+        );
+        tokio::spawn(run_collector(
+            collector,
+            schedule,
+            Arc::clone(state),
+            stats,
+            initial_delay,
+        ));
+    }
+}
+
+/// Runs every enabled system collector once, so the first scrape after
+/// startup already has data.
+pub fn collect_all_system(state: &AppState) {
+    for collector in Collector::ALL {
+        if collector != Collector::Processes && collector.enabled(state) {
+            collect_system(collector, state);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::config::CollectorSchedule;
+    use crate::fixtures::app_state;
+    use rand::rngs::StdRng;
+    use rand::SeedableRng;
+
+    #[test]
+    fn test_names_round_trip() {
+        for collector in Collector::ALL {
+            assert_eq!(Collector::from_name(collector.name()), Some(collector));
+        }
+        assert_eq!(Collector::from_name("sensors"), None);
+    }
+
+    #[test]
+    fn test_resolve_applies_overrides() {
+        let mut cfg = Config {
+            cache_ttl: Some(45),
+            ..Config::default()
+        };
+        cfg.collectors.insert(
+            "diskstats".to_string(),
+            CollectorSchedule {
+                interval_seconds: Some(2),
+                budget_ms: None,
+                jitter_percent: Some(90),
+            },
+        );
+
+        let processes = Schedule::resolve(Collector::Processes, &cfg);
+        assert_eq!(processes.interval, Duration::from_secs(45));
+        assert_eq!(processes.jitter_percent, DEFAULT_JITTER_PERCENT);
+
+        let diskstats = Schedule::resolve(Collector::Diskstats, &cfg);
+        assert_eq!(diskstats.interval, Duration::from_secs(2));
+        assert_eq!(diskstats.budget, Duration::from_millis(100));
+        assert_eq!(diskstats.jitter_percent, MAX_JITTER_PERCENT);
+    }
+
+    #[test]
+    fn test_next_delay_stays_within_jitter() {
+        let mut rng = StdRng::seed_from_u64(7);
+        let schedule = Schedule {
+            interval: Duration::from_secs(10),
+            budget: Duration::from_millis(100),
+            jitter_percent: 20,
+        };
+        for _ in 0..1000 {
+            let delay = schedule.next_delay(&mut rng);
+            assert!(delay >= Duration::from_secs(8) && delay <= Duration::from_secs(12));
+        }
+
+        let fixed = Schedule {
+            jitter_percent: 0,
+            ..schedule
+        };
+        assert_eq!(fixed.next_delay(&mut rng), Duration::from_secs(10));
+    }
+
+    #[test]
+    fn test_only_published_values_advance_generation() {
+        let root = tempfile::tempdir().unwrap();
+        let state = app_state(root.path()).unwrap();
+        let generation = || state.system_snapshot.read().unwrap().generation;
+
+        let failed: Result<f64, String> = Err("unreadable".to_string());
+        publish_one(&state, failed, "uptime", |s| &mut s.uptime_seconds);
+        assert_eq!(generation(), 0);
+
+        publish_one(&state, Ok(12.5), "uptime", |s| &mut s.uptime_seconds);
+        assert_eq!(generation(), 1);
+        assert_eq!(
+            state.system_snapshot.read().unwrap().uptime_seconds,
+            Some(12.5)
+        );
+    }
+}
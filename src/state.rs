@@ -1,23 +1,29 @@
 //! Application state management for the exporter.
 //!
 //! This module defines the shared application state that is passed
-//! to HTTP handlers and used by the background cache update task.
+//! to HTTP handlers and used by the background collector tasks.
 
-use ahash::AHashMap as HashMap;
-use herakles_node_exporter::HealthState;
 use prometheus::{Gauge, Registry};
-use std::sync::{Arc, RwLock as StdRwLock};
+use std::sync::{Arc, Mutex as StdMutex, RwLock as StdRwLock};
 use std::time::Instant;
-use tokio::sync::RwLock;
+use tokio::sync::{Mutex, Notify, RwLock};
 
 use crate::cache::MetricsCache;
+use crate::collectors::filesystem::FilesystemCollector;
 use crate::config::Config;
 use crate::ebpf::EbpfManager;
+use crate::exposition::RenderedMetrics;
+use crate::health::HealthState;
+use crate::health_config::{AppConfig as HealthAppConfig, BufferHealthConfig};
 use crate::health_stats::HealthStats;
-use crate::metrics::MemoryMetrics;
-use crate::process::{BufferConfig, CpuEntry};
+use crate::metrics::{MemoryMetrics, PhaseMetrics, SystemHandles};
+use crate::process::{
+    BufferConfig, CgroupCache, CgroupMembers, ClassCache, CpuCache, ProcessTracker, SmapsCache,
+};
 use crate::ringbuffer_manager::RingbufferManager;
+use crate::scheduler::{SystemReaders, SystemSnapshot};
 use crate::system::CpuStatsCache;
+use crate::uring::BatchReader;
 
 /// Type alias for shared application state.
 pub type SharedState = Arc<AppState>;
@@ -26,20 +32,51 @@ pub type SharedState = Arc<AppState>;
 pub struct AppState {
     pub registry: Registry,
     pub metrics: MemoryMetrics,
+    /// Phase profiles of the cache updates, renders and eBPF reads.
+    pub phase_metrics: PhaseMetrics,
     pub scrape_duration: Gauge,
+    /// Generation of the pre-rendered /metrics body.
+    pub scrape_generation: Gauge,
     pub processes_total: Gauge,
     pub cache_update_duration: Gauge,
     pub cache_update_success: Gauge,
     pub cache_updating: Gauge,
     pub cache: Arc<RwLock<MetricsCache>>,
+    /// Signalled after each published cache update; drives the push task.
+    pub cache_published: Notify,
+    /// Last rendered /metrics body, served to scrapes until it is stale.
+    pub rendered_metrics: StdRwLock<Option<Arc<RenderedMetrics>>>,
+    /// Serializes renders of the /metrics body.
+    pub render_lock: Mutex<()>,
     pub config: Arc<Config>,
     pub buffer_config: BufferConfig,
-    pub cpu_cache: StdRwLock<HashMap<u32, CpuEntry>>,
+    /// CPU samples of the previous scan for usage deltas.
+    pub cpu_cache: CpuCache,
+    /// Process classifications of the previous scan.
+    pub class_cache: ClassCache,
+    /// Process cgroups of the previous scan.
+    pub cgroup_cache: CgroupCache,
+    /// Last smaps reads per process, for tiered smaps sampling.
+    pub smaps_cache: SmapsCache,
+    /// cgroups of the last scan, largest first, limited to `max_cgroups`.
+    pub cgroups: StdRwLock<Arc<Vec<CgroupMembers>>>,
+    /// Per-process state for incremental /proc scans.
+    pub process_tracker: ProcessTracker,
+    /// io_uring reader for single-pass scans, `None` if disabled or unavailable.
+    pub uring: Option<StdMutex<BatchReader>>,
     pub health_stats: Arc<HealthStats>,
     /// Health state for buffer monitoring.
     pub health_state: Arc<HealthState>,
     /// CPU statistics cache for calculating usage ratios.
     pub system_cpu_cache: CpuStatsCache,
+    /// Open /proc files of the memory, diskstats and netdev collectors.
+    pub system_readers: SystemReaders,
+    /// Mount table and statvfs state of the filesystem collector.
+    pub filesystem_collector: FilesystemCollector,
+    /// Latest system readings, published by the background collectors.
+    pub system_snapshot: StdRwLock<SystemSnapshot>,
+    /// Per-device metric handles, kept while the device lists are unchanged.
+    pub system_handles: StdMutex<SystemHandles>,
     /// eBPF manager for process I/O tracking (optional).
     pub ebpf: Option<Arc<EbpfManager>>,
     /// Ringbuffer manager for historical metrics tracking.
@@ -47,3 +84,101 @@ pub struct AppState {
     /// Server start time for uptime calculation.
     pub start_time: Instant,
 }
+
+impl AppState {
+    /// Creates the state with empty caches and registers the exporter's own
+    /// gauges and the process metrics in `registry`.
+    ///
+    /// The eBPF manager and the io_uring reader are set up by the caller,
+    /// since both depend on the privileges the process still holds.
+    pub fn new(
+        config: Config,
+        buffer_config: BufferConfig,
+        registry: Registry,
+        health_stats: Arc<HealthStats>,
+        ebpf: Option<Arc<EbpfManager>>,
+        ringbuffer_manager: Arc<RingbufferManager>,
+        uring: Option<StdMutex<BatchReader>>,
+    ) -> Result<Self, Box<dyn std::error::Error>> {
+        let metrics = MemoryMetrics::new(&registry)?;
+        let phase_metrics = PhaseMetrics::new(&registry)?;
+        let scrape_duration = Gauge::new(
+            "herakles_exporter_scrape_duration_seconds",
+            "Time spent serving /metrics request (reading from cache)",
+        )?;
+        let scrape_generation = Gauge::new(
+            "herakles_exporter_scrape_generation",
+            "Number of times the /metrics body has been rendered since startup",
+        )?;
+        let processes_total = Gauge::new(
+            "herakles_exporter_processes_total",
+            "Number of processes currently exported by herakles-node-exporter",
+        )?;
+        let cache_update_duration = Gauge::new(
+            "herakles_exporter_cache_update_duration_seconds",
+            "Time spent updating the process metrics cache in background",
+        )?;
+        let cache_update_success = Gauge::new(
+            "herakles_exporter_cache_update_success",
+            "Whether the last cache update was successful (1) or failed (0)",
+        )?;
+        let cache_updating = Gauge::new(
+            "herakles_exporter_cache_updating",
+            "Whether cache update is currently in progress (1) or idle (0)",
+        )?;
+
+        registry.register(Box::new(scrape_duration.clone()))?;
+        registry.register(Box::new(scrape_generation.clone()))?;
+        registry.register(Box::new(processes_total.clone()))?;
+        registry.register(Box::new(cache_update_duration.clone()))?;
+        registry.register(Box::new(cache_update_success.clone()))?;
+        registry.register(Box::new(cache_updating.clone()))?;
+
+        let buffer_health = |capacity_kb| BufferHealthConfig {
+            capacity_kb,
+            larger_is_better: false,
+            warn_percent: Some(80.0),
+            critical_percent: Some(95.0),
+        };
+        let health_state = Arc::new(HealthState::new(HealthAppConfig {
+            io_buffer: buffer_health(buffer_config.io_kb),
+            smaps_buffer: buffer_health(buffer_config.smaps_kb),
+            smaps_rollup_buffer: buffer_health(buffer_config.smaps_rollup_kb),
+        }));
+
+        Ok(Self {
+            registry,
+            metrics,
+            phase_metrics,
+            scrape_duration,
+            scrape_generation,
+            processes_total,
+            cache_update_duration,
+            cache_update_success,
+            cache_updating,
+            cache: Arc::new(RwLock::new(MetricsCache::default())),
+            cache_published: Notify::new(),
+            rendered_metrics: StdRwLock::new(None),
+            render_lock: Mutex::new(()),
+            config: Arc::new(config),
+            buffer_config,
+            cpu_cache: CpuCache::default(),
+            class_cache: ClassCache::default(),
+            cgroup_cache: CgroupCache::default(),
+            smaps_cache: SmapsCache::default(),
+            cgroups: StdRwLock::new(Arc::new(Vec::new())),
+            process_tracker: ProcessTracker::new(),
+            uring,
+            health_stats,
+            health_state,
+            system_cpu_cache: CpuStatsCache::new(),
+            system_readers: SystemReaders::default(),
+            filesystem_collector: FilesystemCollector::default(),
+            system_snapshot: StdRwLock::new(SystemSnapshot::default()),
+            system_handles: StdMutex::new(SystemHandles::default()),
+            ebpf,
+            ringbuffer_manager,
+            start_time: Instant::now(),
+        })
+    }
+}
@@ -3,9 +3,11 @@
 //! This module provides functions to read system-wide metrics such as
 //! load average, total RAM, and total SWAP from the /proc filesystem.
 
-use std::collections::HashMap;
 use std::fs;
-use std::sync::RwLock;
+use std::path::Path;
+use std::sync::Mutex;
+
+use crate::procfs::{self, ProcFile};
 
 /// System load averages for 1, 5, and 15 minute intervals.
 #[derive(Debug, Clone, Copy)]
@@ -94,81 +96,28 @@ pub fn read_load_average() -> Result<LoadAverage, String> {
 
 /// Reads extended memory information from /proc/meminfo including MemAvailable, Cached, Buffers, and Swap.
 ///
-/// Returns total and available memory in bytes.
-pub fn read_extended_memory_info() -> Result<ExtendedMemoryInfo, String> {
-    let content = fs::read_to_string("/proc/meminfo")
+/// `file` stays open between calls. Returns total and available memory in bytes.
+pub fn read_extended_memory_info(file: &mut ProcFile) -> Result<ExtendedMemoryInfo, String> {
+    let content = file
+        .read()
         .map_err(|e| format!("Failed to read /proc/meminfo: {}", e))?;
+    parse_meminfo(content)
+}
 
-    let mut total_bytes: Option<u64> = None;
-    let mut available_bytes: Option<u64> = None;
-    let mut cached_bytes: Option<u64> = None;
-    let mut buffers_bytes: Option<u64> = None;
-    let mut swap_total_bytes: Option<u64> = None;
-    let mut swap_free_bytes: Option<u64> = None;
-
-    for line in content.lines() {
-        if line.starts_with("MemTotal:") {
-            let parts: Vec<&str> = line.split_whitespace().collect();
-            if parts.len() >= 2 {
-                if let Ok(kb) = parts[1].parse::<u64>() {
-                    total_bytes = Some(kb * 1024);
-                }
-            }
-        } else if line.starts_with("MemAvailable:") {
-            let parts: Vec<&str> = line.split_whitespace().collect();
-            if parts.len() >= 2 {
-                if let Ok(kb) = parts[1].parse::<u64>() {
-                    available_bytes = Some(kb * 1024);
-                }
-            }
-        } else if line.starts_with("Cached:") {
-            let parts: Vec<&str> = line.split_whitespace().collect();
-            if parts.len() >= 2 {
-                if let Ok(kb) = parts[1].parse::<u64>() {
-                    cached_bytes = Some(kb * 1024);
-                }
-            }
-        } else if line.starts_with("Buffers:") {
-            let parts: Vec<&str> = line.split_whitespace().collect();
-            if parts.len() >= 2 {
-                if let Ok(kb) = parts[1].parse::<u64>() {
-                    buffers_bytes = Some(kb * 1024);
-                }
-            }
-        } else if line.starts_with("SwapTotal:") {
-            let parts: Vec<&str> = line.split_whitespace().collect();
-            if parts.len() >= 2 {
-                if let Ok(kb) = parts[1].parse::<u64>() {
-                    swap_total_bytes = Some(kb * 1024);
-                }
-            }
-        } else if line.starts_with("SwapFree:") {
-            let parts: Vec<&str> = line.split_whitespace().collect();
-            if parts.len() >= 2 {
-                if let Ok(kb) = parts[1].parse::<u64>() {
-                    swap_free_bytes = Some(kb * 1024);
-                }
-            }
-        }
-
-        if total_bytes.is_some()
-            && available_bytes.is_some()
-            && cached_bytes.is_some()
-            && buffers_bytes.is_some()
-            && swap_total_bytes.is_some()
-            && swap_free_bytes.is_some()
-        {
-            break;
-        }
-    }
+fn parse_meminfo(content: &[u8]) -> Result<ExtendedMemoryInfo, String> {
+    let bytes = |key: &[u8]| {
+        procfs::find_field(content, key)
+            .and_then(procfs::parse_u64)
+            .map(|kb| kb * 1024)
+    };
 
     match (
-        total_bytes,
-        available_bytes,
-        cached_bytes,
-        buffers_bytes,
-        swap_total_bytes,
-        swap_free_bytes,
+        bytes(b"MemTotal:"),
+        bytes(b"MemAvailable:"),
+        bytes(b"Cached:"),
+        bytes(b"Buffers:"),
+        bytes(b"SwapTotal:"),
+        bytes(b"SwapFree:"),
     ) {
         (
             Some(total),
@@ -189,141 +138,135 @@ pub fn read_extended_memory_info() -> Result<ExtendedMemoryInfo, String> {
     }
 }
 
-/// Reads CPU statistics from /proc/stat.
-///
-/// Returns a HashMap with CPU name as key and CpuStat as value.
-/// "cpu" represents total across all cores, "cpu0", "cpu1", etc. are individual cores.
-pub fn read_cpu_stats() -> Result<HashMap<String, CpuStat>, String> {
-    let content = fs::read_to_string("/proc/stat")
-        .map_err(|e| format!("Failed to read /proc/stat: {}", e))?;
-
-    let mut stats = HashMap::new();
+/// The parts of /proc/stat used by the collectors, parsed in one pass.
+#[derive(Debug, Clone, Copy)]
+pub struct ProcStat {
+    /// The aggregate "cpu" line, totals across all cores
+    pub cpu: CpuStat,
+    /// Boot time in seconds since the epoch
+    pub boot_time: u64,
+    pub context_switches: u64,
+    pub forks: u64,
+}
 
-    for line in content.lines() {
-        if line.starts_with("cpu") {
-            let parts: Vec<&str> = line.split_whitespace().collect();
-            if parts.len() < 8 {
-                continue;
+/// Parses /proc/stat.
+pub fn parse_proc_stat(content: &[u8]) -> Result<ProcStat, String> {
+    let mut cpu = None;
+    let mut boot_time = None;
+    let mut context_switches = None;
+    let mut forks = None;
+
+    for line in procfs::lines(content) {
+        if let Some(rest) = line.strip_prefix(b"cpu ") {
+            // Fields: user nice system idle iowait irq softirq steal; steal
+            // is missing on old kernels
+            let mut values = [0u64; 8];
+            let mut found = 0;
+            for (value, field) in values.iter_mut().zip(procfs::fields(rest)) {
+                *value = procfs::parse_u64(field).unwrap_or(0);
+                found += 1;
             }
-
-            let cpu_name = parts[0].to_string();
-
-            // Parse CPU time fields
-            let user = parts[1].parse::<u64>().unwrap_or(0);
-            let nice = parts[2].parse::<u64>().unwrap_or(0);
-            let system = parts[3].parse::<u64>().unwrap_or(0);
-            let idle = parts[4].parse::<u64>().unwrap_or(0);
-            let iowait = parts[5].parse::<u64>().unwrap_or(0);
-            let irq = parts[6].parse::<u64>().unwrap_or(0);
-            let softirq = parts[7].parse::<u64>().unwrap_or(0);
-            let steal = if parts.len() > 8 {
-                parts[8].parse::<u64>().unwrap_or(0)
-            } else {
-                0
-            };
-
-            stats.insert(
-                cpu_name,
-                CpuStat {
-                    user,
-                    nice,
-                    system,
-                    idle,
-                    iowait,
-                    irq,
-                    softirq,
-                    steal,
-                },
-            );
+            if found >= 7 {
+                cpu = Some(CpuStat {
+                    user: values[0],
+                    nice: values[1],
+                    system: values[2],
+                    idle: values[3],
+                    iowait: values[4],
+                    irq: values[5],
+                    softirq: values[6],
+                    steal: values[7],
+                });
+            }
+        } else if let Some(value) = line.strip_prefix(b"btime ") {
+            boot_time = procfs::parse_u64(value);
+        } else if let Some(value) = line.strip_prefix(b"ctxt ") {
+            context_switches = procfs::parse_u64(value);
+        } else if let Some(value) = line.strip_prefix(b"processes ") {
+            forks = procfs::parse_u64(value);
         }
     }
 
-    if stats.is_empty() {
-        return Err("No CPU statistics found in /proc/stat".to_string());
+    match (cpu, boot_time, context_switches, forks) {
+        (Some(cpu), Some(boot_time), Some(context_switches), Some(forks)) => Ok(ProcStat {
+            cpu,
+            boot_time,
+            context_switches,
+            forks,
+        }),
+        (None, ..) => Err("No CPU statistics found in /proc/stat".to_string()),
+        _ => Err("Failed to parse all stat counters from /proc/stat".to_string()),
     }
+}
 
-    Ok(stats)
+/// CPU usage ratios over the interval between two /proc/stat samples.
+#[derive(Debug, Clone, Copy)]
+pub struct CpuRatios {
+    pub usage: f64,
+    pub idle: f64,
+    pub iowait: f64,
+    pub steal: f64,
+}
+
+impl CpuRatios {
+    /// Ratios between two samples, `None` if no CPU time passed.
+    fn between(previous: &CpuStat, current: &CpuStat) -> Option<Self> {
+        let delta_total = current.total().saturating_sub(previous.total());
+        if delta_total == 0 {
+            return None;
+        }
+        let delta_non_active = current.idle_total().saturating_sub(previous.idle_total());
+        let delta_idle = current.idle.saturating_sub(previous.idle);
+        let delta_iowait = current.iowait.saturating_sub(previous.iowait);
+        let delta_steal = current.steal.saturating_sub(previous.steal);
+
+        Some(Self {
+            usage: delta_total.saturating_sub(delta_non_active) as f64 / delta_total as f64,
+            idle: delta_idle as f64 / delta_total as f64,
+            iowait: delta_iowait as f64 / delta_total as f64,
+            steal: delta_steal as f64 / delta_total as f64,
+        })
+    }
 }
 
-/// CPU statistics cache for calculating deltas.
+/// Keeps /proc/stat open and the previous sample for calculating deltas.
 pub struct CpuStatsCache {
-    previous: RwLock<Option<HashMap<String, CpuStat>>>,
+    state: Mutex<CpuStatsState>,
 }
 
-/// CPU usage ratios returned from calculate_usage_ratios.
-#[derive(Debug, Clone)]
-pub struct CpuRatios {
-    pub usage: HashMap<String, f64>,
-    pub idle: HashMap<String, f64>,
-    pub iowait: HashMap<String, f64>,
-    pub steal: HashMap<String, f64>,
+struct CpuStatsState {
+    file: ProcFile,
+    previous: Option<CpuStat>,
 }
 
 impl CpuStatsCache {
     pub fn new() -> Self {
         Self {
-            previous: RwLock::new(None),
+            state: Mutex::new(CpuStatsState {
+                file: ProcFile::new("/proc/stat"),
+                previous: None,
+            }),
         }
     }
 
-    /// Calculate CPU usage ratios by comparing current and previous stats.
-    /// Returns CpuRatios struct with all ratio types.
-    pub fn calculate_usage_ratios(&self) -> Result<CpuRatios, String> {
-        let current_stats = read_cpu_stats()?;
-
-        let mut usage_ratios = HashMap::new();
-        let mut idle_ratios = HashMap::new();
-        let mut iowait_ratios = HashMap::new();
-        let mut steal_ratios = HashMap::new();
-
-        // Try to get previous stats
-        let prev_guard = self
-            .previous
-            .read()
+    /// Reads /proc/stat once and returns its counters together with the CPU
+    /// usage ratios since the previous sample (`None` on the first sample).
+    pub fn sample(&self) -> Result<(ProcStat, Option<CpuRatios>), String> {
+        let mut state = self
+            .state
+            .lock()
             .map_err(|e| format!("Failed to acquire lock: {}", e))?;
+        let content = state
+            .file
+            .read()
+            .map_err(|e| format!("Failed to read /proc/stat: {}", e))?;
+        let stat = parse_proc_stat(content)?;
 
-        if let Some(prev_stats) = prev_guard.as_ref() {
-            // Calculate deltas for each CPU
-            for (cpu_name, current) in &current_stats {
-                if let Some(previous) = prev_stats.get(cpu_name) {
-                    let delta_total = current.total().saturating_sub(previous.total());
-                    let delta_non_active =
-                        current.idle_total().saturating_sub(previous.idle_total());
-                    let delta_idle = current.idle.saturating_sub(previous.idle);
-                    let delta_iowait = current.iowait.saturating_sub(previous.iowait);
-                    let delta_steal = current.steal.saturating_sub(previous.steal);
-
-                    if delta_total > 0 {
-                        let usage_ratio =
-                            (delta_total - delta_non_active) as f64 / delta_total as f64;
-                        let idle_ratio = delta_idle as f64 / delta_total as f64;
-                        let iowait_ratio = delta_iowait as f64 / delta_total as f64;
-                        let steal_ratio = delta_steal as f64 / delta_total as f64;
-
-                        usage_ratios.insert(cpu_name.clone(), usage_ratio);
-                        idle_ratios.insert(cpu_name.clone(), idle_ratio);
-                        iowait_ratios.insert(cpu_name.clone(), iowait_ratio);
-                        steal_ratios.insert(cpu_name.clone(), steal_ratio);
-                    }
-                }
-            }
-        }
-
-        drop(prev_guard);
-
-        // Update cache with current stats
-        let mut cache_guard = self
+        let ratios = state
             .previous
-            .write()
-            .map_err(|e| format!("Failed to acquire write lock: {}", e))?;
-        *cache_guard = Some(current_stats);
-
-        Ok(CpuRatios {
-            usage: usage_ratios,
-            idle: idle_ratios,
-            iowait: iowait_ratios,
-            steal: steal_ratios,
-        })
+            .and_then(|previous| CpuRatios::between(&previous, &stat.cpu));
+        state.previous = Some(stat.cpu);
+        Ok((stat, ratios))
     }
 }
 
@@ -399,6 +342,71 @@ mod tests {
             fifteen_min,
         })
     }
+
+    const PROC_STAT: &[u8] = b"cpu  100 10 50 800 20 5 5 10 0 0
+cpu0 50 5 25 400 10 2 3 5 0 0
+intr 12345 0 0
+ctxt 987654
+btime 1700000000
+processes 4321
+procs_running 2
+";
+
+    #[test]
+    fn test_parse_proc_stat() {
+        let stat = parse_proc_stat(PROC_STAT).unwrap();
+        assert_eq!(stat.cpu.total(), 1000);
+        assert_eq!(stat.cpu.idle_total(), 820);
+        assert_eq!(stat.cpu.steal, 10);
+        assert_eq!(
+            (stat.boot_time, stat.context_switches, stat.forks),
+            (1_700_000_000, 987_654, 4321)
+        );
+
+        assert!(parse_proc_stat(b"ctxt 1\nbtime 2\nprocesses 3\n").is_err());
+        assert!(parse_proc_stat(b"cpu  1 2 3 4 5 6 7 8\n").is_err());
+    }
+
+    #[test]
+    fn test_cpu_ratios_between_samples() {
+        let previous = parse_proc_stat(PROC_STAT).unwrap().cpu;
+        let current = CpuStat {
+            user: previous.user + 60,
+            idle: previous.idle + 30,
+            iowait: previous.iowait + 5,
+            steal: previous.steal + 5,
+            ..previous
+        };
+
+        let ratios = CpuRatios::between(&previous, &current).unwrap();
+        assert!((ratios.usage - 0.65).abs() < 1e-9);
+        assert!((ratios.idle - 0.30).abs() < 1e-9);
+        assert!((ratios.iowait - 0.05).abs() < 1e-9);
+        assert!((ratios.steal - 0.05).abs() < 1e-9);
+        assert!(CpuRatios::between(&current, &current).is_none());
+    }
+
+    #[test]
+    fn test_parse_meminfo() {
+        let content = b"MemTotal:       16000000 kB
+MemFree:         1000000 kB
+MemAvailable:    8000000 kB
+Buffers:          100000 kB
+Cached:          4000000 kB
+SwapCached:            0 kB
+SwapTotal:       2000000 kB
+SwapFree:        1500000 kB
+";
+        let info = parse_meminfo(content).unwrap();
+        assert_eq!(info.total_bytes, 16_000_000 * 1024);
+        assert_eq!(info.available_bytes, 8_000_000 * 1024);
+        assert_eq!(info.cached_bytes, 4_000_000 * 1024);
+        assert_eq!(info.buffers_bytes, 100_000 * 1024);
+        assert_eq!(info.swap_total_bytes, 2_000_000 * 1024);
+        assert_eq!(info.swap_free_bytes, 1_500_000 * 1024);
+
+        assert!(parse_meminfo(b"MemTotal: 1 kB\n").is_err());
+    }
 }
 
 /// Gets file descriptor usage for the current process.
@@ -464,8 +472,14 @@ pub fn read_system_fd_stats() -> Result<(u64, u64, u64), String> {
 /// Returns uptime in seconds.
 /// Format: "<uptime_seconds> <idle_seconds>"
 pub fn read_uptime() -> Result<f64, String> {
-    let content = fs::read_to_string("/proc/uptime")
-        .map_err(|e| format!("Failed to read /proc/uptime: {}", e))?;
+    read_uptime_at(Path::new("/proc/uptime"))
+}
+
+/// Reads uptime from an `uptime` file at `path`, such as the one of a
+/// synthetic /proc tree.
+pub fn read_uptime_at(path: &Path) -> Result<f64, String> {
+    let content = fs::read_to_string(path)
+        .map_err(|e| format!("Failed to read {}: {}", path.display(), e))?;
 
     let parts: Vec<&str> = content.split_whitespace().collect();
     if parts.is_empty() {
@@ -479,38 +493,6 @@ pub fn read_uptime() -> Result<f64, String> {
     Ok(uptime_seconds)
 }
 
-/// Reads system boot time and context switches/forks from /proc/stat.
-/// Returns (boot_time_seconds, context_switches, forks).
-pub fn read_stat_counters() -> Result<(u64, u64, u64), String> {
-    let content = fs::read_to_string("/proc/stat")
-        .map_err(|e| format!("Failed to read /proc/stat: {}", e))?;
-
-    let mut boot_time: Option<u64> = None;
-    let mut context_switches: Option<u64> = None;
-    let mut forks: Option<u64> = None;
-
-    for line in content.lines() {
-        if line.starts_with("btime ") {
-            if let Some(value_str) = line.strip_prefix("btime ") {
-                boot_time = value_str.trim().parse::<u64>().ok();
-            }
-        } else if line.starts_with("ctxt ") {
-            if let Some(value_str) = line.strip_prefix("ctxt ") {
-                context_switches = value_str.trim().parse::<u64>().ok();
-            }
-        } else if line.starts_with("processes ") {
-            if let Some(value_str) = line.strip_prefix("processes ") {
-                forks = value_str.trim().parse::<u64>().ok();
-            }
-        }
-    }
-
-    match (boot_time, context_switches, forks) {
-        (Some(bt), Some(cs), Some(f)) => Ok((bt, cs, f)),
-        _ => Err("Failed to parse all stat counters from /proc/stat".to_string()),
-    }
-}
-
 /// Reads available entropy from /proc/sys/kernel/random/entropy_avail.
 pub fn read_entropy() -> Result<u64, String> {
     let content = fs::read_to_string("/proc/sys/kernel/random/entropy_avail")
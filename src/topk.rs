@@ -0,0 +1,351 @@
+//! Bounded top-K selection for per-subgroup process rankings.
+//!
+//! [`TopK`] keeps the K largest items seen so far in a small sorted buffer.
+//! Most pushes are rejected with a single comparison against the current
+//! minimum, so ranking n processes costs O(n) plus O(K) per accepted item
+//! instead of a full O(n log n) sort. Partial results from parallel workers
+//! are combined with [`TopK::merge`].
+//!
+//! [`ProcessRankings`] computes every ranking of a subgroup in one pass over
+//! its processes.
+
+use std::cmp::Reverse;
+
+use crate::cache::ProcMem;
+
+/// The `limit` items with the largest keys, kept in descending key order.
+///
+/// Among items with equal keys the one pushed first ranks first.
+#[derive(Debug, Clone)]
+pub struct TopK<K, T> {
+    limit: usize,
+    items: Vec<(K, T)>,
+}
+
+impl<K: Ord, T> TopK<K, T> {
+    /// Creates an empty selector keeping at most `limit` items.
+    pub fn new(limit: usize) -> Self {
+        Self {
+            limit,
+            items: Vec::new(),
+        }
+    }
+
+    /// Maximum number of items kept.
+    pub fn limit(&self) -> usize {
+        self.limit
+    }
+
+    pub fn len(&self) -> usize {
+        self.items.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.items.is_empty()
+    }
+
+    /// Offers an item; it is kept if it ranks among the `limit` largest keys.
+    pub fn push(&mut self, key: K, item: T) {
+        if self.items.len() == self.limit {
+            // Full (or a zero limit): the key must beat the current minimum
+            match self.items.last() {
+                Some((min, _)) if key > *min => {
+                    self.items.pop();
+                }
+                _ => return,
+            }
+        }
+        // Insert after existing equal keys so earlier items win ties
+        let pos = self.items.partition_point(|(k, _)| *k >= key);
+        self.items.insert(pos, (key, item));
+    }
+
+    /// Adds all items of `other`, as if they had been pushed into `self`.
+    pub fn merge(&mut self, other: Self) {
+        for (key, item) in other.items {
+            self.push(key, item);
+        }
+    }
+
+    /// Kept items, largest key first.
+    pub fn as_slice(&self) -> &[(K, T)] {
+        &self.items
+    }
+
+    /// Consumes the selector, returning the items largest key first.
+    pub fn into_vec(self) -> Vec<(K, T)> {
+        self.items
+    }
+}
+
+/// Metric a subgroup's processes are ranked by.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Ranking {
+    Cpu,
+    Rss,
+    Pss,
+    ReadBytes,
+    WriteBytes,
+    RxBytes,
+    TxBytes,
+}
+
+/// Number of [`Ranking`] variants.
+pub const RANKING_COUNT: usize = 7;
+
+impl Ranking {
+    pub const ALL: [Ranking; RANKING_COUNT] = [
+        Ranking::Cpu,
+        Ranking::Rss,
+        Ranking::Pss,
+        Ranking::ReadBytes,
+        Ranking::WriteBytes,
+        Ranking::RxBytes,
+        Ranking::TxBytes,
+    ];
+
+    /// Short name, as used in labels and page headings.
+    pub fn as_str(self) -> &'static str {
+        match self {
+            Ranking::Cpu => "cpu",
+            Ranking::Rss => "rss",
+            Ranking::Pss => "pss",
+            Ranking::ReadBytes => "read_bytes",
+            Ranking::WriteBytes => "write_bytes",
+            Ranking::RxBytes => "rx_bytes",
+            Ranking::TxBytes => "tx_bytes",
+        }
+    }
+
+    /// The value `p` is ranked by: CPU in thousandths of a percent, memory
+    /// and I/O in bytes.
+    pub fn value(self, p: &ProcMem) -> u64 {
+        match self {
+            Ranking::Cpu => (p.cpu_percent.max(0.0) * 1000.0) as u64,
+            Ranking::Rss => p.rss,
+            Ranking::Pss => p.pss,
+            Ranking::ReadBytes => p.read_bytes,
+            Ranking::WriteBytes => p.write_bytes,
+            Ranking::RxBytes => p.rx_bytes,
+            Ranking::TxBytes => p.tx_bytes,
+        }
+    }
+}
+
+/// Ties go to the lower PID, so the result does not depend on the order in
+/// which parallel workers saw the processes.
+type RankKey = (u64, Reverse<u32>);
+
+/// Top-K processes of one subgroup by every [`Ranking`], borrowed from the
+/// snapshot they were computed from.
+pub struct ProcessRankings<'a> {
+    tops: [TopK<RankKey, &'a ProcMem>; RANKING_COUNT],
+}
+
+impl<'a> ProcessRankings<'a> {
+    /// Creates empty rankings keeping `limit` processes each.
+    pub fn new(limit: usize) -> Self {
+        Self {
+            tops: std::array::from_fn(|_| TopK::new(limit)),
+        }
+    }
+
+    /// Offers `p` to every ranking.
+    pub fn push(&mut self, p: &'a ProcMem) {
+        for (top, ranking) in self.tops.iter_mut().zip(Ranking::ALL) {
+            top.push((ranking.value(p), Reverse(p.pid)), p);
+        }
+    }
+
+    /// Combines the rankings of another worker into `self`.
+    pub fn merge(&mut self, other: Self) {
+        for (top, other) in self.tops.iter_mut().zip(other.tops) {
+            top.merge(other);
+        }
+    }
+
+    /// Processes ranked by `ranking`, highest first.
+    pub fn top(&self, ranking: Ranking) -> impl Iterator<Item = &'a ProcMem> + '_ {
+        self.tops[ranking as usize]
+            .as_slice()
+            .iter()
+            .map(|(_, p)| *p)
+    }
+
+    /// Owned copy of the rankings that outlives the snapshot borrow.
+    pub fn to_subgroup_top(&self) -> SubgroupTop {
+        SubgroupTop {
+            rankings: std::array::from_fn(|i| {
+                self.tops[i]
+                    .as_slice()
+                    .iter()
+                    .map(|((value, _), p)| RankedProcess {
+                        pid: p.pid,
+                        value: *value,
+                    })
+                    .collect()
+            }),
+        }
+    }
+}
+
+/// A ranked process; `value` is [`Ranking::value`] at the time of the scan.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct RankedProcess {
+    pub pid: u32,
+    pub value: u64,
+}
+
+/// Top-K processes of one subgroup, published with the process snapshot.
+#[derive(Debug, Clone, Default)]
+pub struct SubgroupTop {
+    rankings: [Vec<RankedProcess>; RANKING_COUNT],
+}
+
+impl SubgroupTop {
+    /// Processes ranked by `ranking`, highest first.
+    pub fn get(&self, ranking: Ranking) -> &[RankedProcess] {
+        &self.rankings[ranking as usize]
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.rankings.iter().all(Vec::is_empty)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::fixtures;
+
+    fn proc_mem(pid: u32, rss: u64, cpu_percent: f32, tx_bytes: u64) -> ProcMem {
+        ProcMem {
+            rss,
+            pss: rss / 2,
+            uss: rss / 4,
+            cpu_percent,
+            tx_bytes,
+            ..fixtures::proc_mem(pid)
+        }
+    }
+
+    #[test]
+    fn test_topk_keeps_largest_in_order() {
+        let mut top = TopK::new(3);
+        for (key, item) in [(5, 'a'), (1, 'b'), (9, 'c'), (7, 'd'), (3, 'e'), (8, 'f')] {
+            top.push(key, item);
+        }
+        assert_eq!(top.as_slice(), &[(9, 'c'), (8, 'f'), (7, 'd')]);
+
+        // Equal to the current minimum: not kept, earlier items win ties
+        top.push(7, 'g');
+        assert_eq!(top.into_vec(), vec![(9, 'c'), (8, 'f'), (7, 'd')]);
+    }
+
+    #[test]
+    fn test_topk_limits() {
+        let mut empty = TopK::new(0);
+        empty.push(1, ());
+        assert!(empty.is_empty());
+
+        let mut short = TopK::new(10);
+        short.push(2, ());
+        short.push(4, ());
+        assert_eq!(short.len(), 2);
+        assert_eq!(short.as_slice()[0].0, 4);
+    }
+
+    #[test]
+    fn test_topk_merge_matches_sequential() {
+        let keys: Vec<u64> = (0..200).map(|i| (i * 7919) % 1000).collect();
+
+        let mut sequential = TopK::new(10);
+        for &key in &keys {
+            sequential.push(key, key);
+        }
+
+        let mut left = TopK::new(10);
+        let mut right = TopK::new(10);
+        for &key in &keys[..120] {
+            left.push(key, key);
+        }
+        for &key in &keys[120..] {
+            right.push(key, key);
+        }
+        left.merge(right);
+
+        let mut sorted = keys.clone();
+        sorted.sort_unstable_by(|a, b| b.cmp(a));
+        let expected: Vec<u64> = sorted.into_iter().take(10).collect();
+        let merged: Vec<u64> = left.into_vec().into_iter().map(|(k, _)| k).collect();
+        let single: Vec<u64> = sequential.into_vec().into_iter().map(|(k, _)| k).collect();
+        assert_eq!(merged, expected);
+        assert_eq!(single, expected);
+    }
+
+    #[test]
+    fn test_process_rankings_single_pass() {
+        let procs = [
+            proc_mem(10, 300, 1.0, 0),
+            proc_mem(11, 100, 50.0, 900),
+            proc_mem(12, 200, 50.0, 100),
+            proc_mem(13, 400, 0.5, 0),
+        ];
+
+        let mut rankings = ProcessRankings::new(2);
+        for p in &procs {
+            rankings.push(p);
+        }
+
+        let pids = |r: Ranking| rankings.top(r).map(|p| p.pid).collect::<Vec<_>>();
+        assert_eq!(pids(Ranking::Rss), vec![13, 10]);
+        assert_eq!(pids(Ranking::Pss), vec![13, 10]);
+        // Equal CPU: the lower PID ranks first
+        assert_eq!(pids(Ranking::Cpu), vec![11, 12]);
+        assert_eq!(pids(Ranking::TxBytes), vec![11, 12]);
+
+        let top = rankings.to_subgroup_top();
+        assert_eq!(
+            top.get(Ranking::Cpu)[0],
+            RankedProcess {
+                pid: 11,
+                value: 50_000
+            }
+        );
+        assert!(!top.is_empty());
+        assert!(SubgroupTop::default().is_empty());
+    }
+
+    #[test]
+    fn test_process_rankings_merge_is_order_independent() {
+        let procs: Vec<ProcMem> = (0..50)
+            .map(|pid| proc_mem(pid, 1000, (pid % 5) as f32, 0))
+            .collect();
+
+        let mut forward = ProcessRankings::new(3);
+        for p in &procs {
+            forward.push(p);
+        }
+
+        let mut left = ProcessRankings::new(3);
+        let mut right = ProcessRankings::new(3);
+        for p in procs.iter().rev() {
+            if p.pid % 2 == 0 {
+                left.push(p);
+            } else {
+                right.push(p);
+            }
+        }
+        right.merge(left);
+
+        for ranking in Ranking::ALL {
+            let a: Vec<u32> = forward.top(ranking).map(|p| p.pid).collect();
+            let b: Vec<u32> = right.top(ranking).map(|p| p.pid).collect();
+            assert_eq!(a, b, "{}", ranking.as_str());
+        }
+        assert_eq!(
+            forward.top(Ranking::Cpu).map(|p| p.pid).collect::<Vec<_>>(),
+            vec![4, 9, 14]
+        );
+    }
+}
@@ -0,0 +1,607 @@
+//! Batched file reads through io_uring.
+//!
+//! [`BatchReader`] reads many small files, such as the `/proc/<pid>` files of
+//! every process, with a few `io_uring_enter` calls instead of an
+//! `openat`/`read`/`close` triple per file. Files are handled in chunks of
+//! one pool slot each: one submission opens the chunk (`IORING_OP_OPENAT`),
+//! a second reads every opened file into its slot and closes it (a read
+//! hard-linked to `IORING_OP_CLOSE`).
+//!
+//! The buffer pool is allocated once and registered with the kernel, so reads
+//! use `IORING_OP_READ_FIXED` and skip pinning the pages on every call. If
+//! registration is refused (for example by `RLIMIT_MEMLOCK` on older kernels)
+//! the same pool is read into with plain `IORING_OP_READ`.
+//!
+//! The ring is set up through the raw syscalls, so liburing is not needed.
+//! It requires Linux 5.6 for the open, read and close operations;
+//! [`BatchReader::new`] fails on older kernels and where io_uring is disabled
+//! (`kernel.io_uring_disabled`, container seccomp profiles), and callers are
+//! expected to fall back to plain reads.
+
+use std::ffi::CStr;
+use std::io;
+use std::mem::size_of;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd, RawFd};
+use std::ptr;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+use crate::procfs;
+
+/// Pool slot size: fits `comm`, `stat`, `status`, `io` and `smaps_rollup`.
+pub const DEFAULT_SLOT_BYTES: usize = 4096;
+/// Files in flight per submission.
+pub const DEFAULT_SLOTS: usize = 256;
+/// Upper bound for the number of slots (registered buffers per ring).
+pub const MAX_SLOTS: usize = 1024;
+
+const IORING_OFF_SQ_RING: libc::off_t = 0;
+const IORING_OFF_CQ_RING: libc::off_t = 0x800_0000;
+const IORING_OFF_SQES: libc::off_t = 0x1000_0000;
+const IORING_ENTER_GETEVENTS: libc::c_uint = 1;
+const IORING_REGISTER_BUFFERS: libc::c_uint = 0;
+const IORING_OP_READ_FIXED: u8 = 4;
+const IORING_OP_OPENAT: u8 = 18;
+const IORING_OP_CLOSE: u8 = 19;
+const IORING_OP_READ: u8 = 22;
+/// Runs the next SQE after this one even if this one fails.
+const IOSQE_IO_HARDLINK: u8 = 1 << 3;
+/// Set in the `user_data` of close completions, next to the slot.
+const CLOSE_TAG: u64 = 1 << 63;
+/// `opened` of a slot whose open has not completed.
+const NOT_OPENED: i32 = -libc::ECANCELED;
+
+#[repr(C)]
+#[derive(Default)]
+struct SqRingOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    flags: u32,
+    dropped: u32,
+    array: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct CqRingOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    overflow: u32,
+    cqes: u32,
+    flags: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+/// `struct io_uring_params`
+#[repr(C)]
+#[derive(Default)]
+struct Params {
+    sq_entries: u32,
+    cq_entries: u32,
+    flags: u32,
+    sq_thread_cpu: u32,
+    sq_thread_idle: u32,
+    features: u32,
+    wq_fd: u32,
+    resv: [u32; 3],
+    sq_off: SqRingOffsets,
+    cq_off: CqRingOffsets,
+}
+
+/// `struct io_uring_sqe`, with the unions flattened to the fields used here.
+#[repr(C)]
+#[derive(Default, Clone, Copy)]
+struct Sqe {
+    opcode: u8,
+    flags: u8,
+    ioprio: u16,
+    fd: i32,
+    off: u64,
+    addr: u64,
+    len: u32,
+    op_flags: u32,
+    user_data: u64,
+    buf_index: u16,
+    personality: u16,
+    file_index: u32,
+    addr3: u64,
+    pad: u64,
+}
+
+/// `struct io_uring_cqe`
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct Cqe {
+    user_data: u64,
+    res: i32,
+    flags: u32,
+}
+
+const _: () = assert!(size_of::<Params>() == 120);
+const _: () = assert!(size_of::<Sqe>() == 64);
+const _: () = assert!(size_of::<Cqe>() == 16);
+
+/// A shared mapping of one of the ring regions.
+struct Mmap {
+    ptr: *mut libc::c_void,
+    len: usize,
+}
+
+impl Mmap {
+    fn new(fd: RawFd, len: usize, offset: libc::off_t) -> io::Result<Self> {
+        // SAFETY: maps a region of the ring fd; the result is checked below
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd,
+                offset,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Self { ptr, len })
+    }
+
+    /// Pointer to the value at byte `offset`, as reported by the kernel.
+    fn at<T>(&self, offset: u32) -> *mut T {
+        debug_assert!((offset as usize) < self.len);
+        // SAFETY: offsets come from io_uring_params and lie within the mapping
+        unsafe { self.ptr.cast::<u8>().add(offset as usize).cast() }
+    }
+}
+
+impl Drop for Mmap {
+    fn drop(&mut self) {
+        // SAFETY: ptr and len describe a mapping created in Mmap::new
+        unsafe {
+            libc::munmap(self.ptr, self.len);
+        }
+    }
+}
+
+/// A minimal io_uring instance: one submitter, completions reaped in place.
+struct Ring {
+    sq_head: *const AtomicU32,
+    sq_tail: *const AtomicU32,
+    sq_mask: u32,
+    sq_entries: u32,
+    sq_array: *mut u32,
+    sqes: *mut Sqe,
+    cq_head: *const AtomicU32,
+    cq_tail: *const AtomicU32,
+    cq_mask: u32,
+    cqes: *const Cqe,
+    _sq_ring: Mmap,
+    _cq_ring: Mmap,
+    _sqe_ring: Mmap,
+    fd: OwnedFd,
+}
+
+impl Ring {
+    fn new(entries: u32) -> io::Result<Self> {
+        let mut params = Params::default();
+        // SAFETY: params is a valid io_uring_params the kernel fills in
+        let fd = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_setup,
+                entries as libc::c_long,
+                &mut params as *mut Params,
+            )
+        };
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        // SAFETY: io_uring_setup returned a new fd owned by nobody else
+        let fd = unsafe { OwnedFd::from_raw_fd(fd as RawFd) };
+
+        let sq_len = params.sq_off.array as usize + params.sq_entries as usize * size_of::<u32>();
+        let cq_len = params.cq_off.cqes as usize + params.cq_entries as usize * size_of::<Cqe>();
+        let sq_ring = Mmap::new(fd.as_raw_fd(), sq_len, IORING_OFF_SQ_RING)?;
+        let cq_ring = Mmap::new(fd.as_raw_fd(), cq_len, IORING_OFF_CQ_RING)?;
+        let sqe_ring = Mmap::new(
+            fd.as_raw_fd(),
+            params.sq_entries as usize * size_of::<Sqe>(),
+            IORING_OFF_SQES,
+        )?;
+
+        // SAFETY: the mask offsets point at u32 values within the mappings
+        let (sq_mask, cq_mask) = unsafe {
+            (
+                *sq_ring.at::<u32>(params.sq_off.ring_mask),
+                *cq_ring.at::<u32>(params.cq_off.ring_mask),
+            )
+        };
+        Ok(Self {
+            sq_head: sq_ring.at(params.sq_off.head),
+            sq_tail: sq_ring.at(params.sq_off.tail),
+            sq_mask,
+            sq_entries: params.sq_entries,
+            sq_array: sq_ring.at(params.sq_off.array),
+            sqes: sqe_ring.ptr.cast(),
+            cq_head: cq_ring.at(params.cq_off.head),
+            cq_tail: cq_ring.at(params.cq_off.tail),
+            cq_mask,
+            cqes: cq_ring.at(params.cq_off.cqes),
+            _sq_ring: sq_ring,
+            _cq_ring: cq_ring,
+            _sqe_ring: sqe_ring,
+            fd,
+        })
+    }
+
+    /// Registers `buffers` for `IORING_OP_READ_FIXED`.
+    fn register_buffers(&self, buffers: &[libc::iovec]) -> io::Result<()> {
+        // SAFETY: buffers is a valid iovec array; the memory it points to is
+        // owned by the caller and outlives the ring
+        let ret = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_register,
+                self.fd.as_raw_fd() as libc::c_long,
+                IORING_REGISTER_BUFFERS as libc::c_long,
+                buffers.as_ptr(),
+                buffers.len() as libc::c_long,
+            )
+        };
+        if ret < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(())
+    }
+
+    /// Queues `sqe` for the next [`Ring::complete`].
+    ///
+    /// Callers never queue more than `sq_entries` between completions.
+    fn push(&mut self, sqe: Sqe) {
+        // SAFETY: head and tail point into the SQ ring; only this thread
+        // writes the tail, the kernel advances the head
+        unsafe {
+            let tail = (*self.sq_tail).load(Ordering::Relaxed);
+            let head = (*self.sq_head).load(Ordering::Acquire);
+            assert!(
+                tail.wrapping_sub(head) < self.sq_entries,
+                "io_uring submission queue overflow"
+            );
+            let index = tail & self.sq_mask;
+            self.sqes.add(index as usize).write(sqe);
+            self.sq_array.add(index as usize).write(index);
+            (*self.sq_tail).store(tail.wrapping_add(1), Ordering::Release);
+        }
+    }
+
+    /// Submits the queued SQEs and passes `count` completions to `f`.
+    fn complete(&mut self, count: usize, mut f: impl FnMut(Cqe)) -> io::Result<()> {
+        let mut done = 0;
+        while done < count {
+            // SAFETY: see push
+            let pending = unsafe {
+                (*self.sq_tail)
+                    .load(Ordering::Relaxed)
+                    .wrapping_sub((*self.sq_head).load(Ordering::Acquire))
+            };
+            // The ring's openat/read/close are not counted: they are no
+            // syscalls of this thread
+            procfs::count_syscalls(1);
+            // SAFETY: plain syscall on the ring fd, no signal mask
+            let ret = unsafe {
+                libc::syscall(
+                    libc::SYS_io_uring_enter,
+                    self.fd.as_raw_fd() as libc::c_long,
+                    pending as libc::c_long,
+                    (count - done) as libc::c_long,
+                    IORING_ENTER_GETEVENTS as libc::c_long,
+                    ptr::null::<libc::sigset_t>(),
+                    0 as libc::c_long,
+                )
+            };
+            if ret < 0 {
+                let err = io::Error::last_os_error();
+                if err.kind() == io::ErrorKind::Interrupted {
+                    continue;
+                }
+                return Err(err);
+            }
+            while let Some(cqe) = self.pop() {
+                f(cqe);
+                done += 1;
+            }
+        }
+        Ok(())
+    }
+
+    fn pop(&mut self) -> Option<Cqe> {
+        // SAFETY: head and tail point into the CQ ring; only this thread
+        // writes the head, the kernel advances the tail
+        unsafe {
+            let head = (*self.cq_head).load(Ordering::Relaxed);
+            let tail = (*self.cq_tail).load(Ordering::Acquire);
+            if head == tail {
+                return None;
+            }
+            let cqe = *self.cqes.add((head & self.cq_mask) as usize);
+            (*self.cq_head).store(head.wrapping_add(1), Ordering::Release);
+            Some(cqe)
+        }
+    }
+}
+
+/// Reads files in batches through io_uring into a fixed buffer pool.
+pub struct BatchReader {
+    ring: Ring,
+    pool: Box<[u8]>,
+    slot_bytes: usize,
+    slots: usize,
+    /// Whether the pool is registered with the kernel
+    fixed: bool,
+    /// Per-slot result of the open (fd or negative errno) and the read
+    opened: Vec<i32>,
+    read: Vec<i32>,
+    /// Per-slot whether the ring closed the opened file
+    closed: Vec<bool>,
+}
+
+// SAFETY: the raw pointers refer to the ring mappings and are only used
+// through &mut self
+unsafe impl Send for BatchReader {}
+
+impl BatchReader {
+    /// Sets up a ring with `slots` buffers of `slot_bytes` each.
+    ///
+    /// Fails if io_uring is unavailable or lacks the required operations,
+    /// which is checked by reading `/proc/self/stat` through the ring.
+    pub fn new(slots: usize, slot_bytes: usize) -> io::Result<Self> {
+        let slots = slots.clamp(1, MAX_SLOTS);
+        // Each slot needs a read and a close in flight
+        let ring = Ring::new((slots * 2) as u32)?;
+        let mut pool = vec![0u8; slots * slot_bytes].into_boxed_slice();
+        let iovecs: Vec<libc::iovec> = pool
+            .chunks_exact_mut(slot_bytes)
+            .map(|slot| libc::iovec {
+                iov_base: slot.as_mut_ptr().cast(),
+                iov_len: slot.len(),
+            })
+            .collect();
+        let fixed = ring.register_buffers(&iovecs).is_ok();
+
+        let mut reader = Self {
+            ring,
+            pool,
+            slot_bytes,
+            slots,
+            fixed,
+            opened: Vec::with_capacity(slots),
+            read: Vec::with_capacity(slots),
+            closed: Vec::with_capacity(slots),
+        };
+        let mut probe = Err(io::Error::from(io::ErrorKind::Unsupported));
+        reader.read_all(libc::AT_FDCWD, &[c"/proc/self/stat"], |_, result| {
+            probe = match result {
+                Err(e) if e.kind() == io::ErrorKind::FileTooLarge => Ok(()),
+                result => result.map(|_| ()),
+            };
+        })?;
+        probe?;
+        Ok(reader)
+    }
+
+    /// Whether reads use the registered buffer pool.
+    pub fn fixed_buffers(&self) -> bool {
+        self.fixed
+    }
+
+    /// Reads every file in `paths`, relative to the directory `dir`, and
+    /// passes its index and contents to `f`.
+    ///
+    /// Each file is read with a single read of up to one slot. A file that
+    /// fills its slot may be truncated and is reported as
+    /// [`io::ErrorKind::FileTooLarge`]. An `Err` from this function means the
+    /// ring itself failed; files of the failed chunk may not have been passed
+    /// to `f`, but every file it opened is closed.
+    pub fn read_all<P: AsRef<CStr>>(
+        &mut self,
+        dir: RawFd,
+        paths: &[P],
+        mut f: impl FnMut(usize, io::Result<&[u8]>),
+    ) -> io::Result<()> {
+        for (chunk_index, chunk) in paths.chunks(self.slots).enumerate() {
+            self.opened.clear();
+            self.opened.resize(chunk.len(), NOT_OPENED);
+            self.closed.clear();
+            self.closed.resize(chunk.len(), false);
+            for (slot, path) in chunk.iter().enumerate() {
+                self.ring.push(Sqe {
+                    opcode: IORING_OP_OPENAT,
+                    fd: dir,
+                    addr: path.as_ref().as_ptr() as u64,
+                    op_flags: (libc::O_RDONLY | libc::O_CLOEXEC) as u32,
+                    user_data: slot as u64,
+                    ..Default::default()
+                });
+            }
+            let opened = &mut self.opened;
+            let result = self
+                .ring
+                .complete(chunk.len(), |cqe| opened[cqe.user_data as usize] = cqe.res);
+            if let Err(e) = result {
+                self.close_leftovers();
+                return Err(e);
+            }
+
+            self.read.clear();
+            self.read.resize(chunk.len(), 0);
+            let mut reads = 0;
+            for (slot, &fd) in self.opened.iter().enumerate() {
+                if fd < 0 {
+                    continue;
+                }
+                let (opcode, buf_index) = if self.fixed {
+                    (IORING_OP_READ_FIXED, slot as u16)
+                } else {
+                    (IORING_OP_READ, 0)
+                };
+                self.ring.push(Sqe {
+                    opcode,
+                    flags: IOSQE_IO_HARDLINK,
+                    fd,
+                    addr: self.pool[slot * self.slot_bytes..].as_mut_ptr() as u64,
+                    len: self.slot_bytes as u32,
+                    buf_index,
+                    user_data: slot as u64,
+                    ..Default::default()
+                });
+                self.ring.push(Sqe {
+                    opcode: IORING_OP_CLOSE,
+                    fd,
+                    user_data: CLOSE_TAG | slot as u64,
+                    ..Default::default()
+                });
+                reads += 1;
+            }
+            let (read, closed) = (&mut self.read, &mut self.closed);
+            let result = self.ring.complete(reads * 2, |cqe| {
+                let slot = (cqe.user_data & !CLOSE_TAG) as usize;
+                if cqe.user_data & CLOSE_TAG != 0 {
+                    closed[slot] = cqe.res >= 0;
+                } else {
+                    read[slot] = cqe.res;
+                }
+            });
+            if let Err(e) = result {
+                self.close_leftovers();
+                return Err(e);
+            }
+
+            let base = chunk_index * self.slots;
+            for slot in 0..chunk.len() {
+                let (opened, read) = (self.opened[slot], self.read[slot]);
+                let result = if opened < 0 {
+                    Err(io::Error::from_raw_os_error(-opened))
+                } else if read < 0 {
+                    Err(io::Error::from_raw_os_error(-read))
+                } else if read as usize >= self.slot_bytes {
+                    Err(io::Error::from(io::ErrorKind::FileTooLarge))
+                } else {
+                    let start = slot * self.slot_bytes;
+                    Ok(&self.pool[start..start + read as usize])
+                };
+                f(base + slot, result);
+            }
+        }
+        Ok(())
+    }
+
+    /// Closes the files of the current chunk that the ring opened but did
+    /// not close, after it failed in the middle of the chunk.
+    fn close_leftovers(&mut self) {
+        for (&fd, &closed) in self.opened.iter().zip(&self.closed) {
+            if fd >= 0 && !closed {
+                // SAFETY: fd was opened by this chunk and is not used after
+                unsafe { libc::close(fd) };
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::ffi::CString;
+    use std::fs::{self, File};
+    use std::os::fd::IntoRawFd;
+    use tempfile::tempdir;
+
+    /// io_uring may be disabled where the tests run (containers, sysctl).
+    fn reader(slots: usize, slot_bytes: usize) -> Option<BatchReader> {
+        match BatchReader::new(slots, slot_bytes) {
+            Ok(reader) => Some(reader),
+            Err(e) => {
+                eprintln!("skipping: io_uring unavailable: {}", e);
+                None
+            }
+        }
+    }
+
+    #[test]
+    fn test_read_all_in_chunks() {
+        let mut reader = match reader(2, 64) {
+            Some(reader) => reader,
+            None => return,
+        };
+        let dir = tempdir().unwrap();
+        for i in 0..5 {
+            fs::write(dir.path().join(i.to_string()), format!("file {}\n", i)).unwrap();
+        }
+        fs::write(dir.path().join("large"), [b'x'; 64]).unwrap();
+
+        let mut names: Vec<CString> = (0..5)
+            .map(|i| CString::new(i.to_string()).unwrap())
+            .collect();
+        names.push(CString::new("large").unwrap());
+        names.push(CString::new("missing").unwrap());
+
+        let root = File::open(dir.path()).unwrap();
+        let mut results = Vec::new();
+        reader
+            .read_all(root.as_raw_fd(), &names, |index, result| {
+                results.push((index, result.map(|content| content.to_vec())));
+            })
+            .unwrap();
+
+        assert_eq!(results.len(), 7);
+        for (i, (index, result)) in results[..5].iter().enumerate() {
+            assert_eq!(*index, i);
+            assert_eq!(result.as_ref().unwrap(), format!("file {}\n", i).as_bytes());
+        }
+        let kind = |i: usize| results[i].1.as_ref().unwrap_err().kind();
+        assert_eq!(kind(5), io::ErrorKind::FileTooLarge);
+        assert_eq!(kind(6), io::ErrorKind::NotFound);
+    }
+
+    #[test]
+    fn test_read_all_reuses_ring() {
+        // Many more files than slots: the rings wrap around repeatedly
+        let mut reader = match reader(4, 4096) {
+            Some(reader) => reader,
+            None => return,
+        };
+        let paths = vec![c"/proc/self/stat"; 1000];
+        let mut read = 0;
+        reader
+            .read_all(libc::AT_FDCWD, &paths, |_, result| {
+                assert!(!result.unwrap().is_empty());
+                read += 1;
+            })
+            .unwrap();
+        assert_eq!(read, paths.len());
+    }
+
+    #[test]
+    fn test_close_leftovers() {
+        let mut reader = match reader(2, 64) {
+            Some(reader) => reader,
+            None => return,
+        };
+        let is_open = |fd: RawFd| unsafe { libc::fcntl(fd, libc::F_GETFD) } >= 0;
+        let fds: Vec<RawFd> = (0..2)
+            .map(|_| File::open("/proc/self/stat").unwrap().into_raw_fd())
+            .collect();
+
+        // As after a failed read: one file closed by the ring, one not, and
+        // one open that never completed
+        reader.opened = vec![fds[0], fds[1], NOT_OPENED];
+        reader.closed = vec![false, true, false];
+        reader.close_leftovers();
+        assert!(!is_open(fds[0]));
+        assert!(is_open(fds[1]));
+        unsafe { libc::close(fds[1]) };
+    }
+}